@@ -0,0 +1,194 @@
+// Tests that the camera loops do no heap allocations per frame in the steady state: the global
+// operator new is replaced by a counting one and the frames are parsed again and again after a
+// warm-up - with a reused ImageFrameResult (line-by-line, bulk, batched merge, subsampled and YUYV view feeds)
+// and with the Fast3DPoser. The results must be the same as those of the allocating API.
+// Also tests that the length affection table is shared: copying the tokenizers and making more
+// Homers of the same setup must not allocate.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "mcparser.h"
+#include "pixelviews.h"
+#include "fast3dposer.h"
+#include "testhelpers.h"
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define FRAME_COUNT 4
+#define WARMUP_ROUNDS 2
+#define MEASURED_ROUNDS 10
+
+/** Number of heap allocations since the start */
+static size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+	++allocations;
+	void *p = malloc(size ? size : 1);
+	if(p == nullptr) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	free(p);
+}
+
+/**
+ * Runs "parse" for all frames WARMUP_ROUNDS times then MEASURED_ROUNDS times while counting the allocations.
+ * Returns the number of failures (allocations in the steady state or results different from the expected ones).
+ */
+template<typename PARSE>
+int testLoop(const char *name, int frameCount, const std::vector<ImageFrameResult> &expected, PARSE parse) {
+	bool same = true;
+	for(int round = 0; round < WARMUP_ROUNDS; ++round) {
+		for(int f = 0; f < frameCount; ++f) {
+			same = sameResults(expected[f], parse(f)) && same;
+		}
+	}
+	size_t before = allocations;
+	for(int round = 0; round < MEASURED_ROUNDS; ++round) {
+		for(int f = 0; f < frameCount; ++f) {
+			// Rem.: the comparison itself does not allocate
+			same = sameResults(expected[f], parse(f)) && same;
+		}
+	}
+	size_t count = allocations - before;
+	printf("%s: %s - %d allocation(s) in %d frames\n", name, (same && (count == 0)) ? "OK" : "FAILED",
+			(int)count, MEASURED_ROUNDS * frameCount);
+	return (same && (count == 0)) ? 0 : 1;
+}
+
+int main() {
+	printf("Testing allocation-free frame parsing...\n");
+
+	// Frames with different number of markers so the result sizes vary between frames
+	std::vector<std::vector<uint8_t>> frames(FRAME_COUNT);
+	std::vector<std::vector<uint8_t>> yuyvFrames(FRAME_COUNT);
+	for(int f = 0; f < FRAME_COUNT; ++f) {
+		auto &grey = frames[f];
+		grey.resize(WIDTH * HEIGHT);
+		for(auto &p : grey) p = 224 + (rand() % 8);
+		for(int i = 0; i <= f; ++i) {
+			drawMarker(grey, WIDTH, HEIGHT, 150 + i * 300, (i % 2 == 0) ? 200 : 500, 40 + 10 * f, 6);
+		}
+		auto &yuyv = yuyvFrames[f];
+		yuyv.resize(WIDTH * HEIGHT * 2);
+		for(int i = 0; i < WIDTH * HEIGHT; ++i) {
+			yuyv[2 * i] = grey[i];
+			yuyv[2 * i + 1] = 128;
+		}
+	}
+
+	// Expected results using the allocating API
+	std::vector<ImageFrameResult> expected;
+	std::vector<ImageFrameResult> expectedSubsampled;
+	MCParserConfig subsampledConfig;
+	subsampledConfig.rowStride = 4;
+	MCParser<> reference;
+	MCParser<> subsampledReference(subsampledConfig);
+	for(auto &grey : frames) {
+		expected.push_back(reference.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH));
+		expectedSubsampled.push_back(subsampledReference.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH));
+	}
+	int failures = 0;
+	for(int f = 0; f < FRAME_COUNT; ++f) {
+		if((int)expected[f].markers.size() != f + 1) {
+			printf("Found %d markers instead of %d on frame %d - the test frames are bad!\n", (int)expected[f].markers.size(), f + 1, f);
+			++failures;
+		}
+	}
+
+	// Rem.: the allocating API gets a new vector for every frame - this also shows that the counting works
+	size_t before = allocations;
+	for(auto &grey : frames) {
+		reference.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	}
+	if(allocations == before) {
+		printf("The allocating API did not allocate - the allocation counting is broken!\n");
+		++failures;
+	}
+
+	MCParser<> lineParser;
+	ImageFrameResult lineResult;
+	failures += testLoop("processLine(..) + endImageFrame(out)", FRAME_COUNT, expected, [&](int f) -> const ImageFrameResult& {
+		for(int j = 0; j < HEIGHT; ++j) {
+			lineParser.processLine(&frames[f][j * WIDTH], WIDTH);
+		}
+		lineParser.endImageFrame(lineResult);
+		return lineResult;
+	});
+
+	MCParser<> frameParser;
+	ImageFrameResult frameResult;
+	failures += testLoop("processFrame(.., out)", FRAME_COUNT, expected, [&](int f) -> const ImageFrameResult& {
+		frameParser.processFrame(&frames[f][0], WIDTH, HEIGHT, WIDTH, frameResult);
+		return frameResult;
+	});
+
+	MCParserConfig batchedConfig;
+	batchedConfig.batchMerge = true;
+	MCParser<> batchedParser(batchedConfig);
+	ImageFrameResult batchedResult;
+	failures += testLoop("batched merge processFrame(.., out)", FRAME_COUNT, expected, [&](int f) -> const ImageFrameResult& {
+		batchedParser.processFrame(&frames[f][0], WIDTH, HEIGHT, WIDTH, batchedResult);
+		return batchedResult;
+	});
+
+	MCParser<> subsampledParser(subsampledConfig);
+	ImageFrameResult subsampledResult;
+	failures += testLoop("subsampled processFrame(.., out)", FRAME_COUNT, expectedSubsampled, [&](int f) -> const ImageFrameResult& {
+		subsampledParser.processFrame(&frames[f][0], WIDTH, HEIGHT, WIDTH, subsampledResult);
+		return subsampledResult;
+	});
+
+	MCParser<> viewParser;
+	ImageFrameResult viewResult;
+	PixelView<YuyvFormat> view(&yuyvFrames[0][0], WIDTH, HEIGHT, WIDTH * 2);
+	failures += testLoop("YUYV processView(.., out)", FRAME_COUNT, expected, [&](int f) -> const ImageFrameResult& {
+		view.setBase(&yuyvFrames[f][0]);
+		viewParser.processView(view, viewResult);
+		return viewResult;
+	});
+
+	Fast3DPoser<> poser;
+	failures += testLoop("Fast3DPoser", FRAME_COUNT, expected, [&](int f) -> const ImageFrameResult& {
+		for(int j = 0; j < HEIGHT; ++j) {
+			poser.processLine(&frames[f][j * WIDTH], WIDTH);
+		}
+		poser.endImageFrame();
+		return poser.getMarkers();
+	});
+
+	// Rem.: The first Homer of this setup builds its table - the others only get the shared one
+	HomerSetup setup;
+	setup.hodeltaLen = 7;
+	Homer<> first(setup);
+	std::vector<Hoparser<>> copies;
+	copies.reserve(64);
+	before = allocations;
+	Homer<> second(setup);
+	Homer<> third(setup);
+	Hoparser<> prototype;
+	size_t setupAllocations = allocations - before;
+	before = allocations;
+	for(int i = 0; i < 64; ++i) {
+		copies.push_back(prototype);
+	}
+	size_t copyAllocations = allocations - before;
+	bool shared = (setupAllocations == 0) && (copyAllocations == 0);
+	printf("Shared length affection tables: %s - %d allocation(s) for the same setups, %d for 64 tokenizer copies\n",
+			shared ? "OK" : "FAILED", (int)setupAllocations, (int)copyAllocations);
+	if(!shared) ++failures;
+
+	printf("...testing allocation-free frame parsing ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,298 @@
+#ifndef FASTTRACK_ASYNC_CAPTURE_H
+#define FASTTRACK_ASYNC_CAPTURE_H
+
+// Asynchronous frame capture: a dedicated thread dequeues the camera buffers into a lock-free
+// single-producer single-consumer ring while the caller is detecting markers on earlier frames,
+// so the wait for the camera is not dead time on the detecting thread anymore.
+//
+// The caller gets RAII leases of the frames: several can be held at the same time and each buffer
+// goes back to the camera when its lease is destroyed (or released).
+//
+// Usage (see marker_camapp.cpp):
+//
+//     V4LWrapper<640, 480> camera;
+//     AsyncCapture<V4LWrapper<640, 480>> capture(camera, CapturePolicy::NEWEST);
+//     while(running) {
+//         auto frame = capture.acquire();
+//         ... parse frame.data() ...
+//     } // the buffer goes back to the camera here
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/** A filled camera buffer as dequeued from the camera - see V4LWrapper::dequeue(..) */
+struct CapturedBuffer {
+	/** Index of the buffer of the camera - give this back with requeue(..) */
+	int index = -1;
+	/** The raw frame data */
+	uint8_t *data = nullptr;
+	/** Number of the bytes filled in data */
+	unsigned int bytesUsed = 0;
+	/** Frame counter of the camera - gaps mean frames that the camera had to drop */
+	uint32_t sequence = 0;
+	/** When the buffer got dequeued */
+	std::chrono::steady_clock::time_point captured;
+};
+
+/**
+ * Lock-free single-producer single-consumer ring of N elements (N must be a power of two).
+ * Only one thread may push(..) and only one other thread may pop(..) at the same time.
+ */
+template<typename T, int N>
+class SpscRing {
+	static_assert((N > 0) && ((N & (N - 1)) == 0), "SpscRing size must be a power of two!");
+public:
+	/** Adds a copy of the element - false when the ring is full (producer side) */
+	inline bool push(const T &element) noexcept {
+		unsigned int tail = tailCount.load(std::memory_order_relaxed);
+		if((tail - headCount.load(std::memory_order_acquire)) == (unsigned int)N) return false;
+		elements[tail & (N - 1)] = element;
+		tailCount.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Takes the oldest element - false when the ring is empty (consumer side) */
+	inline bool pop(T &element) noexcept {
+		unsigned int head = headCount.load(std::memory_order_relaxed);
+		if(head == tailCount.load(std::memory_order_acquire)) return false;
+		element = elements[head & (N - 1)];
+		headCount.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Tells if the ring is empty - only a hint when the other side is working on it */
+	inline bool isEmpty() const noexcept {
+		return headCount.load(std::memory_order_acquire) == tailCount.load(std::memory_order_acquire);
+	}
+
+private:
+	// Rem.: On their own cache lines so that the producer and the consumer do not invalidate each others
+	alignas(64) std::atomic<unsigned int> headCount{0};
+	alignas(64) std::atomic<unsigned int> tailCount{0};
+	alignas(64) T elements[N];
+};
+
+/** Which frames AsyncCapture::acquire(..) gives out */
+enum class CapturePolicy {
+	/** Always the newest captured frame - the older waiting ones are given back unseen (dropped as stale) */
+	NEWEST,
+	/** Every captured frame in order - a slow consumer gets them late (see CaptureStats::late) */
+	EVERY_FRAME
+};
+
+/** Frame counters of an AsyncCapture */
+struct CaptureStats {
+	/** Frames dequeued from the camera */
+	uint64_t captured = 0;
+	/** Frames given out by acquire(..) */
+	uint64_t delivered = 0;
+	/** Frames never given out: stale ones of the NEWEST policy, lost ones in the camera (sequence gaps) */
+	uint64_t dropped = 0;
+	/** Frames given out while a newer frame was already waiting (the consumer is behind) */
+	uint64_t late = 0;
+};
+
+/**
+ * Runs the capture of the CAMERA on a dedicated thread. The CAMERA must have:
+ *
+ *     int bufferCount();                                  // number of its buffers
+ *     bool dequeue(CapturedBuffer &out, int timeoutMs);   // waits for a filled buffer - false on timeout or error
+ *     void requeue(int index);                            // gives back the buffer for filling
+ *     bool isOk();                                        // false after an error - the capture ends then
+ *
+ * Rem.: requeue(..) is called from the consumer thread while dequeue(..) can be waiting on the capture thread!
+ * Rem.: dequeue(..) and requeue(..) must not exit() on errors - they can run on the capture thread.
+ * Rem.: Every buffer is either in the camera, in the ring or leased - so the ring is never full if RING is not
+ *       smaller than the buffer count of the camera. The camera drops frames when all of its buffers are leased.
+ */
+template<typename CAMERA, int RING = 32>
+class AsyncCapture {
+public:
+	/** A frame of the camera that is ours until the lease is destroyed or released - movable, not copyable */
+	class FrameLease {
+	public:
+		FrameLease() noexcept {}
+		FrameLease(AsyncCapture *owner, const CapturedBuffer &buffer) noexcept : owner(owner), buffer(buffer) {}
+		FrameLease(FrameLease &&other) noexcept : owner(other.owner), buffer(other.buffer) {
+			other.owner = nullptr;
+		}
+		FrameLease& operator=(FrameLease &&other) noexcept {
+			if(this != &other) {
+				release();
+				owner = other.owner;
+				buffer = other.buffer;
+				other.owner = nullptr;
+			}
+			return *this;
+		}
+		FrameLease(const FrameLease&) = delete;
+		FrameLease& operator=(const FrameLease&) = delete;
+		~FrameLease() {
+			release();
+		}
+
+		/** Gives the buffer back to the camera now - the lease is empty after this */
+		inline void release() noexcept {
+			if(owner != nullptr) {
+				owner->camera.requeue(buffer.index);
+				owner = nullptr;
+			}
+		}
+
+		/** True when this lease holds a frame */
+		inline explicit operator bool() const noexcept {
+			return (owner != nullptr);
+		}
+
+		inline const uint8_t* data() const noexcept { return buffer.data; }
+		inline unsigned int bytesUsed() const noexcept { return buffer.bytesUsed; }
+		inline uint32_t sequence() const noexcept { return buffer.sequence; }
+
+		/** Milliseconds since the frame got dequeued from the camera */
+		inline double ageMs() const noexcept {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buffer.captured).count();
+		}
+
+	private:
+		AsyncCapture *owner = nullptr;
+		CapturedBuffer buffer;
+	};
+
+	/** Starts capturing from the camera right away - the camera must live longer than this and the leases */
+	AsyncCapture(CAMERA &camera, CapturePolicy policy = CapturePolicy::NEWEST) : camera(camera), policy(policy) {
+		running = true;
+		thread = std::thread([this] { run(); });
+	}
+
+	~AsyncCapture() {
+		stop();
+	}
+
+	AsyncCapture(const AsyncCapture&) = delete;
+	AsyncCapture& operator=(const AsyncCapture&) = delete;
+
+	/** Stops the capture thread and gives back the frames that were never acquired (they count as dropped) */
+	inline void stop() noexcept {
+		if(!running.exchange(false)) return;
+		wakeConsumer();
+		thread.join();
+		CapturedBuffer buffer;
+		while(ring.pop(buffer)) {
+			camera.requeue(buffer.index);
+			++dropped;
+		}
+	}
+
+	/** Gets a captured frame according to the policy - an empty lease when there is none waiting */
+	inline FrameLease tryAcquire() noexcept {
+		CapturedBuffer buffer;
+		if(!ring.pop(buffer)) return FrameLease();
+		if(policy == CapturePolicy::NEWEST) {
+			CapturedBuffer newer;
+			while(ring.pop(newer)) {
+				camera.requeue(buffer.index);
+				++dropped;
+				buffer = newer;
+			}
+		} else if(!ring.isEmpty()) {
+			++late;
+		}
+		++delivered;
+		return FrameLease(this, buffer);
+	}
+
+	/**
+	 * Waits for a captured frame at most timeoutMs milliseconds (forever if negative) - see tryAcquire().
+	 * Returns an empty lease right away when the capture is stopped or has failed (see hasFailed()).
+	 */
+	inline FrameLease acquire(int timeoutMs = -1) noexcept {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((timeoutMs >= 0) ? timeoutMs : 0);
+		auto ready = [this] { return !ring.isEmpty() || !running || failed; };
+		while(true) {
+			FrameLease lease = tryAcquire();
+			if(lease || !running || failed) return lease;
+			// Rem.: The capture thread wakes us up after each push - the ring itself stays lock-free
+			std::unique_lock<std::mutex> lock(waitMutex);
+			if(timeoutMs < 0) {
+				waitCondition.wait(lock, ready);
+			} else if(!waitCondition.wait_until(lock, deadline, ready)) {
+				return FrameLease();
+			}
+		}
+	}
+
+	/** True when the camera failed (see CAMERA::isOk()) - the capture thread has ended then */
+	inline bool hasFailed() const noexcept {
+		return failed;
+	}
+
+	/** The frame counters so far */
+	inline CaptureStats getStats() const noexcept {
+		CaptureStats stats;
+		stats.captured = captured;
+		stats.delivered = delivered;
+		stats.dropped = dropped;
+		stats.late = late;
+		return stats;
+	}
+
+private:
+	/** The capture thread: dequeues the filled buffers into the ring */
+	void run() noexcept {
+		bool first = true;
+		uint32_t lastSequence = 0;
+		while(running) {
+			CapturedBuffer buffer;
+			// Rem.: The timeout is only there to notice stop() in time
+			if(!camera.dequeue(buffer, 50)) {
+				if(camera.isOk()) continue;
+				// An error (like an unplugged camera) would fail again right away - so no more tries
+				failed = true;
+				wakeConsumer();
+				return;
+			}
+			++captured;
+			if(!first && (buffer.sequence > lastSequence + 1)) {
+				dropped += buffer.sequence - lastSequence - 1;
+			}
+			first = false;
+			lastSequence = buffer.sequence;
+			if(!ring.push(buffer)) {
+				// Only when RING is smaller than the buffer count of the camera
+				camera.requeue(buffer.index);
+				++dropped;
+			}
+			wakeConsumer();
+		}
+	}
+
+	/** Wakes up acquire(..) - the lock makes sure that a consumer just going to wait does not miss this */
+	inline void wakeConsumer() noexcept {
+		{
+			std::lock_guard<std::mutex> lock(waitMutex);
+		}
+		waitCondition.notify_one();
+	}
+
+	CAMERA &camera;
+	CapturePolicy policy;
+	SpscRing<CapturedBuffer, RING> ring;
+	std::atomic<bool> running{false};
+	std::atomic<bool> failed{false};
+	std::thread thread;
+	std::mutex waitMutex;
+	std::condition_variable waitCondition;
+
+	std::atomic<uint64_t> captured{0};
+	std::atomic<uint64_t> delivered{0};
+	std::atomic<uint64_t> dropped{0};
+	std::atomic<uint64_t> late{0};
+};
+
+#endif // FASTTRACK_ASYNC_CAPTURE_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
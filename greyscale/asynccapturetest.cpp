@@ -0,0 +1,280 @@
+// Tests the AsyncCapture (asynccapture.h) with a fake camera that fills its buffers with the frame
+// number at a fixed frame rate and drops frames when all of its buffers are taken (like V4L2 does):
+// - every frame in order with the EVERY_FRAME policy and a fast consumer
+// - always newer frames with the NEWEST policy and a slow consumer - the skipped ones counted as dropped
+// - several leases held at the same time keep their data and all buffers get back to the camera
+// - the SpscRing on its own between two threads
+// - a failing camera (like an unplugged one) ends the capture: acquire(..) returns at once and no retries spin
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include "asynccapture.h"
+
+#define BUFFER_COUNT 4
+#define FRAME_BYTES 4096
+
+/** Camera that "captures" a frame in every frameMs milliseconds - the data is the frame number everywhere */
+class FakeCamera {
+public:
+	FakeCamera(int frameMs) : frameMs(frameMs) {
+		for(int i = 0; i < BUFFER_COUNT; ++i) {
+			queued[i] = true;
+		}
+		nextFrameTime = std::chrono::steady_clock::now();
+	}
+
+	int bufferCount() {
+		return BUFFER_COUNT;
+	}
+
+	bool dequeue(CapturedBuffer &out, int timeoutMs) {
+		++dequeueCalls;
+		if((failAfter >= 0) && (frames >= (uint32_t)failAfter)) {
+			broken = true;
+			return false;
+		}
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		while(true) {
+			if(nextFrameTime > deadline) {
+				std::this_thread::sleep_until(deadline);
+				return false;
+			}
+			std::this_thread::sleep_until(nextFrameTime);
+			nextFrameTime += std::chrono::milliseconds(frameMs);
+			uint32_t sequence = frames++;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			for(int i = 0; i < BUFFER_COUNT; ++i) {
+				if(queued[i]) {
+					queued[i] = false;
+					memset(data[i], (uint8_t)sequence, FRAME_BYTES);
+					out.index = i;
+					out.data = data[i];
+					out.bytesUsed = FRAME_BYTES;
+					out.sequence = sequence;
+					out.captured = std::chrono::steady_clock::now();
+					return true;
+				}
+			}
+			// Rem.: No buffer to fill - the frame is lost (the next one has a bigger sequence)
+			++lost;
+		}
+	}
+
+	void requeue(int index) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if(queued[index]) ++doubleRequeues;
+		queued[index] = true;
+	}
+
+	bool isOk() {
+		return !broken;
+	}
+
+	/** Number of the buffers in the camera (not dequeued) */
+	int queuedCount() {
+		std::lock_guard<std::mutex> lock(mutex);
+		int count = 0;
+		for(int i = 0; i < BUFFER_COUNT; ++i) {
+			if(queued[i]) ++count;
+		}
+		return count;
+	}
+
+	int doubleRequeues = 0;
+	uint32_t lost = 0;
+	uint32_t frames = 0;
+	/** Every dequeue fails after this many frames (never if negative) */
+	int failAfter = -1;
+	std::atomic<int> dequeueCalls{0};
+	std::atomic<bool> broken{false};
+private:
+	int frameMs;
+	std::chrono::steady_clock::time_point nextFrameTime;
+	std::mutex mutex;
+	bool queued[BUFFER_COUNT];
+	uint8_t data[BUFFER_COUNT][FRAME_BYTES];
+};
+
+/** Tells if the whole frame is filled with the low byte of its sequence */
+template<typename LEASE>
+bool intact(const LEASE &lease) {
+	for(unsigned int i = 0; i < lease.bytesUsed(); ++i) {
+		if(lease.data()[i] != (uint8_t)lease.sequence()) return false;
+	}
+	return true;
+}
+
+int testEveryFrame() {
+	FakeCamera camera(5);
+	int failures = 0;
+	std::vector<uint32_t> sequences;
+	{
+		AsyncCapture<FakeCamera> capture(camera, CapturePolicy::EVERY_FRAME);
+		while(sequences.size() < 100) {
+			auto frame = capture.acquire(1000);
+			if(!frame || !intact(frame)) {
+				++failures;
+				break;
+			}
+			sequences.push_back(frame.sequence());
+		}
+		capture.stop();
+		auto stats = capture.getStats();
+		// Rem.: Consecutive unless the camera itself lost frames (when this thread did not run for long)
+		bool inOrder = true;
+		for(size_t i = 1; i < sequences.size(); ++i) {
+			if((sequences[i] <= sequences[i - 1]) || ((camera.lost == 0) && (sequences[i] != sequences[i - 1] + 1))) {
+				inOrder = false;
+			}
+		}
+		bool ok = inOrder && (stats.delivered == sequences.size());
+		if(!ok) ++failures;
+		printf("EVERY_FRAME: %d frames in order, %llu captured, %llu dropped, %llu late: %s\n", (int)sequences.size(),
+				(unsigned long long)stats.captured, (unsigned long long)stats.dropped, (unsigned long long)stats.late,
+				ok ? "OK" : "FAILED");
+	}
+	if(camera.queuedCount() != BUFFER_COUNT || camera.doubleRequeues != 0) {
+		++failures;
+		printf("EVERY_FRAME: buffers not given back properly: FAILED\n");
+	}
+	return failures;
+}
+
+int testNewest() {
+	FakeCamera camera(1);
+	int failures = 0;
+	{
+		AsyncCapture<FakeCamera> capture(camera, CapturePolicy::NEWEST);
+		uint32_t last = 0;
+		bool increasing = true;
+		bool allIntact = true;
+		int count = 0;
+		for(; count < 20; ++count) {
+			auto frame = capture.acquire(1000);
+			if(!frame) break;
+			if((count > 0) && (frame.sequence() <= last)) increasing = false;
+			last = frame.sequence();
+			// A slow consumer: some frames are captured while we are "detecting"
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			allIntact = allIntact && intact(frame);
+		}
+		capture.stop();
+		auto stats = capture.getStats();
+		// Rem.: Every frame of the camera is either delivered, dropped by us or lost in the camera (after the first)
+		bool accounted = (stats.delivered + stats.dropped >= camera.frames - camera.lost - 1)
+			&& (stats.delivered == (uint64_t)count);
+		bool ok = (count == 20) && increasing && allIntact && (stats.dropped > 0) && accounted;
+		if(!ok) ++failures;
+		printf("NEWEST: %d frames, %llu captured, %llu dropped (%u lost in the camera): %s\n", count,
+				(unsigned long long)stats.captured, (unsigned long long)stats.dropped, camera.lost, ok ? "OK" : "FAILED");
+	}
+	if(camera.queuedCount() != BUFFER_COUNT || camera.doubleRequeues != 0) {
+		++failures;
+		printf("NEWEST: buffers not given back properly: FAILED\n");
+	}
+	return failures;
+}
+
+int testOutstandingLeases() {
+	FakeCamera camera(1);
+	int failures = 0;
+	{
+		AsyncCapture<FakeCamera> capture(camera, CapturePolicy::EVERY_FRAME);
+		std::vector<AsyncCapture<FakeCamera>::FrameLease> held;
+		for(int i = 0; i < BUFFER_COUNT - 1; ++i) {
+			held.push_back(capture.acquire(1000));
+		}
+		// Let the camera run out of buffers for a while (it must drop the frames, not overwrite ours)
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		bool ok = true;
+		for(auto &lease : held) {
+			ok = ok && lease && intact(lease);
+		}
+		// Moving keeps the ownership - only one give-back
+		AsyncCapture<FakeCamera>::FrameLease moved = std::move(held[0]);
+		ok = ok && moved && !held[0];
+		held.clear();
+		moved.release();
+		capture.stop();
+		ok = ok && (capture.getStats().dropped > 0);
+		if(!ok) ++failures;
+		printf("%d leases held at the same time: %s\n", BUFFER_COUNT - 1, ok ? "OK" : "FAILED");
+	}
+	if(camera.queuedCount() != BUFFER_COUNT || camera.doubleRequeues != 0) {
+		++failures;
+		printf("Outstanding leases: buffers not given back properly: FAILED\n");
+	}
+	return failures;
+}
+
+/** The camera fails after some frames: they are still given out, then acquire(..) tells the failure at once */
+int testFailure() {
+	FakeCamera camera(2);
+	camera.failAfter = 3;
+	bool ok = true;
+	{
+		AsyncCapture<FakeCamera> capture(camera, CapturePolicy::EVERY_FRAME);
+		for(int i = 0; i < 3; ++i) {
+			ok = ok && capture.acquire(1000);
+		}
+		auto start = std::chrono::steady_clock::now();
+		ok = ok && !capture.acquire(1000) && capture.hasFailed();
+		double waitedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		ok = ok && (waitedMs < 500) && !capture.acquire();
+		// Rem.: The capture thread gave up after the first failing dequeue - no busy retries
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		ok = ok && (camera.dequeueCalls == 4);
+		printf("Failing camera: %d dequeue calls, acquire returned in %.1f ms: %s\n", camera.dequeueCalls.load(), waitedMs,
+				ok ? "OK" : "FAILED");
+	}
+	if(camera.queuedCount() != BUFFER_COUNT || camera.doubleRequeues != 0) {
+		ok = false;
+		printf("Failing camera: buffers not given back properly: FAILED\n");
+	}
+	return ok ? 0 : 1;
+}
+
+int testRing() {
+	static SpscRing<uint32_t, 8> ring;
+	const uint32_t COUNT = 100000;
+	// Rem.: Yielding when full or empty - so this is quick on a single core too
+	std::thread producer([] {
+		for(uint32_t i = 0; i < COUNT;) {
+			if(ring.push(i)) ++i; else std::this_thread::yield();
+		}
+	});
+	bool ok = true;
+	for(uint32_t expected = 0; expected < COUNT;) {
+		uint32_t value;
+		if(ring.pop(value)) {
+			ok = ok && (value == expected);
+			++expected;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	ok = ok && ring.isEmpty();
+	printf("SpscRing between two threads: %s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+int main() {
+	printf("Testing asynccapture.h...\n");
+
+	int failures = 0;
+	failures += testRing();
+	failures += testEveryFrame();
+	failures += testNewest();
+	failures += testOutstandingLeases();
+	failures += testFailure();
+
+	printf("...testing asynccapture.h ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,111 @@
+// Tests the batched merge of the MCParser (MCParserConfig::batchMerge) against the online merge as the oracle:
+// the markers (in the same order) and the emitted markers must be the very same for every batching feed -
+// bulk processFrame(..) with and without the closing sweep, scanline subsampling, processLine(..) collecting
+// the debug tokens and the ParallelMCParser.
+//
+// The batch is made very small so the scanlines full of markers are merged in more batches too.
+// Uses generated frames full of markers and the raw webcam frames of the input_poc directory.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+#define MC_LINE_BATCH_SIZE 7 // many flushes per scanline
+
+#include <cstdio>
+#include <vector>
+#include "parallelmcparser.h"
+#include "testhelpers.h"
+
+/** Parses the frame line-by-line with processLine(..) collecting the debug tokens */
+template<typename PARSER>
+ImageFrameResult parseLines(PARSER &mcp, const std::vector<uint8_t> &grey, int width, int height,
+		std::vector<DebugToken> &tokens) {
+	for(int j = 0; j < height; ++j) {
+		mcp.processLine(&grey[j * width], width, &tokens);
+	}
+	return mcp.endImageFrame();
+}
+
+/** Tells if the debug tokens are the very same */
+bool sameTokens(const std::vector<DebugToken> &a, const std::vector<DebugToken> &b) {
+	if(a.size() != b.size()) return false;
+	for(size_t i = 0; i < a.size(); ++i) {
+		if((a[i].x != b[i].x) || (a[i].y != b[i].y) || (a[i].isToken != b[i].isToken) ||
+				(a[i].foundMarker != b[i].foundMarker) || (a[i].markerX != b[i].markerX) || (a[i].order != b[i].order)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Tests one frame with all the feeds - returns the number of failures */
+int testFrame(const char *name, const std::vector<uint8_t> &grey, int width, int height) {
+	int failures = 0;
+	for(unsigned int rowStride : {1u, 4u}) {
+		for(unsigned int sweepBudget : {0u, 8u}) {
+			MCParserConfig config;
+			config.rowStride = rowStride;
+			config.closeSweepBudget = sweepBudget;
+			MCParser<> online(config);
+			config.batchMerge = true;
+			MCParser<> batched(config);
+
+			// Rem.: The order of the emitted markers must be the same too (the row is the same as well)
+			std::vector<unsigned int> onlineRows;
+			std::vector<unsigned int> batchedRows;
+			auto collectOnline = [&onlineRows](const Marker2D &marker, unsigned int row) { onlineRows.push_back(row); };
+			auto collectBatched = [&batchedRows](const Marker2D &marker, unsigned int row) { batchedRows.push_back(row); };
+			online.setMarkerSink(makeMarkerSink(collectOnline));
+			batched.setMarkerSink(makeMarkerSink(collectBatched));
+
+			auto expected = online.processFrame(&grey[0], width, height, width);
+			// Rem.: twice to see that the state is properly reset between frames
+			batched.processFrame(&grey[0], width, height, width);
+			batchedRows.clear();
+			auto result = batched.processFrame(&grey[0], width, height, width);
+			bool ok = sameResults(expected.markers, result.markers) && (onlineRows == batchedRows);
+			if(!ok) ++failures;
+			printf("%s (%dx%d, %d markers, row stride %u, sweep %u) bulk: %s\n", name, width, height,
+					(int)expected.markers.size(), rowStride, sweepBudget, ok ? "OK" : "MISMATCH");
+		}
+	}
+
+	MCParserConfig config;
+	MCParser<> online(config);
+	config.batchMerge = true;
+	MCParser<> batched(config);
+	std::vector<DebugToken> onlineTokens;
+	std::vector<DebugToken> batchedTokens;
+	auto expected = parseLines(online, grey, width, height, onlineTokens);
+	auto result = parseLines(batched, grey, width, height, batchedTokens);
+	bool ok = sameResults(expected.markers, result.markers) && sameTokens(onlineTokens, batchedTokens);
+	if(!ok) ++failures;
+	printf("%s (%dx%d, %d markers) line-by-line with debug tokens: %s\n", name, width, height,
+			(int)expected.markers.size(), ok ? "OK" : "MISMATCH");
+
+	ParallelMCParser<> parallel(4, config, HoparserSetup(), HomerSetup());
+	result = parallel.processFrame(&grey[0], width, height, width);
+	ok = sameResults(expected.markers, result.markers);
+	if(!ok) ++failures;
+	printf("%s (%dx%d, %d markers) 4 threads: %s\n", name, width, height,
+			(int)expected.markers.size(), ok ? "OK" : "MISMATCH");
+	return failures;
+}
+
+int main() {
+	printf("Testing the batched merge of the MCParser against the online merge...\n");
+
+	int failures = 0;
+	// Every row of markers is shifted so the 1D markers of a scanline are not all in the same columns
+	MarkerGrid grid;
+	grid.rowShift = 11;
+	grid.shiftPeriod = 3;
+	failures += testFrame("wide frame", generateMarkers(3840, 480, 40, grid), 3840, 480);
+	failures += testFrame("generated markers", generateMarkers(1280, 960, 40, grid), 1280, 960);
+	failures += testWebcamFrames([](const char *file, const std::vector<uint8_t> &grey) {
+		return testFrame(file, grey, WEBCAM_WIDTH, WEBCAM_HEIGHT);
+	});
+
+	printf("...testing the batched merge ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,123 @@
+// The capture pipeline of marker_camapp without any camera or display: the VirtualCamera (virtualcamera.h)
+// replays recorded frames at a camera frame rate, the AsyncCapture takes the newest frames and the MCParser
+// detects the markers on them - just like in the camapp. As fast as possible every frame is detected instead
+// (the newest ones would make the capture thread spin). Reports:
+// - the sustained frame rate of the detection
+// - the frames lost by the camera (no free buffer) and all the ones not detected (lost or dropped as stale)
+// - the latency from the capture to the end of the detection (mean and max) and the detection time
+//
+// Usage: camerabench [fps [files...]] - the raw webcam dumps of input_poc at 30 FPS and as fast as possible
+//        by default (raw files are 640x480 YUYV, see VirtualCamera for the other kinds)
+
+#define FFL_NO_DEBUG_MODE 1 // no debug logging in the measured loops
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "virtualcamera.h"
+#include "asynccapture.h"
+#include "mcparser.h"
+#include "pixelviews.h"
+
+/** Raw YUYV webcam frames used when no files are given - the missing ones are skipped */
+static const char* DEFAULT_BENCH_FILES[] = {
+	"../input_poc/out_interesting/marker1/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/marker2/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/marker_reco1/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/marker_reco2/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/4_good/webcam_output.yuv422.data",
+};
+
+/** Runs the detection on frames of the camera for the given seconds - like draw() of marker_camapp does */
+void bench(const std::vector<std::string> &files, double fps, double seconds) {
+	VirtualCameraConfig config;
+	config.files = files;
+	config.fps = fps;
+	VirtualCamera camera(config);
+	if(!camera.isOk()) {
+		printf("Cannot replay the files!\n");
+		return;
+	}
+
+	static MCParser<> mcp;
+	static ImageFrameResult results;
+	PixelView<GreyFormat> greyView(nullptr, camera.getWidth(), camera.getHeight(), camera.getBytesPerLine());
+	PixelView<YuyvFormat> view(nullptr, camera.getWidth(), camera.getHeight(), camera.getBytesPerLine());
+	bool grey = (camera.getPixelFormat() == V4L2_PIX_FMT_GREY);
+
+	int frames = 0;
+	size_t markers = 0;
+	double detectMs = 0;
+	double latencyMs = 0;
+	double maxLatencyMs = 0;
+	CaptureStats captureStats;
+	auto begin = std::chrono::steady_clock::now();
+	{
+		AsyncCapture<VirtualCamera> capture(camera, (fps > 0) ? CapturePolicy::NEWEST : CapturePolicy::EVERY_FRAME);
+		auto end = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(seconds));
+		while(std::chrono::steady_clock::now() < end) {
+			auto frame = capture.acquire(1000);
+			if(!frame) break;
+			auto start = std::chrono::steady_clock::now();
+			greyView.setBase(frame.data());
+			view.setBase(frame.data());
+			for(int j = 0; j < camera.getHeight(); ++j) {
+				mcp.processLine(grey ? greyView.row(j) : view.row(j), camera.getWidth(), nullptr);
+			}
+			mcp.endImageFrame(results);
+			detectMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			markers += results.markers.size();
+			++frames;
+			// Rem.: From the (virtual) capture of the frame
+			double age = frame.ageMs();
+			latencyMs += age;
+			if(age > maxLatencyMs) maxLatencyMs = age;
+		}
+		capture.stop();
+		captureStats = capture.getStats();
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	auto stats = camera.getStats();
+	char rate[32];
+	if(fps > 0) snprintf(rate, sizeof(rate), "%.0f FPS camera", fps); else snprintf(rate, sizeof(rate), "as fast as possible");
+	printf("%s: %d frames in %.1f s - %.1f FPS sustained\n", rate, frames, elapsed, frames / elapsed);
+	printf("  %llu lost in the camera, %llu not detected (lost or stale), %.1f markers per frame\n",
+			(unsigned long long)stats.lost, (unsigned long long)captureStats.dropped,
+			(frames > 0) ? ((double)markers / frames) : 0.0);
+	printf("  latency %.2f ms (max %.2f ms), detection %.2f ms per frame\n", (frames > 0) ? (latencyMs / frames) : 0.0,
+			maxLatencyMs, (frames > 0) ? (detectMs / frames) : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::string> files;
+	for(int i = 2; i < argc; ++i) {
+		files.push_back(argv[i]);
+	}
+	if(files.empty()) {
+		for(auto file : DEFAULT_BENCH_FILES) {
+			FILE *f = fopen(file, "rb");
+			if(f == nullptr) continue;
+			fclose(f);
+			files.push_back(file);
+		}
+	}
+	if(files.empty()) {
+		printf("No frames to replay - give the files as parameters!\n");
+		return 0;
+	}
+
+	printf("Replaying %d file(s) through the capture pipeline of marker_camapp...\n", (int)files.size());
+	if(argc > 1) {
+		bench(files, atof(argv[1]), 3);
+	} else {
+		bench(files, 30, 3);
+		bench(files, 0, 3);
+	}
+	return 0;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
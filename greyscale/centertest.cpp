@@ -0,0 +1,89 @@
+// Tests the CompactMarkerCenter (see the CENTER of the MCParser): the markers must be the very same as with
+// the MarkerCenter on frames that fit into its 16 bit coordinates - with the bulk and subsampled feeds and with
+// both list kinds. Also tests that the order histograms saturate instead of wrapping around on very tall
+// markers and that the 16 bit confidences saturate too.
+//
+// Uses generated frames full of markers and the raw webcam frames of the input_poc directory.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include "mcparser.h"
+#include "testhelpers.h"
+
+template<template<typename, int> class LIST, typename CENTER>
+using Parser = MCParser<uint8_t, int, DefaultAttrition, DefaultHomerPrecision, RuntimeConfig,
+	Hoparser<uint8_t, int>, LIST, CENTER>;
+
+/** Tests one frame with all the setups - returns the number of failures */
+int testFrame(const char *name, const std::vector<uint8_t> &grey, int width, int height) {
+	int failures = 0;
+	for(unsigned int rowStride : {1u, 4u}) {
+		MCParserConfig config;
+		config.rowStride = rowStride;
+		Parser<FastForwardList, MarkerCenter> wide(config);
+		Parser<FastForwardList, CompactMarkerCenter> compact(config);
+		Parser<SoaFastForwardList, CompactMarkerCenter> soaCompact(config);
+		auto expected = wide.processFrame(&grey[0], width, height, width);
+		auto result = compact.processFrame(&grey[0], width, height, width);
+		auto soaResult = soaCompact.processFrame(&grey[0], width, height, width);
+		bool ok = sameResults(expected.markers, result.markers) && sameResults(expected.markers, soaResult.markers);
+		if(!ok) ++failures;
+		printf("%s (%dx%d, %d markers, row stride %u): %s\n", name, width, height,
+				(int)expected.markers.size(), rowStride, ok ? "OK" : "MISMATCH");
+	}
+	return failures;
+}
+
+/**
+ * A center extended by many more 1D markers of order 3 than what fits into a byte and by some of order 2:
+ * the order must be 3 (with a wrapping histogram it would be 2 as 300 % 256 < 60).
+ * Returns the number of failures.
+ */
+template<typename CENTER>
+int testTallMarker(const char *name) {
+	const MCParserConfig config;
+	CENTER center(100, 0, 3);
+	unsigned int y = 1;
+	for(int i = 0; i < 60; ++i) center.tryExtend(100, y++, 2, config.deltaDiffMax, config.widthDiffMax);
+	for(int i = 1; i < 300; ++i) center.tryExtend(100, y++, 3, config.deltaDiffMax, config.widthDiffMax);
+	Marker2D marker = center.constructMarker(config.ignoreWhenSignalCountLessThan);
+	bool ok = (marker.order == 3) && (marker.y == (y - 1) / 2) && (marker.x == 100);
+	printf("%s of a very tall marker: order %u - %s\n", name, marker.order, ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/** The 16 bit confidence of the CompactMarkerCenter must saturate - returns the number of failures */
+int testConfidenceSaturation() {
+	CompactMarkerCenter center(100, 0, 3);
+	int confidence = 0;
+	for(int i = 0; i < 70000; ++i) confidence = (int16_t)center.skipUpd();
+	bool ok = (confidence == INT16_MIN);
+	printf("CompactMarkerCenter confidence after many skips: %d - %s\n", confidence, ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+int main() {
+	printf("Testing the CompactMarkerCenter against the MarkerCenter...\n");
+
+	int failures = 0;
+	failures += testTallMarker<MarkerCenter>("MarkerCenter");
+	failures += testTallMarker<CompactMarkerCenter>("CompactMarkerCenter");
+	failures += testConfidenceSaturation();
+	// Every row of markers is shifted so the 1D markers of a scanline are not all in the same columns
+	MarkerGrid grid;
+	grid.rowShift = 11;
+	grid.shiftPeriod = 3;
+	failures += testFrame("wide frame", generateMarkers(3840, 480, 40, grid), 3840, 480);
+	failures += testFrame("generated markers", generateMarkers(1280, 960, 40, grid), 1280, 960);
+	failures += testWebcamFrames([](const char *file, const std::vector<uint8_t> &grey) {
+		return testFrame(file, grey, WEBCAM_WIDTH, WEBCAM_HEIGHT);
+	});
+
+	printf("...testing the CompactMarkerCenter ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
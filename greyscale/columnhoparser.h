@@ -0,0 +1,336 @@
+#ifndef FASTTRACK_COLUMN_HOPARSER_H
+#define FASTTRACK_COLUMN_HOPARSER_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "microshackz.h"
+#include "lanehomer.h"
+#include "mcparser.h"
+
+/**
+ * COLUMN-DIRECTION HOMERS
+ * =======================
+ *
+ * One Homer for every column of the image - kept in struct-of-arrays form as wide as the image and
+ * stepped by the HomerLanes kernels with a whole row at a time. This way the columns are lexed in the
+ * very same row-order pass as the scanlines and the row is read with contiguous loads (no transpose).
+ *
+ * The state of each column after next(..) is exactly that of a Homer that got the column top-down.
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition,
+	typename PRECISION = DefaultHomerPrecision, typename CONFIG = RuntimeConfig>
+class ColumnHomer final {
+public:
+	/** Create column homers with the default setup (or the one of a compile-time CONFIG) */
+	ColumnHomer() noexcept {
+	}
+
+	/** Create column homers with the given setup */
+	ColumnHomer(HomerSetup setup, LenAffectParams params = LenAffectParams{}) noexcept : lanes(setup, params) {
+	}
+
+	/**
+	 * Sets the number of columns and resets all of them - like calling Homer::reset() for each.
+	 * Rem.: This only allocates when the width grows (not per-frame)!
+	 */
+	void NOINLINE resize(int width) noexcept {
+		columns = width;
+		// Rem.: padded to whole groups so that the kernels never need a remainder loop on the state
+		int padded = (width + 7) & ~7;
+		for(auto arr : { &len, &magSum, &magMin, &magMax, &isHo, &last, &wasLen, &wasMagSum }) {
+			arr->resize(padded);
+		}
+		ended.resize((padded + 31) / 32);
+		reset();
+	}
+
+	/** Resets every column - like calling Homer::reset() for each */
+	inline void reset() noexcept {
+		Lanes::reset(state(), 0, (int)len.size());
+	}
+
+	/**
+	 * Sends row[x] to the homer of column x - for every column at once.
+	 * Returns true when any column ended a homogenous area with this row: see getEnded() for which.
+	 */
+	inline bool next(const MT *row) noexcept {
+		auto s = state();
+		uint32_t any = 0;
+		int g = 0;
+		for(; g + 8 <= columns; g += 8) {
+			uint32_t bits = lanes.next8(s, g, row + g);
+			any |= bits;
+			setEnded(g, bits);
+		}
+		if(g < columns) {
+			// The last partial group is stepped on a padded copy - its padding lanes are never reported
+			MT tail[8] = { 0 };
+			int rest = columns - g;
+			for(int i = 0; i < rest; ++i) tail[i] = row[g + i];
+			uint32_t bits = lanes.next8(s, g, tail) & ((1u << rest) - 1);
+			any |= bits;
+			setEnded(g, bits);
+		}
+		return (any != 0);
+	}
+
+	/**
+	 * The columns that ended a homogenous area at the last next(..) call: bit (x % 32) of word (x / 32)
+	 * is set when column x was isHo before, but not after the row (only these matter for a Hoparser).
+	 */
+	inline const std::vector<uint32_t>& getEnded() const noexcept {
+		return ended;
+	}
+
+	/** Homer::getLen() of the column before the last next(..) */
+	inline int getWasLen(int x) const noexcept {
+		return wasLen[x];
+	}
+
+	/** Homer::getMagSum() of the column before the last next(..) */
+	inline CT getWasMagSum(int x) const noexcept {
+		return (CT)wasMagSum[x];
+	}
+
+	/** Homer::getLen() of the column */
+	inline int getLen(int x) const noexcept {
+		return len[x];
+	}
+
+	/** The number of columns */
+	inline int getWidth() const noexcept {
+		return columns;
+	}
+
+private:
+	using Lanes = HomerLanes<MT, CT, ATTRITION, PRECISION, CONFIG>;
+
+	/** The state arrays for the kernels */
+	inline typename Lanes::State state() noexcept {
+		return typename Lanes::State{len.data(), magSum.data(), magMin.data(), magMax.data(), isHo.data(), last.data(), wasLen.data(), wasMagSum.data()};
+	}
+
+	/** Saves the ended bits of the group of 8 columns starting at g */
+	inline void setEnded(int g, uint32_t bits) noexcept {
+		uint32_t &word = ended[g / 32];
+		int shift = g % 32;
+		word = (word & ~(0xFFu << shift)) | (bits << shift);
+	}
+
+	/** Setup and kernels */
+	Lanes lanes;
+
+	/** Number of columns (the state arrays are padded to a multiple of 8) */
+	int columns = 0;
+
+	// Homarea of each column
+	std::vector<int32_t> len;
+	std::vector<int32_t> magSum;
+	std::vector<int32_t> magMin;
+	std::vector<int32_t> magMax;
+	std::vector<int32_t> isHo;
+	std::vector<int32_t> last;
+
+	// State of each column before the last next(..)
+	std::vector<int32_t> wasLen;
+	std::vector<int32_t> wasMagSum;
+
+	/** Bitmask of the columns that ended an area at the last next(..) */
+	std::vector<uint32_t> ended;
+};
+
+/** A 1D marker found in a column: the center is at (x, y) */
+struct ColumnMarker {
+	unsigned int x;
+	unsigned int y;
+	unsigned int order;
+};
+
+/**
+ * A Hoparser for every column of the image - fed row by row using a ColumnHomer as lexer.
+ * Finds vertical 1D markers the same way the usual Hoparsers find the horizontal ones.
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition,
+	typename PRECISION = DefaultHomerPrecision, typename CONFIG = RuntimeConfig>
+class ColumnHoparserBank final {
+public:
+	/** Used for finding the 1D markers of one column */
+	using Tokenizer = Hoparser<MT, CT, ATTRITION, PRECISION, CONFIG>;
+
+	/** Create a column hoparser bank with default configuration */
+	ColumnHoparserBank() noexcept {
+	}
+
+	/** Create a column hoparser bank with the given configurations */
+	ColumnHoparserBank(HoparserSetup hoparserSetup, HomerSetup homerSetup) noexcept
+		: homer(homerSetup), prototype(homerSetup, hoparserSetup) {
+	}
+
+	/** Starts a new frame with the given width - drops all the earlier state and found markers */
+	void NOINLINE startFrame(int width) noexcept {
+		if(width != homer.getWidth()) {
+			homer.resize(width);
+			tokenizers.assign(width, prototype);
+		} else {
+			homer.reset();
+		}
+		for(auto &tokenizer : tokenizers) {
+			tokenizer.newLine();
+		}
+		y = 0;
+		markers.clear();
+	}
+
+	/** Sends the next row of the frame to all the columns */
+	inline void nextRow(const MT *row) noexcept {
+		if(UNLIKELY(homer.next(row))) {
+			const auto &ended = homer.getEnded();
+			for(size_t w = 0; w < ended.size(); ++w) {
+				uint32_t bits = ended[w];
+				while(bits != 0) {
+					int x = (int)(w * 32) + __builtin_ctz(bits);
+					bits &= bits - 1;
+					auto ret = tokenizers[x].nextLexed(y, homer.getWasLen(x), homer.getWasMagSum(x), homer.getLen(x));
+					if(ret.foundMarker) {
+						markers.push_back(ColumnMarker{(unsigned int)x,
+								(unsigned int)tokenizers[x].getMarkerX(), (unsigned int)tokenizers[x].getOrder()});
+					}
+				}
+			}
+		}
+		++y;
+	}
+
+	/** The vertical 1D markers found in the frame so far - in the order of the rows they ended at */
+	inline std::vector<ColumnMarker>& getMarkers() noexcept {
+		return markers;
+	}
+
+private:
+	/** Lexer of all the columns */
+	ColumnHomer<MT, CT, ATTRITION, PRECISION, CONFIG> homer;
+
+	/**
+	 * Hoparser of each column - only fed by nextLexed(..).
+	 * Rem.: The copies share the length affection table of the prototype so a column costs no extra allocation.
+	 */
+	std::vector<Tokenizer> tokenizers;
+
+	/** New columns get a copy of this (so the setup is only given once) */
+	Tokenizer prototype;
+
+	/** Index of the next row */
+	int y = 0;
+
+	/** The found vertical 1D markers */
+	std::vector<ColumnMarker> markers;
+};
+
+/**
+ * Result of parsing marker centers in both directions
+ */
+struct CrossFrameResult {
+	/** The same as ImageFrameResult::markers */
+	std::vector<Marker2D> markers;
+
+	/**
+	 * For each of the markers: the number of vertical 1D markers that confirm it.
+	 * Zero means the marker was only seen by the scanlines (false positive or a badly rotated marker).
+	 */
+	std::vector<unsigned int> columnSignals;
+
+	/** All vertical 1D markers of the frame - sorted by x (and by y when x is the same) */
+	std::vector<ColumnMarker> columnMarkers;
+};
+
+/**
+ * A MCParser that also runs a ColumnHoparserBank in the same single row-order pass over the frame.
+ * The 2D markers are built by the MCParser from the horizontal 1D markers as usual - then each one
+ * is cross-validated by counting the vertical 1D markers close to its center: a vertical marker
+ * confirms a 2D marker when their y differs by at most deltaDiffMax and x by at most widthDiffMax
+ * (these are the same MCParserConfig values that stack the horizontal 1D markers).
+ *
+ * Template parameters are those of the MCParser (without the TOKENIZER).
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition,
+	typename PRECISION = DefaultHomerPrecision, typename CONFIG = RuntimeConfig>
+class CrossMCParser final {
+public:
+	/** Parses the scanlines and stacks their 1D markers */
+	using Parser = MCParser<MT, CT, ATTRITION, PRECISION, CONFIG>;
+
+	/** Create a cross-validating parser with default configuration */
+	CrossMCParser() noexcept {
+	}
+
+	/** Create a cross-validating parser with the given configurations */
+	CrossMCParser(MCParserConfig parserConfig, HoparserSetup hoparserSetup, HomerSetup homerSetup) noexcept
+		: parser(parserConfig, hoparserSetup, homerSetup), columns(hoparserSetup, homerSetup) {
+	}
+
+	/** BULK FEED OF A WHOLE SCANLINE: same as MCParser::processLine(..) and feeds the columns too */
+	inline void processLine(const MT *row, int width) noexcept {
+		if(UNLIKELY(!inFrame)) {
+			columns.startFrame(width);
+			inFrame = true;
+		}
+		parser.processLine(row, width);
+		columns.nextRow(row);
+	}
+
+	/** BULK FEED OF A WHOLE FRAME: same as MCParser::processFrame(..) - both directions in the same pass */
+	inline CrossFrameResult processFrame(const MT *base, int width, int height, int stride) noexcept {
+		for(int j = 0; j < height; ++j) {
+			processLine(base + (size_t)j * stride, width);
+		}
+		return endImageFrame();
+	}
+
+	/** Ends the current image frame and returns the found 2D markers with their cross-validation */
+	inline CrossFrameResult endImageFrame() noexcept {
+		CrossFrameResult ret;
+		ret.markers = std::move(parser.endImageFrame().markers);
+		std::swap(ret.columnMarkers, columns.getMarkers());
+		inFrame = false;
+
+		std::sort(ret.columnMarkers.begin(), ret.columnMarkers.end(),
+			[](const ColumnMarker &a, const ColumnMarker &b) {
+				return (a.x < b.x) || ((a.x == b.x) && (a.y < b.y));
+			});
+
+		decltype(auto) config = parser.getConfig();
+		ret.columnSignals.resize(ret.markers.size());
+		for(size_t i = 0; i < ret.markers.size(); ++i) {
+			const Marker2D &m = ret.markers[i];
+			unsigned int minX = (m.x > config.widthDiffMax) ? (m.x - config.widthDiffMax) : 0;
+			auto it = std::lower_bound(ret.columnMarkers.begin(), ret.columnMarkers.end(), minX,
+				[](const ColumnMarker &c, unsigned int x) {
+					return c.x < x;
+				});
+			unsigned int signals = 0;
+			for(; (it != ret.columnMarkers.end()) && (it->x <= m.x + config.widthDiffMax); ++it) {
+				int dy = (int)it->y - (int)m.y;
+				if((it->order >= config.ignoreOrderSmallerThan) && (abs(dy) <= (int)config.deltaDiffMax)) {
+					++signals;
+				}
+			}
+			ret.columnSignals[i] = signals;
+		}
+		return ret;
+	}
+
+private:
+	/** The usual (horizontal) parser */
+	Parser parser;
+
+	/** The vertical 1D markers */
+	ColumnHoparserBank<MT, CT, ATTRITION, PRECISION, CONFIG> columns;
+
+	/** False before the first scanline of each frame */
+	bool inFrame = false;
+};
+
+#endif // FASTTRACK_COLUMN_HOPARSER_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,147 @@
+// Tests the column-direction parsing of columnhoparser.h:
+// - The ColumnHoparserBank must find exactly the same vertical 1D markers as
+//   plain Hoparsers that get each column top-down one-by-one.
+// - The CrossMCParser must find the same 2D markers as MCParser::processFrame(..)
+//   and the markers of the generated frame must all be confirmed vertically.
+// - The footprint of a wide ColumnHoparserBank must stay small: the column tokenizers share
+//   the length affection table so starting a frame allocates only the state arrays.
+//
+// Compile with and without -mavx2 to test both the AVX2 and the generic kernels!
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include "columnhoparser.h"
+#include "testhelpers.h"
+
+/** Number and total size of heap allocations since the start */
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+void* operator new(std::size_t size) {
+	++allocations;
+	allocatedBytes += size;
+	void *p = malloc(size ? size : 1);
+	if(p == nullptr) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	free(p);
+}
+
+bool lessColumnMarker(const ColumnMarker &a, const ColumnMarker &b) {
+	return (a.x < b.x) || ((a.x == b.x) && (a.y < b.y));
+}
+
+/** Reference: a plain Hoparser for each column fed top-down */
+std::vector<ColumnMarker> referenceColumnMarkers(const std::vector<uint8_t> &grey, int width, int height) {
+	std::vector<ColumnMarker> ret;
+	Hoparser<> hop;
+	for(int x = 0; x < width; ++x) {
+		hop.newLine();
+		for(int y = 0; y < height; ++y) {
+			if(hop.next(grey[y * width + x]).foundMarker) {
+				ret.push_back(ColumnMarker{(unsigned int)x, (unsigned int)hop.getMarkerX(), (unsigned int)hop.getOrder()});
+			}
+		}
+	}
+	return ret;
+}
+
+/** Tests one frame - returns the number of failures */
+int testFrame(const char *name, const std::vector<uint8_t> &grey, int width, int height, bool allConfirmed) {
+	int failures = 0;
+
+	// Vertical 1D markers
+	auto expected = referenceColumnMarkers(grey, width, height);
+	ColumnHoparserBank<> bank;
+	// Rem.: twice to see that the state is properly reset between frames
+	std::vector<ColumnMarker> found;
+	for(int run = 0; run < 2; ++run) {
+		bank.startFrame(width);
+		for(int y = 0; y < height; ++y) {
+			bank.nextRow(&grey[y * width]);
+		}
+		found = bank.getMarkers();
+	}
+	std::sort(found.begin(), found.end(), lessColumnMarker);
+	bool ok = (expected.size() == found.size());
+	for(size_t i = 0; ok && (i < found.size()); ++i) {
+		ok = (expected[i].x == found[i].x) && (expected[i].y == found[i].y) && (expected[i].order == found[i].order);
+	}
+	if(!ok) ++failures;
+	printf("%s (%dx%d) column markers: %s (%d found)\n", name, width, height, ok ? "OK" : "MISMATCH", (int)found.size());
+
+	// 2D markers and their cross-validation
+	MCParser<> mcp;
+	auto expectedFrame = mcp.processFrame(&grey[0], width, height, width);
+	CrossMCParser<> cmcp;
+	auto result = cmcp.processFrame(&grey[0], width, height, width);
+	ok = (expectedFrame.markers.size() == result.markers.size()) && (result.columnMarkers.size() == found.size());
+	int confirmed = 0;
+	for(size_t i = 0; ok && (i < result.markers.size()); ++i) {
+		ok = (expectedFrame.markers[i].x == result.markers[i].x) && (expectedFrame.markers[i].y == result.markers[i].y);
+		if(result.columnSignals[i] > 0) ++confirmed;
+	}
+	if(allConfirmed && (confirmed != (int)result.markers.size())) ok = false;
+	if(!ok) ++failures;
+	printf("%s (%dx%d) cross-validated 2D markers: %s (%d of %d confirmed)\n", name, width, height, ok ? "OK" : "MISMATCH",
+			confirmed, (int)result.markers.size());
+	return failures;
+}
+
+/**
+ * Tests the heap footprint of starting frames of the given width - returns the number of failures.
+ * Rem.: Only the state arrays of the ColumnHomer and the tokenizers are allowed - no per-column allocation.
+ */
+int testFootprint(int width) {
+	using Bank = ColumnHoparserBank<>;
+	Bank bank;
+	size_t before = allocations;
+	size_t beforeBytes = allocatedBytes;
+	bank.startFrame(width);
+	size_t count = allocations - before;
+	size_t bytes = allocatedBytes - beforeBytes;
+	// 8 int32_t state arrays and the ended bitmask of the lexer, one tokenizer per column
+	size_t maxBytes = (size_t)width * (sizeof(Bank::Tokenizer) + 64);
+	bool small = (count <= 16) && (bytes <= maxBytes);
+	before = allocations;
+	bank.startFrame(width);
+	bool reused = (allocations == before);
+	printf("Footprint of width %d: %s - %d allocation(s), %d bytes (max. %d), %s on the next frame\n", width,
+			(small && reused) ? "OK" : "FAILED", (int)count, (int)bytes, (int)maxBytes,
+			reused ? "no allocation" : "ALLOCATED");
+	return (small && reused) ? 0 : 1;
+}
+
+int main() {
+	printf("Testing ColumnHoparserBank and CrossMCParser...\n");
+
+	int failures = 0;
+	failures += testFootprint(1920);
+
+	// Enough margin for a homogenous prefix in both directions
+	MarkerGrid grid;
+	grid.margin = 25;
+	grid.endMargin = 20;
+	// Rem.: the width is not a multiple of 8 so the partial column group is tested too
+	failures += testFrame("generated markers", generateMarkers(1277, 960, 40, grid), 1277, 960, true);
+
+	failures += testWebcamFrames([](const char *file, const std::vector<uint8_t> &grey) {
+		return testFrame(file, grey, WEBCAM_WIDTH, WEBCAM_HEIGHT, false);
+	});
+
+	printf("...testing ColumnHoparserBank and CrossMCParser ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
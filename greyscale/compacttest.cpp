@@ -0,0 +1,89 @@
+// Tests the compaction of the marker center list (MCParserConfig::compactCheckLines): compacting at every
+// scanline must give the very same markers (in the same order) as never compacting - with and without the
+// closing sweep (its cursor is kept over the compaction), with the batched merge, with both list kinds
+// and with the ParallelMCParser too.
+//
+// Uses generated frames full of markers and the raw webcam frames of the input_poc directory.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <vector>
+#include "parallelmcparser.h"
+#include "testhelpers.h"
+
+/** The same parser with the SoaFastForwardList */
+using SoaMCParser = MCParser<uint8_t, int, DefaultAttrition, DefaultHomerPrecision, RuntimeConfig,
+	Hoparser<uint8_t, int>, SoaFastForwardList>;
+
+/** Parses the frame with the given parser kind - returns its number of compactions in "compactions" */
+template<typename PARSER>
+ImageFrameResult parse(const MCParserConfig &config, const std::vector<uint8_t> &grey, int width, int height,
+		unsigned int &compactions) {
+	PARSER mcp(config);
+	auto result = mcp.processFrame(&grey[0], width, height, width);
+	compactions = mcp.getListStats().compactions;
+	return result;
+}
+
+/** Tests one frame with all the setups - returns the number of failures */
+int testFrame(const char *name, const std::vector<uint8_t> &grey, int width, int height) {
+	int failures = 0;
+	for(unsigned int sweepBudget : {0u, 8u}) {
+		for(bool batchMerge : {false, true}) {
+			MCParserConfig config;
+			config.closeSweepBudget = sweepBudget;
+			config.batchMerge = batchMerge;
+			config.compactCheckLines = 0;
+			unsigned int compactions;
+			auto expected = parse<MCParser<>>(config, grey, width, height, compactions);
+			// Rem.: Zero percent means compacting whenever there is anything out of order
+			config.compactCheckLines = 1;
+			config.compactFragmentationPercent = 0;
+			config.compactMinLength = 0;
+			auto result = parse<MCParser<>>(config, grey, width, height, compactions);
+			unsigned int soaCompactions;
+			auto soaResult = parse<SoaMCParser>(config, grey, width, height, soaCompactions);
+			bool ok = sameResults(expected.markers, result.markers) && sameResults(expected.markers, soaResult.markers);
+			if(!ok) ++failures;
+			printf("%s (%dx%d, %d markers, sweep %u, %s merge) %u/%u compactions: %s\n", name, width, height,
+					(int)expected.markers.size(), sweepBudget, batchMerge ? "batched" : "online",
+					compactions, soaCompactions, ok ? "OK" : "MISMATCH");
+		}
+	}
+
+	MCParserConfig config;
+	config.compactCheckLines = 0;
+	MCParser<> plain(config);
+	auto expected = plain.processFrame(&grey[0], width, height, width);
+	config.compactCheckLines = 1;
+	config.compactFragmentationPercent = 0;
+	config.compactMinLength = 0;
+	ParallelMCParser<> parallel(4, config, HoparserSetup(), HomerSetup());
+	auto result = parallel.processFrame(&grey[0], width, height, width);
+	bool ok = sameResults(expected.markers, result.markers);
+	if(!ok) ++failures;
+	printf("%s (%dx%d, %d markers) 4 threads: %s\n", name, width, height,
+			(int)expected.markers.size(), ok ? "OK" : "MISMATCH");
+	return failures;
+}
+
+int main() {
+	printf("Testing the compaction of the marker center list...\n");
+
+	int failures = 0;
+	// Every row of markers is shifted so the 1D markers of a scanline are not all in the same columns
+	MarkerGrid grid;
+	grid.rowShift = 11;
+	grid.shiftPeriod = 3;
+	failures += testFrame("wide frame", generateMarkers(3840, 480, 40, grid), 3840, 480);
+	failures += testFrame("generated markers", generateMarkers(1280, 960, 40, grid), 1280, 960);
+	failures += testWebcamFrames([](const char *file, const std::vector<uint8_t> &grey) {
+		return testFrame(file, grey, WEBCAM_WIDTH, WEBCAM_HEIGHT);
+	});
+
+	printf("...testing the compaction ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,92 @@
+// Tests the online marker emission of the MCParser (see MCParser::setMarkerSink(..)) on a
+// generated frame with three rows of markers: the sink must get exactly the markers of the
+// frame results (in the same order) and the markers of the upper rows must be emitted in the
+// middle of the frame - not just at its end. Also tested with scanline subsampling.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "mcparser.h"
+#include "testhelpers.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define CIRCLE_SIZE 50
+/** Markers left of this are not in the rightmost column */
+#define LAST_COLUMN_X 1700
+
+/** A marker as the sink got it */
+struct Emitted {
+	Marker2D marker;
+	unsigned int row;
+};
+
+/** Tests the emission with the given parser configuration - returns the number of failures */
+int testEmission(const char *name, const std::vector<uint8_t> &grey, MCParserConfig config) {
+	std::vector<Emitted> emitted;
+	auto collect = [&emitted](const Marker2D &marker, unsigned int row) {
+		emitted.push_back(Emitted{marker, row});
+	};
+	MCParser<> mcp(config);
+	mcp.setMarkerSink(makeMarkerSink(collect));
+	auto result = mcp.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+
+	bool same = (emitted.size() == result.markers.size());
+	for(size_t i = 0; same && (i < emitted.size()); ++i) {
+		const Marker2D &a = emitted[i].marker;
+		const Marker2D &b = result.markers[i];
+		same = (a.x == b.x) && (a.y == b.y) && (a.order == b.order) && (a.confidence == b.confidence);
+	}
+
+	// The upper half markers must be there before the end of the frame - and never before the marker itself
+	// Rem.: Except for the rightmost column: without the closing sweep of endLine() (closeSweepBudget = 0)
+	//       centers only close when a later 1D marker walks over them and nothing is on their right below them!
+	bool early = true;
+	int upper = 0;
+	double rowSum = 0;
+	for(const auto &e : emitted) {
+		if(e.row < e.marker.y) early = false;
+		if(e.marker.y < HEIGHT / 2) {
+			if((e.row >= HEIGHT) && (e.marker.x < LAST_COLUMN_X)) early = false;
+			rowSum += e.row;
+			++upper;
+		}
+	}
+	if(upper == 0) early = false;
+	printf("%s: %s - %d markers emitted, the %d upper half ones at %.1f%% of the frame on average\n", name,
+			(same && early) ? "OK" : "FAILED", (int)emitted.size(), upper, (upper > 0) ? (100.0 * rowSum / upper / HEIGHT) : 0.0);
+
+	// Turning it off
+	emitted.clear();
+	mcp.setMarkerSink(MarkerSink());
+	mcp.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	bool off = emitted.empty();
+	if(!off) printf("%s: markers emitted after turning off the sink!\n", name);
+
+	return (same && early && off) ? 0 : 1;
+}
+
+int main() {
+	printf("Testing online marker emission...\n");
+
+	std::vector<uint8_t> grey(WIDTH * HEIGHT);
+	for(auto &p : grey) p = 224 + (rand() % 8);
+	for(int y = 150; y < HEIGHT; y += 350) {
+		for(int x = 200; x < WIDTH; x += 400) {
+			drawMarker(grey, WIDTH, HEIGHT, x, y, CIRCLE_SIZE, 6);
+		}
+	}
+
+	int failures = 0;
+	MCParserConfig config;
+	failures += testEmission("every scanline", grey, config);
+	config.rowStride = 4;
+	failures += testEmission("subsampled", grey, config);
+
+	printf("...testing online marker emission ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -60,12 +60,25 @@ private:
 	// The MCParser as given by the user
 	MCP mcp;
 	PnPCalculator pnp;
+	// The 2D markers of the last frame - reused between frames so no allocations happen per frame
+	ImageFrameResult mcres;
 public:
+	/**
+	 * Tells if endImageFrame() gives real pose estimates - false while the PnPCalculator is not called there yet
+	 * (see the TODO in it): the returned pose is all zero until then. Tools should not offer the pose without it!
+	 */
+	static constexpr bool calculatesPose = false;
+
 	/** FEED OF THE NEXT MAGNITUDE: Returns the "isToken" data if available - mostly debug-only return value! */
 	inline NexRes next(MT mag) noexcept {
 		return mcp.next(mag);
 	}
 
+	/** BULK FEED OF A WHOLE SCANLINE: see MCParser::processLine(..) - this also ends the line */
+	inline void processLine(const MT *row, int width, std::vector<DebugToken> *debugTokens = nullptr) noexcept {
+		mcp.processLine(row, width, debugTokens);
+	}
+
 	/**
 	 * Indicates that the line has ended and "next" pixels are on a following line.
 	 * Rem.: Lines should be normally of the same size otherwise the algorithm can fail!
@@ -81,15 +94,21 @@ public:
 	 * Rem.: This algorithm is not completely online - the 2D->3D calculations mostly happen here!
 	 */
 	inline const PoseRes3D endImageFrame() noexcept {
-		// Get 2D marker results
-		ImageFrameResult mcres = mcp.endImageFrame();
+		// Get 2D marker results (into the storage of the earlier frame)
+		mcp.endImageFrame(mcres);
 
 		// TODO: Calculate 3D camera pose estimate
-		PoseRes3D res;
+		// Rem.: All zero until then - not the garbage of the stack
+		PoseRes3D res = PoseRes3D();
 
 		// Return the 3D camera pose estimate
 		return res;
 	}
+
+	/** The 2D markers found on the last frame - only valid until the next endImageFrame() call */
+	inline const ImageFrameResult& getMarkers() const noexcept {
+		return mcres;
+	}
 };
 
 #endif // FT_3D_QR_POSER
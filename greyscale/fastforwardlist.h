@@ -4,12 +4,16 @@
 #include<array>         // std::array
 #include<utility>       // std::pair
 #include<cassert>
+#include"microshackz.h"
 
 /** This is a logical position before the head of any FastForwardList. Useful for inserting before head! */
 #define NIL_POS  FFLPosition(-1)
 
 // Uncomment to log debug messages to stdout...
+// Rem.: Define FFL_NO_DEBUG_MODE (from client code) to turn this off - like benchmarks do
+#ifndef FFL_NO_DEBUG_MODE
 #define FFL_DEBUG_MODE 1
+#endif // FFL_NO_DEBUG_MODE
 
 // You need to define this if you want range checks:
 //#define FFL_INSERT_RANGE_CHECK 1
@@ -28,6 +32,8 @@
 class FFLPosition final {
 	template<typename U, int MAX>
 	friend class FastForwardList; // let them use the underlying index and constructor
+	template<typename U, int MAX>
+	friend class SoaFastForwardList; // same
 private:
 	// Rem.: This is much faster then always returning the complete NODE!!!
 	int index;
@@ -172,11 +178,11 @@ class FastForwardList {
 
 		/** Tells if there is at least one available hole to get */
 		inline bool hasHole() {
-			// True if: Start is smaller (pointers are in the same loopNo) with enough space to have elements
-			// OR the end is earlier than the start (it is one loopNo ahead in circular buffer modulo group)
-			// and start is not at the end of the buffer (as that would be the only case of too small difference).
-			return ((int)holeStart < ((int)holeEnd - 1))
-			   	|| ((holeStart != MAX) && (holeEnd < holeStart));
+			// The circular buffer is empty exactly when End is the next of Start (see reset()).
+			// Rem.: Earlier this was deduced from the Start < End relation and when Start stood
+			//       at the last slot with wrapped-around holes, those were not found - so after
+			//       more than MAX unlinks the list could write past its array!
+			return (holeEnd != ((holeStart + 1) % (MAX+1)));
 		}
 
 		/** Resets the holekeeper structure */
@@ -263,6 +269,11 @@ public:
 		return (data[positionFromTheList.index].first);
 	}
 
+	/** Hints the CPU to load the element at the given position - a NO-OP for NIL positions */
+	inline void prefetch(FFLPosition position) const noexcept {
+		if(!position.isNil()) PREFETCH(&data[position.index]);
+	}
+
 	/**
 	 * Inserts a copy of the provided element as the new head. The earlier
 	 * head becomes the "next" after the new one - if there was space for it.
@@ -458,6 +469,258 @@ public:
 		// Return the position of the successor of the unlinked element
 		return succUnlinkPos;
 	}
+
+	/**
+	 * Tells how many links (from an element to the next one - and to the head) do not go to the physically
+	 * next slot of the array. Zero means the elements are in their logical order like after compact().
+	 * Rem.: This walks the whole list!
+	 */
+	inline int fragmentation() const noexcept {
+		int broken = (headIndex > 0) ? 1 : 0;
+		for(int i = headIndex; (i >= 0) && (data[i].second >= 0); i = data[i].second) {
+			if(data[i].second != (i + 1)) ++broken;
+		}
+		return broken;
+	}
+
+	/**
+	 * Rewrites the elements in-place into their logical order at the start of the array so iterating
+	 * over the list is a sequential memory walk again (and there are no holes to reuse).
+	 * Every earlier handle gets invalid - except "keep", whose new position is returned (NIL_POS for NIL_POS).
+	 */
+	inline FFLPosition compact(FFLPosition keep = NIL_POS) noexcept {
+		FFLPosition kept = NIL_POS;
+		int i = 0;
+		int pos = headIndex;
+		while(pos >= 0) {
+			// Rem.: Links still hold the original slots so this is the place to find "keep"
+			if(pos == keep.index) kept = FFLPosition(i);
+			// Elements swapped away from the already rewritten slots left their new slot in the "next" there
+			while(pos < i) pos = data[pos].second;
+			int succ = data[pos].second;
+			if(pos != i) {
+				std::swap(data[i], data[pos]);
+				data[i].second = pos;
+			}
+			++i;
+			pos = succ;
+		}
+		// Relink in array order
+		for(int j = 0; j < curLen; ++j) {
+			data[j].second = j + 1;
+		}
+		if(curLen > 0) data[curLen - 1].second = -1;
+		headIndex = (curLen > 0) ? 0 : (-1);
+		filledLenMax = curLen;
+		holeKeeper.reset();
+		return kept;
+	}
+};
+
+/**
+ * Struct-of-arrays variant of the FastForwardList with the very same interface (FFLPosition handles too).
+ *
+ * Differences:
+ * - The next indices are in their own array - separate from the elements - so walking the links does not
+ *   pull the elements into the cache and the elements are tightly packed (no std::pair padding).
+ * - Unlinked slots are reused in LIFO order (a stack instead of the circular queue of the HoleKeeper):
+ *   the most recently freed slot is the most likely to be still in the cache.
+ * - There is no modulo anywhere so every MAX is equally fast: the power-of-two-minus-one advice of the
+ *   FastForwardList does not apply (MAX_MARKER_PER_SCANLINE of 1024 is a real modulo by 1025 there).
+ *
+ * Rem.: The range checks (FFL_INSERT_RANGE_CHECK) and debug assertions (FFL_DEBUG_MODE) work the same way.
+ */
+template<typename T, int MAX>
+class SoaFastForwardList {
+	// The current length of this list
+	int curLen;
+
+	// The left-to-right filled area size - not counting holes
+	int filledLenMax;
+
+	// Index of the current head element - (-1) represents the nullptr in indices
+	int headIndex;
+
+	// Number of unlinked slots on the holes stack
+	int holeCount;
+
+	// The index of the next element for each slot - (-1) for the last element
+	std::array<int, MAX> nexts;
+
+	// The elements in the slots
+	std::array<T, MAX> values;
+
+	// Stack of the unlinked slots - the top is reused first
+	std::array<int, MAX> holes;
+public:
+	SoaFastForwardList() : curLen(0), filledLenMax(0), headIndex(-1), holeCount(0) {}
+
+	// Move and copy constructors are just the default generated ones!
+	SoaFastForwardList(const SoaFastForwardList& ffl)            = default;
+	SoaFastForwardList(SoaFastForwardList&& ffl)                 = default;
+	SoaFastForwardList& operator=(const SoaFastForwardList& ffl) = default;
+	SoaFastForwardList& operator=(SoaFastForwardList&& ffl)      = default;
+
+	/** Get a handle to the head - isNil() for an empty list */
+	inline FFLPosition head() const noexcept {
+		return FFLPosition(headIndex);
+	}
+
+	/** Reset this list for reuse in-place - every earlier handle is considered invalid! */
+	inline void reset() noexcept {
+		headIndex = -1;
+		curLen = 0;
+		filledLenMax = 0;
+		holeCount = 0;
+	}
+
+	/** Gets the next position after the provided one - NIL when the list ended */
+	inline FFLPosition next(FFLPosition current) const noexcept {
+#ifdef FFL_INSERT_RANGE_CHECK
+		if(current.isNil()) {
+			fprintf(stderr, "next: Range error!\n");
+			return NIL_POS;
+		}
+#endif // FFL_INSERT_RANGE_CHECK
+#ifdef FFL_DEBUG_MODE
+		FFL_ASSERTION(!current.isNil());
+#endif // FFL_DEBUG_MODE
+		return FFLPosition(nexts[current.index]);
+	}
+
+	/** Returns reference to the stored value for the given non-NIL position */
+	inline T& operator[](FFLPosition positionFromTheList) noexcept {
+		return values[positionFromTheList.index];
+	}
+
+	/** Returns the const reference to the stored value for the given non-NIL position */
+	inline const T& operator[](FFLPosition positionFromTheList) const noexcept {
+		return values[positionFromTheList.index];
+	}
+
+	/** Hints the CPU to load the element at the given position - a NO-OP for NIL positions */
+	inline void prefetch(FFLPosition position) const noexcept {
+		if(!position.isNil()) PREFETCH(&values[position.index]);
+	}
+
+	/** Inserts a copy of the provided element as the new head - returns its position (NIL_POS on failure) */
+	inline FFLPosition push_front(T element) noexcept {
+		return insertAfter(element, NIL_POS);
+	}
+
+	/** Tells if the list is empty or not */
+	inline bool isEmpty() const noexcept {
+		return (curLen == 0);
+	}
+
+	/** Tells the number of elements in the list */
+	inline int size() const noexcept {
+		return curLen;
+	}
+
+	/** Tells the number of remaining free positions in the list */
+	inline int freeCapacity() const noexcept {
+		return MAX - curLen;
+	}
+
+	/**
+	 * Inserts a copy of the provided element AFTER the provided position (NIL_POS: as the new head).
+	 * Returns NIL_POS in case of failure, otherwise the position of the newly inserted element!
+	 */
+	inline FFLPosition insertAfter(T element, FFLPosition position) noexcept {
+#ifdef FFL_INSERT_RANGE_CHECK
+		if(curLen >= MAX) {
+			return NIL_POS;
+		}
+#endif // FFL_INSERT_RANGE_CHECK
+#ifdef FFL_DEBUG_MODE
+		FFL_ASSERTION(curLen < MAX);
+#endif // FFL_DEBUG_MODE
+		// The most recently unlinked slot - or a never used one
+		int targetInsertPos = (holeCount > 0) ? holes[--holeCount] : filledLenMax++;
+
+		values[targetInsertPos] = element;
+		if(!position.isNil()) {
+			nexts[targetInsertPos] = nexts[position.index];
+			nexts[position.index] = targetInsertPos;
+		} else {
+			// Rem.: headIndex is (-1) for the empty list so that case needs no branch
+			nexts[targetInsertPos] = headIndex;
+			headIndex = targetInsertPos;
+		}
+
+		++curLen;
+		return FFLPosition(targetInsertPos);
+	}
+
+	/** Unlink/delete the head node. Returns position after the unlinked element. */
+	inline FFLPosition unlinkHead() noexcept {
+		return unlinkAfter(NIL_POS);
+	}
+
+	/**
+	 * Unlink/delete the node AFTER the given position (NIL_POS: the head).
+	 * Returns a position AFTER the unlinked element
+	 * Rem.: Might return NIL_POS on range check errors!
+	 */
+	inline FFLPosition unlinkAfter(FFLPosition position) noexcept {
+		int unlinkPos = position.isNil() ? headIndex : nexts[position.index];
+#ifdef FFL_INSERT_RANGE_CHECK
+		if(unlinkPos < 0) {
+			return NIL_POS;
+		}
+#endif // FFL_INSERT_RANGE_CHECK
+#ifdef FFL_DEBUG_MODE
+		FFL_ASSERTION(unlinkPos >= 0);
+#endif // FFL_DEBUG_MODE
+		int succ = nexts[unlinkPos];
+		if(position.isNil()) {
+			headIndex = succ;
+		} else {
+			nexts[position.index] = succ;
+		}
+
+		// Push the slot on the hole stack - it is reused first as it is the "hottest" in the cache
+		holes[holeCount++] = unlinkPos;
+		--curLen;
+		return FFLPosition(succ);
+	}
+
+	/** Tells how many links do not go to the physically next slot - see FastForwardList::fragmentation() */
+	inline int fragmentation() const noexcept {
+		int broken = (headIndex > 0) ? 1 : 0;
+		for(int i = headIndex; (i >= 0) && (nexts[i] >= 0); i = nexts[i]) {
+			if(nexts[i] != (i + 1)) ++broken;
+		}
+		return broken;
+	}
+
+	/** Rewrites the elements in-place into their logical order - see FastForwardList::compact(..) */
+	inline FFLPosition compact(FFLPosition keep = NIL_POS) noexcept {
+		FFLPosition kept = NIL_POS;
+		int i = 0;
+		int pos = headIndex;
+		while(pos >= 0) {
+			if(pos == keep.index) kept = FFLPosition(i);
+			while(pos < i) pos = nexts[pos];
+			int succ = nexts[pos];
+			if(pos != i) {
+				std::swap(values[i], values[pos]);
+				nexts[pos] = nexts[i];
+				nexts[i] = pos;
+			}
+			++i;
+			pos = succ;
+		}
+		for(int j = 0; j < curLen; ++j) {
+			nexts[j] = j + 1;
+		}
+		if(curLen > 0) nexts[curLen - 1] = -1;
+		headIndex = (curLen > 0) ? 0 : (-1);
+		filledLenMax = curLen;
+		holeCount = 0;
+		return kept;
+	}
 };
 
 #endif // _FASTFORWARD_LIST_H
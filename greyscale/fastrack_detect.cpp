@@ -0,0 +1,309 @@
+// Headless marker detection for the production units without a display server: capture -> detect ->
+// (optional) pose in a tight loop and the results of every frame written to stdout, a file or a socket.
+// No X11, GL or CImg is linked in - only the header-only parser, the capture and libc (see the makefile).
+//
+// Usage: fastrackdetect [options] [files to replay...]
+//   -d DEVICE  video device to capture from (default: /dev/video0) - not used when files are given
+//   -s WxH     frame size (default: 640x480) - also the size of the frames of the raw replayed files
+//   -r FPS     frame rate (default: 30) - 0 replays the files as fast as possible
+//   -n FRAMES  stop after this many frames (default: until interrupted or the replay ends)
+//   -o OUTPUT  "-" for stdout (default), a file, udp:HOST:PORT (a datagram per frame) or tcp:HOST:PORT
+//   -b         binary records instead of text lines
+//   -p         add the pose estimate of each frame - rejected while the poser has no solver
+//              (see Fast3DPoser::calculatesPose - it would only be zeros)
+//   -l         loop the replayed files
+//   -q         no statistics on stderr at the end
+//
+// Text output - one line per frame (the pose is the 3x4 transform of PoseRes3D):
+//   <sequence> <marker count>[ <x>,<y>,<order>,<confidence>]...[ P <12 numbers>]
+//
+// Binary output - one record per frame in host byte order (little endian on our units):
+//   "FTD1" | uint32 sequence | uint16 marker count | uint16 flags (1: pose follows)
+//   | marker count x (uint16 x, uint16 y, uint16 order, uint16 confidence) - the last two saturate
+//   | 12 x float32 transform (when the pose flag is set)
+//
+// Files are replayed with the VirtualCamera (see virtualcamera.h) - so this runs on CI as well.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the loop
+#define V4L_WRAPPER_NO_DEBUG 1 // stdout is for the results only
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "v4lwrapper.h"
+#include "virtualcamera.h"
+#include "asynccapture.h"
+#include "mcparser.h"
+#include "fast3dposer.h"
+#include "pixelviews.h"
+
+/** The 16 bit marker centers are plenty for camera frames and keep the parser state small */
+typedef MCParser<uint8_t, int, DefaultAttrition, DefaultHomerPrecision, RuntimeConfig,
+	Hoparser<uint8_t, int>, FastForwardList, CompactMarkerCenter> Parser;
+// Rem.: The calculator does not matter until the poser calls it - see Fast3DPoser::calculatesPose
+typedef Fast3DPoser<NopPnPCalculator, uint8_t, int, Parser> Poser;
+
+/** Rem.: Static so the big parser state is in the bss and costs nothing until its pages are touched */
+static Poser poser;
+
+struct Options {
+	std::string device = "/dev/video0";
+	std::vector<std::string> files;
+	int width = 640;
+	int height = 480;
+	double fps = 30;
+	long frames = 0;
+	std::string output = "-";
+	bool binary = false;
+	bool pose = false;
+	bool loop = false;
+	bool quiet = false;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void stopRunning(int) {
+	running = 0;
+}
+
+static void usage() {
+	fprintf(stderr, "Usage: fastrackdetect [-d DEVICE] [-s WxH] [-r FPS] [-n FRAMES] [-o -|FILE|udp:HOST:PORT|tcp:HOST:PORT]"
+			" [-b] [-p] [-l] [-q] [files to replay...]\n");
+	exit(1);
+}
+
+static Options parseOptions(int argc, char *argv[]) {
+	Options options;
+	int opt;
+	while((opt = getopt(argc, argv, "d:s:r:n:o:bplqh")) != -1) {
+		switch(opt) {
+			case 'd': options.device = optarg; break;
+			case 's':
+				if(sscanf(optarg, "%dx%d", &options.width, &options.height) != 2) usage();
+				break;
+			case 'r': options.fps = atof(optarg); break;
+			case 'n': options.frames = atol(optarg); break;
+			case 'o': options.output = optarg; break;
+			case 'b': options.binary = true; break;
+			case 'p': options.pose = true; break;
+			case 'l': options.loop = true; break;
+			case 'q': options.quiet = true; break;
+			default: usage();
+		}
+	}
+	for(int i = optind; i < argc; ++i) {
+		options.files.push_back(argv[i]);
+	}
+	if(options.pose && !Poser::calculatesPose) {
+		fprintf(stderr, "-p is not available: the poser of this build has no pose solver (see Fast3DPoser::calculatesPose)!\n");
+		exit(1);
+	}
+	return options;
+}
+
+/** Opens the output: stdout, a file or a connected udp / tcp socket - exits on errors */
+static int openOutput(const std::string &output) {
+	if(output == "-") return STDOUT_FILENO;
+	bool udp = (output.compare(0, 4, "udp:") == 0);
+	bool tcp = (output.compare(0, 4, "tcp:") == 0);
+	if(!udp && !tcp) {
+		int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0) {
+			perror(output.c_str());
+			exit(1);
+		}
+		return fd;
+	}
+
+	size_t colon = output.rfind(':');
+	std::string host = output.substr(4, colon - 4);
+	std::string port = output.substr(colon + 1);
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+	addrinfo *addresses = nullptr;
+	if((colon <= 4) || (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)) {
+		fprintf(stderr, "Cannot resolve %s!\n", output.c_str());
+		exit(1);
+	}
+	int fd = -1;
+	for(addrinfo *address = addresses; (address != nullptr) && (fd < 0); address = address->ai_next) {
+		fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if((fd >= 0) && (connect(fd, address->ai_addr, address->ai_addrlen) != 0)) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addresses);
+	if(fd < 0) {
+		perror(output.c_str());
+		exit(1);
+	}
+	return fd;
+}
+
+/** Appends the bytes of a value (host byte order) */
+template<typename T>
+static inline void appendBytes(std::string &record, T value) {
+	record.append((const char*)&value, sizeof(value));
+}
+
+static inline uint16_t saturate16(unsigned int value) {
+	return (value > 0xffff) ? 0xffff : (uint16_t)value;
+}
+
+/** Makes the output record of a frame into the reused string - see the top of this file for the formats */
+static void makeRecord(std::string &record, uint32_t sequence, const ImageFrameResult &results, const PoseRes3D *pose,
+		bool binary) {
+	record.clear();
+	if(binary) {
+		record.append("FTD1", 4);
+		appendBytes(record, sequence);
+		appendBytes(record, saturate16(results.markers.size()));
+		appendBytes(record, (uint16_t)((pose != nullptr) ? 1 : 0));
+		size_t count = saturate16(results.markers.size());
+		for(size_t i = 0; i < count; ++i) {
+			const Marker2D &marker = results.markers[i];
+			appendBytes(record, saturate16(marker.x));
+			appendBytes(record, saturate16(marker.y));
+			appendBytes(record, saturate16(marker.order));
+			appendBytes(record, saturate16(marker.confidence));
+		}
+		if(pose != nullptr) {
+			for(int i = 0; i < FT_TRANSFORM_MATRIX_SIZE; ++i) {
+				appendBytes(record, (float)pose->transform[i]);
+			}
+		}
+		return;
+	}
+
+	char buf[64];
+	record.append(buf, snprintf(buf, sizeof(buf), "%u %u", sequence, (unsigned int)results.markers.size()));
+	for(const Marker2D &marker : results.markers) {
+		record.append(buf, snprintf(buf, sizeof(buf), " %u,%u,%u,%u", marker.x, marker.y, marker.order, marker.confidence));
+	}
+	if(pose != nullptr) {
+		record.append(" P");
+		for(int i = 0; i < FT_TRANSFORM_MATRIX_SIZE; ++i) {
+			record.append(buf, snprintf(buf, sizeof(buf), " %g", pose->transform[i]));
+		}
+	}
+	record.push_back('\n');
+}
+
+/** Only replays can end on their own */
+static inline bool replayEnded(V4LDevice&) {
+	return false;
+}
+
+static inline bool replayEnded(VirtualCamera &camera) {
+	return camera.hasEnded();
+}
+
+/** The capture -> detect -> pose -> output loop - returns the exit code */
+template<typename CAMERA>
+static int run(CAMERA &camera, const Options &options, int out) {
+	bool grey = (camera.getPixelFormat() == V4L2_PIX_FMT_GREY);
+	if(!camera.isOk() || (!grey && (camera.getPixelFormat() != V4L2_PIX_FMT_YUYV))) {
+		fprintf(stderr, "The source cannot give GREY or YUYV frames!\n");
+		return 1;
+	}
+	int width = camera.getWidth();
+	int height = camera.getHeight();
+	PixelView<GreyFormat> greyView(nullptr, width, height, camera.getBytesPerLine());
+	PixelView<YuyvFormat> view(nullptr, width, height, camera.getBytesPerLine());
+	std::string record;
+	long frames = 0;
+	double latencyMs = 0;
+	int exitCode = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	// Rem.: A real camera keeps going, so the newest frame is detected - a fast replay should not skip any
+	AsyncCapture<CAMERA> capture(camera, (options.fps > 0) ? CapturePolicy::NEWEST : CapturePolicy::EVERY_FRAME);
+	int idleAfterEnd = 0;
+	while(running && ((options.frames <= 0) || (frames < options.frames))) {
+		auto frame = capture.acquire(100);
+		if(!frame) {
+			// A few more tries as the capture thread might still hold the last frame
+			if(replayEnded(camera) && (++idleAfterEnd > 2)) break;
+			continue;
+		}
+
+		greyView.setBase(frame.data());
+		view.setBase(frame.data());
+		for(int j = 0; j < height; ++j) {
+			poser.processLine(grey ? greyView.row(j) : view.row(j), width);
+		}
+		PoseRes3D pose = poser.endImageFrame();
+		makeRecord(record, frame.sequence(), poser.getMarkers(), options.pose ? &pose : nullptr, options.binary);
+		latencyMs += frame.ageMs();
+		frame.release();
+		++frames;
+
+		// One write per frame: a whole datagram for udp and no partial lines for the readers
+		if(write(out, record.data(), record.size()) != (ssize_t)record.size()) {
+			// Rem.: A udp receiver might just not listen yet - the frame is lost like any datagram
+			if(errno == ECONNREFUSED) continue;
+			// Rem.: The reader of stdout went away (like "| head") - that is just the end
+			if((errno == EPIPE) && (out == STDOUT_FILENO)) break;
+			perror("Cannot write the results");
+			exitCode = 1;
+			break;
+		}
+	}
+	capture.stop();
+
+	if(!options.quiet) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto stats = capture.getStats();
+		fprintf(stderr, "%ld frames in %.1f s: %.1f FPS, %llu dropped, %.2f ms mean latency\n", frames, seconds,
+				frames / seconds, (unsigned long long)stats.dropped, (frames > 0) ? (latencyMs / frames) : 0.0);
+	}
+	return exitCode;
+}
+
+int main(int argc, char *argv[]) {
+	Options options = parseOptions(argc, argv);
+	signal(SIGINT, stopRunning);
+	signal(SIGTERM, stopRunning);
+	// Rem.: A closed tcp peer or pipe is a write error then - not a silent death
+	signal(SIGPIPE, SIG_IGN);
+	int out = openOutput(options.output);
+
+	int exitCode;
+	if(!options.files.empty()) {
+		VirtualCameraConfig config;
+		config.files = options.files;
+		config.width = options.width;
+		config.height = options.height;
+		config.fps = options.fps;
+		config.loop = options.loop;
+		VirtualCamera camera(config);
+		exitCode = run(camera, options, out);
+	} else {
+		V4LConfig config;
+		config.device = options.device;
+		config.width = options.width;
+		config.height = options.height;
+		config.preferGrey = true;
+		config.fps = options.fps;
+		config.controls = V4LControls::tracking();
+		V4LDevice camera(config);
+		exitCode = run(camera, options, out);
+	}
+
+	if(out != STDOUT_FILENO) close(out);
+	return exitCode;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
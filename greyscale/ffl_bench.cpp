@@ -0,0 +1,358 @@
+// Microbenchmark of the list of the suspected marker centers: FastForwardList (array of pairs, FIFO hole
+// reuse), SoaFastForwardList (separate next indices, LIFO hole reuse), std::forward_list and a sorted
+// std::vector - all on the insert/extend/unlink pattern of MCParser::process1DMarker(..).
+//
+// The 1D markers are recorded once (from a generated 4K frame packed with markers and from a synthetic
+// cluttered scene with a lot more markers per scanline) and then the same merge is replayed on all the
+// lists. The merge is the one of MCParser - including that a 1D marker appended after the last center
+// is tried on the next 1D marker too. All the lists must find the same markers - MISMATCH is printed
+// otherwise. At the end MCParser itself is measured with both FastForwardList kinds (see its LIST).
+//
+// Fragmentation: how scattered the centers get in the list memory on these merges (the percentage of the
+// links that do not go to the physically next slot) and how much a walk over a scattered list costs
+// compared to the compacted one (see FastForwardList::compact() and MCParserConfig::compactCheckLines).
+
+#define FFL_NO_DEBUG_MODE 1 // no debug logging in the measured loops
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <forward_list>
+#include <chrono>
+#include <algorithm>
+#include "mcparser.h"
+#include "testhelpers.h"
+
+// Repeat each measurement this many times for more stable measurements
+#define RUNS 20
+// The best of this many measurements is taken - the lists are measured in turns
+#define ROUNDS 5
+
+/** The 1D markers of a frame: (centerX, order) pairs and the index after the last one of each scanline */
+struct Recorded {
+	std::vector<int> tokens;
+	std::vector<size_t> lineEnds;
+};
+
+/** Records the 1D markers of a generated frame packed with markers */
+Recorded recordFrame(int width, int height, int circleSize) {
+	MarkerGrid grid;
+	grid.rowShift = circleSize;
+	grid.shiftPeriod = 2;
+	std::vector<uint8_t> grey = generateMarkers(width, height, circleSize, grid);
+
+	Recorded rec;
+	MCParser<> mcp;
+	for(int j = 0; j < height; ++j) {
+		for(int i = 0; i < width; ++i) {
+			if(mcp.next(grey[j * width + i]).foundMarker) {
+				rec.tokens.push_back(mcp.tokenizer.getMarkerX());
+				rec.tokens.push_back(mcp.tokenizer.getOrder());
+			}
+		}
+		mcp.endLine();
+		rec.lineEnds.push_back(rec.tokens.size());
+	}
+	return rec;
+}
+
+/**
+ * Synthetic cluttered scene: "columns" of 1D markers that live for a random number of scanlines at a
+ * slightly wandering x - with random gaps - so the list is long and it is changing all the time. The
+ * columns must not be denser than the merge window of the centers (or the list could overflow).
+ */
+Recorded recordClutter(int width, int height, int columns) {
+	struct Column { int x; int left; };
+	std::vector<Column> cols(columns);
+	for(int i = 0; i < columns; ++i) {
+		cols[i].x = (i * width) / columns + 8;
+		cols[i].left = -(rand() % 80);
+	}
+	Recorded rec;
+	for(int j = 0; j < height; ++j) {
+		for(auto &c : cols) {
+			if(c.left > 0) {
+				// Rem.: Sometimes missing - like on a real blurry marker
+				if((rand() % 8) != 0) {
+					rec.tokens.push_back(c.x + (rand() % 5) - 2);
+					rec.tokens.push_back(3 + (rand() % 3));
+				}
+				// Rem.: A gap after each "marker" so that the centers get closed
+				if(--c.left == 0) c.left = -(8 + (rand() % 40));
+			} else if(++c.left == 0) {
+				c.left = 10 + (rand() % 60);
+			}
+		}
+		rec.lineEnds.push_back(rec.tokens.size());
+	}
+	return rec;
+}
+
+/** FastForwardList and SoaFastForwardList in the interface of the merge below */
+template<typename FFL>
+struct FFLAdapter {
+	using Pos = FFLPosition;
+	FFL list;
+	inline Pos beforeHead() { return NIL_POS; }
+	inline Pos after(Pos p) { return p.isNil() ? list.head() : list.next(p); }
+	inline bool isEnd(Pos p) { return p.isNil(); }
+	inline MarkerCenter& at(Pos p) { return list[p]; }
+	inline Pos insertAfter(Pos p, const MarkerCenter &c) { return list.insertAfter(c, p); }
+	inline void unlinkAfter(Pos p) { list.unlinkAfter(p); }
+	inline void clear() { list.reset(); }
+};
+
+/** std::forward_list in the interface of the merge below */
+struct ForwardListAdapter {
+	using Pos = std::forward_list<MarkerCenter>::iterator;
+	std::forward_list<MarkerCenter> list;
+	inline Pos beforeHead() { return list.before_begin(); }
+	inline Pos after(Pos p) { return std::next(p); }
+	inline bool isEnd(Pos p) { return p == list.end(); }
+	inline MarkerCenter& at(Pos p) { return *p; }
+	inline Pos insertAfter(Pos p, const MarkerCenter &c) { return list.insert_after(p, c); }
+	inline void unlinkAfter(Pos p) { list.erase_after(p); }
+	inline void clear() { list.clear(); }
+};
+
+/** Sorted std::vector in the interface of the merge below - positions are indices, (-1) is before the head */
+struct VectorAdapter {
+	using Pos = int;
+	std::vector<MarkerCenter> list;
+	inline Pos beforeHead() { return -1; }
+	inline Pos after(Pos p) { return p + 1; }
+	inline bool isEnd(Pos p) { return p >= (int)list.size(); }
+	inline MarkerCenter& at(Pos p) { return list[p]; }
+	inline Pos insertAfter(Pos p, const MarkerCenter &c) { list.insert(list.begin() + (p + 1), c); return p + 1; }
+	inline void unlinkAfter(Pos p) { list.erase(list.begin() + (p + 1)); }
+	inline void clear() { list.clear(); }
+};
+
+/** Does nothing at the end of the scanlines */
+struct NoLineEnd {
+	template<typename ADAPTER>
+	inline void operator()(ADAPTER &a) {}
+};
+
+/**
+ * Runs the merge of MCParser on the recorded 1D markers with the given list - the found markers go to "out".
+ * The lineEnd(a) is called after every scanline.
+ */
+template<typename ADAPTER, typename LINE_END = NoLineEnd>
+void mergeAll(ADAPTER &a, const Recorded &rec, std::vector<Marker2D> &out, LINE_END lineEnd = LINE_END()) {
+	const MCParserConfig config;
+	out.clear();
+	a.clear();
+	size_t from = 0;
+	unsigned int y = 0;
+	for(size_t to : rec.lineEnds) {
+		auto last = a.beforeHead();
+		for(size_t i = from; i < to; i += 2) {
+			int centerX = rec.tokens[i];
+			int order = rec.tokens[i + 1];
+			if(order < (int)config.ignoreOrderSmallerThan) continue;
+			while(true) {
+				auto cur = a.after(last);
+				if(a.isEnd(cur)) {
+					// Rem.: "last" stays so the next 1D marker is tried on this one too (like in MCParser)
+					a.insertAfter(last, MarkerCenter(centerX, y, order));
+					break;
+				}
+				MarkerCenter &center = a.at(cur);
+				bool open = !center.shouldClose(y, config.closeDiffY);
+				if(open && center.tryExtend(centerX, y, order, config.deltaDiffMax, config.widthDiffMax)) {
+					last = cur;
+					break;
+				}
+				if(center.getRightMostCurrentAcceptableX(config.deltaDiffMax, config.widthDiffMax) > centerX) {
+					last = a.insertAfter(last, MarkerCenter(centerX, y, order));
+					break;
+				}
+				if(!open) {
+					auto marker = center.constructMarker(config.ignoreWhenSignalCountLessThan);
+					if(marker.order > 0) out.push_back(marker);
+					a.unlinkAfter(last);
+				} else {
+					last = cur;
+				}
+			}
+		}
+		from = to;
+		++y;
+		lineEnd(a);
+	}
+	for(auto pos = a.after(a.beforeHead()); !a.isEnd(pos); pos = a.after(pos)) {
+		auto marker = a.at(pos).constructMarker(config.ignoreWhenSignalCountLessThan);
+		if(marker.order > 0) out.push_back(marker);
+	}
+}
+
+/** Returns the milliseconds of one f() call */
+template<typename F>
+double measure(F f) {
+	f();
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < RUNS; ++i) {
+		f();
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / RUNS;
+}
+
+/** Replays the recorded 1D markers into the parser and ends the frame */
+template<typename PARSER>
+void replay(PARSER &mcp, const Recorded &rec, ImageFrameResult &out) {
+	size_t from = 0;
+	for(size_t to : rec.lineEnds) {
+		for(size_t i = from; i < to; i += 2) {
+			mcp.merge1DMarker(rec.tokens[i], rec.tokens[i + 1]);
+		}
+		mcp.endLine();
+		from = to;
+	}
+	mcp.endImageFrame(out);
+}
+
+void bench(const char *name, const Recorded &rec) {
+	// Rem.: Static so that the big arrays are not on the stack
+	static FFLAdapter<FastForwardList<MarkerCenter, MAX_MARKER_PER_SCANLINE>> aos;
+	static FFLAdapter<SoaFastForwardList<MarkerCenter, MAX_MARKER_PER_SCANLINE>> soa;
+	static ForwardListAdapter fwd;
+	static VectorAdapter vec;
+	std::vector<Marker2D> aosOut, soaOut, fwdOut, vecOut;
+
+	double aosMs = 1e9, soaMs = 1e9, fwdMs = 1e9, vecMs = 1e9;
+	for(int round = 0; round < ROUNDS; ++round) {
+		aosMs = std::min(aosMs, measure([&] { mergeAll(aos, rec, aosOut); }));
+		soaMs = std::min(soaMs, measure([&] { mergeAll(soa, rec, soaOut); }));
+		fwdMs = std::min(fwdMs, measure([&] { mergeAll(fwd, rec, fwdOut); }));
+		vecMs = std::min(vecMs, measure([&] { mergeAll(vec, rec, vecOut); }));
+	}
+	printf("%s (%.1f 1D markers per scanline, %d markers):\n", name,
+			rec.tokens.size() / 2.0 / rec.lineEnds.size(), (int)aosOut.size());
+	printf("  FastForwardList:    %.3f ms\n", aosMs);
+	printf("  SoaFastForwardList: %.3f ms%s\n", soaMs, sameResults(aosOut, soaOut) ? "" : " MISMATCH!");
+	printf("  std::forward_list:  %.3f ms%s\n", fwdMs, sameResults(aosOut, fwdOut) ? "" : " MISMATCH!");
+	printf("  sorted std::vector: %.3f ms%s\n", vecMs, sameResults(aosOut, vecOut) ? "" : " MISMATCH!");
+
+	static MCParser<> aosParser;
+	static MCParser<uint8_t, int, DefaultAttrition, DefaultHomerPrecision, RuntimeConfig,
+		Hoparser<uint8_t, int>, SoaFastForwardList> soaParser;
+	ImageFrameResult aosResult, soaResult;
+	aosMs = 1e9;
+	soaMs = 1e9;
+	for(int round = 0; round < ROUNDS; ++round) {
+		aosMs = std::min(aosMs, measure([&] { replay(aosParser, rec, aosResult); }));
+		soaMs = std::min(soaMs, measure([&] { replay(soaParser, rec, soaResult); }));
+	}
+	printf("  MCParser with FastForwardList:    %.3f ms\n", aosMs);
+	printf("  MCParser with SoaFastForwardList: %.3f ms%s\n", soaMs,
+			sameResults(aosResult.markers, soaResult.markers) ? "" : " MISMATCH!");
+}
+
+/** Prints the fragmentation of the list over the merge of the recorded 1D markers - without and with compaction */
+void benchFragmentation(const Recorded &rec) {
+	static FFLAdapter<FastForwardList<MarkerCenter, MAX_MARKER_PER_SCANLINE>> aos;
+	std::vector<Marker2D> out;
+	for(bool compacting : {false, true}) {
+		double fragmentationSum = 0;
+		int lines = 0;
+		int compactions = 0;
+		mergeAll(aos, rec, out, [&](FFLAdapter<FastForwardList<MarkerCenter, MAX_MARKER_PER_SCANLINE>> &a) {
+			int length = a.list.size();
+			int fragmentation = a.list.fragmentation();
+			if(length > 1) fragmentationSum += (100.0 * fragmentation) / length;
+			++lines;
+			// Rem.: Like MCParser with the default MCParserConfig - but checking at every scanline of any length
+			if(compacting && (fragmentation * 100 > 25 * length)) {
+				a.list.compact();
+				++compactions;
+			}
+		});
+		printf("  fragmentation %s: %.1f%% of the links on average (%d compactions)\n",
+				compacting ? "with compaction" : "without compaction", fragmentationSum / lines, compactions);
+	}
+
+	// The MCParser without compaction and with compacting even the short lists
+	MCParserConfig config;
+	config.compactCheckLines = 0;
+	static MCParser<> plainParser(config);
+	config.compactCheckLines = MCParserConfig().compactCheckLines;
+	config.compactMinLength = 0;
+	static MCParser<> compactingParser(config);
+	ImageFrameResult result;
+	double plainMs = 1e9, compactingMs = 1e9;
+	for(int round = 0; round < ROUNDS; ++round) {
+		plainMs = std::min(plainMs, measure([&] { replay(plainParser, rec, result); }));
+		compactingMs = std::min(compactingMs, measure([&] { replay(compactingParser, rec, result); }));
+	}
+	printf("  MCParser without compaction: %.3f ms, compacting short lists too: %.3f ms (%u compactions)\n",
+			plainMs, compactingMs, compactingParser.getListStats().compactions);
+}
+
+/** Sums a field of all elements of the list - the walk is measured */
+template<typename FFL>
+int walk(const FFL &list) {
+	int sum = 0;
+	for(FFLPosition pos = list.head(); !pos.isNil(); pos = list.next(pos)) {
+		sum += list[pos].lastX;
+	}
+	return sum;
+}
+
+/** Prints the cost of walking a list scattered by random inserts and unlinks - then after compacting it */
+template<typename FFL>
+void benchWalk(const char *name, int length) {
+	static FFL list;
+	list.reset();
+	// Rem.: Random inserts and unlinks around the whole list until it has the length
+	std::vector<FFLPosition> positions;
+	while(list.size() < length) {
+		FFLPosition pos = NIL_POS;
+		int at = rand() % (list.size() + 1);
+		for(int k = 0; k < at; ++k) pos = (k == 0) ? list.head() : list.next(pos);
+		list.insertAfter(MarkerCenter(rand() % 3840, 0, 3), pos);
+		if(((rand() % 3) == 0) && (list.size() > 1)) {
+			at = rand() % list.size();
+			pos = NIL_POS;
+			for(int k = 0; k < at; ++k) pos = (k == 0) ? list.head() : list.next(pos);
+			list.unlinkAfter(pos);
+		}
+	}
+	volatile int sink = 0;
+	for(int compacted = 0; compacted < 2; ++compacted) {
+		if(compacted) list.compact();
+		int fragmentation = list.fragmentation();
+		double ms = 1e9;
+		for(int round = 0; round < ROUNDS; ++round) {
+			ms = std::min(ms, measure([&] {
+				for(int i = 0; i < 1000; ++i) sink = sink + walk(list);
+			}));
+		}
+		printf("  %s of %d centers %s: %.1f%% fragmentation, %.2f ns per element\n", name, length,
+				compacted ? "compacted" : "scattered", (100.0 * fragmentation) / length, (ms * 1e6) / (1000.0 * length));
+	}
+}
+
+int main() {
+	printf("Benchmarking the marker center lists on the merge pattern of the MCParser...\n");
+	const char *names[] = {"3840x2160 frame packed with markers", "synthetic clutter (60 columns)", "synthetic clutter (180 columns)"};
+	Recorded recs[] = {recordFrame(3840, 2160, 40), recordClutter(3840, 2160, 60), recordClutter(3840, 2160, 180)};
+	for(int i = 0; i < 3; ++i) {
+		bench(names[i], recs[i]);
+	}
+
+	printf("Fragmentation of the marker center lists...\n");
+	for(int i = 0; i < 3; ++i) {
+		printf("%s:\n", names[i]);
+		benchFragmentation(recs[i]);
+	}
+	printf("Walking a scattered and a compacted list...\n");
+	for(int length : {64, 1000}) {
+		benchWalk<FastForwardList<MarkerCenter, MAX_MARKER_PER_SCANLINE>>("FastForwardList", length);
+		benchWalk<SoaFastForwardList<MarkerCenter, MAX_MARKER_PER_SCANLINE>>("SoaFastForwardList", length);
+	}
+	return 0;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -1,16 +1,18 @@
 #include <cstdio>
+#include <cstdlib>
+#include <vector>
 
 // You need to define this if you want to test the range checks (and with them)
 //#define FFL_INSERT_RANGE_CHECK 1
 
 #include "fastforwardlist.h"
 
-int main() {
-	printf("Testing fastforwardlist.h...\n");
+/** Runs the tests on the given list type - the printed values must be the same for all of them */
+template<typename FFL>
+void testList(const char *name) {
+	printf("Testing %s...\n", name);
 
-	// Create a maximum 127 length list
-	// Rem.: (2^x)-1 is the most optimal and the smaller the better!
-	FastForwardList<int, 127> ffl;
+	FFL ffl;
 
 	// (A) Simple test
 	printf("SIMPLE TEST:\n");
@@ -165,6 +167,110 @@ int main() {
 	}
 	printf("\n");
 
+	// Many more unlinks than MAX: the reused holes must wrap around properly
+	// and a full list must still fit - like in a long cluttered frame
+	ffl.reset();
+	ffl.push_front(0);
+	for(int i = 0; i < 10 * ffl.freeCapacity(); ++i) {
+		ffl.insertAfter(i, ffl.head());
+		ffl.unlinkAfter(ffl.head());
+	}
+	int expectedSum = 0;
+	for(int i = 1; ffl.freeCapacity() > 0; ++i) {
+		ffl.push_front(i);
+		expectedSum += i;
+	}
+	int sum = 0;
+	int count = 0;
+	for(readHead = ffl.head(); !readHead.isNil(); readHead = ffl.next(readHead)) {
+		sum += ffl[readHead];
+		++count;
+	}
+	printf("Hole wrap-around TEST: %s\n", ((sum == expectedSum) && (count == ffl.size())) ? "OK" : "FAILED");
+
+	// Compaction after random inserts and unlinks: the same sequence must stay - in array order
+	// and the kept handle must point to the same value (reference is a vector of the values)
+	bool compactOk = true;
+	srand(42);
+	for(int round = 0; round < 50; ++round) {
+		ffl.reset();
+		std::vector<int> expected;
+		for(int op = 0; op < 1000; ++op) {
+			int at = (expected.empty()) ? (-1) : ((rand() % (expected.size() + 1)) - 1);
+			// The (at)th element - or NIL_POS for (-1)
+			FFLPosition pos = NIL_POS;
+			for(int k = 0; k <= at; ++k) pos = (k == 0) ? ffl.head() : ffl.next(pos);
+			if(((rand() % 3) != 0) && (ffl.freeCapacity() > 0)) {
+				ffl.insertAfter(op, pos);
+				expected.insert(expected.begin() + (at + 1), op);
+			} else if((size_t)(at + 1) < expected.size()) {
+				ffl.unlinkAfter(pos);
+				expected.erase(expected.begin() + (at + 1));
+			}
+		}
+		int keepIndex = expected.empty() ? (-1) : (rand() % expected.size());
+		FFLPosition keep = NIL_POS;
+		for(int k = 0; k <= keepIndex; ++k) keep = (k == 0) ? ffl.head() : ffl.next(keep);
+		keep = ffl.compact(keep);
+		compactOk = compactOk && (ffl.fragmentation() == 0) && (ffl.size() == (int)expected.size());
+		compactOk = compactOk && ((keepIndex < 0) ? keep.isNil() : (ffl[keep] == expected[keepIndex]));
+		size_t k = 0;
+		for(readHead = ffl.head(); !readHead.isNil(); readHead = ffl.next(readHead), ++k) {
+			compactOk = compactOk && (k < expected.size()) && (ffl[readHead] == expected[k]);
+		}
+		// Keeps working after the compaction
+		if(ffl.size() > 1) {
+			ffl.unlinkHead();
+			ffl.insertAfter(-1, ffl.head());
+			compactOk = compactOk && (ffl[ffl.next(ffl.head())] == -1);
+		}
+	}
+	printf("Compaction TEST: %s\n", compactOk ? "OK" : "FAILED");
+}
+
+int main() {
+	printf("Testing fastforwardlist.h...\n");
+
+	// Create maximum 127 length lists
+	// Rem.: (2^x)-1 is the most optimal and the smaller the better for the FastForwardList!
+	testList<FastForwardList<int, 127>>("FastForwardList");
+	testList<SoaFastForwardList<int, 127>>("SoaFastForwardList");
+
+	// The SoaFastForwardList reuses the most recently unlinked slot first (LIFO)
+	SoaFastForwardList<int, 128> soa;
+	FFLPosition a = soa.push_front(1);
+	FFLPosition b = soa.push_front(2);
+	FFLPosition c = soa.push_front(3);
+	soa.unlinkAfter(b); // unlinks 1
+	soa.unlinkHead(); // unlinks 3
+	soa.unlinkHead(); // unlinks 2
+	FFLPosition first = soa.push_front(4);
+	FFLPosition second = soa.push_front(5);
+	FFLPosition third = soa.push_front(6);
+	printf("LIFO hole reuse TEST: %s\n", ((first == b) && (second == c) && (third == a)) ? "OK" : "FAILED");
+
+	// Two holes between kept elements - they must come back in the reverse order of their unlinking
+	bool twoHolesOk = true;
+	for(bool reverseFree : {false, true}) {
+		SoaFastForwardList<int, 128> holes;
+		FFLPosition tail = holes.push_front(1);
+		FFLPosition x = holes.push_front(2);
+		FFLPosition mid = holes.push_front(3);
+		FFLPosition y = holes.push_front(4);
+		holes.push_front(5);
+		if(reverseFree) {
+			holes.unlinkAfter(holes.head()); // unlinks 4 (y)
+			holes.unlinkAfter(mid); // unlinks 2 (x)
+		} else {
+			holes.unlinkAfter(mid); // unlinks 2 (x)
+			holes.unlinkAfter(holes.head()); // unlinks 4 (y)
+		}
+		FFLPosition reused1 = holes.insertAfter(6, tail);
+		FFLPosition reused2 = holes.insertAfter(7, tail);
+		twoHolesOk = twoHolesOk && (reused1 == (reverseFree ? x : y)) && (reused2 == (reverseFree ? y : x));
+		twoHolesOk = twoHolesOk && (holes.size() == 5);
+	}
+	printf("LIFO hole reuse TEST (two holes, both unlink orders): %s\n", twoHolesOk ? "OK" : "FAILED");
 
 	printf("...testing fastforwardlist.h ended!\n");
 }
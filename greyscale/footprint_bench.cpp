@@ -0,0 +1,93 @@
+// Memory footprint report of the MCParser for embedded builds - and the speed of its marker center kinds:
+// - bytes per suspected (active) marker center: MarkerCenter and CompactMarkerCenter (see MCParser's CENTER)
+//   in the FastForwardList and in the SoaFastForwardList (see MCParser's LIST)
+// - the total size of the parser state with all of these - this is what needs to be allocated for it
+// - how many suspected marker centers fit into a 32 KB L1 data cache
+// - milliseconds per frame with processFrame(..) on generated frames packed with markers
+//
+// Rem.: Build with a smaller MAX_MARKER_PER_SCANLINE (-DMAX_MARKER_PER_SCANLINE=128) to see the embedded case!
+
+#define FFL_NO_DEBUG_MODE 1 // no debug logging in the measured loops
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "mcparser.h"
+#include "testhelpers.h"
+
+// Repeat each measurement this many times for more stable measurements
+#define RUNS_PER_FRAME 10
+// The best of this many measurements is taken - the parsers are measured in turns
+#define ROUNDS 5
+// Size of the L1 data cache for the report
+#define L1_BYTES (32 * 1024)
+
+template<template<typename, int> class LIST, typename CENTER>
+using Parser = MCParser<uint8_t, int, DefaultAttrition, DefaultHomerPrecision, RuntimeConfig,
+	Hoparser<uint8_t, int>, LIST, CENTER>;
+
+/** Prints the footprint of a marker center kind in a list kind */
+template<template<typename, int> class LIST, typename CENTER>
+void reportFootprint(const char *name) {
+	size_t listBytes = sizeof(LIST<CENTER, MAX_MARKER_PER_SCANLINE>);
+	// Rem.: The list has MAX_MARKER_PER_SCANLINE slots - its hole book-keeping is counted per slot too
+	double perCenter = (double)listBytes / MAX_MARKER_PER_SCANLINE;
+	printf("  %-42s %3d bytes/center, %6.1f bytes/slot in the list, %4d centers in L1, parser state: %7d bytes\n",
+			name, (int)sizeof(CENTER), perCenter, (int)(L1_BYTES / perCenter), (int)sizeof(Parser<LIST, CENTER>));
+}
+
+/** Parses the frame with a parser kind - returns milliseconds per frame and the result in "out" */
+template<typename PARSER>
+double measure(PARSER &mcp, const std::vector<uint8_t> &grey, int width, int height, ImageFrameResult &out) {
+	mcp.processFrame(&grey[0], width, height, width, out);
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < RUNS_PER_FRAME; ++i) {
+		mcp.processFrame(&grey[0], width, height, width, out);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / RUNS_PER_FRAME;
+}
+
+void bench(int width, int height, int circleSize) {
+	// Packed with markers - every second row of them is shifted by a half
+	MarkerGrid grid;
+	grid.rowShift = circleSize;
+	grid.shiftPeriod = 2;
+	auto grey = generateMarkers(width, height, circleSize, grid);
+	// Rem.: Static so that the big arrays are not on the stack
+	static Parser<FastForwardList, MarkerCenter> wide;
+	static Parser<FastForwardList, CompactMarkerCenter> compact;
+	static Parser<SoaFastForwardList, CompactMarkerCenter> soaCompact;
+	ImageFrameResult wideOut, compactOut, soaCompactOut;
+	double wideMs = 1e9, compactMs = 1e9, soaCompactMs = 1e9;
+	for(int round = 0; round < ROUNDS; ++round) {
+		wideMs = std::min(wideMs, measure(wide, grey, width, height, wideOut));
+		compactMs = std::min(compactMs, measure(compact, grey, width, height, compactOut));
+		soaCompactMs = std::min(soaCompactMs, measure(soaCompact, grey, width, height, soaCompactOut));
+	}
+	printf("%dx%d frame with %d markers (longest active list: %u centers):\n", width, height,
+			(int)wideOut.markers.size(), wide.getListStats().maxLength);
+	printf("  MarkerCenter:                         %.3f ms\n", wideMs);
+	printf("  CompactMarkerCenter:                  %.3f ms%s\n", compactMs,
+			sameResults(wideOut.markers, compactOut.markers) ? "" : " MISMATCH!");
+	printf("  CompactMarkerCenter in SoA list:      %.3f ms%s\n", soaCompactMs,
+			sameResults(wideOut.markers, soaCompactOut.markers) ? "" : " MISMATCH!");
+}
+
+int main() {
+	printf("Footprint of the MCParser (MAX_MARKER_PER_SCANLINE = %d):\n", MAX_MARKER_PER_SCANLINE);
+	reportFootprint<FastForwardList, MarkerCenter>("MarkerCenter in FastForwardList");
+	reportFootprint<FastForwardList, CompactMarkerCenter>("CompactMarkerCenter in FastForwardList");
+	reportFootprint<SoaFastForwardList, MarkerCenter>("MarkerCenter in SoaFastForwardList");
+	reportFootprint<SoaFastForwardList, CompactMarkerCenter>("CompactMarkerCenter in SoaFastForwardList");
+	printf("  (plus the heap of the found markers and of the subsampled feed)\n");
+
+	printf("Parsing frames packed with markers...\n");
+	bench(1920, 1080, 40);
+	bench(3840, 2160, 40);
+	return 0;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
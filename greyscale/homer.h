@@ -5,15 +5,22 @@
 //#define HOMER_MEASURE_NEXT_BRANCHES 1
 // Enable this (from client code) if you want more "imul" operations per pixel in exchange for better precision :-)
 //#define SLOW_PRECISE_HOMER 1 
+// Rem.: These only select the default policies - see the ATTRITION and PRECISION template parameters of Homer!
 
 #include <vector>
 #include <cstdint>
 #include <cmath>
 #include <limits> // for templated min-max integer values
+#include <type_traits> // std::integral_constant for selecting compile-time setups
+#include <algorithm>
+#include <memory> // the shared LenAffectTable
+#include <mutex>
 
 #include "microshackz.h"
 
-/* Use this for exponential: affection #define EXPONENTIAL_ATTRITION */
+#if !defined(HOMER_NO_SIMD) && (defined(__SSE2__) || defined(__AVX2__))
+#include <immintrin.h> // span-skipping kernels of Homer::nextSpan(..)
+#endif
 
 /** For parametrization of the lenAffect(...) methods */
 struct LenAffectParams final {
@@ -27,85 +34,235 @@ struct LenAffectParams final {
 	unsigned int attrExp = 2;
 };
 
-/**
- * Devalvate "value" using the length
- * Useful for: devalving check constraints so that they are relative to length 
- * and not absolute! Many constrainst are best when relative.
+/*
+ * ATTRITION POLICIES
+ * ==================
+ *
+ * These tell how the Homer thresholds are affected by the length of the homogenous area.
+ * Any of them can be given as the ATTRITION template parameter of Homer, Hoparser and MCParser
+ * so that more variants can live in the same binary (see variant_bench.cpp). Each of them provides:
  *
- * BEWARE: Only 0, 1, 2, 4, 8, ... "steps" are supported because of performance, so stepPointExponential
- *         values 0, 1, 2, 3, 4 means the above mentioned powers of two when considering step counts!
- * BEWARE: The fullAffectLenUpCons must be smaller than leastAffectLenBottCons. Just give both
- *         of these parameters something big in order to default to not affect the value at all!
+ * - lenAffect(value, len, params): the length-affected value
+ * - headroom(len, params): for how many more increments of "len" the lenAffect(..) result
+ *                          stays the same (std::numeric_limits<int>::max() means "forever")
  *
- * Remarks:
- * - Any length smaller than fullAffectLenUpCons will have the full "value"
- * - Any length longer than leastAffectLenBottCons will have the value halved "step"-times...
- * - Any length in-between is (approximately) interpolateda with "2^(stepPointExponential)" number of halving-steps!
- * Remarks: Best is to use only a small number of "stepPointExponential" and the possibly longerst fullAffectLenUpCons
- *          to achieve the best speed and branch prediction operations here.
+ * Rem.: The NO_ATTRITION, SIMPLE_ATTRITION and EXPONENTIAL_ATTRITION macros still work: they just
+ *       select the DefaultAttrition policy below.
  */
-template<typename T>
-inline T lenAffect(T value, int len, LenAffectParams params) {
-	T ret = value;
-#ifdef NO_ATTRITION
-	return ret;
-#else
 
-#ifdef SIMPLE_ATTRITION
-	// Usually the fullAffectLenUpCons is not a really-really big value!
-	if(UNLIKELY(len < params.fullAffectLenUpCons)) return ret;
-	else return (ret<<1);
-#else
-	// Reasons for the fast-path:
-	// 1.) Not reached minimal delta length for starting the stepping procedure
-	// 2.) We are configured to not do any step at all (zero stepping)
-	// 3.) The special case when the length is zero at the start of suspecting areas
-	// 4.) In case the original value is zero (which would stay zero - just faster without calc.)
-	if(LIKELY((len < params.fullAffectLenUpCons) || (params.stepPointExponential == 0) || (len == 0) || (ret == 0))) {
-		// fast-path - mostly we are coming here with a right setup!!!
+/** Never affects the values: simplest operation (harder to use proper parameters though) */
+struct NoAttrition final {
+	template<typename T>
+	static inline T lenAffect(T value, int len, LenAffectParams params) noexcept {
+		return value;
+	}
+
+	static inline int headroom(int len, LenAffectParams params) noexcept {
+		return std::numeric_limits<int>::max();
+	}
+};
+
+/** Doubles the values above fullAffectLenUpCons: nearly as good as NoAttrition */
+struct SimpleAttrition final {
+	template<typename T>
+	static inline T lenAffect(T value, int len, LenAffectParams params) noexcept {
+		// Usually the fullAffectLenUpCons is not a really-really big value!
+		if(UNLIKELY(len < params.fullAffectLenUpCons)) return value;
+		else return (value<<1);
+	}
+
+	static inline int headroom(int len, LenAffectParams params) noexcept {
+		if(len < params.fullAffectLenUpCons) return (params.fullAffectLenUpCons - 1 - len);
+		else return std::numeric_limits<int>::max();
+	}
+};
+
+/**
+ * Interpolates between fullAffectLenUpCons and leastAffectLenBottCons in steps.
+ * The EXPONENTIAL variant doubles the value in every step, otherwise an "attrExp"-based
+ * linear growth happens (see LinearAttrition and ExponentialAttrition below).
+ */
+template<bool EXPONENTIAL>
+struct SteppedAttrition final {
+	/**
+	 * Devalvate "value" using the length
+	 * Useful for: devalving check constraints so that they are relative to length 
+	 * and not absolute! Many constrainst are best when relative.
+	 *
+	 * BEWARE: Only 0, 1, 2, 4, 8, ... "steps" are supported because of performance, so stepPointExponential
+	 *         values 0, 1, 2, 3, 4 means the above mentioned powers of two when considering step counts!
+	 * BEWARE: The fullAffectLenUpCons must be smaller than leastAffectLenBottCons. Just give both
+	 *         of these parameters something big in order to default to not affect the value at all!
+	 *
+	 * Remarks:
+	 * - Any length smaller than fullAffectLenUpCons will have the full "value"
+	 * - Any length longer than leastAffectLenBottCons will have the value halved "step"-times...
+	 * - Any length in-between is (approximately) interpolateda with "2^(stepPointExponential)" number of halving-steps!
+	 * Remarks: Best is to use only a small number of "stepPointExponential" and the possibly longerst fullAffectLenUpCons
+	 *          to achieve the best speed and branch prediction operations here.
+	 */
+	template<typename T>
+	static inline T lenAffect(T value, int len, LenAffectParams params) noexcept {
+		T ret = value;
+		// Reasons for the fast-path:
+		// 1.) Not reached minimal delta length for starting the stepping procedure
+		// 2.) We are configured to not do any step at all (zero stepping)
+		// 3.) The special case when the length is zero at the start of suspecting areas
+		// 4.) In case the original value is zero (which would stay zero - just faster without calc.)
+		if(LIKELY((len < params.fullAffectLenUpCons) || (params.stepPointExponential == 0) || (len == 0) || (ret == 0))) {
+			// fast-path - mostly we are coming here with a right setup!!!
+			return ret;
+		} else {
+			// slower path (still just fast halving-params.stepPointExponential and simple calculations)
+			int curStepLen = params.leastAffectLenBottCons - params.fullAffectLenUpCons;
+			// Rem.: Here substraction is needed as the stepping should start from full
+			//       magnitude at the least affected length bottom constraint!
+			int curLen = len - params.fullAffectLenUpCons;
+			unsigned int realSteps = (1 << (params.stepPointExponential - 1)); // always bit shift
+			// The loop variable realSteps runs like [...16, 8, 4, 2, 1]
+			// But the loop runs always "params.stepPointExponential" times and not more!
+			do {
+				// Step the loop variable used both as exit condition and division rate
+				realSteps >>= 1; // always bit-shift
+				curStepLen >>= 1; // halving the binary tree of walking
+				if(curLen > curStepLen) {
+					// Remaining length is in the upper half of this halving-step
+					// We calculate halving-params.stepPointExponential like walking on a binary
+					// tree while the loop is going!
+					// Rem.: this shift does all divisions beforehand!
+					if(EXPONENTIAL) {
+						ret <<= realSteps; // division by 2^(realSteps)
+					} else {
+						ret = ret + ((ret >> params.attrExp) * realSteps);
+					}
+
+					// For iterating with the tree, we must update the len to the remaining
+					// (the right side of the cut-down part of the stepping is kept)
+					curLen -= curStepLen;
+
+				}/* else {
+					// Remaining lenght is in the lower half of the binary tree step
+					// NO-OP
+				}*/
+			} while(realSteps);
+		}
+
 		return ret;
-	} else {
-		// slower path (still just fast halving-params.stepPointExponential and simple calculations)
-		int curStepLen = params.leastAffectLenBottCons - params.fullAffectLenUpCons;
-		// Rem.: Here substraction is needed as the stepping should start from full
-		//       magnitude at the least affected length bottom constraint!
-		int curLen = len - params.fullAffectLenUpCons;
-		unsigned int realSteps = (1 << (params.stepPointExponential - 1)); // always bit shift
-		// The loop variable realSteps runs like [...16, 8, 4, 2, 1]
-		// But the loop runs always "params.stepPointExponential" times and not more!
-		do {
-			// Step the loop variable used both as exit condition and division rate
-			realSteps >>= 1; // always bit-shift
-			curStepLen >>= 1; // halving the binary tree of walking
-//printf("rs:%d  ", realSteps);
-			if(curLen > curStepLen) {
-				// Remaining length is in the upper half of this halving-step
-				// We calculate halving-params.stepPointExponential like walking on a binary
-				// tree while the loop is going!
-				// Rem.: this shift does all divisions beforehand!
-#ifdef EXPONENTIAL_ATTRITION
-				ret <<= realSteps; // division by 2^(realSteps)
-#else
-//printf("***");
-				ret = ret + ((ret >> params.attrExp) * realSteps);
-#endif // EXPONENTIAL_ATTRITION
+	}
 
-				// For iterating with the tree, we must update the len to the remaining
-				// (the right side of the cut-down part of the stepping is kept)
-				curLen -= curStepLen;
+	/**
+	 * Rem.: This walks the very same binary tree as lenAffect(..) does, but instead of
+	 *       updating the value, it collects how far "len" is from flipping the first
+	 *       "lower half" decision into an "upper half" one (upper halves never flip back).
+	 */
+	static inline int headroom(int len, LenAffectParams params) noexcept {
+		if(params.stepPointExponential == 0) {
+			// Zero stepping: never affected at all
+			return std::numeric_limits<int>::max();
+		} else if(len < params.fullAffectLenUpCons) {
+			// Fast-path lengths of lenAffect(..) - these are all unaffected
+			return (params.fullAffectLenUpCons - 1 - len);
+		} else if(len == 0) {
+			// Special unaffected zero length (only when fullAffectLenUpCons <= 0)
+			return 0;
+		} else {
+			int headroom = std::numeric_limits<int>::max();
+			int curStepLen = params.leastAffectLenBottCons - params.fullAffectLenUpCons;
+			int curLen = len - params.fullAffectLenUpCons;
+			unsigned int realSteps = (1 << (params.stepPointExponential - 1));
+			do {
+				realSteps >>= 1;
+				curStepLen >>= 1;
+				if(curLen > curStepLen) {
+					// Upper half: stays the upper half for any longer length
+					curLen -= curStepLen;
+				} else {
+					// Lower half: flips after this many more length increments
+					int flipsAfter = curStepLen - curLen;
+					if(flipsAfter < headroom) headroom = flipsAfter;
+				}
+			} while(realSteps);
 
-			}/* else {
-				// Remaining lenght is in the lower half of the binary tree step
-				// NO-OP
-			}*/
-		} while(realSteps);
+			return headroom;
+		}
 	}
+};
 
-//printf("l:%d r:%d", len, ret);
+/** The original (no-macro) attrition: linear growth in the steps using attrExp */
+typedef SteppedAttrition<false> LinearAttrition;
+/** Doubling values in each of the steps */
+typedef SteppedAttrition<true> ExponentialAttrition;
 
-	return ret;
-#endif // SIMPLE_ATTRITION
+/** The attrition policy selected by the old-style macros (default is LinearAttrition) */
+#ifdef NO_ATTRITION
+typedef NoAttrition DefaultAttrition;
+#elif defined(SIMPLE_ATTRITION)
+typedef SimpleAttrition DefaultAttrition;
+#elif defined(EXPONENTIAL_ATTRITION)
+typedef ExponentialAttrition DefaultAttrition;
+#else
+typedef LinearAttrition DefaultAttrition;
 #endif // NO_ATTRITION
+
+/*
+ * PRECISION POLICIES
+ * ==================
+ *
+ * Any of these can be given as the PRECISION template parameter of Homer, Hoparser and MCParser.
+ * Rem.: The SLOW_PRECISE_HOMER macro still works: it just selects the DefaultHomerPrecision.
+ */
+
+/** Only checks the difference from the min-max avarage in homogenous areas */
+struct FastHomerPrecision final {
+	static constexpr bool slowPrecise = false;
+};
+
+/** More "imul" operations per pixel in exchange for better precision: also checks the real avarage */
+struct SlowPreciseHomerPrecision final {
+	static constexpr bool slowPrecise = true;
+};
+
+/** The precision policy selected by the old-style macro (default is FastHomerPrecision) */
+#ifdef SLOW_PRECISE_HOMER
+typedef SlowPreciseHomerPrecision DefaultHomerPrecision;
+#else
+typedef FastHomerPrecision DefaultHomerPrecision;
+#endif // SLOW_PRECISE_HOMER
+
+/*
+ * CONFIGURATION POLICIES
+ * ======================
+ *
+ * Any of these can be given as the CONFIG template parameter of Homer, Hoparser and MCParser.
+ * The RuntimeConfig is the default: all setups are stored in the objects and given in constructors.
+ * A compile-time config has "isCompileTime = true" and static constexpr functions returning the
+ * setups (see CompileTimeConfig in mcparser.h). With those all threshold comparisons fold into
+ * immediates and the dead branches disappear - good for fixed-camera deployments!
+ */
+
+/** Setups are runtime values stored in the objects - this is the default */
+struct RuntimeConfig final {
+	static constexpr bool isCompileTime = false;
+};
+
+/**
+ * Devalvate "value" using the length - using the given (or macro-selected) ATTRITION policy.
+ * See SteppedAttrition::lenAffect(..) for the details of the default behaviour.
+ */
+template<typename ATTRITION = DefaultAttrition, typename T>
+inline T lenAffect(T value, int len, LenAffectParams params) {
+	return ATTRITION::lenAffect(value, len, params);
+}
+
+/**
+ * Tells for how many more increments of "len" the lenAffect(..) result stays the same.
+ * Returns "d" so that lenAffect(value, len + i, params) == lenAffect(value, len, params)
+ * for every 0 <= i <= d (and for any value). Useful for span-skipping as the affected
+ * thresholds can be calculated only once for a whole run of pixels this way!
+ */
+template<typename ATTRITION = DefaultAttrition>
+inline int lenAffectHeadroom(int len, LenAffectParams params) {
+	return ATTRITION::headroom(len, params);
 }
 
 /** Holds configuration data values for Homer */
@@ -141,28 +298,256 @@ struct HomerSetup final {
 	int minMaxDeltaMax = 20;
 
 	/** Uses lenAffect(..) to change the values in a returned copy - does not change the original  */
-	inline HomerSetup applyLenAffection(int len, LenAffectParams params = LenAffectParams{}) noexcept {
+	template<typename ATTRITION = DefaultAttrition>
+	inline HomerSetup applyLenAffection(int len, LenAffectParams params = LenAffectParams{}) const noexcept {
 		// Create a new setup with default values
 		HomerSetup ret;
 
 		// Apply affections and copy original data
-		ret.hodeltaLen = lenAffect(this->hodeltaLen, len, params);
-		ret.hodeltaDiff = lenAffect(this->hodeltaDiff, len, params);
-		ret.hodeltaAvgDiff = lenAffect(this->hodeltaAvgDiff, len, params);
-		ret.hodeltaMinMaxAvgDiff = lenAffect(this->hodeltaMinMaxAvgDiff, len, params);
-		ret.minMaxDeltaMax = lenAffect(this->minMaxDeltaMax, len, params);
+		ret.hodeltaLen = lenAffect<ATTRITION>(this->hodeltaLen, len, params);
+		ret.hodeltaDiff = lenAffect<ATTRITION>(this->hodeltaDiff, len, params);
+		ret.hodeltaAvgDiff = lenAffect<ATTRITION>(this->hodeltaAvgDiff, len, params);
+		ret.hodeltaMinMaxAvgDiff = lenAffect<ATTRITION>(this->hodeltaMinMaxAvgDiff, len, params);
+		ret.minMaxDeltaMax = lenAffect<ATTRITION>(this->minMaxDeltaMax, len, params);
 
 		return ret;
 	}
 };
 
+/** The lenAffect(..)-ed setup for a given length */
+struct LenAffected final {
+	/** The setup with all its values length-affected */
+	HomerSetup setup;
+	/** The same as lenAffectHeadroom(..) for this length */
+	int headroom;
+};
+
+/**
+ * The length-affected setups of a HomerSetup for every length until they become constant.
+ * Only depends on the setup, the LenAffectParams and the ATTRITION - so it is built once per these
+ * (see get(..)) and shared read-only by every Homer and HomerLanes (lanehomer.h) using the same setup.
+ * Copying a Homer (or a Hoparser, MCParser..) never copies or allocates the table this way!
+ *
+ * Rem.: The leading unaffected lengths share the very first entry so that a big fullAffectLenUpCons
+ *       does not make the table big (only leastAffectLenBottCons minus fullAffectLenUpCons entries
+ *       are needed usually). Lengths after the last entry use the last one.
+ */
+template<typename ATTRITION>
+class LenAffectTable final {
+public:
+	/** The shared table of the setup - built on the first request (thread-safe, but slow: do not call per-pixel!) */
+	static std::shared_ptr<const LenAffectTable> get(HomerSetup setup, LenAffectParams params) noexcept {
+		static std::mutex mutex;
+		static std::vector<Cached> cache;
+		std::lock_guard<std::mutex> lock(mutex);
+		for(const auto &c : cache) {
+			if(sameSetup(c.setup, setup) && sameParams(c.params, params)) {
+				auto table = c.table.lock();
+				if(table) return table;
+			}
+		}
+		// Rem.: Tables nobody uses anymore are dropped here - the cache only has the living ones
+		cache.erase(std::remove_if(cache.begin(), cache.end(), [](const Cached &c) { return c.table.expired(); }), cache.end());
+		std::shared_ptr<const LenAffectTable> table(new LenAffectTable(setup, params));
+		cache.push_back(Cached{setup, params, table});
+		return table;
+	}
+
+	/** The entries - the first one is for the length start() (and all the smaller ones) */
+	inline const LenAffected* entries() const noexcept {
+		return table.data();
+	}
+
+	/** The length of the first entry */
+	inline int start() const noexcept {
+		return tableStart;
+	}
+
+	/** Index of the last entry */
+	inline int last() const noexcept {
+		return (int)table.size() - 1;
+	}
+
+private:
+	/** A table in the cache of get(..) */
+	struct Cached final {
+		HomerSetup setup;
+		LenAffectParams params;
+		std::weak_ptr<const LenAffectTable> table;
+	};
+
+	LenAffectTable(HomerSetup setup, LenAffectParams params) noexcept {
+		// Lengths 0..tableStart all have the same values as the first entry
+		int headroom = lenAffectHeadroom<ATTRITION>(0, params);
+		tableStart = (headroom == std::numeric_limits<int>::max()) ? 0 : headroom;
+		int len = tableStart;
+		do {
+			headroom = lenAffectHeadroom<ATTRITION>(len, params);
+			table.push_back(LenAffected{setup.template applyLenAffection<ATTRITION>(len, params), headroom});
+			++len;
+		} while(headroom != std::numeric_limits<int>::max());
+	}
+
+	static inline bool sameSetup(const HomerSetup &a, const HomerSetup &b) noexcept {
+		return (a.hodeltaLen == b.hodeltaLen) && (a.hodeltaDiff == b.hodeltaDiff) && (a.hodeltaAvgDiff == b.hodeltaAvgDiff)
+			&& (a.hodeltaMinMaxAvgDiff == b.hodeltaMinMaxAvgDiff) && (a.minMaxDeltaMax == b.minMaxDeltaMax);
+	}
+
+	static inline bool sameParams(const LenAffectParams &a, const LenAffectParams &b) noexcept {
+		return (a.fullAffectLenUpCons == b.fullAffectLenUpCons) && (a.leastAffectLenBottCons == b.leastAffectLenBottCons)
+			&& (a.stepPointExponential == b.stepPointExponential) && (a.attrExp == b.attrExp);
+	}
+
+	/** The length-affected setups from tableStart */
+	std::vector<LenAffected> table;
+	/** The length of the first entry - all smaller lengths use the first entry too */
+	int tableStart = 0;
+};
+
+
+/**
+ * Helper kernels for Homer::nextSpan(..) - these only answer "how long is the uneventful prefix".
+ * The generic version is plain scalar code that works for every magnitude type.
+ */
+template<typename MT, typename CT>
+struct HomerSpanKernels final {
+	/** Returns the length of the prefix of mags[0..n) being in [lo, hi] - sum of that prefix is added to sum */
+	static inline int inRangePrefix(const MT *mags, int n, MT lo, MT hi, CT &sum) noexcept {
+		int i = 0;
+		while((i < n) && (mags[i] >= lo) && (mags[i] <= hi)) {
+			sum += mags[i];
+			++i;
+		}
+		return i;
+	}
+
+	/**
+	 * Returns the length of the prefix of mags[0..n) where every magnitude differs more than hodeltaDiff
+	 * from the one before it. The one "before" mags[0] is the provided last value.
+	 */
+	static inline int lookingPrefix(const MT *mags, int n, MT last, int hodeltaDiff) noexcept {
+		int i = 0;
+		while((i < n) && (abs((CT)last - (CT)mags[i]) > hodeltaDiff)) {
+			last = mags[i];
+			++i;
+		}
+		return i;
+	}
+};
+
+#if !defined(HOMER_NO_SIMD) && (defined(__SSE2__) || defined(__AVX2__))
+/**
+ * Byte-magnitude kernels using SSE2 (and AVX2 if the compiler is allowed to emit it: -mavx2).
+ * Rem.: These handle whole 32/16 pixel chunks and let the scalar version do the remainders!
+ */
+template<typename CT>
+struct HomerSpanKernels<uint8_t, CT> final {
+	static inline int inRangePrefix(const uint8_t *mags, int n, uint8_t lo, uint8_t hi, CT &sum) noexcept {
+		int i = 0;
+		uint64_t simdSum = 0;
+#ifdef __AVX2__
+		{
+			const __m256i vlo = _mm256_set1_epi8((char)lo);
+			const __m256i vhi = _mm256_set1_epi8((char)hi);
+			const __m256i zero = _mm256_setzero_si256();
+			__m256i acc = _mm256_setzero_si256();
+			while(i + 32 <= n) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)(mags + i));
+				// clamping keeps the value as-is only when it was in range
+				__m256i clamped = _mm256_min_epu8(_mm256_max_epu8(v, vlo), vhi);
+				if(UNLIKELY(_mm256_movemask_epi8(_mm256_cmpeq_epi8(clamped, v)) != -1)) break;
+				acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+				i += 32;
+			}
+			uint64_t lanes[4];
+			_mm256_storeu_si256((__m256i*)lanes, acc);
+			simdSum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		}
+#endif // __AVX2__
+		{
+			const __m128i vlo = _mm_set1_epi8((char)lo);
+			const __m128i vhi = _mm_set1_epi8((char)hi);
+			const __m128i zero = _mm_setzero_si128();
+			__m128i acc = _mm_setzero_si128();
+			while(i + 16 <= n) {
+				__m128i v = _mm_loadu_si128((const __m128i*)(mags + i));
+				__m128i clamped = _mm_min_epu8(_mm_max_epu8(v, vlo), vhi);
+				if(UNLIKELY(_mm_movemask_epi8(_mm_cmpeq_epi8(clamped, v)) != 0xFFFF)) break;
+				acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+				i += 16;
+			}
+			uint64_t lanes[2];
+			_mm_storeu_si128((__m128i*)lanes, acc);
+			simdSum += lanes[0] + lanes[1];
+		}
+		sum += (CT)simdSum;
+		// Remainder and the prefix of the first failing chunk
+		return i + scalarInRangePrefix(mags + i, n - i, lo, hi, sum);
+	}
+
+	static inline int lookingPrefix(const uint8_t *mags, int n, uint8_t last, int hodeltaDiff) noexcept {
+		// The first one is compared to the provided last - this is the only "special" one
+		if((n == 0) || !(abs((CT)last - (CT)mags[0]) > hodeltaDiff)) return 0;
+		// No byte difference can be bigger than 255 so nothing is "looking" then
+		if(hodeltaDiff >= 255) return 1;
+		// We check for (absdiff >= hodeltaDiff + 1) - negative values just accept everything
+		uint8_t minDiff = (uint8_t)((hodeltaDiff < 0) ? 0 : (hodeltaDiff + 1));
+		int i = 1;
+#ifdef __AVX2__
+		{
+			const __m256i vmin = _mm256_set1_epi8((char)minDiff);
+			while(i + 32 <= n) {
+				__m256i cur = _mm256_loadu_si256((const __m256i*)(mags + i));
+				__m256i prev = _mm256_loadu_si256((const __m256i*)(mags + i - 1));
+				__m256i diff = _mm256_or_si256(_mm256_subs_epu8(cur, prev), _mm256_subs_epu8(prev, cur));
+				if(UNLIKELY(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(diff, vmin), diff)) != -1)) break;
+				i += 32;
+			}
+		}
+#endif // __AVX2__
+		{
+			const __m128i vmin = _mm_set1_epi8((char)minDiff);
+			while(i + 16 <= n) {
+				__m128i cur = _mm_loadu_si128((const __m128i*)(mags + i));
+				__m128i prev = _mm_loadu_si128((const __m128i*)(mags + i - 1));
+				__m128i diff = _mm_or_si128(_mm_subs_epu8(cur, prev), _mm_subs_epu8(prev, cur));
+				if(UNLIKELY(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(diff, vmin), diff)) != 0xFFFF)) break;
+				i += 16;
+			}
+		}
+		// Remainder and the prefix of the first failing chunk
+		return i + scalarLookingPrefix(mags + i, n - i, mags[i - 1], hodeltaDiff);
+	}
+
+	/** Same as the generic inRangePrefix(..) */
+	static inline int scalarInRangePrefix(const uint8_t *mags, int n, uint8_t lo, uint8_t hi, CT &sum) noexcept {
+		int i = 0;
+		while((i < n) && (mags[i] >= lo) && (mags[i] <= hi)) {
+			sum += mags[i];
+			++i;
+		}
+		return i;
+	}
+
+	/** Same as the generic lookingPrefix(..) */
+	static inline int scalarLookingPrefix(const uint8_t *mags, int n, uint8_t last, int hodeltaDiff) noexcept {
+		int i = 0;
+		while((i < n) && (abs((int)last - (int)mags[i]) > hodeltaDiff)) {
+			last = mags[i];
+			++i;
+		}
+		return i;
+	}
+};
+#endif // !HOMER_NO_SIMD && (__SSE2__ || __AVX2__)
 
-/** 
+/**
  * A scanline-parser as described below.
  * Simple driver for instantly analysing 1D scanlines (in-place) for homogenous areas of interest.
  * MT: "Magnitude Type" and CT: "Magnitude Collector type" (later is for sum calculations)
  */
-template<typename MT = uint8_t, typename CT = int>
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition, typename PRECISION = DefaultHomerPrecision,
+	typename CONFIG = RuntimeConfig>
 class Homer final {
 #ifdef HOMER_MEASURE_NEXT_BRANCHES
 	unsigned int branch_1_looking = 0;
@@ -195,6 +580,9 @@ public:
 	 * - using default state
 	 */
 	Homer() noexcept {
+		// Precompute length-affected setups
+		buildLenAffectTable();
+
 		// Set default state
 		reset();
 	}
@@ -203,14 +591,26 @@ public:
 	 * Create a driver for analysing 1D homogenous areas in scanlines
 	 * - using default state and given setup
 	 */
-	Homer(HomerSetup setup) noexcept {
-		// Save setup
-		homerSetup = setup;
+	Homer(HomerSetup setup, LenAffectParams params = LenAffectParams{}) noexcept {
+		static_assert(!CONFIG::isCompileTime, "Setup of compile-time configured Homer comes from its CONFIG!");
+		// Save setup and precompute the length-affected setups
+		changeSetup(setup, params);
 
 		// Set default state
 		reset();
 	}
 
+	/**
+	 * Changes the configuration - keeps the current homarea state as-is
+	 * Rem.: This is slow as it recalculates the length affection table - do not call per-pixel!
+	 */
+	void NOINLINE changeSetup(HomerSetup setup, LenAffectParams params = LenAffectParams{}) noexcept {
+		static_assert(!CONFIG::isCompileTime, "Setup of compile-time configured Homer comes from its CONFIG!");
+		homerSetup = setup;
+		lenAffectParams = params;
+		buildLenAffectTable();
+	}
+
 	/**
 	 * Set default state
 	 * - resets all the system knows about its homarea, but keeps configuration as-is
@@ -240,7 +640,10 @@ public:
 			// Decide if we need to CONTINUE this area
 
 			// Apply lengthAffection to the homerSetup values when in a homogenous area!
-			auto lenAffectedHomerSetup = homerSetup.applyLenAffection(homarea.getLen());
+			// Rem.: This is just a lookup in the precomputed table (see buildLenAffectTable()) - or
+			//       constants for a compile-time CONFIG
+			const auto &affected = lenAffected(homarea.getLen());
+			const HomerSetup &lenAffectedHomerSetup = affected.setup;
 
 			// Check delta difference from the min/max magnitudes centerlne - too much indicates non-homogenity
 			// Rem.: First the faster check so the optimizer can optimize jumps better...
@@ -249,15 +652,11 @@ public:
 			bool tooMuchDiffFromMinMaxAvg = (abs(homarea.magMinMaxAvg() - mag) > lenAffectedHomerSetup.hodeltaMinMaxAvgDiff);
 			// Check difference from the avarage being too much
 			// Rem.: it is faster to multiply here twice at every pixel than to use magAvg() which uses division!!!
-#ifdef SLOW_PRECISE_HOMER
-			bool tooMuchDiffFromAvg = (abs((long long)homarea.getMagSum() - (long long)(mag * homarea.getLen()))
+			// Rem.: This is a compile-time constant so the fast precision optimizes this all away
+			bool tooMuchDiffFromAvg = PRECISION::slowPrecise
+					&& (abs((long long)homarea.getMagSum() - (long long)(mag * homarea.getLen()))
 					> ((long long)lenAffectedHomerSetup.hodeltaAvgDiff * homarea.getLen()));
-#endif // SLOW_PRECISE_HOMER
-			if(LIKELY(!tooMuchDiffFromMinMaxAvg
-#ifdef SLOW_PRECISE_HOMER
-						&& !tooMuchDiffFromAvg
-#endif // SLOW_PRECISE_HOMER
-						)) {
+			if(LIKELY(!tooMuchDiffFromMinMaxAvg && !tooMuchDiffFromAvg)) {
 				// Rem.: This will always return true EXCEPT when the min-max does not differ greatly
 				//       because all other checks are done above...
 				bool isOpenStill = homarea.tryOpenOrKeepWith(mag, lenAffectedHomerSetup.hodeltaLen, lenAffectedHomerSetup.minMaxDeltaMax);
@@ -288,8 +687,50 @@ public:
 				return false;
 			}
 		} else {
-			return slowNext(homarea, homerSetup, mag);
+			return slowNext(homarea, mag);
+		}
+	}
+
+	/**
+	 * Span-skipping: send a run of magnitudes at once, but only consume the uneventful prefix.
+	 * Returns the number of consumed magnitudes (0..n) and the state is exactly the same as if
+	 * next(..) would have been called for each of them. A magnitude is uneventful when either:
+	 * - we are in an isHo area and it just keeps extending it (min/max does not change), or
+	 * - we are not in an isHo area and it differs too much from the last (still "looking").
+	 * The caller should send the magnitude right after the consumed ones using next(..) as that
+	 * is where something happens (or the affected thresholds would change at that length).
+	 * Rem.: Uses SSE2/AVX2 compares for byte magnitudes - generic types go the scalar way.
+	 */
+	inline int nextSpan(const MT *mags, int n) noexcept {
+		int consumed = 0;
+		while(consumed < n) {
+			int spanLen;
+			if(homarea.isHo) {
+				// Rem.: With slow precision the avarage-check depends on the sum at every pixel so
+				//       only the scalar path is exact - we cannot skip then!
+				spanLen = PRECISION::slowPrecise ? 0 : extendSpan(mags + consumed, n - consumed);
+			} else {
+				spanLen = HomerSpanKernels<MT, CT>::lookingPrefix(
+						mags + consumed, n - consumed, homarea.last, getSetup().hodeltaDiff);
+				if(spanLen > 0) {
+					reset(mags[consumed + spanLen - 1]);
+#ifdef HOMER_MEASURE_NEXT_BRANCHES
+					branch_1_looking += spanLen;
+#endif // HOMER_MEASURE_NEXT_BRANCHES
+				}
+			}
+			if(spanLen == 0) break;
+			consumed += spanLen;
 		}
+		return consumed;
+	}
+
+	/**
+	 * The setup in use: the stored one for runtime configs - a constexpr value otherwise
+	 * Rem.: Use "decltype(auto)" or "const HomerSetup&" for the result to not copy needlessly!
+	 */
+	inline decltype(auto) getSetup() const noexcept {
+		return selectSetup(std::integral_constant<bool, CONFIG::isCompileTime>());
 	}
 
 	/** Tells if we are in a homogenous area according to the last "next" call or not */
@@ -443,12 +884,13 @@ private:
 		 */
 		template<typename T>
 		inline T lenAffect(T value, LenAffectParams params) const noexcept {
-			lenAffect(value, len, params);
+			return ATTRITION::lenAffect(value, len, params);
 		}
 	};
 
 	// Rem.: Not inlined because this is the rare part and is only here to make the hot-spot more cache friendly!
-	bool NOINLINE slowNext(Homarea &homarea, HomerSetup &homerSetup, MT mag) {
+	bool NOINLINE slowNext(Homarea &homarea, MT mag) {
+		const HomerSetup &homerSetup = getSetup();
 		if(!(abs((CT)homarea.last - (CT)mag) > homerSetup.hodeltaDiff)) {
 			// The difference was small enough - but we are not in the homarea
 			// ===============================================================
@@ -492,10 +934,107 @@ private:
 	}
 
 
+	/**
+	 * Consumes the prefix of mags that keeps extending the current (isHo) homarea without
+	 * changing its min/max magnitudes and without reaching a length where the length-affected
+	 * thresholds would change. Returns the number of consumed magnitudes.
+	 * Rem.: With unchanged min/max, the fast-path of next(..) reduces to a range check on mag!
+	 */
+	inline int extendSpan(const MT *mags, int n) noexcept {
+		int len = homarea.getLen();
+		const auto &affected = lenAffected(len);
+		// Thresholds stay the same for lengths len..(len + headroom)
+		int headroom = affected.headroom;
+		if(len < lenAffectTableStart) headroom += (lenAffectTableStart - len);
+		if(headroom < n) n = headroom + 1;
+		const HomerSetup &lenAffectedHomerSetup = affected.setup;
+
+		// The area must stay open after each of them (min/max do not change and len only grows)
+		if(!((len + 1) >= lenAffectedHomerSetup.hodeltaLen)
+				|| !((homarea.magMax - homarea.magMin) < lenAffectedHomerSetup.minMaxDeltaMax)) {
+			return 0;
+		}
+
+		// Magnitudes in [lo, hi] neither change min/max nor differ too much from their avarage
+		CT avg = homarea.magMinMaxAvg();
+		CT lo = avg - lenAffectedHomerSetup.hodeltaMinMaxAvgDiff;
+		CT hi = avg + lenAffectedHomerSetup.hodeltaMinMaxAvgDiff;
+		if(lo < (CT)homarea.magMin) lo = homarea.magMin;
+		if(hi > (CT)homarea.magMax) hi = homarea.magMax;
+		if(lo > hi) return 0;
+
+		CT sum = 0;
+		int spanLen = HomerSpanKernels<MT, CT>::inRangePrefix(mags, n, (MT)lo, (MT)hi, sum);
+		if(spanLen > 0) {
+			homarea.len += spanLen;
+			homarea.magSum += sum;
+			homarea.last = mags[spanLen - 1];
+#ifdef HOMER_MEASURE_NEXT_BRANCHES
+			branch_4_stillopen += spanLen;
+#endif // HOMER_MEASURE_NEXT_BRANCHES
+		}
+		return spanLen;
+	}
+
+	/** Runtime setup: the stored one */
+	inline const HomerSetup& selectSetup(std::false_type) const noexcept {
+		return homerSetup;
+	}
+
+	/** Compile-time setup: folds into immediates */
+	inline constexpr HomerSetup selectSetup(std::true_type) const noexcept {
+		return CONFIG::homerSetup();
+	}
+
+	/**
+	 * Gets the shared length-affected setups of the current setup (see LenAffectTable).
+	 * Rem.: Compile-time setups are length-affected inline instead (see lenAffected(..)).
+	 */
+	void buildLenAffectTable() noexcept {
+		if(CONFIG::isCompileTime) return;
+		lenAffectTable = LenAffectTable<ATTRITION>::get(getSetup(), lenAffectParams);
+		lenAffectEntries = lenAffectTable->entries();
+		lenAffectTableStart = lenAffectTable->start();
+		lenAffectTableLast = lenAffectTable->last();
+	}
+
+	/** Runtime setup: the precomputed length-affected setup - a single indexed load */
+	inline const LenAffected& lenAffected(int len, std::false_type) const noexcept {
+		int index = len - lenAffectTableStart;
+		if(index < 0) index = 0;
+		if(index > lenAffectTableLast) index = lenAffectTableLast;
+		return lenAffectEntries[index];
+	}
+
+	/**
+	 * Compile-time setup: applies the length affection right here so that the thresholds fold into immediates
+	 * (below fullAffectLenUpCons the attrition policies just return the constant values).
+	 */
+	inline LenAffected lenAffected(int len, std::true_type) const noexcept {
+		return LenAffected{CONFIG::homerSetup().template applyLenAffection<ATTRITION>(len, CONFIG::lenAffectParams()),
+				lenAffectHeadroom<ATTRITION>(len, CONFIG::lenAffectParams())};
+	}
+
+	/** Returns the length-affected setup for the given length - one of the above by the CONFIG */
+	inline auto lenAffected(int len) const noexcept
+			-> decltype(this->lenAffected(len, std::integral_constant<bool, CONFIG::isCompileTime>())) {
+		return lenAffected(len, std::integral_constant<bool, CONFIG::isCompileTime>());
+	}
+
 	/** Current homogenous area */
 	Homarea homarea;
-	/** Current configuration */
+	/** Current configuration - only used with runtime CONFIG (see getSetup()) */
 	HomerSetup homerSetup;
+	/** Current configuration of the length affection - only used with runtime CONFIG */
+	LenAffectParams lenAffectParams;
+	/** The shared length-affected setups (runtime CONFIG) - the members below are its values for the hot path */
+	std::shared_ptr<const LenAffectTable<ATTRITION>> lenAffectTable;
+	/** Length-affected setups for lengths starting from lenAffectTableStart - bigger lengths use the last */
+	const LenAffected *lenAffectEntries = nullptr;
+	/** The length of the first table entry - all smaller lengths use the first entry too */
+	int lenAffectTableStart = 0;
+	/** Index of the last element of the lenAffectTable */
+	int lenAffectTableLast = 0;
 };
 
 #endif //FASTTRACK_HOMER_H
@@ -71,7 +71,8 @@ struct HoparserSetup final {
  * The result of the parse are the suspected marker center positions in the scanline!
  * Rem.: Template parameters are those of Homer!
  */
-template<typename MT = uint8_t, typename CT = int>
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition, typename PRECISION = DefaultHomerPrecision,
+	typename CONFIG = RuntimeConfig>
 class Hoparser final {
 // For simple branch profiling data measurement
 #ifdef HOPARSER_MEASURE_NEXT_BRANCHES
@@ -96,12 +97,13 @@ public:
 
 	/** Create a Hoparser using the default configuration and the given Homer setup values */
 	Hoparser(HomerSetup hs) noexcept {
-		homer = Homer<MT, CT>(hs);
+		homer = Homer<MT, CT, ATTRITION, PRECISION, CONFIG>(hs);
 	}
 
 	/** Create a Hoparser using the given configuration and the given Homer setup values */
 	Hoparser(HomerSetup hs, HoparserSetup hps) noexcept {
-		homer = Homer<MT, CT>(hs);
+		static_assert(!CONFIG::isCompileTime, "Setup of compile-time configured Hoparser comes from its CONFIG!");
+		homer = Homer<MT, CT, ATTRITION, PRECISION, CONFIG>(hs);
 		setup = hps;
 	}
 
@@ -119,6 +121,14 @@ public:
 		sustate = SuspectionState();
 	}
 
+	/**
+	 * The setup in use: the stored one for runtime configs - a constexpr value otherwise
+	 * Rem.: Use "decltype(auto)" or "const HoparserSetup&" for the result to not copy needlessly!
+	 */
+	inline decltype(auto) getSetup() const noexcept {
+		return selectSetup(std::integral_constant<bool, CONFIG::isCompileTime>());
+	}
+
 	/** Number of found stripes */
 	inline int getOrder() const noexcept {
 		return sustate.openp;
@@ -168,20 +178,49 @@ public:
 			// Return
 			return std::move(ret);
 		} else {
-			return slowNext();
+			return slowNext(homer.getLen());
 		}
 	}
+
+	/**
+	 * Span-skipping: consumes the prefix of mags that surely produce no tokens (see Homer::nextSpan).
+	 * Returns the number of consumed magnitudes - the rest should be sent to next(..) one-by-one
+	 * until the next span can be skipped. Results are exactly the same as calling next(..) for all.
+	 */
+	inline int nextSpan(const MT *mags, int n) noexcept {
+		// Rem.: the last* data is always updated from the homer at the start of next(..)
+		//       so there is nothing to update here except the scanline-pointer!
+		int consumed = homer.nextSpan(mags, n);
+		sustate.x += consumed;
+		return consumed;
+	}
+
+	/**
+	 * EXTERNALLY LEXED FEED: the same as next(..) for a pixel that was lexed by some other Homer (see lanehomer.h).
+	 * Only needed for pixels that end a homogenous area (wasHo is true, but the homer is not isHo after the pixel)
+	 * as only those can be tokens - for any other pixels next(..) does not do anything but stepping the position.
+	 * x: position of the pixel in the scanline - wasLen, wasMagSum: Homer::getLen() and getMagSum() before the pixel
+	 * len: Homer::getLen() after the pixel
+	 */
+	inline NexRes nextLexed(int x, int wasLen, CT wasMagSum, int len) noexcept {
+		sustate.x = x;
+		sustate.wasInHo = true;
+		sustate.lastLen = wasLen;
+		sustate.__hackz_saved_homarea_len = wasLen;
+		sustate.__hackz_saved_homarea_magSum = wasMagSum;
+		return slowNext(len);
+	}
 private:
 
 	// Rem.: Not inlined because this is the rare part and is only here to make the hot-spot more cache friendly!
-	NexRes NOINLINE slowNext() {
+	NexRes NOINLINE slowNext(int homerLen) {
 		// TODO: extract into method
 		NexRes ret;
 
 		// Check if the "homogenity" state has changed or not
 		// And then check if the homogenity area is too small or not
 		if(!(sustate.wasInHo
-				&& homer.getLen() < setup.ignoreSmallHotokenDeltaLen)) {
+				&& homerLen < getSetup().ignoreSmallHotokenDeltaLen)) {
 			// We are surely not found the marker when we are
 			// still in the middle of a homogenity area (or inhomogen)
 			ret.foundMarker = false;
@@ -213,7 +252,7 @@ private:
 	 * Returns true when marker has been found and marker data can be asked for!
 	 * BEWARE: Changes/updates this->sustate!!!
 	 */
-	bool processHotoken(Homer<MT, CT> &homer) noexcept {
+	bool processHotoken(Homer<MT, CT, ATTRITION, PRECISION, CONFIG> &homer) noexcept {
 #ifdef DEBUGLOG
 // Rem.: \n is always at the "return" operation!
 		printf("Token: AVG= %d at LEN= %d @ %d..%d --- ", sustate.lastMagAvg, sustate.lastLen, sustate.x - sustate.lastLen, sustate.x);
@@ -229,17 +268,17 @@ private:
 			// CHECK markStartSuspectionMagDeltaMin
 			if(LIKELY(
 					((sustate.lastLastMagAvg - sustate.lastMagAvg) <= 0) || 
-					(abs(sustate.lastLastMagAvg - sustate.lastMagAvg) < setup.markStartSuspectionMagDeltaMin))) {
+					(abs(sustate.lastLastMagAvg - sustate.lastMagAvg) < getSetup().markStartSuspectionMagDeltaMin))) {
 #ifdef DEBUGLOG
 				printf("NOT_MARKER_START: markStartSuspectionMagDeltaMin abs(%d - %d)<%d ",
 					   	sustate.lastLastMagAvg,
 						sustate.lastMagAvg,
-						setup.markStartSuspectionMagDeltaMin
+						getSetup().markStartSuspectionMagDeltaMin
 				);
 #endif //DEBUGLOG
 			} else {
 				// If we are here, we suspect that this might be a start of a marker
-				if(LIKELY(sustate.lastLastLen < setup.markStartPrefixHomoLenMin)) {
+				if(LIKELY(sustate.lastLastLen < getSetup().markStartPrefixHomoLenMin)) {
 #ifdef DEBUGLOG
 					printf("NOT_MARKER_START: markStartPrefixHomoLenMincheck! ");
 #endif //DEBUGLOG
@@ -249,7 +288,7 @@ private:
 					int lastStartX = sustate.lastEndX - sustate.lastLen;
 					//Rem.: abs is not needed here: int transitionLen = abs(sustate.lastLastEndX - lastStartX);
 					int transitionLen = (sustate.lastLastEndX - lastStartX);
-					if(LIKELY(transitionLen > setup.markStartTransitionLenMax)) {
+					if(LIKELY(transitionLen > getSetup().markStartTransitionLenMax)) {
 #ifdef DEBUGLOG
 						printf("NOT_MARKER_START: markStartTransitionLenMax! ");
 #endif //DEBUGLOG
@@ -284,7 +323,7 @@ private:
 			int delta = abs(sustate.lastLen - sustate.lastLastLen);
 			int delta_cen = abs(sustate.lastLen - sustate.lastLastLen * 2);
 			delta = (delta < delta_cen) ? delta : delta_cen;
-			if(delta > setup.markContinueStripeSizeMaxDelta) {
+			if(delta > getSetup().markContinueStripeSizeMaxDelta) {
 				// PROBLEM: indicate no parenthesis
 				isParenthesis = false;
 #ifdef DEBUGLOG
@@ -297,7 +336,7 @@ private:
 			int lastStartX = sustate.lastEndX - sustate.lastLen;
 			//Rem.: abs is not needed here: int stripeLen = abs(sustate.lastLastEndX - lastStartX);
 			int stripeLen = (sustate.lastLastEndX - lastStartX);
-			if(stripeLen > setup.markContinueTooBigWidthDelta) {
+			if(stripeLen > getSetup().markContinueTooBigWidthDelta) {
 				// PROBLEM: indicate no parenthesis
 				isParenthesis = false;
 #ifdef DEBUGLOG
@@ -333,7 +372,7 @@ private:
 					// CHECK: This must be nearly two times as big as the ealier one(s)!
 					if((sustate.lastLen < sustate.lastLastLen) ||
 						   	(abs(sustate.lastLastLen - (sustate.lastLen - sustate.lastLastLen))
-							  < (setup.markContinueStripeSizeMaxDelta))) {
+							  < (getSetup().markContinueStripeSizeMaxDelta))) {
 						isRealCenterSuspected = false;
 #ifdef DEBUGLOG
 						printf(" NOT REAL CENTER (markContinueStripeSizeMaxDelta) ");
@@ -385,7 +424,7 @@ private:
 			int delta = abs(sustate.lastLen - sustate.lastLastLen);
 			int delta_cen = abs(sustate.lastLen - sustate.lastLastLen / 2); // nodiv: just a right shift here!
 			delta = (delta < delta_cen) ? delta : delta_cen;
-			if(delta > setup.markContinueStripeSizeMaxDelta) {
+			if(delta > getSetup().markContinueStripeSizeMaxDelta) {
 				// PROBLEM: indicate no parenthesis
 				isParenthesis = false;
 #ifdef DEBUGLOG
@@ -398,7 +437,7 @@ private:
 			int lastStartX = sustate.lastEndX - sustate.lastLen;
 			//Rem.: abs is not needed here: int stripeLen = abs(sustate.lastLastEndX - lastStartX);
 			int stripeLen = (sustate.lastLastEndX - lastStartX);
-			if(stripeLen > setup.markContinueTooBigWidthDelta) {
+			if(stripeLen > getSetup().markContinueTooBigWidthDelta) {
 				// PROBLEM: indicate no parenthesis
 				isParenthesis = false;
 #ifdef DEBUGLOG
@@ -544,7 +583,7 @@ private:
 		MT lastLastMagAvg = 0;
 
 		/** Updates wasInHo and lastLen */
-		inline void updateLast(Homer<MT, CT> &homer) noexcept {
+		inline void updateLast(Homer<MT, CT, ATTRITION, PRECISION, CONFIG> &homer) noexcept {
 			// Update new state
 			// Rem.: default homer values are good for kickstarting the first hotoken
 			wasInHo = homer.isHo();
@@ -555,7 +594,7 @@ private:
 		//       that runs for every pixel of the image. This way no div will be necessary!
 		//       This only saves out simple values as you can see!
 		/** Saves data for the updateLastMagAvg(..) call without doing a slow division op */
-		inline void saveDataForUpdateLastMagAvg(Homer<MT, CT> &homer) noexcept {
+		inline void saveDataForUpdateLastMagAvg(Homer<MT, CT, ATTRITION, PRECISION, CONFIG> &homer) noexcept {
 			__hackz_saved_homarea_len = homer.getLen();
 			__hackz_saved_homarea_magSum = homer.getMagSum();
 		}
@@ -563,7 +602,7 @@ private:
 		CT __hackz_saved_homarea_magSum = 0;
 
 		/** Updates lastMagAvg */
-		inline void updateLastMagAvg(Homer<MT, CT> &homer) noexcept {
+		inline void updateLastMagAvg(Homer<MT, CT, ATTRITION, PRECISION, CONFIG> &homer) noexcept {
 			//A faster: lastMagAvg = homer.magAvg();
 			lastMagAvg = (MT) (__hackz_saved_homarea_magSum / __hackz_saved_homarea_len);
 		}
@@ -600,10 +639,20 @@ private:
 	};
 
 
+	/** Runtime setup: the stored one */
+	inline const HoparserSetup& selectSetup(std::false_type) const noexcept {
+		return setup;
+	}
+
+	/** Compile-time setup: folds into immediates */
+	inline constexpr HoparserSetup selectSetup(std::true_type) const noexcept {
+		return CONFIG::hoparserSetup();
+	}
+
 	/** The undelying homer as lexer of homogenous areas */
-	Homer<MT, CT> homer;
+	Homer<MT, CT, ATTRITION, PRECISION, CONFIG> homer;
 
-	/** Holds configuration values for a Hoparser */
+	/** Holds configuration values for a Hoparser - only used with runtime CONFIG (see getSetup()) */
 	HoparserSetup setup;
 
 	/** Holds data about current suspections*/
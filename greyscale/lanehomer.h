@@ -0,0 +1,459 @@
+#ifndef FASTTRACK_LANE_HOMER_H
+#define FASTTRACK_LANE_HOMER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "microshackz.h"
+#include "mcparser.h"
+
+#if !defined(HOMER_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h> // the 8-lane kernel of HomerLanes
+#endif
+
+/**
+ * Branchless kernels stepping many Homers at once (each one is a "lane") - with their setup.
+ * The state of the lanes is kept in struct-of-arrays form by the users (see LaneHomer and the
+ * ColumnHomer of columnhoparser.h) and is only given here as pointers to eight lanes at a time.
+ * With AVX2 and byte magnitudes eight lanes are stepped by a handful of instructions (the
+ * length-affected thresholds are gathered from the shared LenAffectTable that Homer uses) - other
+ * compilers and magnitude types get a plain per-lane loop.
+ *
+ * The state after each step is exactly the state of a Homer that got the same magnitudes one-by-one.
+ * Rem.: Lengths and sums are 32 bit lanes - areas shorter than 2^23 pixels are exact in every mode.
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition,
+	typename PRECISION = DefaultHomerPrecision, typename CONFIG = RuntimeConfig>
+class HomerLanes final {
+	static_assert(sizeof(MT) <= 2, "HomerLanes keeps magnitudes in 32 bit lanes - use at most 16 bit magnitudes!");
+public:
+	/** Pointers to the state arrays of the lanes (isHo is 0 or -1 so that it is a ready-made SIMD mask) */
+	struct State final {
+		int32_t *len;
+		int32_t *magSum;
+		int32_t *magMin;
+		int32_t *magMax;
+		int32_t *isHo;
+		int32_t *last;
+		/** State of each lane before the last step - this is what the Hoparsers need */
+		int32_t *wasLen;
+		int32_t *wasMagSum;
+	};
+
+	/** Create with the default setup (or the one of a compile-time CONFIG) */
+	HomerLanes() noexcept {
+		buildLenAffectTable(configSetup(std::integral_constant<bool, CONFIG::isCompileTime>()),
+				configParams(std::integral_constant<bool, CONFIG::isCompileTime>()));
+	}
+
+	/** Create with the given setup */
+	HomerLanes(HomerSetup setup, LenAffectParams params = LenAffectParams{}) noexcept {
+		static_assert(!CONFIG::isCompileTime, "Setup of compile-time configured Homer comes from its CONFIG!");
+		buildLenAffectTable(setup, params);
+	}
+
+	/** Resets the lanes from..(from + count - 1) - like calling Homer::reset() for each */
+	static inline void reset(State s, int from, int count) noexcept {
+		for(int l = from; l < from + count; ++l) {
+			s.len[l] = 0;
+			s.magSum[l] = 0;
+			s.magMin[l] = std::numeric_limits<MT>::max();
+			s.magMax[l] = std::numeric_limits<MT>::min();
+			s.isHo[l] = 0;
+			s.last[l] = 0;
+			s.wasLen[l] = 0;
+			s.wasMagSum[l] = 0;
+		}
+	}
+
+	/**
+	 * Sends mags[i] to the homer of lane (g + i) for the eight lanes from g.
+	 * Returns the lanes that ended a homogenous area with this magnitude: bit i is set when lane (g + i)
+	 * was isHo before, but not after the magnitude (these are the only ones a Hoparser cares about).
+	 */
+	inline uint32_t next8(State s, int g, const MT *mags) const noexcept {
+		return next8(s, g, mags, std::integral_constant<bool, USE_AVX2>());
+	}
+
+private:
+#if !defined(HOMER_NO_SIMD) && defined(__AVX2__)
+	static constexpr bool USE_AVX2 = std::is_same<MT, uint8_t>::value;
+#else
+	static constexpr bool USE_AVX2 = false;
+#endif
+
+	/**
+	 * Steps the eight lanes from g - the same as Homer::next(..) (and its slowNext(..)) just branchless:
+	 * - isHo lanes "accept" the magnitude when it is close to the min/max avarage (and the real avarage
+	 *   with slow precision) using the length-affected setup, the others when it is close to the last one.
+	 * - Accepted magnitudes extend the area and isHo is set by the length and min/max checks.
+	 * - Otherwise (or when an isHo area could not stay open or the min/max check fails) the lane resets.
+	 */
+	inline uint32_t next8(State s, int g, const MT *mags, std::false_type) const noexcept {
+		uint32_t ended = 0;
+		for(int i = 0; i < 8; ++i) {
+			int l = g + i;
+			int32_t mag = mags[i];
+			int32_t ln = s.len[l];
+			int32_t sum = s.magSum[l];
+			int32_t mn = s.magMin[l];
+			int32_t mx = s.magMax[l];
+			int32_t ho = s.isHo[l];
+			s.wasLen[l] = ln;
+			s.wasMagSum[l] = sum;
+
+			int32_t index = ln - lenAffectTableStart;
+			if(index < 0) index = 0;
+			if(index > lenAffectTableLast) index = lenAffectTableLast;
+			const HomerSetup &affected = lenAffectEntries[index].setup;
+
+			bool accept;
+			int32_t hodeltaLen;
+			int32_t minMaxDeltaMax;
+			if(ho) {
+				int32_t minMaxAvg = (ln == 0) ? 0 : (((mx - mn) / 2) + mn);
+				accept = !(abs(minMaxAvg - mag) > affected.hodeltaMinMaxAvgDiff);
+				if(PRECISION::slowPrecise) {
+					accept = accept && !(abs(sum - mag * ln) > affected.hodeltaAvgDiff * ln);
+				}
+				hodeltaLen = affected.hodeltaLen;
+				minMaxDeltaMax = affected.minMaxDeltaMax;
+			} else {
+				accept = !(abs(s.last[l] - mag) > baseDiff);
+				hodeltaLen = baseLen;
+				minMaxDeltaMax = baseMinMaxDeltaMax;
+			}
+			int32_t newMin = (mn < mag) ? mn : mag;
+			int32_t newMax = (mx > mag) ? mx : mag;
+			bool minMaxOk = ((newMax - newMin) < minMaxDeltaMax);
+			bool newHo = accept && ((ln + 1) >= hodeltaLen) && minMaxOk;
+			bool keep = ho ? newHo : (accept && minMaxOk);
+
+			s.len[l] = keep ? (ln + 1) : 0;
+			s.magSum[l] = keep ? (sum + mag) : 0;
+			s.magMin[l] = keep ? newMin : std::numeric_limits<MT>::max();
+			s.magMax[l] = keep ? newMax : std::numeric_limits<MT>::min();
+			s.last[l] = mag;
+			s.isHo[l] = newHo ? -1 : 0;
+			if(ho && !newHo) ended |= (1u << i);
+		}
+		return ended;
+	}
+
+#if !defined(HOMER_NO_SIMD) && defined(__AVX2__)
+	/** The same as the generic next8(..) for byte magnitudes using AVX2 */
+	inline uint32_t next8(State s, int g, const MT *mags, std::true_type) const noexcept {
+		const __m256i one = _mm256_set1_epi32(1);
+		__m256i mag = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)mags));
+		__m256i ln = _mm256_loadu_si256((const __m256i*)(s.len + g));
+		__m256i sum = _mm256_loadu_si256((const __m256i*)(s.magSum + g));
+		__m256i mn = _mm256_loadu_si256((const __m256i*)(s.magMin + g));
+		__m256i mx = _mm256_loadu_si256((const __m256i*)(s.magMax + g));
+		__m256i ho = _mm256_loadu_si256((const __m256i*)(s.isHo + g));
+		__m256i lst = _mm256_loadu_si256((const __m256i*)(s.last + g));
+		_mm256_storeu_si256((__m256i*)(s.wasLen + g), ln);
+		_mm256_storeu_si256((__m256i*)(s.wasMagSum + g), sum);
+
+		// Length-affected setup of each lane (isHo lanes only use it)
+		__m256i index = _mm256_sub_epi32(ln, _mm256_set1_epi32(lenAffectTableStart));
+		index = _mm256_min_epi32(_mm256_max_epi32(index, _mm256_setzero_si256()), _mm256_set1_epi32(lenAffectTableLast));
+		// Rem.: The entries are six ints each - so the gathers go with index * 6 ints from the field of the first one
+		static_assert(sizeof(LenAffected) == 6 * sizeof(int32_t), "The gathers expect six ints per LenAffected!");
+		index = _mm256_add_epi32(_mm256_slli_epi32(index, 2), _mm256_slli_epi32(index, 1));
+		const HomerSetup &first = lenAffectEntries[0].setup;
+		__m256i affMinMaxAvgDiff = _mm256_i32gather_epi32((const int*)&first.hodeltaMinMaxAvgDiff, index, 4);
+		__m256i affLen = _mm256_i32gather_epi32((const int*)&first.hodeltaLen, index, 4);
+		__m256i affMinMaxDeltaMax = _mm256_i32gather_epi32((const int*)&first.minMaxDeltaMax, index, 4);
+
+		// isHo lanes: close enough to the min/max avarage (and the real avarage with slow precision)?
+		// Rem.: a zero length isHo lane has a zero min/max avarage - just like Homarea::magMinMaxAvg()
+		__m256i minMaxAvg = _mm256_add_epi32(_mm256_srli_epi32(_mm256_sub_epi32(mx, mn), 1), mn);
+		minMaxAvg = _mm256_andnot_si256(_mm256_cmpeq_epi32(ln, _mm256_setzero_si256()), minMaxAvg);
+		__m256i acceptHo = _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(minMaxAvg, mag)), affMinMaxAvgDiff);
+		if(PRECISION::slowPrecise) {
+			__m256i affAvgDiff = _mm256_i32gather_epi32((const int*)&first.hodeltaAvgDiff, index, 4);
+			__m256i avgDiff = _mm256_abs_epi32(_mm256_sub_epi32(sum, _mm256_mullo_epi32(mag, ln)));
+			acceptHo = _mm256_or_si256(acceptHo, _mm256_cmpgt_epi32(avgDiff, _mm256_mullo_epi32(affAvgDiff, ln)));
+		}
+		// Rem.: the compares above are "rejects" - this flips them
+		acceptHo = _mm256_xor_si256(acceptHo, _mm256_set1_epi32(-1));
+
+		// Other lanes: close enough to the last magnitude?
+		__m256i acceptLooking = _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(lst, mag)), _mm256_set1_epi32(baseDiff));
+		acceptLooking = _mm256_xor_si256(acceptLooking, _mm256_set1_epi32(-1));
+
+		__m256i accept = _mm256_blendv_epi8(acceptLooking, acceptHo, ho);
+		__m256i hodeltaLen = _mm256_blendv_epi8(_mm256_set1_epi32(baseLen), affLen, ho);
+		__m256i minMaxDeltaMax = _mm256_blendv_epi8(_mm256_set1_epi32(baseMinMaxDeltaMax), affMinMaxDeltaMax, ho);
+
+		// Extend the area and check it
+		__m256i newLen = _mm256_add_epi32(ln, one);
+		__m256i newMin = _mm256_min_epi32(mn, mag);
+		__m256i newMax = _mm256_max_epi32(mx, mag);
+		__m256i minMaxOk = _mm256_cmpgt_epi32(minMaxDeltaMax, _mm256_sub_epi32(newMax, newMin));
+		__m256i lenOk = _mm256_cmpgt_epi32(newLen, _mm256_sub_epi32(hodeltaLen, one)); // newLen >= hodeltaLen
+		__m256i acceptAndMinMaxOk = _mm256_and_si256(accept, minMaxOk);
+		__m256i newHo = _mm256_and_si256(acceptAndMinMaxOk, lenOk);
+		__m256i keep = _mm256_blendv_epi8(acceptAndMinMaxOk, newHo, ho);
+
+		// Keep the extended area or reset the lane
+		_mm256_storeu_si256((__m256i*)(s.len + g), _mm256_and_si256(keep, newLen));
+		_mm256_storeu_si256((__m256i*)(s.magSum + g), _mm256_and_si256(keep, _mm256_add_epi32(sum, mag)));
+		_mm256_storeu_si256((__m256i*)(s.magMin + g),
+				_mm256_blendv_epi8(_mm256_set1_epi32(std::numeric_limits<MT>::max()), newMin, keep));
+		_mm256_storeu_si256((__m256i*)(s.magMax + g), _mm256_and_si256(keep, newMax));
+		_mm256_storeu_si256((__m256i*)(s.last + g), mag);
+		_mm256_storeu_si256((__m256i*)(s.isHo + g), newHo);
+
+		return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(newHo, ho)));
+	}
+#endif // !HOMER_NO_SIMD && __AVX2__
+
+	/** Default setup for runtime configs */
+	static inline HomerSetup configSetup(std::false_type) noexcept {
+		return HomerSetup();
+	}
+
+	/** The setup of compile-time configs */
+	static inline HomerSetup configSetup(std::true_type) noexcept {
+		return CONFIG::homerSetup();
+	}
+
+	/** Default length affection for runtime configs */
+	static inline LenAffectParams configParams(std::false_type) noexcept {
+		return LenAffectParams();
+	}
+
+	/** The length affection of compile-time configs */
+	static inline LenAffectParams configParams(std::true_type) noexcept {
+		return CONFIG::lenAffectParams();
+	}
+
+	/** Gets the shared length-affected setups - the very same LenAffectTable that the Homers of this setup use */
+	void buildLenAffectTable(HomerSetup setup, LenAffectParams params) noexcept {
+		baseLen = setup.hodeltaLen;
+		baseDiff = setup.hodeltaDiff;
+		baseMinMaxDeltaMax = setup.minMaxDeltaMax;
+
+		lenAffectTable = LenAffectTable<ATTRITION>::get(setup, params);
+		lenAffectEntries = lenAffectTable->entries();
+		lenAffectTableStart = lenAffectTable->start();
+		lenAffectTableLast = lenAffectTable->last();
+	}
+
+	/** The not length-affected setup values (used when not in a homogenous area) */
+	int32_t baseLen;
+	int32_t baseDiff;
+	int32_t baseMinMaxDeltaMax;
+
+	/** The shared length-affected setups - the members below are its values for the kernels */
+	std::shared_ptr<const LenAffectTable<ATTRITION>> lenAffectTable;
+	/** Length-affected setups for lengths starting from lenAffectTableStart - bigger lengths use the last */
+	const LenAffected *lenAffectEntries = nullptr;
+	/** The length of the first table entry - all smaller lengths use the first entry too */
+	int lenAffectTableStart = 0;
+	/** Index of the last element of the tables */
+	int lenAffectTableLast = 0;
+};
+
+/**
+ * "VERTICAL SIMD" HOMER
+ * =====================
+ *
+ * The Homer state machine is serial along a scanline, but the scanlines are independent. This is
+ * LANES Homers - one for each of LANES adjacent scanlines - advanced in lockstep by the HomerLanes
+ * kernels: every next(..) call takes a column of LANES magnitudes (the pixels of the same x in
+ * each scanline) and steps all the lanes with branchless code.
+ *
+ * Rem.: LANES must be 8, 16, 24 or 32 - template parameters are otherwise those of Homer.
+ */
+template<int LANES = 16, typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition,
+	typename PRECISION = DefaultHomerPrecision, typename CONFIG = RuntimeConfig>
+class LaneHomer final {
+	static_assert((LANES % 8 == 0) && (LANES >= 8) && (LANES <= 32), "LaneHomer needs 8, 16, 24 or 32 lanes!");
+public:
+	/** Create LANES homers with the default setup (or the one of a compile-time CONFIG) */
+	LaneHomer() noexcept {
+		reset();
+	}
+
+	/** Create LANES homers with the given setup */
+	LaneHomer(HomerSetup setup, LenAffectParams params = LenAffectParams{}) noexcept : lanes(setup, params) {
+		reset();
+	}
+
+	/** Resets every lane - like calling Homer::reset() for each */
+	inline void reset() noexcept {
+		Lanes::reset(state(), 0, LANES);
+	}
+
+	/**
+	 * Sends column[l] to the homer of lane l - for every lane at once.
+	 * Returns the lanes that ended a homogenous area with this magnitude: bit l is set when lane l
+	 * was isHo before, but not after the magnitude (these are the only ones a Hoparser cares about).
+	 */
+	inline uint32_t next(const MT *column) noexcept {
+		uint32_t ended = 0;
+		for(int g = 0; g < LANES; g += 8) {
+			ended |= lanes.next8(state(), g, column + g) << g;
+		}
+		return ended;
+	}
+
+	/** Homer::getLen() of the lane before the last next(..) */
+	inline int getWasLen(int lane) const noexcept {
+		return wasLen[lane];
+	}
+
+	/** Homer::getMagSum() of the lane before the last next(..) */
+	inline CT getWasMagSum(int lane) const noexcept {
+		return (CT)wasMagSum[lane];
+	}
+
+	/** Homer::getLen() of the lane */
+	inline int getLen(int lane) const noexcept {
+		return len[lane];
+	}
+
+	/** Homer::isHo() of the lane */
+	inline bool getIsHo(int lane) const noexcept {
+		return (isHo[lane] != 0);
+	}
+
+private:
+	using Lanes = HomerLanes<MT, CT, ATTRITION, PRECISION, CONFIG>;
+
+	/** The state arrays for the kernels */
+	inline typename Lanes::State state() noexcept {
+		return typename Lanes::State{len, magSum, magMin, magMax, isHo, last, wasLen, wasMagSum};
+	}
+
+	/** Setup and kernels */
+	Lanes lanes;
+
+	// Homarea of each lane
+	alignas(32) int32_t len[LANES];
+	alignas(32) int32_t magSum[LANES];
+	alignas(32) int32_t magMin[LANES];
+	alignas(32) int32_t magMax[LANES];
+	alignas(32) int32_t isHo[LANES];
+	alignas(32) int32_t last[LANES];
+
+	// State of each lane before the last next(..)
+	alignas(32) int32_t wasLen[LANES];
+	alignas(32) int32_t wasMagSum[LANES];
+};
+
+/**
+ * Whole-frame parser using the LaneHomer: gives the very same ImageFrameResult as MCParser::processFrame(..)
+ *
+ * Every LANES scanlines are transposed into a small column-major tile so that the LaneHomer can read
+ * the column of each x with a single load. The lanes that end a homogenous area are sent to the Hoparser
+ * of their scanline (see Hoparser::nextLexed(..)) and the found 1D markers are merged in scanline order
+ * into a usual MCParser (see MCParser::merge1DMarker(..)). The last (height % LANES) scanlines simply go
+ * through the MCParser itself.
+ *
+ * Template parameters are those of the LaneHomer.
+ */
+template<int LANES = 16, typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition,
+	typename PRECISION = DefaultHomerPrecision, typename CONFIG = RuntimeConfig>
+class LaneMCParser final {
+public:
+	/** Used for merging the 1D markers of the lanes */
+	using Parser = MCParser<MT, CT, ATTRITION, PRECISION, CONFIG>;
+	/** Used for finding the 1D markers of one lane */
+	using Tokenizer = Hoparser<MT, CT, ATTRITION, PRECISION, CONFIG>;
+
+	/** Create a lane-parser with default configuration */
+	LaneMCParser() noexcept {
+	}
+
+	/** Create a lane-parser with the given configurations */
+	LaneMCParser(MCParserConfig parserConfig, HoparserSetup hoparserSetup, HomerSetup homerSetup) noexcept
+		: laneHomer(homerSetup), merger(parserConfig, hoparserSetup, homerSetup) {
+		for(auto &tokenizer : tokenizers) {
+			tokenizer = Tokenizer(homerSetup, hoparserSetup);
+		}
+	}
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME: same as MCParser::processFrame(..) - just LANES scanlines at once.
+	 * The stride is the distance of the rows counted in MT elements (not bytes).
+	 */
+	const ImageFrameResult processFrame(const MT *base, int width, int height, int stride) noexcept {
+		tile.resize((size_t)width * LANES);
+		int y = 0;
+		for(; y + LANES <= height; y += LANES) {
+			processLanes(base + (size_t)y * stride, width, stride);
+		}
+		// Remaining scanlines go the usual way
+		for(; y < height; ++y) {
+			merger.processLine(base + (size_t)y * stride, width);
+		}
+		return merger.endImageFrame();
+	}
+
+private:
+	/** Parses the LANES scanlines starting at the given row */
+	inline void processLanes(const MT *rows, int width, int stride) noexcept {
+		// Transpose: the column of each x becomes continuous
+		for(int l = 0; l < LANES; ++l) {
+			const MT *row = rows + (size_t)l * stride;
+			MT *to = &tile[l];
+			for(int x = 0; x < width; ++x) {
+				*to = row[x];
+				to += LANES;
+			}
+		}
+
+		// Lex all the lanes in lockstep - only the ended homogenous areas are sent to the Hoparsers
+		laneHomer.reset();
+		for(int l = 0; l < LANES; ++l) {
+			tokenizers[l].newLine();
+			tokens[l].clear();
+		}
+		const MT *column = &tile[0];
+		for(int x = 0; x < width; ++x) {
+			uint32_t ended = laneHomer.next(column);
+			while(UNLIKELY(ended != 0)) {
+				int l = __builtin_ctz(ended);
+				ended &= ended - 1;
+				auto ret = tokenizers[l].nextLexed(x, laneHomer.getWasLen(l), laneHomer.getWasMagSum(l), laneHomer.getLen(l));
+				if(ret.foundMarker) {
+					tokens[l].push_back(tokenizers[l].getMarkerX());
+					tokens[l].push_back(tokenizers[l].getOrder());
+				}
+			}
+			column += LANES;
+		}
+
+		// Vertical merge in scanline order
+		for(int l = 0; l < LANES; ++l) {
+			for(size_t i = 0; i < tokens[l].size(); i += 2) {
+				merger.merge1DMarker(tokens[l][i], tokens[l][i + 1]);
+			}
+			merger.endLine();
+		}
+	}
+
+	/** The homers of the lanes */
+	LaneHomer<LANES, MT, CT, ATTRITION, PRECISION, CONFIG> laneHomer;
+
+	/** Hoparser of each lane - only fed by nextLexed(..) */
+	Tokenizer tokenizers[LANES];
+
+	/** The found 1D markers of each lane as (centerX, order) pairs */
+	std::vector<int> tokens[LANES];
+
+	/** Column-major copy of the scanlines of the lanes */
+	std::vector<MT> tile;
+
+	/** Merges the lanes - and parses the remaining scanlines */
+	Parser merger;
+};
+
+#endif // FASTTRACK_LANE_HOMER_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
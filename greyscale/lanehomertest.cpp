@@ -0,0 +1,75 @@
+// Tests that LaneMCParser (many scanlines lexed at once by the "vertical SIMD"
+// LaneHomer) gives exactly the same markers (in the same order) as the serial
+// MCParser::processFrame(..) does - with 8, 16 and 32 lanes and with different
+// attrition and precision policies. Also prints the time of both per frame.
+//
+// Compile with and without -mavx2 to test both the AVX2 and the generic kernels!
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include "lanehomer.h"
+#include "testhelpers.h"
+
+// Repeat each frame this many times for the timing
+#define RUNS_PER_FRAME 10
+
+/** Returns the milliseconds per frame and the result of the parser */
+template<typename PARSER>
+double measure(PARSER &parser, const std::vector<uint8_t> &grey, int width, int height, ImageFrameResult &result) {
+	result = parser.processFrame(&grey[0], width, height, width);
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < RUNS_PER_FRAME; ++i) {
+		parser.processFrame(&grey[0], width, height, width);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / RUNS_PER_FRAME;
+}
+
+/** Tests one frame with one lane count and policy set - returns the number of failures */
+template<int LANES, typename ATTRITION, typename PRECISION>
+int testLanes(const char *name, const char *policies, const std::vector<uint8_t> &grey, int width, int height) {
+	MCParser<uint8_t, int, ATTRITION, PRECISION> mcp;
+	LaneMCParser<LANES, uint8_t, int, ATTRITION, PRECISION> lmcp;
+	ImageFrameResult expected;
+	ImageFrameResult result;
+	double serialMs = measure(mcp, grey, width, height, expected);
+	double laneMs = measure(lmcp, grey, width, height, result);
+	// Rem.: again to see that the state is properly reset between frames
+	bool ok = sameResults(expected, result) && sameResults(expected, lmcp.processFrame(&grey[0], width, height, width));
+	printf("%s (%dx%d, %d markers) %s with %d lanes: %s (serial: %.2f ms, lanes: %.2f ms)\n", name, width, height,
+			(int)expected.markers.size(), policies, LANES, ok ? "OK" : "MISMATCH", serialMs, laneMs);
+	return ok ? 0 : 1;
+}
+
+/** Tests one frame with all the lane counts and policies - returns the number of failures */
+int testFrame(const char *name, const std::vector<uint8_t> &grey, int width, int height) {
+	int failures = 0;
+	failures += testLanes<8, DefaultAttrition, DefaultHomerPrecision>(name, "default", grey, width, height);
+	failures += testLanes<16, DefaultAttrition, DefaultHomerPrecision>(name, "default", grey, width, height);
+	failures += testLanes<32, DefaultAttrition, DefaultHomerPrecision>(name, "default", grey, width, height);
+	failures += testLanes<16, NoAttrition, FastHomerPrecision>(name, "no attrition", grey, width, height);
+	failures += testLanes<16, ExponentialAttrition, SlowPreciseHomerPrecision>(name, "exponential + slow precise", grey, width, height);
+	failures += testLanes<16, SimpleAttrition, SlowPreciseHomerPrecision>(name, "simple + slow precise", grey, width, height);
+	return failures;
+}
+
+int main() {
+	printf("Testing LaneMCParser against MCParser...\n");
+
+	int failures = 0;
+	// Rem.: the height is not a multiple of any lane count so the remaining scanlines are tested too
+	failures += testFrame("generated markers", generateMarkers(1280, 957, 40), 1280, 957);
+
+	failures += testWebcamFrames([](const char *file, const std::vector<uint8_t> &grey) {
+		return testFrame(file, grey, WEBCAM_WIDTH, WEBCAM_HEIGHT);
+	});
+
+	printf("...testing LaneMCParser ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
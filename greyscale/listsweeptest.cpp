@@ -0,0 +1,67 @@
+// Tests the closing sweep of MCParser::endLine() (MCParserConfig::closeSweepBudget) on a generated frame
+// with rows of markers that get shorter downwards - so the 1D markers of the later rows never walk over the
+// centers on the right. The markers must be at the same places as without the sweep (their order and confidence
+// can change: a 1D marker appended after the last center is tried on the next 1D marker of the scanline too)
+// and the active list must stay close to the number of markers in a row instead of growing with the frame.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "mcparser.h"
+#include "testhelpers.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define CIRCLE_SIZE 40
+#define ROW_STEP 110
+#define COLUMN_STEP 100
+
+/** Parses the frame with the given sweep budget - returns the result and the list statistics */
+ImageFrameResult parse(const std::vector<uint8_t> &grey, unsigned int budget, ActiveListStats &stats) {
+	MCParserConfig config;
+	config.closeSweepBudget = budget;
+	MCParser<> mcp(config);
+	auto result = mcp.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	stats = mcp.getListStats();
+	return result;
+}
+
+int main() {
+	printf("Testing the closing sweep of the MCParser...\n");
+
+	// Every row of markers is shorter than the one above it
+	std::vector<uint8_t> grey(WIDTH * HEIGHT);
+	for(auto &p : grey) p = 224 + (rand() % 8);
+	int rowMarkers = 0;
+	int n = 0;
+	for(int y = 50; y < HEIGHT - 50; y += ROW_STEP, ++n) {
+		int count = 0;
+		for(int x = 50; x < WIDTH - 50 - n * COLUMN_STEP; x += COLUMN_STEP, ++count) {
+			drawMarker(grey, WIDTH, HEIGHT, x, y, CIRCLE_SIZE, 6);
+		}
+		if(count > rowMarkers) rowMarkers = count;
+	}
+
+	int failures = 0;
+	ActiveListStats off;
+	ActiveListStats on;
+	auto reference = parse(grey, 0, off);
+	for(unsigned int budget : {1u, 4u, 8u, 64u}) {
+		auto result = parse(grey, budget, on);
+		bool same = sameMarkerSet(reference.markers, result.markers);
+		bool bounded = (on.maxLength <= (unsigned int)(2 * rowMarkers)) && (on.meanLength() < off.meanLength())
+			&& (on.sweepClosed > 0) && (on.lines == HEIGHT);
+		printf("budget %u: %s - %d markers, list length max %u mean %.1f (without sweep: max %u mean %.1f), %u swept\n",
+				budget, (same && bounded) ? "OK" : "FAILED", (int)result.markers.size(),
+				on.maxLength, on.meanLength(), off.maxLength, off.meanLength(), on.sweepClosed);
+		if(!(same && bounded)) ++failures;
+	}
+
+	printf("...testing the closing sweep ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
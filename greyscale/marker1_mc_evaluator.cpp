@@ -1,5 +1,5 @@
-//#define NO_ATTRITION 1 // fastest operation (2x speedup - but harder to use proper parameters)
-#define SIMPLE_ATTRITION 1 // second fastest operation mode (nearly as good as the NO_ATTRITION)
+//#define NO_ATTRITION 1 // simplest operation (harder to use proper parameters)
+#define SIMPLE_ATTRITION 1 // nearly as good as the NO_ATTRITION - all modes run at the same speed as of the precomputed tables
 // Enable this to draw some of the debug points and log some more info as in the marker1_eval application
 /*
 #define DEBUG_POINTS 1
@@ -96,7 +96,7 @@ int main(int argc, char** argv) {
 	MCParser<> mcp;
 	LenAffectParams params;
 
-	unsigned long long nextCallNo = 0; // counting total next(..) pixel calls
+	unsigned long long debugTokenNo = 0; // counting total debug tokens
 	while (!main_disp.is_closed() && !draw_disp.is_closed() && !lenAffDisp.is_closed()) {
 		main_disp.wait();
 		if (main_disp.button() && main_disp.mouse_y()>=0) {
@@ -115,10 +115,11 @@ int main(int argc, char** argv) {
 				}
 				lenAffImg.display(lenAffDisp);
 
-				// Only for showing the debug points - as other way is used in the loop 
-				// by not having i,j coordinates, but a j base-offset and i as the extra 
-				// offset in the line! For drawing we need to count lines though here.
-				int jj = 0;
+				// Only for showing the debug points - these are collected by the parser for us
+				std::vector<DebugToken> debugTokens;
+				std::vector<DebugToken> *debugTokensPtr = &debugTokens;
+#else
+				std::vector<DebugToken> *debugTokensPtr = nullptr;
 #endif // DEBUG_POINTS 
 
 				// start measuring time
@@ -126,54 +127,34 @@ int main(int argc, char** argv) {
 
 				ImageFrameResult results;
 				// Parse all the scanlines properly
-				int fullSize = image.height()*image.width();
 for(int k = 0; k < RUNS_PER_FRAME; ++k) {
-				for(int j = 0; j < fullSize; j+=image.width()) {
-					for(int i = 0; i < image.width(); ++i) {
-						// Rem.: The last value means the 'red' channel
-						//       and we can use that to approximate the greyscale :-)
-						//unsigned char redCol = image(i, j, 0, 0);
-						unsigned char redCol2 = origPixels[i + j];
-						//if(redCol != redCol2) printf("%d != %d\n", redCol, redCol2);
-						auto res = mcp.next(redCol2);
+				// Only keep the debug tokens of the last run
+				if(debugTokensPtr != nullptr) debugTokensPtr->clear();
+				// Rem.: The pixels are the 'red' channel and we can use that to approximate the greyscale :-)
+				results = mcp.processFrame(&origPixels[0], image.width(), image.height(), image.width(), debugTokensPtr);
+}
 
 #ifdef DEBUG_POINTS 
-						++nextCallNo;
-						// do this only for debugging?
-						// These should not be on the image actually
-						if(res.isToken) {
-							// Cant do this now as it overwrites the next scanline:
-							// drawBoxAround(image, i, j, (unsigned char*)&blue);
-							// Muh better debug indicator:
-							image.draw_point(i, jj, (unsigned char*)&blue);
-						}
-						// Check for 1D marker result
-						if(res.foundMarker) {
-							// Log and show this marker centerX
-							int centerX = mcp.tokenizer.getMarkerX();
-							auto order = mcp.tokenizer.getOrder();
-							if(order >= 2) {
-								printf("*** Found marker at %d and centerX: %d and order: %d***\n", i, centerX, order);
-								drawBoxAround(image, centerX, jj, (unsigned char*)&green);
-							} else {
-								printf("*** Found marker at %d and centerX: %d and order: %d***\n", i, centerX, order);
-							}
+				// do this only for debugging?
+				// These should not be on the image actually
+				for(auto &token : debugTokens) {
+					++debugTokenNo;
+					if(token.isToken) {
+						// Cant do this now as it overwrites the next scanline:
+						// drawBoxAround(image, token.x, token.y, (unsigned char*)&blue);
+						// Muh better debug indicator:
+						image.draw_point(token.x, token.y, (unsigned char*)&blue);
+					}
+					// Check for 1D marker result
+					if(token.foundMarker) {
+						// Log and show this marker centerX
+						printf("*** Found marker at %d and centerX: %d and order: %d***\n", token.x, token.markerX, token.order);
+						if(token.order >= 2) {
+							drawBoxAround(image, token.markerX, token.y, (unsigned char*)&green);
 						}
-#endif // DEBUG_POINTS 
 					}
-
-					// Notify MCParser about the end of the line
-					mcp.endLine();
-#ifdef DEBUG_POINTS 
-					// Count lines if needed
-					++jj;
-#endif // DEBUG_POINTS 
-
 				}
-
-				// notify MCParserv about the end of the image frame and get the results
-				results = mcp.endImageFrame();
-}
+#endif // DEBUG_POINTS 
 
 				// Calculate time of run
 				auto endCalc = std::chrono::steady_clock::now();
@@ -206,7 +187,7 @@ for(int k = 0; k < RUNS_PER_FRAME; ++k) {
 		}
 	}
 #ifdef DEBUG_POINTS 
-	printf("Number of total next(<pixel>) calls: %llu\n", nextCallNo);
+	printf("Number of total debug tokens: %llu\n", debugTokenNo);
 #endif // DEBUG_POINTS
 
 	return 0;
@@ -1,9 +1,13 @@
 // TODO: Maybe create a fuller app that uses https://github.com/dlbeer/quirc to get QR code encrypted data?
 
 // Sample application that runs 2D marker tracking on /dev/video0 camera
+// (or on the device given as the first argument - so more cameras can run side by side)
+// With -DVIRTUAL_CAMERA it replays recorded frames instead - give the files as the arguments (see virtualcamera.h)
 //
 // Compile with: g++ marker_camapp.cpp -lGL -lX11 -o marker_camapp
-// When having very slow (5FPS) camera speed turn off auto_exposure:
+// The app asks for GREY frames (if the camera has them) at CAM_FPS and turns off auto exposure and
+// auto white balance itself (see V4LControls::tracking() in v4lwrapper.h) - the very slow (5FPS) camera
+// speed of auto exposure is gone this way. The v4l2-ctl commands below are for checking and tuning by hand:
 //
 // $ v4l2-ctl -d /dev/video0 -L
 //                      brightness (int)    : min=-127 max=127 step=1 default=0 value=0
@@ -47,6 +51,7 @@
 // Must be the same as WIN_*RES as of now!
 #define CAM_XRES 640
 #define CAM_YRES 480
+#define CAM_FPS 30
 /*##define CAM_XRES 320
 #define CAM_YRES 240*/
 
@@ -114,9 +119,23 @@ void myassertfun(bool pred) {
 // Use this for wrapping video4linux
 #include "v4lwrapper.h"
 
+// Replaying recorded frames in place of the camera
+#ifdef VIRTUAL_CAMERA
+#include "virtualcamera.h"
+typedef VirtualCamera Camera;
+#else
+typedef V4LDevice Camera;
+#endif // VIRTUAL_CAMERA
+
+// Capturing on a separate thread - define SYNC_CAPTURE to grab the frames on the drawing thread instead
+#include "asynccapture.h"
+
 // MarkerCenter frame parser
 #include "mcparser.h" 
 
+// Camera pixel format views for the parser
+#include "pixelviews.h"
+
 // 3D pose estimations
 #include "fast3dposer.h"
 
@@ -142,11 +161,47 @@ double elapsedMsec(const struct timeval *start, const struct timeval *stop) {
 			(stop->tv_usec - start->tv_usec) / 1000.0);
 }
 
+#ifdef VIRTUAL_CAMERA
+/** The recorded files to replay - given as the arguments */
+static std::vector<std::string> cameraFiles;
+
+/** Replays the files at the frame rate of the camera - the raw dumps are YUYV frames of CAM_XRES x CAM_YRES */
+VirtualCameraConfig cameraConfig() {
+	VirtualCameraConfig config;
+	config.files = cameraFiles;
+	config.width = CAM_XRES;
+	config.height = CAM_YRES;
+	config.fps = CAM_FPS;
+	return config;
+}
+#else
+/** The video device to capture from - can be given as the first argument */
+static const char *cameraDevice = "/dev/video0";
+
+/** GREY when the camera has it (we only use the luma), fixed exposure and no auto white balance */
+V4LConfig cameraConfig() {
+	V4LConfig config;
+	config.device = cameraDevice;
+	config.width = CAM_XRES;
+	config.height = CAM_YRES;
+	config.preferGrey = true;
+	config.fps = CAM_FPS;
+	config.controls = V4LControls::tracking();
+	return config;
+}
+#endif // VIRTUAL_CAMERA
+
 /** This is where we need to show our frames */
 void draw() {
 
 	/** Created at first call of draw() and stays the same through the app run */
-	static V4LWrapper<CAM_XRES, CAM_YRES> cameraWrapper;
+	static Camera cameraWrapper(cameraConfig());
+	bool grey = (cameraWrapper.getPixelFormat() == V4L2_PIX_FMT_GREY);
+	if((cameraWrapper.getWidth() != CAM_XRES) || (cameraWrapper.getHeight() != CAM_YRES)
+			|| (!grey && (cameraWrapper.getPixelFormat() != V4L2_PIX_FMT_YUYV))) {
+		fprintf(stderr, "The camera cannot capture GREY or YUYV frames of %dx%d!\n", CAM_XRES, CAM_YRES);
+		exit(1);
+	}
 
 	glClear(GL_COLOR_BUFFER_BIT);
 	glLoadIdentity();
@@ -159,64 +214,69 @@ void draw() {
 	glEnd();
 	*/
 
-	uint8_t *rawData = cameraWrapper.nextFrame();
-
-	// the position in the buffer and the amoun to copy from the buffer; The latter is 0 here because of hackz for first loop!
-	int bufPos = 0, memBlockSize = 0; 
-	// the remaining buffer size, is decremented by memBlockSize on each loop so we do not overwrite the buffer
-	int remainingBufferSize = cameraWrapper.getBytesUsed();
-	int lineOffset = 0;
-	int destOffset = 0;
+#ifndef SYNC_CAPTURE
+	// The frames are captured on their own thread while we are detecting (see asynccapture.h)
+	// Rem.: Always the newest frame - the ones captured while we were busy are dropped
+	static AsyncCapture<Camera> capture(cameraWrapper, CapturePolicy::NEWEST);
+	// The capture counters are printed once - when the app exits (the lambda can use the static without capturing it)
+	static int captureStatsAtExit = atexit([] {
+		auto captureStats = capture.getStats();
+		printf("Frames: %llu captured, %llu detected, %llu dropped, %llu late\n",
+				(unsigned long long)captureStats.captured, (unsigned long long)captureStats.delivered,
+				(unsigned long long)captureStats.dropped, (unsigned long long)captureStats.late);
+	});
+	(void)captureStatsAtExit;
+	auto frame = capture.acquire();
+	if(!frame) {
+		// Only when the camera failed (like got unplugged) - see AsyncCapture::hasFailed()
+		fprintf(stderr, "The camera stopped giving frames!\n");
+		exit(1);
+	}
+	const uint8_t *rawData = frame.data();
+#else
+	const uint8_t *rawData = cameraWrapper.nextFrame();
+#endif // SYNC_CAPTURE
+
+	// Views of the mmap-ed camera buffer - GREY rows are used in place, the YUYV luma is gathered line-by-line (no frame copy)
+	int bytesPerLine = cameraWrapper.getBytesPerLine();
+	static PixelView<GreyFormat> greyView(rawData, CAM_XRES, CAM_YRES, (bytesPerLine > 0) ? bytesPerLine : CAM_XRES);
+	static PixelView<YuyvFormat> view(rawData, CAM_XRES, CAM_YRES, (bytesPerLine > 0) ? bytesPerLine : (CAM_XRES * 2));
+	greyView.setBase(rawData);
+	view.setBase(rawData);
+#ifdef DEBUG_POINTS
+	std::vector<DebugToken> debugTokens;
+	std::vector<DebugToken> *debugTokensPtr = &debugTokens;
+#else
+	std::vector<DebugToken> *debugTokensPtr = nullptr;
+#endif // DEBUG_POINTS
 	// For each line:
-    while(remainingBufferSize > 0) {
-		bufPos += memBlockSize;
-		// We read the whole line as a buffered reading
-		memBlockSize = CAM_XRES * (4/2); // 4byte = 2pixel in YUYV so reading 2 bytes get us a greyscale pixel!
-        //memcpy(pixBuf, rawData+bufPos, memBlockSize);
-
-		for(int i = 0; i < memBlockSize; i += 2) {
-			// YUYV - so the two relevant grey values are in the Ys (every second byte)
-			uint8_t mag = (rawData+bufPos)[i];
-
-			// TODO: run marker detection code here with MCParser::next(mag);
-			auto res = poser.next(mag);
-#ifdef DEBUG_POINTS // TODO
-			// do this only for debugging?
-			// These should not be on the image actually
-			if(res.isToken) {
-				// Cant do this now as it overwrites the next scanline:
-				// drawBoxAround(image, i, j, (unsigned char*)&blue);
-				// Much better debug indicator:
-				//image.draw_point(i, j, (unsigned char*)&blue);
-			}
-			// Check for 1D marker result
-			if(res.foundMarker) {
-				// Log and show this marker centerX
-				printf("*** Found marker at %d and centerX: ??? and order: ??? ***\n", i);
-				//drawBoxAround(image, centerX, j, (unsigned char*)&green);
-			}
-#endif // DEBUG_POINTS 
+	for(int j = 0; j < view.height(); ++j) {
+		const uint8_t *row = grey ? greyView.row(j) : view.row(j);
+		// Run the marker detection on the whole scanline (this also ends the line)
+		poser.processLine(row, view.width(), debugTokensPtr);
 
-			//Write our output buffer for showing the results
-			pixBuf[destOffset++] = mag;
+		//Write our output buffer for showing the results
+		memcpy(pixBuf + j * CAM_XRES, row, CAM_XRES);
+	}
+#ifdef DEBUG_POINTS // TODO
+	// do this only for debugging?
+	// These should not be on the image actually
+	for(auto &token : debugTokens) {
+		// Check for 1D marker result
+		if(token.foundMarker) {
+			// Log and show this marker centerX
+			printf("*** Found marker at %d and centerX: %d and order: %d***\n", token.x, token.markerX, token.order);
+			//drawBoxAround(image, token.markerX, token.y, (unsigned char*)&green);
 		}
-
-		// Check for end of frame special cases...
-        if(memBlockSize > remainingBufferSize)
-            memBlockSize = remainingBufferSize;
-
-        // Subtract the amount of data we have to copy
-        // from the remaining buffer size
-        remainingBufferSize -= memBlockSize;
-
-		// Increment line offset
-		lineOffset += memBlockSize;
-
-		poser.endLine();
 	}
+#endif // DEBUG_POINTS 
 	// Ends the frame: both for my parser and v4l2
 	// ! NEEDED !
+#ifndef SYNC_CAPTURE
+	frame.release();
+#else
 	cameraWrapper.finishFrame(); // TODO: might be optimised further by different loops for my processing
+#endif // SYNC_CAPTURE
 	// Get results for this camera frame
 	auto results = poser.endImageFrame();
 
@@ -469,6 +529,13 @@ void mainLoop() {
 }
 
 int main(int argc, char *argv[]) {
+#ifdef VIRTUAL_CAMERA
+	cameraFiles.assign(argv + 1, argv + argc);
+#else
+	if(argc > 1) {
+		cameraDevice = argv[1];
+	}
+#endif // VIRTUAL_CAMERA
 	Win.width = WIN_XRES;
 	Win.height = WIN_YRES;
 	createWindow();
@@ -3,6 +3,9 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <limits>
 #include "hoparser.h"
 #include "fastforwardlist.h"
 
@@ -10,6 +13,10 @@
 #define MAX_MARKER_PER_SCANLINE 1024 // Could be smaller I guess
 #endif
 
+#ifndef MC_LINE_BATCH_SIZE // Let the users define this
+#define MC_LINE_BATCH_SIZE 128 // 1D markers collected on the stack per batched merge (see MCParserConfig::batchMerge)
+#endif
+
 // Only define to see debug logs
 /*#define MC_DEBUG_LOG 1*/
 
@@ -64,34 +71,108 @@ struct MCParserConfig {
 
 	/** Marker is closed if there was no pixel for it in the last 50 rows */
 	unsigned int closeDiffY = 20;
+
+	/**
+	 * CLOSING SWEEP: at most this many marker centers are visited at every endLine() to close the ones
+	 * that got older than closeDiffY. The sweep continues where it stopped at the earlier scanline, so the
+	 * stale centers that no 1D marker walks over are closed too and do not lengthen the active list.
+	 * Zero turns off the sweep (centers are then only closed by the 1D markers and at endImageFrame()).
+	 * Rem.: Off by default - an earlier close can change the confidence of a marker by one (8 is a good budget).
+	 */
+	unsigned int closeSweepBudget = 0;
+
+	/**
+	 * BATCHED MERGE: the full scanline bulk feeds (processLine(..), processFrame(..), processView(..) and the
+	 * scanlines of the subsampled frame feed) collect the 1D markers of the scanline into a stack array and
+	 * merge them with the marker centers in one pass before endLine() - instead of one (not inlined) call per
+	 * 1D marker. Gives the very same results - only faster when there are many 1D markers per scanline.
+	 * Rem.: The per-pixel next(..) and merge1DMarker(..) always merge online.
+	 */
+	bool batchMerge = false;
+
+	/**
+	 * COMPACTION: at every compactCheckLines-th endLine() the marker centers are checked for being scattered in
+	 * the memory of their list (by the inserts and unlinks) and they are rewritten into their left-to-right
+	 * order when more than compactFragmentationPercent of their links jump around (see FastForwardList::compact).
+	 * This keeps the walk of the centers a sequential memory access. Zero compactCheckLines turns it off.
+	 * Rem.: Only the memory layout changes - the found markers are always the very same.
+	 */
+	unsigned int compactCheckLines = 16;
+	/** See compactCheckLines */
+	unsigned int compactFragmentationPercent = 25;
+	/** Shorter lists are not compacted: they stay in the L1 cache and are walked just as fast (see ffl_bench) */
+	unsigned int compactMinLength = 256;
+
+	/**
+	 * SCANLINE SUBSAMPLING: the bulk frame feeds (processFrame(..) and processView(..)) only parse every
+	 * rowStride-th scanline fully while searching - markers span many scanlines, so they are hit anyways.
+	 * One means every scanline is parsed (no subsampling). See densifyPadding for the skipped scanlines!
+	 */
+	unsigned int rowStride = 1;
+
+	/**
+	 * Half width of the segments of the skipped scanlines that are filled in around the (not ignored) 1D markers
+	 * of the neighbouring strided scanlines. This restores the full vertical precision of the found markers.
+	 * Zero turns off the densification: ignoreWhenSignalCountLessThan and closeDiffY are then adjusted to the
+	 * stride (only one scanline in rowStride can give a signal).
+	 * BEWARE: Must be bigger than the radius of the markers plus the homogenous prefix that
+	 *         the Hoparser needs before a marker (see HoparserSetup::markStartPrefixHomoLenMin)!
+	 */
+	unsigned int densifyPadding = 160;
+};
+
+/**
+ * Base for compile-time configurations (see the CONFIG template parameter of MCParser)
+ * Derive from this and hide the setups you want to change - the others are the defaults:
+ *
+ *     struct FixedCamConfig : public CompileTimeConfig {
+ *         static constexpr HoparserSetup hoparserSetup() {
+ *             HoparserSetup hps;
+ *             hps.markStartPrefixHomoLenMin = 10;
+ *             return hps;
+ *         }
+ *     };
+ *
+ *     MCParser<uint8_t, int, DefaultAttrition, DefaultHomerPrecision, FixedCamConfig> mcp;
+ */
+struct CompileTimeConfig {
+	static constexpr bool isCompileTime = true;
+	static constexpr HomerSetup homerSetup() { return HomerSetup(); }
+	static constexpr LenAffectParams lenAffectParams() { return LenAffectParams(); }
+	static constexpr HoparserSetup hoparserSetup() { return HoparserSetup(); }
+	static constexpr MCParserConfig mcParserConfig() { return MCParserConfig(); }
 };
 
 /**
  * Defines a marker center we are currently suspecting
+ *
+ * Rem.: COORD is the type of the coordinates and the signal count, CONF is that of the confidences.
+ *       See MarkerCenter and CompactMarkerCenter below - the latter is for frames up to 65535 pixels.
  */
-struct MarkerCenter {
+template<typename COORD, typename CONF>
+struct BasicMarkerCenter {
 public:
 	// Always the X coordinate of the last-line center from hoparser
 	// !! SHOULD BE FIRST!!!
-	unsigned int lastX;
+	COORD lastX;
 	// Mininal X
-	unsigned int minX;
+	COORD minX;
 	// Maximal X
-	unsigned int maxX;
+	COORD maxX;
 	// Initialized when the marker centerline is "started"
-	unsigned int minY;
+	COORD minY;
 	// Incremented whenever the marker centerline is "extended"
-	unsigned int maxY;
+	COORD maxY;
 	// Number of "elements" below each other that constitute a center
-	unsigned int signalCount;
+	COORD signalCount;
 	// Confidence between minY and maxY
-	int confidence;
+	CONF confidence;
 
 	/** Construct with un-initialized data */
-	MarkerCenter() { }
+	BasicMarkerCenter() { }
 
 	/** Construct with data to "start" a marker centerline right now */
-	MarkerCenter(unsigned int x, unsigned int y, uint8_t order) {
+	BasicMarkerCenter(unsigned int x, unsigned int y, uint8_t order) {
 		// This might load cache of next object
 		// This ensures faster addition nearby each in some cases
 		// due to bogus and random cache optimizations :D
@@ -122,7 +203,9 @@ public:
 	 * Returns the calculated temporal confidence value after the skip.
 	 */
 	inline unsigned int skipUpd() {
-		return --confidenceTemp;
+		// Rem.: Saturates (only ever happens with a narrow CONF)
+		if(confidenceTemp > std::numeric_limits<CONF>::min()) --confidenceTemp;
+		return confidenceTemp;
 	}
 
 	/**
@@ -173,7 +256,7 @@ public:
 		printf("Ext??? ");
 #endif // MC_DEBUG_LOG 
 		// lastX access loads cache properly
-		if(abs(lastX - x) > deltaDiffMax) {
+		if(abs((int)(lastX - x)) > deltaDiffMax) {
 			// Skipped
 			skipUpd();
 #ifdef MC_DEBUG_LOG 
@@ -202,7 +285,8 @@ public:
 		lastX = x;
 
 		// Update order counts
-		if(order <= MAX_ORDER) {
+		// Rem.: Saturating - otherwise the most common order of a very tall marker could wrap around to zero
+		if((order <= MAX_ORDER) && (ord[order - MIN_ORDER] < UINT8_MAX)) {
 			++ord[order - MIN_ORDER];
 		}
 
@@ -215,7 +299,7 @@ public:
 		maxY = y;
 
 		// Increase confidence counter
-		++confidenceTemp;
+		if(confidenceTemp < std::numeric_limits<CONF>::max()) ++confidenceTemp;
 		// Count how many markers we had (signal quality?)
 		++signalCount;
 
@@ -264,11 +348,21 @@ public:
 		};
 	}
 
+	/** Tells if the two centers are in the very same state (so they would behave the same from now on) */
+	inline bool operator==(const BasicMarkerCenter &other) const {
+		for(int i = 0; i < (1 + MAX_ORDER - MIN_ORDER); ++i) {
+			if(ord[i] != other.ord[i]) return false;
+		}
+		return (lastX == other.lastX) && (minX == other.minX) && (maxX == other.maxX)
+			&& (minY == other.minY) && (maxY == other.maxY) && (signalCount == other.signalCount)
+			&& (confidence == other.confidence) && (confidenceTemp == other.confidenceTemp);
+	}
+
 private:
 	// Rem.: marker.confidence is only updated with this when maxY is also updated!
 	// This is needed to have the real confidence value there, but we need
 	// a different variable for ending the marker center then. This is it.
-	int confidenceTemp;
+	CONF confidenceTemp;
 
 	// Number of order2s, order3s, order4s, order5s among per-scanline data
 	// counted in ord[0], ord[1], ord[2], ord[3] respectively
@@ -277,11 +371,88 @@ private:
 	uint8_t ord[1 + MAX_ORDER - MIN_ORDER];
 };
 
+/** The default marker center - works with any frame size */
+using MarkerCenter = BasicMarkerCenter<unsigned int, int>;
+
+/**
+ * Marker center with 16 bit coordinates and confidences (saturating) - for frames up to 65535 pixels wide and high.
+ * Much smaller than the MarkerCenter, so more of the suspected centers fit into the L1 cache (see the CENTER
+ * template parameter of the MCParser and footprint_bench). Gives the same markers on these frames.
+ */
+using CompactMarkerCenter = BasicMarkerCenter<uint16_t, int16_t>;
+
+/**
+ * A token as seen by the bulk APIs of the MCParser - only collected for debugging when asked for.
+ * Rem.: The markerX and order are only valid when foundMarker is true!
+ */
+struct DebugToken {
+	/** Position of the pixel that resulted in the token (or found marker) */
+	unsigned int x;
+	unsigned int y;
+	/** Same as NexRes::isToken and NexRes::foundMarker */
+	bool isToken;
+	bool foundMarker;
+	/** Center of the found 1D marker in the scanline */
+	int markerX;
+	/** Order of the found 1D marker */
+	int order;
+};
+
+/**
+ * Receives each Marker2D as soon as its MarkerCenter closes - see MCParser::setMarkerSink(..)
+ * Rem.: Plain function pointer and user data so that setting it never allocates - use makeMarkerSink(..)
+ *       to make one that calls any functor (lambda) that lives longer than the parser uses the sink.
+ */
+struct MarkerSink {
+	/** Called with the user data, the closed marker and the index of the scanline being parsed when it closed */
+	void (*emit)(void *userData, const Marker2D &marker, unsigned int row) = nullptr;
+
+	/** Given back in every emit(..) call */
+	void *userData = nullptr;
+};
+
+/** Makes a sink that calls f(marker, row) for every closed marker - only a pointer is kept to f! */
+template<typename F>
+inline MarkerSink makeMarkerSink(F &f) noexcept {
+	MarkerSink sink;
+	sink.emit = [](void *userData, const Marker2D &marker, unsigned int row) {
+		(*static_cast<F*>(userData))(marker, row);
+	};
+	sink.userData = &f;
+	return sink;
+}
+
+/**
+ * Length statistics of the list of the suspected (active) marker centers over a frame - see MCParser::getListStats()
+ * Useful to see that the list stays proportional to the visible markers (and the closing sweep keeps up).
+ */
+struct ActiveListStats {
+	/** Number of scanlines ended in the frame */
+	unsigned int lines = 0;
+	/** Longest active list at the end of a scanline */
+	unsigned int maxLength = 0;
+	/** Sum of the active list lengths at the ends of the scanlines */
+	size_t lengthSum = 0;
+	/** Number of centers closed by the closing sweep of endLine() - the others are closed by 1D markers */
+	unsigned int sweepClosed = 0;
+	/** Number of times the list got compacted (see MCParserConfig::compactCheckLines) */
+	unsigned int compactions = 0;
+
+	/** Average length of the active list at the ends of the scanlines */
+	inline double meanLength() const noexcept {
+		return (lines > 0) ? ((double)lengthSum / lines) : 0.0;
+	}
+};
+
 /**
  * Result of parsing marker centers in an image frame
  */
 struct ImageFrameResult{
-	/** Build using the found and properly closed MarkerCenters */
+	/**
+	 * Build using the found and properly closed MarkerCenters.
+	 * Rem.: Keep one result object and pass it to MCParser::endImageFrame(ImageFrameResult&) for every
+	 *       frame to reuse the storage of this vector (see there)!
+	 */
 	std::vector<Marker2D> markers;
 };
 
@@ -299,8 +470,12 @@ struct ImageFrameResult{
  *       and of course the tokenizer itself so this template can be
  *       used with more than one kind of tokenizer that provides
  *       per-scanline 1D marker positions. This enables experimenting!
+ * Rem.: LIST is the list of the suspected marker centers: FastForwardList or SoaFastForwardList (see ffl_bench)
+ * Rem.: CENTER is the suspected marker center: MarkerCenter or CompactMarkerCenter (see footprint_bench)
  */
-template<typename MT = uint8_t, typename CT = int, typename TOKENIZER = Hoparser<MT, CT>>
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition, typename PRECISION = DefaultHomerPrecision,
+	typename CONFIG = RuntimeConfig, typename TOKENIZER = Hoparser<MT, CT, ATTRITION, PRECISION, CONFIG>,
+	template<typename, int> class LIST = FastForwardList, typename CENTER = MarkerCenter>
 class MCParser {
 public:
 
@@ -313,14 +488,16 @@ public:
 
 	/** Create a markercenter-parser with the given configuration */
 	MCParser(MCParserConfig parserConfig) noexcept {
+		static_assert(!CONFIG::isCompileTime, "Setup of compile-time configured MCParser comes from its CONFIG!");
 		config = parserConfig;
 	}
 
 	/** Create a markercenter-parser with the given configurations - works only for Hoparser usage */
 	MCParser(MCParserConfig parserConfig, HoparserSetup hoparserSetup, HomerSetup homerSetup) noexcept {
+		static_assert(!CONFIG::isCompileTime, "Setup of compile-time configured MCParser comes from its CONFIG!");
 		config = parserConfig;
-		// TODO: ensure this works when other template parameters are provided
-		tokenizer = Hoparser<MT, CT>(homerSetup, hoparserSetup);
+		// TODO: ensure this works when other TOKENIZER template parameters are provided
+		tokenizer = Hoparser<MT, CT, ATTRITION, PRECISION, CONFIG>(homerSetup, hoparserSetup);
 	}
 
 	/** FEED OF THE NEXT MAGNITUDE: Returns the same data as HoParser - mostly debug-only return value! */
@@ -341,12 +518,105 @@ public:
 		return ret;
 	}
 
+	/**
+	 * Span-skipping: consumes the prefix of mags that surely produce no tokens (see Hoparser::nextSpan).
+	 * Returns the number of consumed magnitudes - send the one after them to next(..) and try again:
+	 *
+	 *     int i = 0;
+	 *     while(i < width) {
+	 *         i += mcp.nextSpan(row + i, width - i);
+	 *         if(i < width) mcp.next(row[i++]);
+	 *     }
+	 *
+	 * Rem.: This is only available when the TOKENIZER supports nextSpan(..) itself!
+	 */
+	inline int nextSpan(const MT *mags, int n) noexcept {
+		int consumed = tokenizer.nextSpan(mags, n);
+		x += consumed;
+		return consumed;
+	}
+
+	/**
+	 * BULK FEED OF A WHOLE SCANLINE: runs the whole chain on the row and then calls endLine().
+	 * Unlike next(..) there is no per-pixel result so the hot loop is kept tight (and spans are
+	 * skipped using nextSpan(..) too). Tokens are only collected when debugTokens is not null.
+	 * Rem.: This is only available when the TOKENIZER supports nextSpan(..) itself!
+	 */
+	inline void processLine(const MT *row, int width, std::vector<DebugToken> *debugTokens = nullptr) noexcept {
+		if(getConfig().batchMerge) {
+			if(LIKELY(debugTokens == nullptr)) {
+				processLineImpl<false, true>(row, width, debugTokens);
+			} else {
+				processLineImpl<true, true>(row, width, debugTokens);
+			}
+		} else {
+			if(LIKELY(debugTokens == nullptr)) {
+				processLineImpl<false, false>(row, width, debugTokens);
+			} else {
+				processLineImpl<true, false>(row, width, debugTokens);
+			}
+		}
+		endLine();
+	}
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME: calls processLine(..) for every row and returns endImageFrame().
+	 * The stride is the distance of the rows counted in MT elements (not bytes) - can be bigger than
+	 * the width. Tokens are only collected when debugTokens is not null (see processLine(..)).
+	 * Rem.: With MCParserConfig::rowStride > 1 the scanlines are subsampled (no debug tokens then)!
+	 */
+	inline const ImageFrameResult processFrame(const MT *base, int width, int height, int stride,
+			std::vector<DebugToken> *debugTokens = nullptr) noexcept {
+		processRows([base, stride](int j) { return base + (size_t)j * stride; }, width, height, debugTokens);
+		return endImageFrame();
+	}
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME INTO A REUSED RESULT: same as processFrame(..) above, but the markers
+	 * are given back in "out" - see endImageFrame(ImageFrameResult&) for why this does not allocate.
+	 */
+	inline void processFrame(const MT *base, int width, int height, int stride, ImageFrameResult &out,
+			std::vector<DebugToken> *debugTokens = nullptr) noexcept {
+		processRows([base, stride](int j) { return base + (size_t)j * stride; }, width, height, debugTokens);
+		endImageFrame(out);
+	}
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME FROM A VIEW: like processFrame(..) but the rows come from a view
+	 * that has width(), height() and row(j) - see PixelView in pixelviews.h for camera formats.
+	 */
+	template<typename VIEW>
+	inline const ImageFrameResult processView(VIEW &view, std::vector<DebugToken> *debugTokens = nullptr) noexcept {
+		processRows([&view](int j) { return view.row(j); }, view.width(), view.height(), debugTokens);
+		return endImageFrame();
+	}
+
+	/** BULK FEED OF A WHOLE FRAME FROM A VIEW INTO A REUSED RESULT: see processView(..) and processFrame(..) */
+	template<typename VIEW>
+	inline void processView(VIEW &view, ImageFrameResult &out, std::vector<DebugToken> *debugTokens = nullptr) noexcept {
+		processRows([&view](int j) { return view.row(j); }, view.width(), view.height(), debugTokens);
+		endImageFrame(out);
+	}
+
 	/**
 	 * Indicates that the line has ended and "next" pixels are on a following line.
 	 * Rem.: Lines should be normally of the same size otherwise the algorithm can fail!
 	 *       This is not a strict requirement, but no resizing will happen along the changes!
 	 */
 	inline void endLine() noexcept {
+		// Close the stale centers that no 1D marker walked over (bounded work per scanline)
+		if(getConfig().closeSweepBudget > 0) {
+			sweepClosing(getConfig().closeSweepBudget);
+		}
+		// Rem.: lastPos and listPos get invalid by a compaction, but they are set again after the newline anyways
+		if((getConfig().compactCheckLines > 0) && ((y % getConfig().compactCheckLines) == 0)) {
+			compactIfFragmented();
+		}
+		unsigned int listLength = (unsigned int)mcCurrentList.size();
+		++listStats.lines;
+		listStats.lengthSum += listLength;
+		if(listLength > listStats.maxLength) listStats.maxLength = listLength;
+
 		// Reset x book-keeping
 		x = 0;
 		// Increment y book-keeping
@@ -359,9 +629,22 @@ public:
 
 	/**
 	 * Ends the current image frame and returns all found 2D marker locations on the image.
-	 * Rem.: The returned reference is only valid until the next() function is called once again.
+	 * Rem.: This gives away the storage of the markers so the next frame allocates it again -
+	 *       use endImageFrame(ImageFrameResult&) in camera loops to avoid that!
 	 */
 	inline const ImageFrameResult endImageFrame() noexcept {
+		ImageFrameResult ret;
+		endImageFrame(ret);
+		return ret;
+	}
+
+	/**
+	 * Ends the current image frame and puts all found 2D marker locations on the image into "out".
+	 * Rem.: The earlier content of "out" is dropped, but its storage is kept and used for collecting
+	 *       the markers of the next frame (the two are swapped). Reusing the same "out" for every frame
+	 *       means no heap allocations at all after a few frames (when the marker counts stop growing).
+	 */
+	inline void endImageFrame(ImageFrameResult &out) noexcept {
 		// Add Marker2Ds from any still unclosed MarkerCenters
 		// This is necessary as things are only closed because of
 		// a Garbage collecting-like operation in the fastforwardlist
@@ -371,13 +654,14 @@ public:
 			auto currentCenter = mcCurrentList[readHead];
 			// Add the generated marker from it to the frame results
 			// Rem.: This adds poor quality markers too, but with small confidence
-			auto marker2d = currentCenter.constructMarker(config.ignoreWhenSignalCountLessThan);
+			auto marker2d = currentCenter.constructMarker(signalCountMin());
 			if(marker2d.order > 0) {
 				// negative order means that the signal count was too small for the threshold!
-				frameResult.markers.push_back(marker2d);
+				emitMarker(marker2d);
 			}
 			readHead = mcCurrentList.next(readHead);
 		}
+		sparseRows = false;
 
 		// Reset x book-keeping
 		x = 0;
@@ -390,192 +674,573 @@ public:
 		// Needed when it is not empty on the last scanline
 		// of the earlier frame!
 		mcCurrentList.reset();
+		sweepLast = NIL_POS;
+		lastListStats = listStats;
+		listStats = ActiveListStats();
 
-		// Reset result and return any earlier collected result
-		// This both resets the original variable
-		// and returns the collection of markers.
-		ImageFrameResult ret;
-		std::swap(frameResult, ret);
-		return std::move(ret);
+		// Hand out the collected result and take over the storage of the earlier one
+		// Rem.: clear() keeps the capacity so this is allocation-free
+		out.markers.clear();
+		std::swap(frameResult.markers, out.markers);
+	}
+
+	/**
+	 * MERGING ALREADY TOKENIZED DATA: feeds a 1D marker of the current scanline as if the tokenizer found it.
+	 * Call these in the increasing order of centerX for each scanline and call endLine() after the scanline.
+	 * Rem.: Useful when the scanlines are tokenized elsewhere (like on other threads) - see parallelmcparser.h
+	 */
+	inline void merge1DMarker(int centerX, int order) noexcept {
+		process1DMarker(centerX, order);
+	}
+
+	/**
+	 * Starts a new frame (dropping any state and result) with the given scanline as its first one.
+	 * Useful when only a horizontal band of the frame is parsed by this parser - see parallelmcparser.h
+	 */
+	inline void startFrameAt(unsigned int startY) noexcept {
+		x = 0;
+		y = startY;
+		afterNewLine = true;
+		mcCurrentList.reset();
+		sweepLast = NIL_POS;
+		listStats = ActiveListStats();
+		frameResult.markers.clear();
+		tokenizer.newLine();
+	}
+
+	/** Tells if the suspected marker centers are the very same as that of the other parser */
+	inline bool sameCenters(const MCParser &other) const noexcept {
+		// Rem.: The closing sweep must continue from the same center too - otherwise they would close differently
+		FFLPosition sweep = sweepLast;
+		FFLPosition otherSweep = other.sweepLast;
+		if(sweep.isNil() != otherSweep.isNil()) return false;
+		auto pos = mcCurrentList.head();
+		auto otherPos = other.mcCurrentList.head();
+		while(!pos.isNil() && !otherPos.isNil()) {
+			if(!(mcCurrentList[pos] == other.mcCurrentList[otherPos])) return false;
+			if((pos == sweep) != (otherPos == otherSweep)) return false;
+			pos = mcCurrentList.next(pos);
+			otherPos = other.mcCurrentList.next(otherPos);
+		}
+		return pos.isNil() && otherPos.isNil();
+	}
+
+	/**
+	 * Continues the frame from where the other parser is: takes over its suspected marker centers
+	 * and scanline position and adds its found markers (from the given index) to our results.
+	 * Rem.: Call this only between scanlines (right after endLine() calls)!
+	 */
+	inline void adoptFrom(const MCParser &other, size_t fromMarker = 0) noexcept {
+		mcCurrentList = other.mcCurrentList;
+		sweepLast = other.sweepLast;
+		x = 0;
+		y = other.y;
+		afterNewLine = true;
+		frameResult.markers.insert(frameResult.markers.end(),
+				other.frameResult.markers.begin() + fromMarker, other.frameResult.markers.end());
+	}
+
+	/** Number of pixels parsed by the last bulk frame feed - less than the frame when rowStride > 1 */
+	inline size_t getScannedPixels() const noexcept {
+		return scannedPixels;
+	}
+
+	/**
+	 * ONLINE MARKER EMISSION: the sink gets every marker of the frame results as soon as it is known - in the
+	 * same order as they are in the results and with the scanline index at that moment. Centers closing in
+	 * the middle of the frame are emitted right then (so downstream stages can start working while the rest
+	 * of the frame is still parsed), the still open ones are emitted in endImageFrame(..) with the frame height.
+	 * Rem.: Centers are closed when a later 1D marker walks over them in the list or the closing sweep of
+	 *       endLine() reaches them - so the emission happens somewhat later than closeDiffY scanlines after
+	 *       the marker (see MCParserConfig::closeSweepBudget). Pass MarkerSink() to turn off!
+	 * Rem.: The sink is called on the parsing thread in the middle of the scanline - keep it short.
+	 */
+	inline void setMarkerSink(MarkerSink markerSink) noexcept {
+		sink = markerSink;
+	}
+
+	/**
+	 * Length statistics of the active marker center list over the last ended frame (see endImageFrame(..))
+	 * Rem.: Only meaningful for frames parsed by this very parser - adoptFrom(..) does not merge them!
+	 */
+	inline const ActiveListStats& getListStats() const noexcept {
+		return lastListStats;
+	}
+
+	/** The number of markers found so far in the current frame (closed centers only) */
+	inline size_t foundMarkerCount() const noexcept {
+		return frameResult.markers.size();
+	}
+
+	/**
+	 * The configuration in use: the stored one for runtime configs - a constexpr value otherwise
+	 * Rem.: Use "decltype(auto)" or "const MCParserConfig&" for the result to not copy needlessly!
+	 */
+	inline decltype(auto) getConfig() const noexcept {
+		return selectConfig(std::integral_constant<bool, CONFIG::isCompileTime>());
 	}
 private:
 
+	/** The loop of processLine(..) - collecting debug tokens and batching the merge or not is decided compile-time */
+	template<bool DEBUG_TOKENS, bool BATCH>
+	inline void processLineImpl(const MT *row, int width, std::vector<DebugToken> *debugTokens) noexcept {
+		// The 1D markers of the scanline waiting for mergeBatch(..) - when batching
+		Line1DMarker batch[BATCH ? MC_LINE_BATCH_SIZE : 1];
+		int batchLen = 0;
+		int i = 0;
+		while(i < width) {
+			// Skip the uneventful runs of the scanline - these never produce tokens
+			i += nextSpan(row + i, width - i);
+			if(i >= width) break;
+
+			// Rem.: Same as next(..) but without materializing the result when not debugging
+			auto ret = tokenizer.next(row[i]);
+			if(DEBUG_TOKENS && (ret.isToken || ret.foundMarker)) {
+				debugTokens->push_back(DebugToken{x, y, ret.isToken, ret.foundMarker,
+						ret.foundMarker ? tokenizer.getMarkerX() : 0,
+						ret.foundMarker ? tokenizer.getOrder() : 0});
+			}
+			if(LIKELY(!ret.foundMarker)) {
+				++x;
+			} else if(BATCH) {
+				batch[batchLen].centerX = tokenizer.getMarkerX();
+				batch[batchLen].order = tokenizer.getOrder();
+				++x;
+				// Rem.: A full batch is merged right away - this keeps the order of the 1D markers in the scanline
+				if(UNLIKELY(++batchLen == MC_LINE_BATCH_SIZE)) {
+					mergeBatch(batch, batchLen);
+					batchLen = 0;
+				}
+			} else {
+				process1DMarker();
+			}
+			++i;
+		}
+		if(BATCH && (batchLen > 0)) mergeBatch(batch, batchLen);
+	}
+
+	/** A 1D marker found by tokenizeSegment(..) */
+	struct Line1DMarker {
+		int centerX;
+		int order;
+	};
+
+	/** A filled in part of a skipped scanline: [x0, x1) */
+	struct Segment {
+		int x0;
+		int x1;
+	};
+
+	/** The bulk frame feeds without ending the frame - ROWS returns the row pointer for a row index */
+	template<typename ROWS>
+	inline void processRows(ROWS rows, int width, int height, std::vector<DebugToken> *debugTokens) noexcept {
+		if(LIKELY(getConfig().rowStride <= 1)) {
+			for(int j = 0; j < height; ++j) {
+				processLine(rows(j), width, debugTokens);
+			}
+			scannedPixels = (size_t)width * height;
+		} else {
+			processSubsampled(rows, width, height);
+		}
+	}
+
+	/**
+	 * Parses every rowStride-th scanline fully and the skipped ones only around the still open marker centers
+	 * and the 1D markers of the next strided scanline (or not at all when densifyPadding is zero). The strided
+	 * scanline below is tokenized before the skipped ones so its 1D markers are known in advance - then all of
+	 * them are merged in the order of the scanlines so the marker centers are built just like for a full frame.
+	 */
+	template<typename ROWS>
+	void NOINLINE processSubsampled(ROWS rows, int width, int height) noexcept {
+		const int rowStride = (int)getConfig().rowStride;
+		const bool densify = (getConfig().densifyPadding > 0);
+		sparseRows = !densify;
+		scannedPixels = 0;
+		if(height <= 0) return;
+
+		lineMarkers.clear();
+		tokenizeSegment(rows(0), 0, width, lineMarkers);
+		mergeLine(lineMarkers);
+		for(int ys = 0; ys < height; ys += rowStride) {
+			const int next = ys + rowStride;
+			aheadMarkers.clear();
+			if(next < height) tokenizeSegment(rows(next), 0, width, aheadMarkers);
+
+			const int last = (next < height) ? next : height;
+			if(densify && (!mcCurrentList.isEmpty() || !aheadMarkers.empty())) {
+				buildSegments(width);
+				for(int j = ys + 1; j < last; ++j) {
+					segmentMarkers.clear();
+					const MT *row = rows(j);
+					for(const auto &s : segments) {
+						tokenizeSegment(row, s.x0, s.x1, segmentMarkers);
+					}
+					mergeLine(segmentMarkers);
+				}
+			} else {
+				for(int j = ys + 1; j < last; ++j) {
+					endLine();
+				}
+			}
+
+			if(next < height) mergeLine(aheadMarkers);
+			std::swap(lineMarkers, aheadMarkers);
+		}
+	}
+
+	/** Runs the tokenizer on row[x0..x1) as if that was a whole scanline - adds the found 1D markers to "to" */
+	inline void tokenizeSegment(const MT *row, int x0, int x1, std::vector<Line1DMarker> &to) noexcept {
+		tokenizer.newLine();
+		int i = x0;
+		while(i < x1) {
+			i += tokenizer.nextSpan(row + i, x1 - i);
+			if(i >= x1) break;
+			if(UNLIKELY(tokenizer.next(row[i]).foundMarker)) {
+				to.push_back(Line1DMarker{x0 + tokenizer.getMarkerX(), tokenizer.getOrder()});
+			}
+			++i;
+		}
+		scannedPixels += (size_t)(x1 - x0);
+	}
+
+	/** Merges the 1D markers of a scanline (in the order of their x) then ends the scanline */
+	inline void mergeLine(const std::vector<Line1DMarker> &markers) noexcept {
+		if(getConfig().batchMerge) {
+			if(!markers.empty()) mergeBatch(markers.data(), (int)markers.size());
+		} else {
+			for(const auto &m : markers) {
+				process1DMarker(m.centerX, m.order);
+			}
+		}
+		endLine();
+	}
+
+	/** Builds the (sorted, not overlapping) segments to fill in around the open marker centers and the next 1D markers */
+	inline void buildSegments(int width) noexcept {
+		const int padding = (int)getConfig().densifyPadding;
+		const int ignoreOrder = (int)getConfig().ignoreOrderSmallerThan;
+		segments.clear();
+		// The still open marker centers (this includes the ones of the strided scanline above)
+		for(auto pos = mcCurrentList.head(); !pos.isNil(); pos = mcCurrentList.next(pos)) {
+			CENTER &center = mcCurrentList[pos];
+			if(!center.shouldClose(y, closeDiff())) {
+				addSegment((int)center.minX - padding, (int)center.maxX + padding + 1, width);
+			}
+		}
+		// The ones that will be opened or extended by the strided scanline below
+		for(const auto &m : aheadMarkers) {
+			if(m.order >= ignoreOrder) addSegment(m.centerX - padding, m.centerX + padding + 1, width);
+		}
+		std::sort(segments.begin(), segments.end(), [](const Segment &a, const Segment &b) {
+			return a.x0 < b.x0;
+		});
+		size_t n = 0;
+		for(size_t i = 0; i < segments.size(); ++i) {
+			if((n > 0) && (segments[i].x0 <= segments[n - 1].x1)) {
+				if(segments[i].x1 > segments[n - 1].x1) segments[n - 1].x1 = segments[i].x1;
+			} else {
+				segments[n++] = segments[i];
+			}
+		}
+		segments.resize(n);
+	}
+
+	/** Adds the marker to the frame results and sends it to the sink (if any) */
+	inline void emitMarker(const Marker2D &marker) noexcept {
+		frameResult.markers.push_back(marker);
+		if(sink.emit != nullptr) sink.emit(sink.userData, marker, y);
+	}
+
+	/** Adds the marker of the closed center to the results - unless its signal count is too small */
+	inline void emitClosed(const CENTER &center) noexcept {
+		// Rem.: This adds poor quality markers too, but with small confidence
+		auto marker2d = center.constructMarker(signalCountMin());
+		if(marker2d.order > 0) {
+			// negative order means that the signal count was too small for the threshold!
+			emitMarker(marker2d);
+		}
+	}
+
+	/**
+	 * Visits at most "budget" centers after sweepLast and closes the ones that should be closed at this scanline.
+	 * Starts again from the head when the end of the list is reached (at the next scanline) - this way every
+	 * center is visited in every ceil(listLength / budget) scanlines even if no 1D marker ever walks over it.
+	 */
+	void NOINLINE sweepClosing(unsigned int budget) noexcept {
+		FFLPosition pos = sweepLast.isNil() ? mcCurrentList.head() : mcCurrentList.next(sweepLast);
+		while((budget > 0) && !pos.isNil()) {
+			CENTER &center = mcCurrentList[pos];
+			if(center.shouldClose(y, closeDiff())) {
+				emitClosed(center);
+				pos = mcCurrentList.unlinkAfter(sweepLast);
+				++listStats.sweepClosed;
+			} else {
+				sweepLast = pos;
+				pos = mcCurrentList.next(pos);
+			}
+			--budget;
+		}
+		if(pos.isNil()) sweepLast = NIL_POS;
+	}
+
+	/** Rewrites the centers into their left-to-right order in the list memory if they got too scattered */
+	void NOINLINE compactIfFragmented() noexcept {
+		unsigned int length = (unsigned int)mcCurrentList.size();
+		if((length < 2) || (length < getConfig().compactMinLength)) return;
+		unsigned int fragmentation = (unsigned int)mcCurrentList.fragmentation();
+		if((fragmentation * 100) > (getConfig().compactFragmentationPercent * length)) {
+			// The closing sweep continues from the same center
+			sweepLast = mcCurrentList.compact(sweepLast);
+			++listStats.compactions;
+		}
+	}
+
+	/** Adds the [x0, x1) segment clamped to the scanline */
+	inline void addSegment(int x0, int x1, int width) noexcept {
+		segments.push_back(Segment{(x0 < 0) ? 0 : x0, (x1 > width) ? width : x1});
+	}
+
+	/** ignoreWhenSignalCountLessThan in effect: divided by the stride when the skipped scanlines are not filled in */
+	inline unsigned int signalCountMin() const noexcept {
+		if(LIKELY(!sparseRows)) return getConfig().ignoreWhenSignalCountLessThan;
+		unsigned int k = getConfig().rowStride;
+		unsigned int n = (getConfig().ignoreWhenSignalCountLessThan + k - 1) / k;
+		return (n < 1) ? 1 : n;
+	}
+
+	/** closeDiffY in effect: at least the stride when the skipped scanlines are not filled in */
+	inline unsigned int closeDiff() const noexcept {
+		if(LIKELY(!sparseRows)) return getConfig().closeDiffY;
+		return (getConfig().closeDiffY < getConfig().rowStride) ? getConfig().rowStride : getConfig().closeDiffY;
+	}
+
+	/** Runtime configuration: the stored one */
+	inline const MCParserConfig& selectConfig(std::false_type) const noexcept {
+		return config;
+	}
+
+	/** Compile-time configuration: folds into immediates */
+	inline constexpr MCParserConfig selectConfig(std::true_type) const noexcept {
+		return CONFIG::mcParserConfig();
+	}
+
+	/** Processes the 1D marker that the tokenizer has just found */
+	inline void process1DMarker() noexcept {
+		process1DMarker(tokenizer.getMarkerX(), tokenizer.getOrder());
+	}
+
 	// Rem.: Not inlined because this is the rare part and is only here to make the hot-spot more cache friendly!
-	NexRes NOINLINE process1DMarker() {
-		// get marker data
-		int centerX = tokenizer.getMarkerX();
-		auto order = tokenizer.getOrder();
-		if(config.ignoreOrderSmallerThan <= order) {
+	void NOINLINE process1DMarker(int centerX, int order) noexcept {
+		if(getConfig().ignoreOrderSmallerThan <= order) {
 			// If not too small to ignore, process it!
+			merge(centerX, order);
+		}
+		++x;
+	}
 
-			// PRE-READ TECHNIQUE
-			// ==================
-			//
-			// Advance list position when we are the first test on a newline
-			// And the list is not empty. The second handles cases when the
-			// list is completely empty
-			if(afterNewLine) {
-				// If the list is empty stays: lastPos == listPos == NIL_POS
-				// If it already has data, we step on the valid data and not be NIL
-				// Rem.: The above if ensures that we are on the beginning NIL_POS
-				if((mcCurrentList.isEmpty())) {
-					// Reset state
-					listPos = NIL_POS;
-					lastPos = NIL_POS;
-				} else {
-					lastPos = NIL_POS;
-					listPos = mcCurrentList.head();
-				}
-				/*
-				else  NIL_POS and NIL_POS for both
-				*/
+	/**
+	 * The batched merge: one pass over the 1D markers of the scanline and the marker centers - both ordered by X.
+	 * Same as process1DMarker(..) for each of them (see merge(..) for the two lists), but the list positions and
+	 * the limits stay in registers for the whole batch - no call, no newline check and no config read per 1D marker.
+	 * The center after the current one is prefetched: the walk mostly steps onto it with the next 1D marker.
+	 */
+	void NOINLINE mergeBatch(const Line1DMarker *markers, int count) noexcept {
+		const unsigned int ignoreOrder = getConfig().ignoreOrderSmallerThan;
+		const unsigned int closeDiffY = closeDiff();
+		const unsigned int deltaDiffMax = getConfig().deltaDiffMax;
+		const unsigned int widthDiffMax = getConfig().widthDiffMax;
+		FFLPosition last = lastPos;
+		FFLPosition pos = listPos;
+		if(afterNewLine) {
+			// Rem.: Same as the PRE-READ of merge(..)
+			last = NIL_POS;
+			pos = mcCurrentList.isEmpty() ? NIL_POS : mcCurrentList.head();
+			afterNewLine = false;
+		}
+		for(int i = 0; i < count; ++i) {
+			if(ignoreOrder <= (unsigned int)markers[i].order) {
+				mcCurrentList.prefetch(pos.isNil() ? NIL_POS : mcCurrentList.next(pos));
+				mergeStep(markers[i].centerX, markers[i].order, last, pos, closeDiffY, deltaDiffMax, widthDiffMax);
+			}
+		}
+		lastPos = last;
+		listPos = pos;
+	}
 
-				// Indicate that we have handled the flag
-				afterNewLine = false;
+	/** The merge step of a 1D marker of the current scanline (see process1DMarker(..)) */
+	inline void merge(int centerX, int order) noexcept {
+		// PRE-READ TECHNIQUE
+		// ==================
+		//
+		// Advance list position when we are the first test on a newline
+		// And the list is not empty. The second handles cases when the
+		// list is completely empty
+		if(afterNewLine) {
+			// If the list is empty stays: lastPos == listPos == NIL_POS
+			// If it already has data, we step on the valid data and not be NIL
+			// Rem.: The above if ensures that we are on the beginning NIL_POS
+			if((mcCurrentList.isEmpty())) {
+				// Reset state
+				listPos = NIL_POS;
+				lastPos = NIL_POS;
+			} else {
+				lastPos = NIL_POS;
+				listPos = mcCurrentList.head();
 			}
+			/*
+			else  NIL_POS and NIL_POS for both
+			*/
 
-			// AFTER THIS POINT WE ARE IN THE INVARIANT!
-			// =========================================
-			//
-			// The best way to imagine this is to imagine always two lists:
-			// - A list of already suspected marker centers up until the last scanline
-			// - And a list of "1D markers at this scanline"
-			//
-			// These two lists are ordered by the x-coordinate (the first is ordered by
-			// its FIRST "lastX") and now in this place we are processing them to make a
-			// vertical parsing. If we would have these two lists at every scanline end
-			// then we could go through both of them and update the first list with the 
-			// latter new line data list.
-			//
-			// In reality however this is an on-line algorithm so there are no two
-			// seperate lists - just this "next(..)" function that gets the pixels
-			// by some provider as a source and the list about what we think where
-			// the markers center lines are! The existing list is the one we named
-			// the "first" above and we are ourselves in the iterator of the other
-			// list actually: we do that second one on-the-fly without collecting.
-			// At the first moment we had to move the "first" list to a valid pos
-			// if that is possible (otherwise just keep listPos, lastPos at NIL_POS
-			// if that was possible as next(..) call indicates there is a valid
-			// suspected pixel in this scanline! (see marker1_eval test app for
-			// these green pixels when you are clicking in that application).
-			// 
-			// Rem.: This is basically a two-variabled-one-valued elementwise
-			//       processing algorithm for unification updates of the list.
-			//       The difference is that this is an "online" working version.
-			//       (*): In Hungarian, this special case is an "Időszerűsítés".
-
-			// Add this new token we have found as a new marker centerline or
-			// extend an already existing marker centerline! Loop until processed.
-			bool tokenProcessed = false;
-			// This while loop search the position to extend or to insert and do that
-			while(!tokenProcessed) {
-				if(listPos.isNil()) {
-					// End of list is reached and the token is not processed yet.
-					// In this case we need to add it to the end of the list right
-					// after the last list Position. We need to insert at the last
-					// valid position - we cannot insert at a NIL position as that
-					// means insertion at the head - the case of empty list is 
-					// handled here too and exactly that way as you can see!
-					//
-					// Increment position!
-					// Rem.: Needed otherwise we could stuck in this 'if' for the
-					//       scanline that added the first marker for us!
-					// Rem.: In the current implementation we "let" the next token
-					//       to extend the directly previous if they are so close
-					//       in the very same scanline which seems positive!
-					listPos = mcCurrentList.insertAfter(
-							std::move(MarkerCenter(centerX, y, order)),
-							lastPos);
-					tokenProcessed = true;
+			// Indicate that we have handled the flag
+			afterNewLine = false;
+		}
+
+		// AFTER THIS POINT WE ARE IN THE INVARIANT!
+		// =========================================
+		//
+		// The best way to imagine this is to imagine always two lists:
+		// - A list of already suspected marker centers up until the last scanline
+		// - And a list of "1D markers at this scanline"
+		//
+		// These two lists are ordered by the x-coordinate (the first is ordered by
+		// its FIRST "lastX") and now in this place we are processing them to make a
+		// vertical parsing. If we would have these two lists at every scanline end
+		// then we could go through both of them and update the first list with the 
+		// latter new line data list.
+		//
+		// In reality however this is an on-line algorithm so there are no two
+		// seperate lists - just this "next(..)" function that gets the pixels
+		// by some provider as a source and the list about what we think where
+		// the markers center lines are! The existing list is the one we named
+		// the "first" above and we are ourselves in the iterator of the other
+		// list actually: we do that second one on-the-fly without collecting.
+		// At the first moment we had to move the "first" list to a valid pos
+		// if that is possible (otherwise just keep listPos, lastPos at NIL_POS
+		// if that was possible as next(..) call indicates there is a valid
+		// suspected pixel in this scanline! (see marker1_eval test app for
+		// these green pixels when you are clicking in that application).
+		// 
+		// Rem.: This is basically a two-variabled-one-valued elementwise
+		//       processing algorithm for unification updates of the list.
+		//       The difference is that this is an "online" working version.
+		//       (*): In Hungarian, this special case is an "Időszerűsítés".
+		mergeStep(centerX, order, lastPos, listPos, closeDiff(), getConfig().deltaDiffMax, getConfig().widthDiffMax);
+	}
+
+	/**
+	 * Extends the center at listPos with the 1D marker or inserts a new one before it - closing and stepping over
+	 * the centers on the left of the 1D marker. The positions are given so the batched merge keeps them in registers.
+	 */
+	inline void mergeStep(int centerX, int order, FFLPosition &lastPos, FFLPosition &listPos,
+			unsigned int closeDiffY, unsigned int deltaDiffMax, unsigned int widthDiffMax) noexcept {
+		// Add this new token we have found as a new marker centerline or
+		// extend an already existing marker centerline! Loop until processed.
+		bool tokenProcessed = false;
+		// This while loop search the position to extend or to insert and do that
+		while(!tokenProcessed) {
+			if(listPos.isNil()) {
+				// End of list is reached and the token is not processed yet.
+				// In this case we need to add it to the end of the list right
+				// after the last list Position. We need to insert at the last
+				// valid position - we cannot insert at a NIL position as that
+				// means insertion at the head - the case of empty list is 
+				// handled here too and exactly that way as you can see!
+				//
+				// Increment position!
+				// Rem.: Needed otherwise we could stuck in this 'if' for the
+				//       scanline that added the first marker for us!
+				// Rem.: In the current implementation we "let" the next token
+				//       to extend the directly previous if they are so close
+				//       in the very same scanline which seems positive!
+				listPos = mcCurrentList.insertAfter(
+						std::move(CENTER(centerX, y, order)),
+						lastPos);
+				tokenProcessed = true;
 #ifdef MC_DEBUG_LOG
 printf("+(%d,%d) ", centerX, y);
 #endif // MC_DEBUG_LOG
-				} else {
-					// Compare if we can merge the next()-ed element into the list
-					// position element... For this we better get a reference to it
-					MarkerCenter &currentCenter = mcCurrentList[listPos];
-
-					bool extendedIt = false;
-					if(!currentCenter.shouldClose(y, config.closeDiffY)) {
-						// Try extending the existing element
-						// This is a NO-OP when we cannot extend it
-						extendedIt = currentCenter.tryExtend(
-								centerX, y, order, 
-								config.deltaDiffMax, config.widthDiffMax);
-					}
+			} else {
+				// Compare if we can merge the next()-ed element into the list
+				// position element... For this we better get a reference to it
+				CENTER &currentCenter = mcCurrentList[listPos];
 
-					// See if we succeeded or not
-					if(extendedIt) {
-						// Because if we did, we processed this token:
-						// Both the lists moves and the user can provide next()
-						// so if there would be two lists, we would move with both
-						// and in this case we move the current list and exit the
-						// loop so that the next() function can be called with the
-						// next token-pixel that is a marker center somewhere...
-						// These both happen in an x-ordered way!
-						tokenProcessed = true;
-						lastPos = listPos;
-						listPos = mcCurrentList.next(listPos);
+				bool extendedIt = false;
+				if(!currentCenter.shouldClose(y, closeDiffY)) {
+					// Try extending the existing element
+					// This is a NO-OP when we cannot extend it
+					extendedIt = currentCenter.tryExtend(
+							centerX, y, order, 
+							deltaDiffMax, widthDiffMax);
+				}
+
+				// See if we succeeded or not
+				if(extendedIt) {
+					// Because if we did, we processed this token:
+					// Both the lists moves and the user can provide next()
+					// so if there would be two lists, we would move with both
+					// and in this case we move the current list and exit the
+					// loop so that the next() function can be called with the
+					// next token-pixel that is a marker center somewhere...
+					// These both happen in an x-ordered way!
+					tokenProcessed = true;
+					lastPos = listPos;
+					listPos = mcCurrentList.next(listPos);
 #ifdef MC_DEBUG_LOG
 printf("E(%d,%d) ", centerX, y);
 #endif // MC_DEBUG_LOG
-					} else {
-						// If we did not succeed, we need to see if the element
-						// is so much before the one in the earlier list that
-						// it should be added as a new element at the current
-						// lastPos insertion position or not:
-						if(currentCenter.getRightMostCurrentAcceptableX(config.deltaDiffMax, config.widthDiffMax)
-								> centerX) {
-							// Completely new suspected marker - in the middle of the list
-							// Rem.: We know we need to insert this here and there will be no list position
-							//       to extend, because the list is ordered by the 'x' coordinate and next()
-							//       is called also in an ordered way. Because of insertion, the list also
-							//       kept ordered now so later iterations and calls to next() work as well!
-							// 
-							// Increment is needed to keep invariant that lastPost is literally the position 
-							// "before" the listpos. Because of the above insertion it would be not true anymore!
-							lastPos = mcCurrentList.insertAfter(
-									std::move(MarkerCenter(centerX, y, order)),
-									lastPos); // Rem.: lastPos insertion is needed as we insert BEFORE listPos
-							// Mark this token as processed
-							// Rem.: We should not move with the list iteraor as the next time of the next(..)
-							//       call might return extension/continuation of what is under the head now!
-							tokenProcessed = true;
+				} else {
+					// If we did not succeed, we need to see if the element
+					// is so much before the one in the earlier list that
+					// it should be added as a new element at the current
+					// lastPos insertion position or not:
+					if(currentCenter.getRightMostCurrentAcceptableX(deltaDiffMax, widthDiffMax)
+							> centerX) {
+						// Completely new suspected marker - in the middle of the list
+						// Rem.: We know we need to insert this here and there will be no list position
+						//       to extend, because the list is ordered by the 'x' coordinate and next()
+						//       is called also in an ordered way. Because of insertion, the list also
+						//       kept ordered now so later iterations and calls to next() work as well!
+						// 
+						// Increment is needed to keep invariant that lastPost is literally the position 
+						// "before" the listpos. Because of the above insertion it would be not true anymore!
+						lastPos = mcCurrentList.insertAfter(
+								std::move(CENTER(centerX, y, order)),
+								lastPos); // Rem.: lastPos insertion is needed as we insert BEFORE listPos
+						// Mark this token as processed
+						// Rem.: We should not move with the list iteraor as the next time of the next(..)
+						//       call might return extension/continuation of what is under the head now!
+						tokenProcessed = true;
 #ifdef MC_DEBUG_LOG
 printf("N(%d,%d) ", centerX, y);
 #endif // MC_DEBUG_LOG
-						} else { // Rem.: This else is necessary or we would need to step with the lastPos too!
-							// See if things indicate we need to close the earlier found stuff
-							if(currentCenter.shouldClose(y, config.closeDiffY)) {
-								// Add the generated marker from it to the frame results
-								// Rem.: This adds poor quality markers too, but with small confidence
-								auto marker2d = currentCenter.constructMarker(config.ignoreWhenSignalCountLessThan);
-								if(marker2d.order > 0) {
-									// negative order means that the signal count was too small for the threshold!
-									frameResult.markers.push_back(marker2d);
-								}
-
-								// Close / Unlink the added one as it is considered to be closed!
-								// Rem.: We need to update list position to a valid position!
-								// Rem.: lastPos keeps to be valid too
-								listPos = mcCurrentList.unlinkAfter(lastPos);
+					} else { // Rem.: This else is necessary or we would need to step with the lastPos too!
+						// See if things indicate we need to close the earlier found stuff
+						if(currentCenter.shouldClose(y, closeDiffY)) {
+							// Add the generated marker from it to the frame results
+							emitClosed(currentCenter);
+
+							// The closing sweep must not continue from an unlinked center
+							if(listPos == sweepLast) sweepLast = lastPos;
+
+							// Close / Unlink the added one as it is considered to be closed!
+							// Rem.: We need to update list position to a valid position!
+							// Rem.: lastPos keeps to be valid too
+							listPos = mcCurrentList.unlinkAfter(lastPos);
 #ifdef MC_DEBUG_LOG
 printf("C(%d,%d) ", centerX, y);
 #endif // MC_DEBUG_LOG
-							} else {
-								// If there was nothing to close, we just update our "iterators"
-								lastPos = listPos;
-								listPos = mcCurrentList.next(listPos);
+						} else {
+							// If there was nothing to close, we just update our "iterators"
+							lastPos = listPos;
+							listPos = mcCurrentList.next(listPos);
 #ifdef MC_DEBUG_LOG
 printf("*(%d,%d) ", centerX, y);
 #endif // MC_DEBUG_LOG
-							}
 						}
 					}
 				}
 			}
 		}
-		++x;
 	}
 	/**
 	 * We are collecting the results in this
@@ -583,7 +1248,7 @@ printf("*(%d,%d) ", centerX, y);
 	ImageFrameResult frameResult;
 
 	/**
-	 * Holds the current configuration values
+	 * Holds the current configuration values - only used with runtime CONFIG (see getConfig())
 	 */
 	MCParserConfig config;
 
@@ -601,10 +1266,32 @@ printf("*(%d,%d) ", centerX, y);
 	 * Always holds the currently suspected marker centers
 	 * This list is sorted by the X coordinate from left-to-right
 	 */
-	FastForwardList<MarkerCenter, MAX_MARKER_PER_SCANLINE> mcCurrentList;
+	LIST<CENTER, MAX_MARKER_PER_SCANLINE> mcCurrentList;
 
 	/** True when we are right after a newline - false otherwise */
 	bool afterNewLine = true;
+
+	/** True while a subsampled frame is parsed without filling in the skipped scanlines */
+	bool sparseRows = false;
+
+	/** Number of pixels parsed by the last bulk frame feed */
+	size_t scannedPixels = 0;
+
+	/** Gets the markers as soon as they close (when set) */
+	MarkerSink sink;
+
+	/** The closing sweep continues after this center at the next endLine() - NIL_POS means from the head */
+	FFLPosition sweepLast;
+
+	/** Active list statistics of the current frame and of the last ended one */
+	ActiveListStats listStats;
+	ActiveListStats lastListStats;
+
+	// Reused by the subsampled frame feed to avoid allocations
+	std::vector<Line1DMarker> lineMarkers;
+	std::vector<Line1DMarker> aheadMarkers;
+	std::vector<Line1DMarker> segmentMarkers;
+	std::vector<Segment> segments;
 };
 
 #endif // _FT_MC_PARSER_H
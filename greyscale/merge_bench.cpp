@@ -0,0 +1,117 @@
+// Benchmark of the batched merge of the MCParser (MCParserConfig::batchMerge) against the online merge
+// on generated frames packed with markers - where the per 1D marker merging work is the biggest.
+//
+// Two things are measured:
+// - whole frames with MCParser::processFrame(..) - merging online and batched
+// - merging only: the 1D markers of the frame are recorded once, then replayed with merge1DMarker(..)
+//   so the time of the tokenization does not hide the (online) merging - this shows its share of the frame.
+// The results must be the very same - MISMATCH is printed otherwise.
+
+#define FFL_NO_DEBUG_MODE 1 // no debug logging in the measured loops
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "mcparser.h"
+#include "testhelpers.h"
+
+// Repeat each measurement this many times for more stable measurements
+#define RUNS_PER_FRAME 10
+// The best of this many measurements is taken - the feeds are measured in turns
+#define ROUNDS 5
+
+/** The 1D markers of a frame: (centerX, order) pairs and the index after the last one of each scanline */
+struct Recorded {
+	std::vector<int> tokens;
+	std::vector<size_t> lineEnds;
+};
+
+/** Records the 1D markers of the frame */
+Recorded record(const std::vector<uint8_t> &grey, int width, int height) {
+	Recorded rec;
+	MCParser<> mcp;
+	for(int j = 0; j < height; ++j) {
+		for(int i = 0; i < width; ++i) {
+			if(mcp.next(grey[j * width + i]).foundMarker) {
+				rec.tokens.push_back(mcp.tokenizer.getMarkerX());
+				rec.tokens.push_back(mcp.tokenizer.getOrder());
+			}
+		}
+		mcp.endLine();
+		rec.lineEnds.push_back(rec.tokens.size());
+	}
+	return rec;
+}
+
+/** Replays the recorded 1D markers into the parser and ends the frame */
+void replay(MCParser<> &mcp, const Recorded &rec, ImageFrameResult &out) {
+	size_t from = 0;
+	for(size_t to : rec.lineEnds) {
+		for(size_t i = from; i < to; i += 2) {
+			mcp.merge1DMarker(rec.tokens[i], rec.tokens[i + 1]);
+		}
+		mcp.endLine();
+		from = to;
+	}
+	mcp.endImageFrame(out);
+}
+
+/** Returns the milliseconds per frame of f(result) */
+template<typename F>
+double measure(F f, ImageFrameResult &result) {
+	// Warm up
+	f(result);
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < RUNS_PER_FRAME; ++i) {
+		f(result);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / RUNS_PER_FRAME;
+}
+
+void benchFrame(int width, int height, int circleSize) {
+	// Packed with markers - every second row of them is shifted by a half
+	MarkerGrid grid;
+	grid.rowShift = circleSize;
+	grid.shiftPeriod = 2;
+	auto grey = generateMarkers(width, height, circleSize, grid);
+	auto rec = record(grey, width, height);
+
+	MCParserConfig config;
+	MCParser<> online(config);
+	config.batchMerge = true;
+	MCParser<> batched(config);
+
+	ImageFrameResult onlineResult;
+	ImageFrameResult batchedResult;
+	ImageFrameResult mergeResult;
+	double onlineMs = 1e9;
+	double batchedMs = 1e9;
+	double mergeMs = 1e9;
+	for(int round = 0; round < ROUNDS; ++round) {
+		onlineMs = std::min(onlineMs, measure([&](ImageFrameResult &r) {
+			online.processFrame(&grey[0], width, height, width, r);
+		}, onlineResult));
+		batchedMs = std::min(batchedMs, measure([&](ImageFrameResult &r) {
+			batched.processFrame(&grey[0], width, height, width, r);
+		}, batchedResult));
+		mergeMs = std::min(mergeMs, measure([&](ImageFrameResult &r) { replay(online, rec, r); }, mergeResult));
+	}
+	bool same = sameResults(onlineResult, batchedResult) && sameResults(onlineResult, mergeResult);
+	printf("%dx%d (%d markers, %.1f 1D markers per scanline): whole frame online %.3f ms, batched %.3f ms - speedup: %.2fx"
+			" - online merging only %.3f ms (%.1f%%)%s\n",
+			width, height, (int)onlineResult.markers.size(), rec.tokens.size() / 2.0 / height, onlineMs, batchedMs,
+			onlineMs / batchedMs, mergeMs, 100.0 * mergeMs / onlineMs, same ? "" : " MISMATCH!");
+}
+
+int main() {
+	printf("Benchmarking the batched merge of the MCParser against the online merge...\n");
+	benchFrame(1280, 720, 40);
+	benchFrame(1920, 1080, 40);
+	benchFrame(3840, 2160, 40);
+	return 0;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -7,12 +7,14 @@
 #define LIKELY(x)      x
 #define UNLIKELY(x)    x
 #define NOINLINE       __declspec(noinline)
+#define PREFETCH(p)    ((void)(p))
 #else
 	// Usual clang++ or g++ or even em++
 #define RESTRICT       __restrict__
 #define LIKELY(x)      __builtin_expect(!!(x), 1)
 #define UNLIKELY(x)    __builtin_expect(!!(x), 0)
 #define NOINLINE       __attribute__ ((noinline))
+#define PREFETCH(p)    __builtin_prefetch(p)
 #endif
 
 
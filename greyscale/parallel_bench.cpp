@@ -0,0 +1,71 @@
+// Scaling benchmark of the band-parallel ParallelMCParser and the two-stage
+// PipelinedMCParser: parses generated high resolution frames full of markers
+// with 1 to N threads and reports the time per frame and the speedup compared
+// to the serial MCParser::processFrame(..)
+//
+// Usage: parallelbench [N] - N defaults to the number of hardware threads
+
+#define FFL_NO_DEBUG_MODE 1 // no debug logging in the measured loops
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include "parallelmcparser.h"
+#include "testhelpers.h"
+
+// Repeat each frame this many times for more stable measurements
+#define RUNS_PER_FRAME 20
+
+/** Returns the milliseconds per frame */
+template<typename PARSER>
+double measure(PARSER &parser, const std::vector<uint8_t> &grey, int width, int height, int &markers) {
+	// Warm up (also spawns everything lazy)
+	markers = (int)parser.processFrame(&grey[0], width, height, width).markers.size();
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < RUNS_PER_FRAME; ++i) {
+		parser.processFrame(&grey[0], width, height, width);
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / RUNS_PER_FRAME;
+}
+
+void benchFrame(int width, int height, int maxThreads) {
+	// A sparser grid than the default one
+	MarkerGrid grid;
+	grid.xStep = grid.yStep = 3 * 40;
+	auto grey = generateMarkers(width, height, 40, grid);
+
+	int markers;
+	MCParser<> serial;
+	double serialMs = measure(serial, grey, width, height, markers);
+	printf("%dx%d (%d markers) serial: %.2f ms/frame\n", width, height, markers, serialMs);
+
+	for(int threads = 1; threads <= maxThreads; ++threads) {
+		ParallelMCParser<> parallel(threads);
+		int parallelMarkers;
+		double ms = measure(parallel, grey, width, height, parallelMarkers);
+		printf("%dx%d (%d markers) %2d thread(s): %.2f ms/frame - speedup: %.2fx (%d scanlines replayed)%s\n",
+				width, height, parallelMarkers, threads, ms, serialMs / ms, parallel.getReplayedLines(),
+				(parallelMarkers == markers) ? "" : " MISMATCH!");
+
+		PipelinedMCParser<> pipelined(threads);
+		ms = measure(pipelined, grey, width, height, parallelMarkers);
+		printf("%dx%d (%d markers) %2d thread(s) pipelined: %.2f ms/frame - speedup: %.2fx%s\n",
+				width, height, parallelMarkers, threads, ms, serialMs / ms,
+				(parallelMarkers == markers) ? "" : " MISMATCH!");
+	}
+}
+
+int main(int argc, char** argv) {
+	int maxThreads = (argc > 1) ? atoi(argv[1]) : ParallelMCParser<>::defaultThreadCount();
+	if(maxThreads < 1) maxThreads = 1;
+
+	printf("Benchmarking ParallelMCParser and PipelinedMCParser with 1..%d threads...\n", maxThreads);
+	benchFrame(1280, 720, maxThreads);
+	benchFrame(1920, 1080, maxThreads);
+	benchFrame(3840, 2160, maxThreads);
+	return 0;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
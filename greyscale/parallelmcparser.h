@@ -0,0 +1,494 @@
+#ifndef FASTTRACK_PARALLEL_MC_PARSER_H
+#define FASTTRACK_PARALLEL_MC_PARSER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "microshackz.h"
+#include "mcparser.h"
+
+/**
+ * Multi-threaded whole-frame parser: gives the very same ImageFrameResult as MCParser::processFrame(..)
+ *
+ * The frame is cut into horizontal bands - one for each thread - and every band is parsed by its own
+ * Hoparser+MCParser (the calling thread parses the first band, a small pool of threads the others).
+ * While parsing, the bands also record their 1D markers (centerX, order) per scanline. These records
+ * are cheap to re-merge so the bands are stitched together on the calling thread like this:
+ *
+ * - A "merger" MCParser holds the real state of the frame at the top of the next band.
+ * - The 1D markers of the band are replayed into the merger AND into a "shadow" parser that starts
+ *   empty on the first scanline of the band - just like the band parser did.
+ * - As soon as the MarkerCenters of the two are the same, the band parser (that did the same as the
+ *   shadow) behaves like the serial parser for the rest of the band: its markers found from that
+ *   scanline are taken and the merger adopts its MarkerCenters at the bottom of the band.
+ *
+ * Usually this happens after a few scanlines: when centers crossing the border got extended or closed.
+ * Rem.: When the centers never converge (like a closed center that is still waiting in the list because
+ *       nothing was found right from it) the whole band is replayed - still exact and only tokens are
+ *       touched in that case, the pixel work stays parallel.
+ *
+ * Template parameters are those of the MCParser.
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition, typename PRECISION = DefaultHomerPrecision,
+	typename CONFIG = RuntimeConfig>
+class ParallelMCParser {
+public:
+	/** The serial parser type used for the bands */
+	using Parser = MCParser<MT, CT, ATTRITION, PRECISION, CONFIG>;
+
+	/** Create a parallel parser with the given number of threads (including the calling one) and default configuration */
+	ParallelMCParser(int threadCount = defaultThreadCount()) noexcept
+		: bandCount((threadCount < 1) ? 1 : threadCount) {
+		bands.resize(bandCount);
+		startWorkers();
+	}
+
+	/** Create a parallel parser with the given number of threads (including the calling one) and configurations */
+	ParallelMCParser(int threadCount, MCParserConfig parserConfig, HoparserSetup hoparserSetup, HomerSetup homerSetup) noexcept
+		: bandCount((threadCount < 1) ? 1 : threadCount),
+		  merger(parserConfig, hoparserSetup, homerSetup),
+		  shadow(parserConfig, hoparserSetup, homerSetup) {
+		bands.reserve(bandCount);
+		for(int i = 0; i < bandCount; ++i) {
+			bands.emplace_back(Parser(parserConfig, hoparserSetup, homerSetup));
+		}
+		startWorkers();
+	}
+
+	/** Stops the threads of the pool */
+	~ParallelMCParser() noexcept {
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			stopping = true;
+		}
+		startCond.notify_all();
+		for(auto &worker : workers) {
+			worker.join();
+		}
+	}
+
+	ParallelMCParser(const ParallelMCParser&) = delete;
+	ParallelMCParser& operator=(const ParallelMCParser&) = delete;
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME: same as MCParser::processFrame(..) - just multi-threaded.
+	 * The stride is the distance of the rows counted in MT elements (not bytes).
+	 * Rem.: Not thread-safe - call this from one thread at a time!
+	 */
+	const ImageFrameResult processFrame(const MT *base, int width, int height, int stride) noexcept {
+		// Cut the frame to bands - the last one gets the remainder rows
+		int bandHeight = height / bandCount;
+		for(int i = 0; i < bandCount; ++i) {
+			bands[i].startY = i * bandHeight;
+			bands[i].endY = (i == bandCount - 1) ? height : ((i + 1) * bandHeight);
+		}
+
+		// Start the pool on the other bands
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			frameBase = base;
+			frameWidth = width;
+			frameStride = stride;
+			pendingBands = bandCount - 1;
+			++frameNo;
+		}
+		startCond.notify_all();
+
+		// The first band is ours
+		parseBand(bands[0], base, width, stride);
+
+		// Wait for the others
+		{
+			std::unique_lock<std::mutex> lock(poolMutex);
+			doneCond.wait(lock, [this] { return pendingBands == 0; });
+		}
+
+		return stitch();
+	}
+
+	/** The number of threads (and bands) in use - including the calling thread */
+	inline int getThreadCount() const noexcept {
+		return bandCount;
+	}
+
+	/** The number of scanlines that needed replaying when stitching the last frame (zero if none) */
+	inline int getReplayedLines() const noexcept {
+		return replayedLines;
+	}
+
+	/** All the hardware threads - or one if that is unknown */
+	static int defaultThreadCount() noexcept {
+		int n = (int)std::thread::hardware_concurrency();
+		return (n < 1) ? 1 : n;
+	}
+
+private:
+	/** A horizontal band of the frame with its own parser and the 1D markers it has found */
+	struct Band {
+		/** Parses only this band */
+		Parser parser;
+		/** First scanline of the band */
+		int startY = 0;
+		/** Scanline after the last of the band */
+		int endY = 0;
+		/** The found 1D markers as (centerX, order) pairs - for all the scanlines of the band */
+		std::vector<int> tokens;
+		/** Index in tokens after the last 1D marker of each scanline */
+		std::vector<size_t> lineTokenEnds;
+		/** The foundMarkerCount() of the parser after each scanline */
+		std::vector<size_t> lineMarkerEnds;
+
+		Band() noexcept { }
+		Band(Parser &&bandParser) noexcept : parser(std::move(bandParser)) { }
+	};
+
+	/** Parses the rows of the band while recording the 1D markers it finds */
+	static void parseBand(Band &band, const MT *base, int width, int stride) noexcept {
+		Parser &parser = band.parser;
+		parser.startFrameAt(band.startY);
+		band.tokens.clear();
+		band.lineTokenEnds.clear();
+		band.lineMarkerEnds.clear();
+
+		for(int j = band.startY; j < band.endY; ++j) {
+			const MT *row = base + (size_t)j * stride;
+			int i = 0;
+			while(i < width) {
+				// Skip the uneventful runs of the scanline - these never produce tokens
+				i += parser.nextSpan(row + i, width - i);
+				if(i >= width) break;
+				auto ret = parser.next(row[i]);
+				if(UNLIKELY(ret.foundMarker)) {
+					band.tokens.push_back(parser.tokenizer.getMarkerX());
+					band.tokens.push_back(parser.tokenizer.getOrder());
+				}
+				++i;
+			}
+			parser.endLine();
+			band.lineTokenEnds.push_back(band.tokens.size());
+			band.lineMarkerEnds.push_back(parser.foundMarkerCount());
+		}
+	}
+
+	/** Merges the recorded 1D markers of a scanline of the band into the parser */
+	static inline void replayLine(Parser &parser, const Band &band, int line) noexcept {
+		size_t from = (line == 0) ? 0 : band.lineTokenEnds[line - 1];
+		size_t to = band.lineTokenEnds[line];
+		for(size_t i = from; i < to; i += 2) {
+			parser.merge1DMarker(band.tokens[i], band.tokens[i + 1]);
+		}
+		parser.endLine();
+	}
+
+	/** Builds the frame result of the bands - see the class description */
+	const ImageFrameResult stitch() noexcept {
+		replayedLines = 0;
+		merger.startFrameAt(0);
+		for(auto &band : bands) {
+			int lines = band.endY - band.startY;
+			if(lines <= 0) continue;
+
+			// Replay until the band parser would do the same as the serial one
+			shadow.startFrameAt(band.startY);
+			int line = 0;
+			while((line < lines) && !merger.sameCenters(shadow)) {
+				replayLine(merger, band, line);
+				replayLine(shadow, band, line);
+				++line;
+			}
+			replayedLines += line;
+
+			// Take over the rest from the band parser (when not everything is replayed)
+			if(line < lines) {
+				merger.adoptFrom(band.parser, (line == 0) ? 0 : band.lineMarkerEnds[line - 1]);
+			}
+		}
+		return merger.endImageFrame();
+	}
+
+	/** Spawns the threads for the bands after the first one */
+	void startWorkers() noexcept {
+		for(int i = 1; i < bandCount; ++i) {
+			workers.emplace_back(&ParallelMCParser::workerLoop, this, i);
+		}
+	}
+
+	/** A pool thread: parses its own band whenever a new frame comes */
+	void workerLoop(int bandIndex) noexcept {
+		unsigned long long seenFrameNo = 0;
+		while(true) {
+			const MT *base;
+			int width;
+			int stride;
+			{
+				std::unique_lock<std::mutex> lock(poolMutex);
+				startCond.wait(lock, [this, seenFrameNo] { return stopping || (frameNo != seenFrameNo); });
+				if(stopping) return;
+				seenFrameNo = frameNo;
+				base = frameBase;
+				width = frameWidth;
+				stride = frameStride;
+			}
+
+			parseBand(bands[bandIndex], base, width, stride);
+
+			{
+				std::lock_guard<std::mutex> lock(poolMutex);
+				if(--pendingBands == 0) doneCond.notify_one();
+			}
+		}
+	}
+
+	/** Number of bands - which is the number of threads too */
+	int bandCount;
+
+	/** One for each band */
+	std::vector<Band> bands;
+
+	/** Holds the serial state of the frame while stitching */
+	Parser merger;
+
+	/** Replays a band from the empty state while stitching */
+	Parser shadow;
+
+	/** Statistics of the last stitching */
+	int replayedLines = 0;
+
+	/** The pool (bands after the first one) */
+	std::vector<std::thread> workers;
+	std::mutex poolMutex;
+	std::condition_variable startCond;
+	std::condition_variable doneCond;
+
+	// Guarded by poolMutex
+	unsigned long long frameNo = 0;
+	int pendingBands = 0;
+	bool stopping = false;
+	const MT *frameBase = nullptr;
+	int frameWidth = 0;
+	int frameStride = 0;
+};
+
+/**
+ * Multi-threaded whole-frame parser as a two-stage pipeline: gives the very same ImageFrameResult
+ * as MCParser::processFrame(..) - just like ParallelMCParser, but without any stitching.
+ *
+ * The Hoparser resets at every scanline so the per-scanline tokenization (the ~99% of the per-pixel
+ * work) is independent for every line. Only the vertical merge of MCParser is order-dependent, so:
+ *
+ * - The pool threads take the next untokenized scanline (an atomic counter) and write its 1D markers
+ *   (centerX, order) to the slot of the line - then publish the slot by a release-store of its stamp.
+ * - The calling thread merges the slots in y order (acquire-load of the stamps) through the usual
+ *   MCParser logic (see MCParser::merge1DMarker(..)). When the next slot is not ready yet, it takes
+ *   and tokenizes a scanline itself instead of waiting.
+ *
+ * Rem.: The slots are lock-free - only the start and the end of the frame touches the pool mutex.
+ * Template parameters are those of the MCParser.
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition, typename PRECISION = DefaultHomerPrecision,
+	typename CONFIG = RuntimeConfig>
+class PipelinedMCParser {
+public:
+	/** The serial parser type used for merging */
+	using Parser = MCParser<MT, CT, ATTRITION, PRECISION, CONFIG>;
+	/** The per-scanline tokenizer type used by the threads */
+	using Tokenizer = Hoparser<MT, CT, ATTRITION, PRECISION, CONFIG>;
+
+	/** Create a pipelined parser with the given number of threads (including the calling one) and default configuration */
+	PipelinedMCParser(int threadCount = ParallelMCParser<MT, CT, ATTRITION, PRECISION, CONFIG>::defaultThreadCount()) noexcept
+		: threadCount((threadCount < 1) ? 1 : threadCount) {
+		tokenizers.resize(this->threadCount);
+		startWorkers();
+	}
+
+	/** Create a pipelined parser with the given number of threads (including the calling one) and configurations */
+	PipelinedMCParser(int threadCount, MCParserConfig parserConfig, HoparserSetup hoparserSetup, HomerSetup homerSetup) noexcept
+		: threadCount((threadCount < 1) ? 1 : threadCount),
+		  merger(parserConfig, hoparserSetup, homerSetup) {
+		tokenizers.reserve(this->threadCount);
+		for(int i = 0; i < this->threadCount; ++i) {
+			tokenizers.emplace_back(Tokenizer(homerSetup, hoparserSetup));
+		}
+		startWorkers();
+	}
+
+	/** Stops the threads of the pool */
+	~PipelinedMCParser() noexcept {
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			stopping = true;
+		}
+		startCond.notify_all();
+		for(auto &worker : workers) {
+			worker.join();
+		}
+	}
+
+	PipelinedMCParser(const PipelinedMCParser&) = delete;
+	PipelinedMCParser& operator=(const PipelinedMCParser&) = delete;
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME: same as MCParser::processFrame(..) - just multi-threaded.
+	 * The stride is the distance of the rows counted in MT elements (not bytes).
+	 * Rem.: Not thread-safe - call this from one thread at a time!
+	 */
+	const ImageFrameResult processFrame(const MT *base, int width, int height, int stride) noexcept {
+		// Rem.: The pool is idle here so the slots can be reallocated
+		if(height > slotCount) {
+			slots.reset(new LineSlot[height]);
+			slotCount = height;
+		}
+
+		// Start the pool
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			frameBase = base;
+			frameWidth = width;
+			frameHeight = height;
+			frameStride = stride;
+			nextLine.store(0, std::memory_order_relaxed);
+			pendingWorkers = threadCount - 1;
+			++frameNo;
+		}
+		startCond.notify_all();
+
+		// Merge the lines in order - tokenizing ourselves when the next one is not ready
+		const unsigned long long stamp = frameNo;
+		for(int j = 0; j < height; ++j) {
+			LineSlot &slot = slots[j];
+			while(slot.stamp.load(std::memory_order_acquire) != stamp) {
+				if(!tokenizeNextLine(tokenizers[0], stamp, base, width, height, stride)) {
+					std::this_thread::yield();
+				}
+			}
+			for(size_t i = 0; i < slot.tokens.size(); i += 2) {
+				merger.merge1DMarker(slot.tokens[i], slot.tokens[i + 1]);
+			}
+			merger.endLine();
+		}
+
+		// Wait for the pool to leave the frame - so that the next one can reuse the slots
+		{
+			std::unique_lock<std::mutex> lock(poolMutex);
+			doneCond.wait(lock, [this] { return pendingWorkers == 0; });
+		}
+
+		return merger.endImageFrame();
+	}
+
+	/** The number of threads in use - including the calling thread */
+	inline int getThreadCount() const noexcept {
+		return threadCount;
+	}
+
+private:
+	/** The 1D markers of a scanline as (centerX, order) pairs - padded to cache line size against false sharing */
+	struct LineSlot {
+		std::vector<int> tokens;
+		/** The frameNo this slot was last written in - the slot is ready when it is the current one */
+		std::atomic<unsigned long long> stamp{0};
+		char padding[64 - sizeof(std::vector<int>) - sizeof(std::atomic<unsigned long long>)];
+	};
+
+	/** Takes and tokenizes the next untokenized scanline - returns false if there was none left */
+	inline bool tokenizeNextLine(Tokenizer &tokenizer, unsigned long long stamp,
+			const MT *base, int width, int height, int stride) noexcept {
+		int j = nextLine.fetch_add(1, std::memory_order_relaxed);
+		if(j >= height) return false;
+
+		LineSlot &slot = slots[j];
+		slot.tokens.clear();
+		const MT *row = base + (size_t)j * stride;
+		int i = 0;
+		while(i < width) {
+			// Skip the uneventful runs of the scanline - these never produce tokens
+			i += tokenizer.nextSpan(row + i, width - i);
+			if(i >= width) break;
+			auto ret = tokenizer.next(row[i]);
+			if(UNLIKELY(ret.foundMarker)) {
+				slot.tokens.push_back(tokenizer.getMarkerX());
+				slot.tokens.push_back(tokenizer.getOrder());
+			}
+			++i;
+		}
+		tokenizer.newLine();
+
+		// Publish the slot for the merging thread
+		slot.stamp.store(stamp, std::memory_order_release);
+		return true;
+	}
+
+	/** Spawns the tokenizer threads */
+	void startWorkers() noexcept {
+		for(int i = 1; i < threadCount; ++i) {
+			workers.emplace_back(&PipelinedMCParser::workerLoop, this, i);
+		}
+	}
+
+	/** A pool thread: tokenizes scanlines while there are any left in the frame */
+	void workerLoop(int tokenizerIndex) noexcept {
+		unsigned long long seenFrameNo = 0;
+		while(true) {
+			const MT *base;
+			int width;
+			int height;
+			int stride;
+			{
+				std::unique_lock<std::mutex> lock(poolMutex);
+				startCond.wait(lock, [this, seenFrameNo] { return stopping || (frameNo != seenFrameNo); });
+				if(stopping) return;
+				seenFrameNo = frameNo;
+				base = frameBase;
+				width = frameWidth;
+				height = frameHeight;
+				stride = frameStride;
+			}
+
+			while(tokenizeNextLine(tokenizers[tokenizerIndex], seenFrameNo, base, width, height, stride)) { }
+
+			{
+				std::lock_guard<std::mutex> lock(poolMutex);
+				if(--pendingWorkers == 0) doneCond.notify_one();
+			}
+		}
+	}
+
+	/** Number of threads - including the calling (merging) thread */
+	int threadCount;
+
+	/** One for each thread - the first is used by the calling thread */
+	std::vector<Tokenizer> tokenizers;
+
+	/** Merges the tokenized lines in order */
+	Parser merger;
+
+	/** One for each scanline */
+	std::unique_ptr<LineSlot[]> slots;
+	int slotCount = 0;
+
+	/** The next scanline to tokenize */
+	std::atomic<int> nextLine{0};
+
+	/** The pool */
+	std::vector<std::thread> workers;
+	std::mutex poolMutex;
+	std::condition_variable startCond;
+	std::condition_variable doneCond;
+
+	// Guarded by poolMutex (frameNo is only written by the calling thread)
+	unsigned long long frameNo = 0;
+	int pendingWorkers = 0;
+	bool stopping = false;
+	const MT *frameBase = nullptr;
+	int frameWidth = 0;
+	int frameHeight = 0;
+	int frameStride = 0;
+};
+
+#endif // FASTTRACK_PARALLEL_MC_PARSER_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
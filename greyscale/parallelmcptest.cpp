@@ -0,0 +1,71 @@
+// Tests that the band-parallel ParallelMCParser and the two-stage pipelined
+// PipelinedMCParser give exactly the same markers (in the same order) as the
+// serial MCParser::processFrame(..) does for many thread counts - so for many
+// different band borders and scanline schedules.
+//
+// Uses a generated frame full of markers (many of them are on band borders) and
+// the raw webcam frames of the input_poc directory - also all of them stacked on
+// each other as one tall frame.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <vector>
+#include "parallelmcparser.h"
+#include "testhelpers.h"
+
+/** Thread counts to test with - odd ones give uneven bands */
+static const int THREAD_COUNTS[] = { 1, 2, 3, 4, 5, 7, 8, 13, 32 };
+
+/** Tests one frame with all the thread counts - returns the number of failures */
+int testFrame(const char *name, const std::vector<uint8_t> &grey, int width, int height) {
+	MCParser<> mcp;
+	auto expected = mcp.processFrame(&grey[0], width, height, width);
+
+	int failures = 0;
+	for(int threadCount : THREAD_COUNTS) {
+		ParallelMCParser<> pmcp(threadCount);
+		// Rem.: twice to see that the state is properly reset between frames
+		auto first = pmcp.processFrame(&grey[0], width, height, width);
+		auto result = pmcp.processFrame(&grey[0], width, height, width);
+		bool ok = sameResults(expected, first) && sameResults(expected, result);
+		if(!ok) ++failures;
+		printf("%s (%dx%d, %d markers) with %d thread(s): %s (%d scanlines replayed)\n", name, width, height,
+				(int)expected.markers.size(), threadCount, ok ? "OK" : "MISMATCH", pmcp.getReplayedLines());
+
+		PipelinedMCParser<> pipelined(threadCount);
+		first = pipelined.processFrame(&grey[0], width, height, width);
+		result = pipelined.processFrame(&grey[0], width, height, width);
+		ok = sameResults(expected, first) && sameResults(expected, result);
+		if(!ok) ++failures;
+		printf("%s (%dx%d, %d markers) with %d thread(s) pipelined: %s\n", name, width, height,
+				(int)expected.markers.size(), threadCount, ok ? "OK" : "MISMATCH");
+	}
+	return failures;
+}
+
+int main() {
+	printf("Testing ParallelMCParser and PipelinedMCParser against MCParser...\n");
+
+	int failures = 0;
+	// Rem.: A white frame - the markers are the only change in it
+	MarkerGrid white;
+	white.white = true;
+	failures += testFrame("generated markers", generateMarkers(1280, 960, 40, white), 1280, 960);
+
+	std::vector<uint8_t> tall;
+	int tallHeight = 0;
+	failures += testWebcamFrames([&](const char *file, const std::vector<uint8_t> &grey) {
+		tall.insert(tall.end(), grey.begin(), grey.end());
+		tallHeight += WEBCAM_HEIGHT;
+		return testFrame(file, grey, WEBCAM_WIDTH, WEBCAM_HEIGHT);
+	});
+	if(tallHeight > 0) {
+		failures += testFrame("all frames stacked", tall, WEBCAM_WIDTH, tallHeight);
+	}
+
+	printf("...testing ParallelMCParser and PipelinedMCParser ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,270 @@
+#ifndef FASTTRACK_PIXEL_VIEWS_H
+#define FASTTRACK_PIXEL_VIEWS_H
+
+// Pixel-format aware views for feeding the detector right from camera (mmap) buffers.
+//
+// The detector only needs the luma (greyscale) magnitudes of each scanline. Planar and
+// greyscale formats are fed directly from the buffer (no copy at all), while interleaved
+// formats get their luma gathered into a single scanline-sized buffer that stays in the
+// L1 cache - so the camera frame is only read once and there is no frame-sized copy!
+//
+// Usage:
+//
+//     PixelView<YuyvFormat> view(rawData, CAM_XRES, CAM_YRES, bytesPerLine);
+//     auto results = mcp.processView(view);
+
+// Define this (from client code) to use the plain scalar gather loops
+//#define PIXELVIEW_NO_SIMD 1
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "microshackz.h"
+
+#if !defined(PIXELVIEW_NO_SIMD) && (defined(__SSE2__) || defined(__AVX2__))
+#include <immintrin.h> // vectorized deinterleave
+#endif
+
+/** Scalar gathering of dst[i] = src[i * STEP + offset] for i in [from, n) */
+template<int STEP>
+inline void gatherRemainder(const uint8_t* RESTRICT src, int offset, int from, int n, uint8_t* RESTRICT dst) noexcept {
+	const uint8_t *s = src + (size_t)from * STEP + offset;
+	for(int i = from; i < n; ++i, s += STEP) {
+		dst[i] = *s;
+	}
+}
+
+/**
+ * Copies every STEP-th byte at "offset" in the groups of STEP bytes: dst[i] = src[i * STEP + offset]
+ * Rem.: Only reads the n * STEP bytes of the groups - never anything after them!
+ */
+template<int STEP>
+struct ByteGather final {
+	static inline void gather(const uint8_t* RESTRICT src, int offset, int n, uint8_t* RESTRICT dst) noexcept {
+		gatherRemainder<STEP>(src, offset, 0, n, dst);
+	}
+};
+
+#if !defined(PIXELVIEW_NO_SIMD) && (defined(__SSE2__) || defined(__AVX2__))
+/** Deinterleaving every second byte (YUYV, UYVY, Bayer rows...) */
+template<>
+struct ByteGather<2> final {
+	static inline void gather(const uint8_t* RESTRICT src, int offset, int n, uint8_t* RESTRICT dst) noexcept {
+		int i = 0;
+		// Rem.: shifting the 16 bit words by 0 or 8 bits then masking gives the wanted bytes
+		const __m128i shift = _mm_cvtsi32_si128(offset * 8);
+#ifdef __AVX2__
+		const __m256i mask32 = _mm256_set1_epi16(0x00FF);
+		for(; i + 32 <= n; i += 32) {
+			__m256i a = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+			__m256i b = _mm256_loadu_si256((const __m256i*)(src + 2 * i + 32));
+			a = _mm256_and_si256(_mm256_srl_epi16(a, shift), mask32);
+			b = _mm256_and_si256(_mm256_srl_epi16(b, shift), mask32);
+			// The pack works per 128 bit lanes so we need to fix the order of the quadwords
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+			_mm256_storeu_si256((__m256i*)(dst + i), packed);
+		}
+#endif // __AVX2__
+		const __m128i mask16 = _mm_set1_epi16(0x00FF);
+		for(; i + 16 <= n; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+			a = _mm_and_si128(_mm_srl_epi16(a, shift), mask16);
+			b = _mm_and_si128(_mm_srl_epi16(b, shift), mask16);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+		}
+		gatherRemainder<2>(src, offset, i, n, dst);
+	}
+};
+
+/** Deinterleaving every fourth byte (decimated YUYV, UYVY, Bayer rows...) */
+template<>
+struct ByteGather<4> final {
+	static inline void gather(const uint8_t* RESTRICT src, int offset, int n, uint8_t* RESTRICT dst) noexcept {
+		int i = 0;
+		const __m128i shift = _mm_cvtsi32_si128(offset * 8);
+		const __m128i mask = _mm_set1_epi32(0x000000FF);
+		for(; i + 16 <= n; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(src + 4 * i + 16));
+			__m128i c = _mm_loadu_si128((const __m128i*)(src + 4 * i + 32));
+			__m128i d = _mm_loadu_si128((const __m128i*)(src + 4 * i + 48));
+			a = _mm_and_si128(_mm_srl_epi32(a, shift), mask);
+			b = _mm_and_si128(_mm_srl_epi32(b, shift), mask);
+			c = _mm_and_si128(_mm_srl_epi32(c, shift), mask);
+			d = _mm_and_si128(_mm_srl_epi32(d, shift), mask);
+			// Rem.: values are 0..255 so the signed saturation of packs_epi32 does not matter
+			__m128i ab = _mm_packs_epi32(a, b);
+			__m128i cd = _mm_packs_epi32(c, d);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(ab, cd));
+		}
+		gatherRemainder<4>(src, offset, i, n, dst);
+	}
+};
+#endif // !PIXELVIEW_NO_SIMD
+
+/**
+ * Luma of packed RGB/BGR pixels (every STEP-th pixel) using fixed point BT.601 weights.
+ * Rem.: Written so that the compiler can auto-vectorize it (3-element interleaved groups).
+ */
+template<int STEP, int R_OFFSET, int B_OFFSET>
+inline void packedRgbLuma(const uint8_t* RESTRICT src, int n, uint8_t* RESTRICT dst) noexcept {
+	const uint8_t *pix = src;
+	for(int i = 0; i < n; ++i, pix += STEP * 3) {
+		dst[i] = (uint8_t)((77 * pix[R_OFFSET] + 150 * pix[1] + 29 * pix[B_OFFSET] + 128) >> 8);
+	}
+}
+
+/*
+ * PIXEL FORMATS
+ * =============
+ *
+ * Each format tells the width of the luma rows (lumaWidth) and returns a pointer to the luma
+ * of a given row (luma) - either right into the source or into the given line buffer. The
+ * "decimate" flag means a 2x horizontal decimation (taking every second luma sample).
+ */
+
+/** 8 bit greyscale (V4L2_PIX_FMT_GREY) - also the luma plane of planar formats */
+struct GreyFormat final {
+	static inline int lumaWidth(int width, bool decimate) noexcept {
+		return decimate ? (width / 2) : width;
+	}
+
+	static inline const uint8_t* luma(const uint8_t *src, int width, int row, bool decimate, uint8_t *lineBuf) noexcept {
+		if(LIKELY(!decimate)) return src; // zero-copy
+		ByteGather<2>::gather(src, 0, width / 2, lineBuf);
+		return lineBuf;
+	}
+};
+
+/** NV12 and NV21: the full resolution luma plane comes first so just give the base of that */
+typedef GreyFormat Nv12Format;
+typedef GreyFormat Nv21Format;
+
+/** Packed 4:2:2 formats: YUYV (Y_OFFSET = 0) and UYVY (Y_OFFSET = 1) */
+template<int Y_OFFSET>
+struct Packed422Format final {
+	static inline int lumaWidth(int width, bool decimate) noexcept {
+		return decimate ? (width / 2) : width;
+	}
+
+	static inline const uint8_t* luma(const uint8_t *src, int width, int row, bool decimate, uint8_t *lineBuf) noexcept {
+		if(LIKELY(!decimate)) {
+			ByteGather<2>::gather(src, Y_OFFSET, width, lineBuf);
+		} else {
+			// Only the first Y of each Y-U-Y-V (or U-Y-V-Y) group
+			ByteGather<4>::gather(src, Y_OFFSET, width / 2, lineBuf);
+		}
+		return lineBuf;
+	}
+};
+
+/** V4L2_PIX_FMT_YUYV - the usual webcam format */
+typedef Packed422Format<0> YuyvFormat;
+/** V4L2_PIX_FMT_UYVY */
+typedef Packed422Format<1> UyvyFormat;
+
+/**
+ * Green channel of 8 bit Bayer patterns - the luma rows are half the width of the sensor.
+ * GREEN_FIRST tells if the even rows start with a green pixel (GRBG, GBRG) or not (RGGB, BGGR).
+ * Rem.: Green samples of the odd and even rows are shifted by one sensor pixel compared to
+ *       each other, but this is below the precision the detector needs anyways.
+ */
+template<bool GREEN_FIRST>
+struct BayerGreenFormat final {
+	static inline int lumaWidth(int width, bool decimate) noexcept {
+		return decimate ? (width / 4) : (width / 2);
+	}
+
+	static inline const uint8_t* luma(const uint8_t *src, int width, int row, bool decimate, uint8_t *lineBuf) noexcept {
+		int offset = ((row & 1) == (GREEN_FIRST ? 0 : 1)) ? 0 : 1;
+		if(LIKELY(!decimate)) {
+			ByteGather<2>::gather(src, offset, width / 2, lineBuf);
+		} else {
+			ByteGather<4>::gather(src, offset, width / 4, lineBuf);
+		}
+		return lineBuf;
+	}
+};
+
+/** V4L2_PIX_FMT_SRGGB8 */
+typedef BayerGreenFormat<false> BayerRggbFormat;
+/** V4L2_PIX_FMT_SBGGR8 */
+typedef BayerGreenFormat<false> BayerBggrFormat;
+/** V4L2_PIX_FMT_SGRBG8 */
+typedef BayerGreenFormat<true> BayerGrbgFormat;
+/** V4L2_PIX_FMT_SGBRG8 */
+typedef BayerGreenFormat<true> BayerGbrgFormat;
+
+/** Packed 24 bit RGB (R_OFFSET = 0) or BGR (R_OFFSET = 2) converted to luma */
+template<int R_OFFSET>
+struct PackedRgbFormat final {
+	static inline int lumaWidth(int width, bool decimate) noexcept {
+		return decimate ? (width / 2) : width;
+	}
+
+	static inline const uint8_t* luma(const uint8_t *src, int width, int row, bool decimate, uint8_t *lineBuf) noexcept {
+		if(LIKELY(!decimate)) {
+			packedRgbLuma<1, R_OFFSET, 2 - R_OFFSET>(src, width, lineBuf);
+		} else {
+			packedRgbLuma<2, R_OFFSET, 2 - R_OFFSET>(src, width / 2, lineBuf);
+		}
+		return lineBuf;
+	}
+};
+
+/** V4L2_PIX_FMT_RGB24 */
+typedef PackedRgbFormat<0> Rgb24Format;
+/** V4L2_PIX_FMT_BGR24 */
+typedef PackedRgbFormat<2> Bgr24Format;
+
+/**
+ * A typed view of a camera frame that gives back the luma scanlines for the detector.
+ * The stride is the distance of the rows in bytes (like bytesperline of V4L2) and the
+ * width and height are that of the camera frame (in pixels of the given FORMAT).
+ *
+ * Rem.: The returned rows are only valid until the next row(..) call!
+ * Rem.: Use setBase(..) for the next frames of the same geometry - no reallocations then.
+ */
+template<typename FORMAT>
+class PixelView final {
+public:
+	PixelView(const uint8_t *base, int width, int height, int stride, bool decimate = false) noexcept
+		: base(base), srcWidth(width), srcHeight(height), stride(stride), decimate(decimate),
+		  lineBuf(FORMAT::lumaWidth(width, decimate) + 1) {
+	}
+
+	/** Change the frame data - like for the next frame of a camera */
+	inline void setBase(const uint8_t *newBase) noexcept {
+		base = newBase;
+	}
+
+	/** Width of the luma rows */
+	inline int width() const noexcept {
+		return FORMAT::lumaWidth(srcWidth, decimate);
+	}
+
+	/** Number of luma rows */
+	inline int height() const noexcept {
+		return srcHeight;
+	}
+
+	/** The luma of the given row - either directly in the frame or in our line buffer */
+	inline const uint8_t* row(int j) noexcept {
+		return FORMAT::luma(base + (size_t)j * stride, srcWidth, j, decimate, &lineBuf[0]);
+	}
+
+private:
+	const uint8_t *base;
+	int srcWidth;
+	int srcHeight;
+	int stride;
+	bool decimate;
+	/** Scanline-sized buffer for the gathered luma - stays in the cache */
+	std::vector<uint8_t> lineBuf;
+};
+
+#endif // FASTTRACK_PIXEL_VIEWS_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
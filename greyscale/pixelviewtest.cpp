@@ -0,0 +1,155 @@
+// Tests the pixel-format views of pixelviews.h against simple reference loops.
+// Widths and strides are chosen so that both the vectorized and the remainder
+// parts of the gathering are used - with and without the 2x decimation.
+//
+// Compile with -mavx2 too to test the AVX2 kernels besides the SSE2 ones!
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the detector test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "pixelviews.h"
+#include "mcparser.h"
+
+/** Reference luma of a pixel in the given frame (x is in luma coordinates without decimation) */
+typedef int (*RefLumaFun)(const std::vector<uint8_t> &frame, int stride, int x, int y);
+
+int refGrey(const std::vector<uint8_t> &frame, int stride, int x, int y) {
+	return frame[y * stride + x];
+}
+
+int refYuyv(const std::vector<uint8_t> &frame, int stride, int x, int y) {
+	return frame[y * stride + x * 2];
+}
+
+int refUyvy(const std::vector<uint8_t> &frame, int stride, int x, int y) {
+	return frame[y * stride + x * 2 + 1];
+}
+
+int refRggb(const std::vector<uint8_t> &frame, int stride, int x, int y) {
+	// R G R G ...
+	// G B G B ...
+	return frame[y * stride + x * 2 + ((y & 1) ? 0 : 1)];
+}
+
+int refGrbg(const std::vector<uint8_t> &frame, int stride, int x, int y) {
+	// G R G R ...
+	// B G B G ...
+	return frame[y * stride + x * 2 + ((y & 1) ? 1 : 0)];
+}
+
+int refRgb(const std::vector<uint8_t> &frame, int stride, int x, int y) {
+	const uint8_t *pix = &frame[y * stride + x * 3];
+	return (77 * pix[0] + 150 * pix[1] + 29 * pix[2] + 128) >> 8;
+}
+
+int refBgr(const std::vector<uint8_t> &frame, int stride, int x, int y) {
+	const uint8_t *pix = &frame[y * stride + x * 3];
+	return (77 * pix[2] + 150 * pix[1] + 29 * pix[0] + 128) >> 8;
+}
+
+/** Tests one format with the given frame geometry - returns the number of failures */
+template<typename FORMAT>
+int testFormat(const char *name, RefLumaFun ref, int bytesPerPixel, int width, int height, bool decimate) {
+	// Rem.: some padding at the end of the rows just like drivers do
+	int stride = width * bytesPerPixel + 7;
+	// Rem.: exact size so that reading after the last row is caught by sanitizers
+	std::vector<uint8_t> frame(stride * (height - 1) + width * bytesPerPixel);
+	for(auto &b : frame) b = (uint8_t)rand();
+
+	PixelView<FORMAT> view(&frame[0], width, height, stride, decimate);
+	int failures = 0;
+	for(int y = 0; y < view.height(); ++y) {
+		const uint8_t *row = view.row(y);
+		for(int x = 0; x < view.width(); ++x) {
+			int expected = ref(frame, stride, decimate ? (x * 2) : x, y);
+			if(row[x] != expected) {
+				if(failures == 0) {
+					printf("  %s (%dx%d, decimate: %d) differs at (%d, %d): %d != %d\n",
+							name, width, height, (int)decimate, x, y, row[x], expected);
+				}
+				++failures;
+			}
+		}
+	}
+	printf("%s (%dx%d, decimate: %d): %s\n", name, width, height, (int)decimate, (failures == 0) ? "OK" : "FAILED");
+	return (failures == 0) ? 0 : 1;
+}
+
+/** Tests all the formats with the given frame geometry */
+int testAllFormats(int width, int height, bool decimate) {
+	int failures = 0;
+	failures += testFormat<GreyFormat>("GREY", refGrey, 1, width, height, decimate);
+	failures += testFormat<Nv12Format>("NV12", refGrey, 1, width, height, decimate);
+	failures += testFormat<YuyvFormat>("YUYV", refYuyv, 2, width, height, decimate);
+	failures += testFormat<UyvyFormat>("UYVY", refUyvy, 2, width, height, decimate);
+	failures += testFormat<BayerRggbFormat>("RGGB", refRggb, 1, width, height, decimate);
+	failures += testFormat<BayerGrbgFormat>("GRBG", refGrbg, 1, width, height, decimate);
+	failures += testFormat<Rgb24Format>("RGB24", refRgb, 3, width, height, decimate);
+	failures += testFormat<Bgr24Format>("BGR24", refBgr, 3, width, height, decimate);
+	return failures;
+}
+
+/** A real webcam frame - when it is not there, the view test is skipped */
+#define WEBCAM_YUYV_FILE "../input_poc/out_interesting/marker2/webcam_output.yuv422.data"
+#define WEBCAM_WIDTH 640
+#define WEBCAM_HEIGHT 480
+
+/** The detector must find the same tokens and markers using a view and using processFrame(..) */
+int testProcessView() {
+	const int width = WEBCAM_WIDTH;
+	const int height = WEBCAM_HEIGHT;
+	std::vector<uint8_t> yuyv(width * height * 2);
+	FILE *f = fopen(WEBCAM_YUYV_FILE, "rb");
+	if((f == nullptr) || (fread(&yuyv[0], 1, yuyv.size(), f) != yuyv.size())) {
+		printf("processView(..): SKIPPED (no " WEBCAM_YUYV_FILE ")\n");
+		if(f != nullptr) fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	// The luma deinterleaved the simplest possible way
+	std::vector<uint8_t> grey(width * height);
+	for(int i = 0; i < width * height; ++i) {
+		grey[i] = yuyv[i * 2];
+	}
+
+	MCParser<> mcp;
+	std::vector<DebugToken> expectedTokens;
+	std::vector<DebugToken> tokens;
+	auto expected = mcp.processFrame(&grey[0], width, height, width, &expectedTokens);
+	PixelView<YuyvFormat> view(&yuyv[0], width, height, width * 2);
+	auto result = mcp.processView(view, &tokens);
+
+	bool ok = (expected.markers.size() == result.markers.size()) && (expectedTokens.size() == tokens.size());
+	for(size_t i = 0; ok && (i < result.markers.size()); ++i) {
+		ok = (expected.markers[i].x == result.markers[i].x) && (expected.markers[i].y == result.markers[i].y);
+	}
+	for(size_t i = 0; ok && (i < tokens.size()); ++i) {
+		ok = (expectedTokens[i].x == tokens[i].x) && (expectedTokens[i].y == tokens[i].y)
+			&& (expectedTokens[i].markerX == tokens[i].markerX);
+	}
+	printf("processView(..) == processFrame(..): %s (%d tokens, %d markers)\n", ok ? "OK" : "FAILED",
+			(int)tokens.size(), (int)result.markers.size());
+	return ok ? 0 : 1;
+}
+
+int main() {
+	printf("Testing pixelviews.h...\n");
+
+	int failures = 0;
+	// Rem.: sizes are chosen to have vector parts and remainders with and without decimation
+	failures += testAllFormats(640, 4, false);
+	failures += testAllFormats(640, 4, true);
+	failures += testAllFormats(4 * 37 + 12, 3, false);
+	failures += testAllFormats(4 * 37 + 12, 3, true);
+	failures += testAllFormats(8, 2, false);
+	failures += testAllFormats(8, 2, true);
+	failures += testProcessView();
+
+	printf("...testing pixelviews.h ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
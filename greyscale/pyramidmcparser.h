@@ -0,0 +1,329 @@
+#ifndef FASTTRACK_PYRAMID_MC_PARSER_H
+#define FASTTRACK_PYRAMID_MC_PARSER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "microshackz.h"
+#include "mcparser.h"
+
+#if !defined(PYRAMID_NO_SIMD) && defined(__SSE2__)
+#include <immintrin.h> // box-downsampling kernels of PyramidKernels
+#endif
+
+/**
+ * The 2x2 box-downsampling of PyramidMCParser in two row passes: the horizontal pair sums of the upper row
+ * then their average with the pairs of the lower row (rounding). The scalar version works for any MT.
+ */
+template<typename MT>
+struct PyramidKernels final {
+	/** Type of the pair sums */
+	using Sum = int;
+
+	/** sums[i] = row[2i] + row[2i+1] for n sums */
+	static inline void pairSums(const MT *row, int n, Sum *sums) noexcept {
+		for(int i = 0; i < n; ++i) {
+			sums[i] = (int)row[2 * i] + (int)row[2 * i + 1];
+		}
+	}
+
+	/** out[i] = (sums[i] + row[2i] + row[2i+1] + 2) / 4 for n outputs */
+	static inline void average(const Sum *sums, const MT *row, int n, MT *out) noexcept {
+		for(int i = 0; i < n; ++i) {
+			out[i] = (MT)((sums[i] + (int)row[2 * i] + (int)row[2 * i + 1] + 2) >> 2);
+		}
+	}
+};
+
+#if !defined(PYRAMID_NO_SIMD) && defined(__SSE2__)
+/**
+ * Luma kernels using SSE2 - 16 output pixels at once with 16 bit sums (the same rounding as the scalar ones).
+ * Rem.: These handle whole chunks and let the scalar version do the remainders!
+ */
+template<>
+struct PyramidKernels<uint8_t> final {
+	using Sum = uint16_t;
+
+	/** Pair sums of 16 bytes as 8 words: the even bytes (masked) plus the odd ones (shifted down) */
+	static inline __m128i pairs(const uint8_t *p) noexcept {
+		const __m128i v = _mm_loadu_si128((const __m128i*)p);
+		return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), _mm_srli_epi16(v, 8));
+	}
+
+	static inline void pairSums(const uint8_t *row, int n, Sum *sums) noexcept {
+		int i = 0;
+		for(; i + 16 <= n; i += 16) {
+			_mm_storeu_si128((__m128i*)(sums + i), pairs(row + 2 * i));
+			_mm_storeu_si128((__m128i*)(sums + i + 8), pairs(row + 2 * i + 16));
+		}
+		for(; i < n; ++i) {
+			sums[i] = (Sum)(row[2 * i] + row[2 * i + 1]);
+		}
+	}
+
+	static inline void average(const Sum *sums, const uint8_t *row, int n, uint8_t *out) noexcept {
+		const __m128i two = _mm_set1_epi16(2);
+		int i = 0;
+		for(; i + 16 <= n; i += 16) {
+			__m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sums + i)), pairs(row + 2 * i));
+			__m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sums + i + 8)), pairs(row + 2 * i + 16));
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+			_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+		}
+		for(; i < n; ++i) {
+			out[i] = (uint8_t)((sums[i] + row[2 * i] + row[2 * i + 1] + 2) >> 2);
+		}
+	}
+};
+#endif // !PYRAMID_NO_SIMD && __SSE2__
+
+/** Holds configuration data values for PyramidMCParser */
+struct PyramidConfig {
+	/**
+	 * Detection happens on this level: 1 means 2x, 2 means 4x (and so on) downsampling in both directions.
+	 * Zero parses the full resolution directly (no pyramid, no refinement) - negative values count as zero.
+	 */
+	int level = 2;
+
+	/**
+	 * Half width of the full resolution window around each coarse marker for refining it (in pixels).
+	 * Zero turns off the refinement: coarse positions are just scaled up then.
+	 * Rem.: Same lower bound as MCParserConfig::densifyPadding, plus the position error of the coarse level.
+	 */
+	int refinePaddingX = 160;
+
+	/**
+	 * Half height of the refinement window (in pixels). Only the scanlines going through the inner
+	 * circle of a marker find its 1D markers, so this can be much smaller than refinePaddingX: the
+	 * radius of the inner circle plus the position error of the coarse level is enough.
+	 */
+	int refinePaddingY = 48;
+};
+
+/**
+ * Coarse-to-fine detection using an image pyramid:
+ *
+ * The luma is 2x2 box-downsampled level by level (in a single streaming pass over the frame for
+ * the first level - reading camera formats through a view works too, see processView(..)) and the
+ * markers are detected on the coarsest level by an MCParser whose pixel-count parameters are scaled
+ * down for that level (see scaleHoparserSetup(..) and friends). Then each coarse marker is refined
+ * by parsing a small full resolution window around it with the original parameters. Results are in
+ * full resolution coordinates - when the refinement finds nothing close, the scaled coarse position is kept.
+ *
+ * Rem.: This is for markers that are big compared to the frame: stripes must stay at least a few
+ *       pixels wide on the coarse level, so 2^level times the minimal stripe width is the limit!
+ * Rem.: Template parameters are those of MCParser - only with runtime configuration (setups get scaled).
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition, typename PRECISION = DefaultHomerPrecision>
+class PyramidMCParser final {
+public:
+	/** Parses the levels */
+	using Parser = MCParser<MT, CT, ATTRITION, PRECISION, RuntimeConfig>;
+
+	/** Create a pyramid parser with the given configurations (the setups are that of the full resolution) */
+	PyramidMCParser(PyramidConfig pyramidConfig = PyramidConfig(), MCParserConfig parserConfig = MCParserConfig(),
+			HoparserSetup hoparserSetup = HoparserSetup(), HomerSetup homerSetup = HomerSetup()) noexcept
+		: config(checkedConfig(pyramidConfig)),
+		  coarse(scaleParserConfig(parserConfig, 1 << config.level),
+				scaleHoparserSetup(hoparserSetup, 1 << config.level),
+				scaleHomerSetup(homerSetup, 1 << config.level)),
+		  fine(parserConfig, hoparserSetup, homerSetup),
+		  levels(config.level + 1) {
+	}
+
+	/** BULK FEED OF A WHOLE FRAME: same as MCParser::processFrame(..) - the stride is counted in MT elements */
+	const ImageFrameResult processFrame(const MT *base, int width, int height, int stride) noexcept {
+		return process([base, stride](int j) { return base + (size_t)j * stride; }, width, height);
+	}
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME FROM A VIEW: like processFrame(..) but the rows come from a view
+	 * that has width(), height() and row(j) - see PixelView in pixelviews.h for camera formats.
+	 * Rem.: The first level is built right from the rows of the view: no full resolution luma copy!
+	 */
+	template<typename VIEW>
+	const ImageFrameResult processView(VIEW &view) noexcept {
+		return process([&view](int j) { return view.row(j); }, view.width(), view.height());
+	}
+
+	/** Number of pixels parsed for the last frame (coarse level and refinement windows together) */
+	inline size_t getScannedPixels() const noexcept {
+		return scannedPixels;
+	}
+
+	/** Width of the given level (zero is the full resolution) */
+	inline int getLevelWidth(int level) const noexcept {
+		return levels[level].width;
+	}
+
+	/** Height of the given level (zero is the full resolution) */
+	inline int getLevelHeight(int level) const noexcept {
+		return levels[level].height;
+	}
+
+	/** The luma of the given downsampled level (row by row without padding) - not valid for level zero */
+	inline const MT* getLevelData(int level) const noexcept {
+		return levels[level].data.data();
+	}
+
+	/** Scales the pixel-count values of a HoparserSetup for a level that is downsampled by "factor" */
+	static inline HoparserSetup scaleHoparserSetup(HoparserSetup setup, int factor) noexcept {
+		setup.markStartPrefixHomoLenMin = scaleLen(setup.markStartPrefixHomoLenMin, factor, 1);
+		setup.markStartTransitionLenMax = scaleLen(setup.markStartTransitionLenMax, factor, 1);
+		setup.markContinueTooBigWidthDelta = scaleLen(setup.markContinueTooBigWidthDelta, factor, 1);
+		setup.markContinueStripeSizeMaxDelta = scaleLen(setup.markContinueStripeSizeMaxDelta, factor, 1);
+		setup.ignoreSmallHotokenDeltaLen = scaleLen(setup.ignoreSmallHotokenDeltaLen, factor, 1);
+		// Rem.: markStartSuspectionMagDeltaMin is a magnitude - box filtering keeps that
+		return setup;
+	}
+
+	/**
+	 * Scales the pixel-count values of a HomerSetup for a level that is downsampled by "factor"
+	 * Rem.: At least two pixels are needed for an area still - otherwise any pixel would be one!
+	 */
+	static inline HomerSetup scaleHomerSetup(HomerSetup setup, int factor) noexcept {
+		setup.hodeltaLen = scaleLen(setup.hodeltaLen, factor, 2);
+		return setup;
+	}
+
+	/**
+	 * Scales the pixel-count values of a MCParserConfig for a level that is downsampled by "factor"
+	 * Rem.: ignoreWhenSignalCountLessThan is kept - it is the noise floor of the stacked scanlines.
+	 */
+	static inline MCParserConfig scaleParserConfig(MCParserConfig config, int factor) noexcept {
+		config.deltaDiffMax = scaleLen(config.deltaDiffMax, factor, 1);
+		config.widthDiffMax = scaleLen(config.widthDiffMax, factor, 1);
+		config.closeDiffY = scaleLen(config.closeDiffY, factor, 1);
+		return config;
+	}
+
+private:
+	/** A downsampled level of the pyramid */
+	struct Level final {
+		int width = 0;
+		int height = 0;
+		std::vector<MT> data;
+	};
+
+	/** Divides a pixel count (rounding) but keeps at least minValue */
+	template<typename T>
+	static inline T scaleLen(T value, int factor, int minValue) noexcept {
+		int ret = ((int)value + factor / 2) / factor;
+		return (T)((ret < minValue) ? minValue : ret);
+	}
+
+	/**
+	 * 2x2 box-downsamples the rows given by ROWS (returning a row pointer for an index) into "to".
+	 * Rem.: Rows are only asked for once and in order - a row is not used after the next one is asked for.
+	 */
+	template<typename ROWS>
+	void NOINLINE downsample(ROWS rows, int width, int height, Level &to) noexcept {
+		to.width = width / 2;
+		to.height = height / 2;
+		to.data.resize((size_t)to.width * to.height);
+		sums.resize(to.width);
+		for(int j = 0; j < to.height; ++j) {
+			PyramidKernels<MT>::pairSums(rows(2 * j), to.width, sums.data());
+			PyramidKernels<MT>::average(sums.data(), rows(2 * j + 1), to.width, &to.data[(size_t)j * to.width]);
+		}
+	}
+
+	/** The given configuration with the level clamped to zero */
+	static PyramidConfig checkedConfig(PyramidConfig pyramidConfig) noexcept {
+		pyramidConfig.level = std::max(0, pyramidConfig.level);
+		return pyramidConfig;
+	}
+
+	/** Builds the pyramid, parses the coarsest level then refines the markers */
+	template<typename ROWS>
+	const ImageFrameResult process(ROWS rows, int width, int height) noexcept {
+		levels[0].width = width;
+		levels[0].height = height;
+		if(config.level == 0) {
+			// Rem.: Nothing to downsample or refine - the input itself is the coarsest level
+			for(int j = 0; j < height; ++j) {
+				fine.processLine(rows(j), width);
+			}
+			scannedPixels = (size_t)width * height;
+			return fine.endImageFrame();
+		}
+		downsample(rows, width, height, levels[1]);
+		for(int l = 2; l <= config.level; ++l) {
+			const Level &from = levels[l - 1];
+			downsample([&from](int j) { return &from.data[(size_t)j * from.width]; }, from.width, from.height, levels[l]);
+		}
+
+		const Level &top = levels[config.level];
+		ImageFrameResult ret = coarse.processFrame(top.data.data(), top.width, top.height, top.width);
+		scannedPixels = (size_t)top.width * top.height;
+
+		const int factor = 1 << config.level;
+		for(auto &m : ret.markers) {
+			// Rem.: the center of the coarse pixel in full resolution
+			int px = (int)m.x * factor + factor / 2;
+			int py = (int)m.y * factor + factor / 2;
+			m.x = px;
+			m.y = py;
+			if(config.refinePaddingX > 0) refine(rows, width, height, px, py, m);
+		}
+		return ret;
+	}
+
+	/**
+	 * Parses the full resolution window around (px, py) and updates the marker to the closest one found there.
+	 * Rem.: Markers further than two coarse pixels are not taken: a refinement should never move the marker
+	 *       more than the precision of the coarse level (noise can break up the full resolution scanlines).
+	 */
+	template<typename ROWS>
+	void refine(ROWS rows, int width, int height, int px, int py, Marker2D &m) noexcept {
+		int x0 = std::max(0, px - config.refinePaddingX);
+		int y0 = std::max(0, py - config.refinePaddingY);
+		int x1 = std::min(width, px + config.refinePaddingX + 1);
+		int y1 = std::min(height, py + config.refinePaddingY + 1);
+		if((x0 >= x1) || (y0 >= y1)) return;
+		for(int j = y0; j < y1; ++j) {
+			fine.processLine(rows(j) + x0, x1 - x0);
+		}
+		auto found = fine.endImageFrame();
+		scannedPixels += (size_t)(x1 - x0) * (y1 - y0);
+
+		const int maxDelta = 2 << config.level;
+		int bestDist = std::numeric_limits<int>::max();
+		for(const auto &f : found.markers) {
+			int dx = abs((int)f.x + x0 - px);
+			int dy = abs((int)f.y + y0 - py);
+			int dist = dx + dy;
+			if((dx <= maxDelta) && (dy <= maxDelta) && (dist < bestDist)) {
+				bestDist = dist;
+				m = f;
+				m.x += x0;
+				m.y += y0;
+			}
+		}
+	}
+
+	/** Pyramid configuration */
+	PyramidConfig config;
+
+	/** Parses the coarsest level with scaled setups */
+	Parser coarse;
+
+	/** Parses the refinement windows with the original setups */
+	Parser fine;
+
+	/** The levels of the pyramid - the zeroth only has its size (it is the input itself) */
+	std::vector<Level> levels;
+
+	/** Horizontal pair sums of the upper row while downsampling */
+	std::vector<typename PyramidKernels<MT>::Sum> sums;
+
+	/** Number of pixels parsed for the last frame */
+	size_t scannedPixels = 0;
+};
+
+#endif // FASTTRACK_PYRAMID_MC_PARSER_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
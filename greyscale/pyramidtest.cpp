@@ -0,0 +1,180 @@
+// Tests the coarse-to-fine detection of pyramidmcparser.h on generated 1080p
+// frames with a few big markers - both for greyscale frames and for YUYV frames
+// read through a PixelView (these two must give the same). With low noise the
+// refined markers must be the very same as the ones MCParser::processFrame(..)
+// finds at full resolution, with strong noise (where the full resolution parsing
+// gets unreliable) all the drawn markers must be found close to their centers.
+// Also prints the time of both and the ratio of the parsed pixels. The levels themselves
+// are checked against a plain 2x2 box filter (odd sizes exercise the kernel remainders).
+// Level zero (and a negative level) must parse the full resolution directly.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "pyramidmcparser.h"
+#include "pixelviews.h"
+#include "testhelpers.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+// Repeat each frame this many times for the timing
+#define RUNS_PER_FRAME 10
+
+/** Returns the milliseconds per frame and the result of the given parsing */
+template<typename FUN>
+double measure(FUN parse, ImageFrameResult &result) {
+	result = parse();
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < RUNS_PER_FRAME; ++i) {
+		parse();
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / RUNS_PER_FRAME;
+}
+
+/** Number of the drawn marker centers that have exactly one found marker at most maxDist pixels away */
+int matchTruth(const std::vector<int> &truthX, const std::vector<int> &truthY, const std::vector<Marker2D> &found, int maxDist) {
+	int matched = 0;
+	for(size_t i = 0; i < truthX.size(); ++i) {
+		int close = 0;
+		for(const auto &m : found) {
+			if((abs((int)m.x - truthX[i]) <= maxDist) && (abs((int)m.y - truthY[i]) <= maxDist)) ++close;
+		}
+		if(close == 1) ++matched;
+	}
+	return matched;
+}
+
+/**
+ * Tests one frame with the given number of big markers - returns the number of failures.
+ * With low noise the results must be the same as the full resolution ones - otherwise
+ * every drawn marker must be found (and nothing else) close to its real center.
+ */
+int testFrame(int markers, int circleSize, int level, int noise) {
+	std::vector<uint8_t> grey(WIDTH * HEIGHT);
+	for(auto &p : grey) p = 200 + (rand() % noise);
+	std::vector<int> truthX;
+	std::vector<int> truthY;
+	for(int i = 0; i < markers; ++i) {
+		truthX.push_back((i + 1) * WIDTH / (markers + 1));
+		truthY.push_back((i % 2 == 0) ? (HEIGHT / 3) : (2 * HEIGHT / 3));
+		drawMarker(grey, WIDTH, HEIGHT, truthX.back(), truthY.back(), circleSize, 6);
+	}
+	// The same as YUYV (with some chroma noise)
+	std::vector<uint8_t> yuyv(WIDTH * HEIGHT * 2);
+	for(int i = 0; i < WIDTH * HEIGHT; ++i) {
+		yuyv[i * 2] = grey[i];
+		yuyv[i * 2 + 1] = (uint8_t)rand();
+	}
+
+	MCParser<> full;
+	PyramidConfig config;
+	config.level = level;
+	config.refinePaddingX = circleSize + 40;
+	config.refinePaddingY = circleSize / 3;
+	PyramidMCParser<> pyramid(config);
+	PixelView<YuyvFormat> view(&yuyv[0], WIDTH, HEIGHT, WIDTH * 2);
+
+	ImageFrameResult expected;
+	ImageFrameResult result;
+	ImageFrameResult viewResult;
+	double fullMs = measure([&]() { return full.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH); }, expected);
+	double pyramidMs = measure([&]() { return pyramid.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH); }, result);
+	double viewMs = measure([&]() { return pyramid.processView(view); }, viewResult);
+
+	bool ok = sameMarkerSet(result.markers, viewResult.markers);
+	// Rem.: a refinement disturbed by the noise still has the precision of the coarse level
+	int maxDist = 2 << level;
+	int fullMatched = matchTruth(truthX, truthY, expected.markers, maxDist);
+	int matched = matchTruth(truthX, truthY, result.markers, maxDist);
+	if(noise <= 8) {
+		ok = ok && sameMarkerSet(expected.markers, result.markers);
+	} else {
+		ok = ok && (matched == markers) && ((int)result.markers.size() == markers);
+	}
+	printf("%dx%d with %d markers (size %d, noise %d) on level %d: %s - found %d (full: %d) of them - "
+			"full: %.2f ms, pyramid: %.2f ms, from YUYV: %.2f ms - parsed %.2f%% of the pixels\n",
+			WIDTH, HEIGHT, markers, circleSize, noise, level, ok ? "OK" : "FAILED", matched, fullMatched,
+			fullMs, pyramidMs, viewMs, 100.0 * pyramid.getScannedPixels() / (WIDTH * HEIGHT));
+	return ok ? 0 : 1;
+}
+
+/** Tests the levels of the pyramid against a plain 2x2 box filter - returns the number of failures */
+int testLevels(int width, int height, int level) {
+	std::vector<uint8_t> grey(width * height);
+	for(auto &p : grey) p = (uint8_t)rand();
+	PyramidConfig config;
+	config.level = level;
+	PyramidMCParser<> pyramid(config);
+	pyramid.processFrame(&grey[0], width, height, width);
+
+	bool ok = true;
+	std::vector<uint8_t> from = grey;
+	int fromWidth = width;
+	for(int l = 1; l <= level; ++l) {
+		int w = fromWidth / 2;
+		int h = pyramid.getLevelHeight(l - 1) / 2;
+		std::vector<uint8_t> expected(w * h);
+		for(int j = 0; j < h; ++j) {
+			for(int i = 0; i < w; ++i) {
+				const uint8_t *a = &from[(2 * j) * fromWidth + 2 * i];
+				const uint8_t *b = a + fromWidth;
+				expected[j * w + i] = (uint8_t)((a[0] + a[1] + b[0] + b[1] + 2) >> 2);
+			}
+		}
+		ok = ok && (pyramid.getLevelWidth(l) == w) && (pyramid.getLevelHeight(l) == h) &&
+				std::equal(expected.begin(), expected.end(), pyramid.getLevelData(l));
+		from = expected;
+		fromWidth = w;
+	}
+	printf("Levels of a %dx%d noise frame up to level %d: %s\n", width, height, level, ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/** Tests that level zero (or less) is the same as the full resolution parsing - returns the number of failures */
+int testLevelZero(int level) {
+	std::vector<uint8_t> grey(WIDTH * HEIGHT);
+	for(auto &p : grey) p = 200 + (rand() % 8);
+	for(int i = 0; i < 4; ++i) {
+		drawMarker(grey, WIDTH, HEIGHT, (i + 1) * WIDTH / 5, (i % 2 == 0) ? (HEIGHT / 3) : (2 * HEIGHT / 3), 40, 6);
+	}
+	PyramidConfig config;
+	config.level = level;
+	PyramidMCParser<> pyramid(config);
+	MCParser<> full;
+	ImageFrameResult expected = full.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	ImageFrameResult result = pyramid.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	// Rem.: the second frame checks that the parser state is clean after the first one
+	ImageFrameResult again = pyramid.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	bool ok = (expected.markers.size() == 4) && sameMarkerSet(expected.markers, result.markers) &&
+			sameMarkerSet(expected.markers, again.markers) && (pyramid.getLevelWidth(0) == WIDTH) &&
+			(pyramid.getLevelHeight(0) == HEIGHT) && (pyramid.getScannedPixels() == (size_t)WIDTH * HEIGHT);
+	printf("Level %d is the full resolution: %s - found %d markers (full: %d)\n", level, ok ? "OK" : "FAILED",
+			(int)result.markers.size(), (int)expected.markers.size());
+	return ok ? 0 : 1;
+}
+
+int main() {
+	printf("Testing PyramidMCParser...\n");
+
+	int failures = 0;
+	failures += testLevels(WIDTH, HEIGHT, 2);
+	failures += testLevels(101, 67, 3);
+	failures += testLevelZero(0);
+	failures += testLevelZero(-1);
+	failures += testFrame(4, 80, 1, 8);
+	failures += testFrame(4, 120, 2, 8);
+	failures += testFrame(8, 160, 2, 8);
+	failures += testFrame(4, 80, 1, 24);
+	failures += testFrame(4, 120, 2, 24);
+	failures += testFrame(8, 160, 2, 24);
+
+	printf("...testing PyramidMCParser ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,141 @@
+// Tests that the span-skipping nextSpan(..) calls give exactly the same tokens
+// and markers as the scalar - pixel-by-pixel - next(..) calls do. The bulk
+// processFrame(..) API is tested the same way (using its debug tokens).
+//
+// Compile with -mavx2 too to test the AVX2 kernels besides the SSE2 ones!
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "CImg.h"
+#include "mcparser.h"
+#include "testhelpers.h"
+
+using namespace cimg_library;
+
+/** Images tested when no parameter is given */
+static const char* DEFAULT_TEST_FILES[] = {
+	"v1_test/real_test1.jpg",
+	"v1_test/real_test2.jpg",
+	"v1_test/real_test3.jpg",
+	"v1_test/real_test4.jpg",
+	"v1_test/real_test4_a.jpg",
+	"v2_test/WP_20180507_07_55_35_Pro.jpg",
+	"v2_test/WP_20180507_07_56_00_Pro.jpg",
+	"v2_test/WP_20180508_09_05_47_Pro.jpg",
+	"v2_test/WP_20180508_09_05_52_Pro.jpg",
+	"v2_test/lores_07_56_00_Pro.jpg",
+};
+
+/** Collects every token and marker event of a frame (with its position) */
+struct FrameLog {
+	std::vector<int> events;
+	ImageFrameResult result;
+
+	void add(int x, int y, NexRes res, MCParser<> &mcp) {
+		if(res.isToken) {
+			events.push_back(x);
+			events.push_back(y);
+		}
+		if(res.foundMarker) {
+			events.push_back(-mcp.tokenizer.getMarkerX());
+			events.push_back(-mcp.tokenizer.getOrder());
+		}
+	}
+};
+
+/** Parse the frame using only next(..) */
+FrameLog parseScalar(const std::vector<unsigned char> &pixels, int width, int height) {
+	FrameLog log;
+	MCParser<> mcp;
+	for(int y = 0; y < height; ++y) {
+		for(int x = 0; x < width; ++x) {
+			log.add(x, y, mcp.next(pixels[x + y * width]), mcp);
+		}
+		mcp.endLine();
+	}
+	log.result = mcp.endImageFrame();
+	return log;
+}
+
+/** Parse the frame using nextSpan(..) wherever possible - and next(..) otherwise */
+FrameLog parseSpans(const std::vector<unsigned char> &pixels, int width, int height, long long &skipped) {
+	FrameLog log;
+	MCParser<> mcp;
+	for(int y = 0; y < height; ++y) {
+		const unsigned char *row = &pixels[y * width];
+		int x = 0;
+		while(x < width) {
+			int spanLen = mcp.nextSpan(row + x, width - x);
+			skipped += spanLen;
+			x += spanLen;
+			if(x < width) {
+				log.add(x, y, mcp.next(row[x]), mcp);
+				++x;
+			}
+		}
+		mcp.endLine();
+	}
+	log.result = mcp.endImageFrame();
+	return log;
+}
+
+/** Parse the frame using processFrame(..) - collecting the debug tokens */
+FrameLog parseBulk(const std::vector<unsigned char> &pixels, int width, int height) {
+	FrameLog log;
+	MCParser<> mcp;
+	std::vector<DebugToken> tokens;
+	log.result = mcp.processFrame(&pixels[0], width, height, width, &tokens);
+	for(auto &token : tokens) {
+		if(token.isToken) {
+			log.events.push_back(token.x);
+			log.events.push_back(token.y);
+		}
+		if(token.foundMarker) {
+			log.events.push_back(-token.markerX);
+			log.events.push_back(-token.order);
+		}
+	}
+	return log;
+}
+
+int main(int argc, char** argv) {
+	printf("Testing nextSpan(..) against next(..)...\n");
+
+	std::vector<std::string> testFiles;
+	for(int i = 1; i < argc; ++i) testFiles.push_back(argv[i]);
+	if(testFiles.empty()) {
+		for(auto f : DEFAULT_TEST_FILES) testFiles.push_back(f);
+	}
+
+	int failures = 0;
+	for(auto &testFile : testFiles) {
+		CImg<unsigned char> image(testFile.c_str());
+		int width = image.width();
+		int height = image.height();
+
+		// Rem.: red channel - just like in marker1_mc_eval
+		std::vector<unsigned char> pixels(width * height, 0);
+		cimg_forXY(image, x, y) {
+			pixels[x + y * width] = image(x, y, 0, 0);
+		}
+
+		long long skipped = 0;
+		FrameLog scalar = parseScalar(pixels, width, height);
+		FrameLog spans = parseSpans(pixels, width, height, skipped);
+		FrameLog bulk = parseBulk(pixels, width, height);
+
+		bool ok = (scalar.events == spans.events) && sameResults(scalar.result, spans.result)
+				&& (scalar.events == bulk.events) && sameResults(scalar.result, bulk.result);
+		if(!ok) ++failures;
+		printf("%s: %s (%d tokens, %d markers, %.1f%% of pixels skipped)\n",
+				testFile.c_str(), ok ? "OK" : "MISMATCH",
+				(int)scalar.events.size() / 2, (int)scalar.result.markers.size(),
+				(100.0 * skipped) / (width * height));
+	}
+
+	printf("...testing nextSpan(..) ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,156 @@
+// Accuracy versus speed of the scanline subsampling (MCParserConfig::rowStride) - with and
+// without the densification of the skipped scanlines and with different paddings for it.
+// Every image is parsed with different strides and compared to the result of parsing every
+// scanline: reports the time per frame, the ratio of parsed pixels, the number of found /
+// missed / extra markers and the mean position error of the found ones.
+//
+// Usage: subsample_bench [images...] - the v1_test and v2_test images are used by default
+
+#define FFL_NO_DEBUG_MODE 1 // no debug logging in the measured loops
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "CImg.h"
+#include "mcparser.h"
+
+using namespace cimg_library;
+
+// Repeat each frame this many times for more stable measurements
+#define RUNS_PER_FRAME 10
+
+// A marker is considered found when it is this close to the one found without subsampling
+#define MATCH_DISTANCE 10
+
+/** Images used when no parameter is given */
+static const char* DEFAULT_BENCH_FILES[] = {
+	"v1_test/real_test1.jpg",
+	"v1_test/real_test2.jpg",
+	"v1_test/real_test3.jpg",
+	"v1_test/real_test4.jpg",
+	"v1_test/real_test4_a.jpg",
+	"v2_test/WP_20180507_07_55_35_Pro.jpg",
+	"v2_test/WP_20180507_07_56_00_Pro.jpg",
+	"v2_test/WP_20180508_09_05_47_Pro.jpg",
+	"v2_test/WP_20180508_09_05_52_Pro.jpg",
+	"v2_test/lores_07_56_00_Pro.jpg",
+};
+
+/** Greyscale pixels of a loaded image */
+struct Frame {
+	std::vector<unsigned char> pixels;
+	int width;
+	int height;
+};
+
+/** Summed up measurement results of one configuration over all frames */
+struct StrideResult {
+	double msPerFrame = 0;
+	double scannedRatio = 0;
+	int found = 0;
+	int missed = 0;
+	int extra = 0;
+	double errorSum = 0;
+};
+
+/** Counts the markers of "result" that match (are close to) the ones in "expected" */
+void compare(const ImageFrameResult &expected, const ImageFrameResult &result, StrideResult &res) {
+	std::vector<bool> used(result.markers.size(), false);
+	for(const auto &e : expected.markers) {
+		int best = -1;
+		int bestDist = MATCH_DISTANCE + 1;
+		for(size_t i = 0; i < result.markers.size(); ++i) {
+			int dist = abs((int)e.x - (int)result.markers[i].x) + abs((int)e.y - (int)result.markers[i].y);
+			if(!used[i] && (dist < bestDist)) {
+				bestDist = dist;
+				best = (int)i;
+			}
+		}
+		if(best >= 0) {
+			used[best] = true;
+			++res.found;
+			res.errorSum += bestDist;
+		} else {
+			++res.missed;
+		}
+	}
+	for(bool u : used) {
+		if(!u) ++res.extra;
+	}
+}
+
+/** Parses all frames with the given configuration and compares the results to the expected ones */
+StrideResult measure(const std::vector<Frame> &frames, const std::vector<ImageFrameResult> &expected, MCParserConfig config) {
+	MCParser<> mcp(config);
+	StrideResult res;
+	for(size_t f = 0; f < frames.size(); ++f) {
+		const Frame &frame = frames[f];
+		auto result = mcp.processFrame(&frame.pixels[0], frame.width, frame.height, frame.width);
+		compare(expected[f], result, res);
+		res.scannedRatio += (double)mcp.getScannedPixels() / ((double)frame.width * frame.height);
+
+		auto start = std::chrono::steady_clock::now();
+		for(int k = 0; k < RUNS_PER_FRAME; ++k) {
+			mcp.processFrame(&frame.pixels[0], frame.width, frame.height, frame.width);
+		}
+		auto end = std::chrono::steady_clock::now();
+		res.msPerFrame += std::chrono::duration<double, std::milli>(end - start).count() / RUNS_PER_FRAME;
+	}
+	res.msPerFrame /= frames.size();
+	res.scannedRatio /= frames.size();
+	return res;
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> benchFiles;
+	for(int i = 1; i < argc; ++i) benchFiles.push_back(argv[i]);
+	if(benchFiles.empty()) {
+		for(auto f : DEFAULT_BENCH_FILES) benchFiles.push_back(f);
+	}
+
+	std::vector<Frame> frames;
+	for(auto &benchFile : benchFiles) {
+		CImg<unsigned char> image(benchFile.c_str());
+		Frame frame;
+		frame.width = image.width();
+		frame.height = image.height();
+		// Rem.: red channel - just like in marker1_mc_eval
+		frame.pixels.resize(frame.width * frame.height);
+		cimg_forXY(image, x, y) {
+			frame.pixels[x + y * frame.width] = image(x, y, 0, 0);
+		}
+		frames.push_back(frame);
+	}
+
+	// The reference: every scanline is parsed
+	std::vector<ImageFrameResult> expected;
+	int expectedMarkers = 0;
+	MCParser<> full;
+	for(auto &frame : frames) {
+		expected.push_back(full.processFrame(&frame.pixels[0], frame.width, frame.height, frame.width));
+		expectedMarkers += (int)expected.back().markers.size();
+	}
+	printf("Benchmarking scanline subsampling on %d image(s) with %d markers (%d runs each)...\n",
+			(int)frames.size(), expectedMarkers, RUNS_PER_FRAME);
+
+	// Rem.: zero padding means no densification
+	printf("%-7s %-8s %10s %9s %6s %7s %6s %10s\n", "stride", "padding", "ms/frame", "parsed", "found", "missed", "extra", "mean error");
+	for(unsigned int rowStride : { 1, 2, 3, 4, 6, 8 }) {
+		for(unsigned int densifyPadding : { 160, 320, 0 }) {
+			if((rowStride == 1) && (densifyPadding != 160)) continue;
+			MCParserConfig config;
+			config.rowStride = rowStride;
+			config.densifyPadding = densifyPadding;
+			auto res = measure(frames, expected, config);
+			printf("%-7u %-8u %10.3f %8.2f%% %6d %7d %6d %10.2f\n", rowStride, densifyPadding,
+					res.msPerFrame, res.scannedRatio * 100.0, res.found, res.missed, res.extra,
+					(res.found > 0) ? (res.errorSum / res.found) : 0.0);
+		}
+	}
+
+	return 0;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,81 @@
+// Tests the scanline subsampling of the MCParser (MCParserConfig::rowStride) on generated frames:
+// - With the densification the result must be the very same as without subsampling.
+// - Without the densification all the markers must be found close to where they really are.
+// Both must parse less pixels than the frame - the ratio is printed.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "mcparser.h"
+#include "testhelpers.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+
+/** Every marker of "expected" has one in "result" closer than maxDist (and the counts are the same) */
+bool closeMarkers(const ImageFrameResult &expected, const ImageFrameResult &result, int maxDist) {
+	if(expected.markers.size() != result.markers.size()) return false;
+	for(const auto &e : expected.markers) {
+		bool found = false;
+		for(const auto &r : result.markers) {
+			if((abs((int)e.x - (int)r.x) <= maxDist) && (abs((int)e.y - (int)r.y) <= maxDist)) found = true;
+		}
+		if(!found) return false;
+	}
+	return true;
+}
+
+/** Tests one stride with and without densification - returns the number of failures */
+int testStride(const std::vector<uint8_t> &grey, const ImageFrameResult &expected, unsigned int rowStride) {
+	int failures = 0;
+	MCParserConfig config;
+	config.rowStride = rowStride;
+	MCParser<> dense(config);
+	// Rem.: twice to see that nothing is left over from the earlier frame
+	dense.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	auto result = dense.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	bool ok = sameResults(expected, result);
+	if(!ok) ++failures;
+	printf("Stride %u with densification: %s (%d markers) - parsed %.2f%% of the pixels\n", rowStride, ok ? "OK" : "MISMATCH",
+			(int)result.markers.size(), 100.0 * dense.getScannedPixels() / (WIDTH * HEIGHT));
+
+	config.densifyPadding = 0;
+	MCParser<> sparse(config);
+	result = sparse.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	ok = closeMarkers(expected, result, (int)rowStride);
+	if(!ok) ++failures;
+	printf("Stride %u without densification: %s (%d markers) - parsed %.2f%% of the pixels\n", rowStride, ok ? "OK" : "MISMATCH",
+			(int)result.markers.size(), 100.0 * sparse.getScannedPixels() / (WIDTH * HEIGHT));
+	return failures;
+}
+
+int main() {
+	printf("Testing scanline subsampling of the MCParser...\n");
+
+	// A slightly noisy frame with markers of different sizes here and there
+	std::vector<uint8_t> grey(WIDTH * HEIGHT);
+	for(auto &p : grey) p = 224 + (rand() % 8);
+	drawMarker(grey, WIDTH, HEIGHT, 300, 200, 40, 6);
+	drawMarker(grey, WIDTH, HEIGHT, 900, 330, 60, 6);
+	drawMarker(grey, WIDTH, HEIGHT, 1500, 800, 50, 6);
+	drawMarker(grey, WIDTH, HEIGHT, 700, 750, 80, 6);
+	drawMarker(grey, WIDTH, HEIGHT, 1700, 250, 40, 6);
+
+	MCParser<> full;
+	auto expected = full.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+	int failures = 0;
+	if(expected.markers.size() != 5) {
+		printf("Found %d markers instead of 5 without subsampling - the test frame is bad!\n", (int)expected.markers.size());
+		++failures;
+	}
+	for(unsigned int rowStride : { 2, 3, 4, 8 }) {
+		failures += testStride(grey, expected, rowStride);
+	}
+
+	printf("...testing scanline subsampling ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,147 @@
+#ifndef FASTTRACK_TEST_HELPERS_H
+#define FASTTRACK_TEST_HELPERS_H
+
+// Fixtures shared by the tests and benchmarks: generated frames of markers, the raw webcam frames
+// of the input_poc directory and the comparisons of detection results.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "mcparser.h"
+
+/** Raw YUYV webcam frames - the missing ones are skipped */
+static const char* WEBCAM_TEST_FILES[] = {
+	"../input_poc/out_interesting/1/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/2/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/3_alg1/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/4_good/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/colormap/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/marker1/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/marker2/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/marker_reco1/webcam_output.yuv422.data",
+	"../input_poc/out_interesting/marker_reco2/webcam_output.yuv422.data",
+};
+#define WEBCAM_WIDTH 640
+#define WEBCAM_HEIGHT 480
+
+/** Loads the luma of a raw YUYV frame to the end of grey - returns false if it is not there */
+inline bool loadLuma(const char *file, std::vector<uint8_t> &grey) {
+	std::vector<uint8_t> yuyv(WEBCAM_WIDTH * WEBCAM_HEIGHT * 2);
+	FILE *f = fopen(file, "rb");
+	if((f == nullptr) || (fread(&yuyv[0], 1, yuyv.size(), f) != yuyv.size())) {
+		if(f != nullptr) fclose(f);
+		return false;
+	}
+	fclose(f);
+	for(int i = 0; i < WEBCAM_WIDTH * WEBCAM_HEIGHT; ++i) {
+		grey.push_back(yuyv[i * 2]);
+	}
+	return true;
+}
+
+/**
+ * Runs test(file, grey) on the luma of each webcam frame that is there and returns the sum of its results
+ * (the failures) - the missing frames are reported as skipped.
+ */
+template<typename TEST>
+inline int testWebcamFrames(TEST test) {
+	int failures = 0;
+	for(auto file : WEBCAM_TEST_FILES) {
+		std::vector<uint8_t> grey;
+		if(!loadLuma(file, grey)) {
+			printf("%s: SKIPPED (missing)\n", file);
+			continue;
+		}
+		failures += test(file, grey);
+	}
+	return failures;
+}
+
+/** Draws a marker like marker1_gen does - concentric circles getting lighter inwards and a black center */
+inline void drawMarker(std::vector<uint8_t> &grey, int width, int height, int midx, int midy, int circleSize, int circleStep) {
+	int colstep = 255 / (circleStep - 3);
+	int c = 0;
+	for(int i = circleStep - 1; i > 0; --i) {
+		int size = (i * circleSize) / circleStep;
+		int col = (i == 1) ? 0 : c;
+		for(int y = midy - size; y <= midy + size; ++y) {
+			for(int x = midx - size; x <= midx + size; ++x) {
+				if((x < 0) || (y < 0) || (x >= width) || (y >= height)) continue;
+				if((x - midx) * (x - midx) + (y - midy) * (y - midy) <= size * size) {
+					grey[y * width + x] = col;
+				}
+			}
+		}
+		c += colstep;
+	}
+}
+
+/** The layout of generateMarkers(..) - the defaults give a tight grid on a light, slightly noisy frame */
+struct MarkerGrid {
+	/** Free pixels before the first markers (besides the circleSize) */
+	int margin = 5;
+	/** Free pixels after the last markers (besides the circleSize) */
+	int endMargin = 0;
+	/** Distance of the markers in a row and of the rows - 0 means 2 * circleSize + 9 and 2 * circleSize + 7 */
+	int xStep = 0;
+	int yStep = 0;
+	/** Every row of markers is shifted right with rowShift * (row % shiftPeriod) */
+	int rowShift = 0;
+	int shiftPeriod = 1;
+	/** A white frame instead of the noisy light grey one */
+	bool white = false;
+};
+
+/** A frame with a grid of markers - the odd default spacing puts them on all kinds of (band, lane..) borders */
+inline std::vector<uint8_t> generateMarkers(int width, int height, int circleSize, MarkerGrid grid = MarkerGrid()) {
+	std::vector<uint8_t> grey(width * height, 255);
+	if(!grid.white) {
+		for(auto &p : grey) p = 224 + (rand() % 8);
+	}
+	int xStep = (grid.xStep > 0) ? grid.xStep : (2 * circleSize + 9);
+	int yStep = (grid.yStep > 0) ? grid.yStep : (2 * circleSize + 7);
+	int row = 0;
+	for(int y = circleSize + grid.margin; y + circleSize + grid.endMargin < height; y += yStep, ++row) {
+		int shift = (row % grid.shiftPeriod) * grid.rowShift;
+		for(int x = circleSize + grid.margin + shift; x + circleSize + grid.endMargin < width; x += xStep) {
+			drawMarker(grey, width, height, x, y, circleSize, 6);
+		}
+	}
+	return grey;
+}
+
+/** Same markers in the same order */
+inline bool sameResults(const std::vector<Marker2D> &a, const std::vector<Marker2D> &b) {
+	if(a.size() != b.size()) return false;
+	for(size_t i = 0; i < a.size(); ++i) {
+		if((a[i].x != b[i].x) || (a[i].y != b[i].y) || (a[i].confidence != b[i].confidence) || (a[i].order != b[i].order)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool sameResults(const ImageFrameResult &a, const ImageFrameResult &b) {
+	return sameResults(a.markers, b.markers);
+}
+
+inline bool lessMarker(const Marker2D &a, const Marker2D &b) {
+	return (a.x < b.x) || ((a.x == b.x) && (a.y < b.y));
+}
+
+/** Same marker positions and orders in any order - the confidences are not compared */
+inline bool sameMarkerSet(std::vector<Marker2D> a, std::vector<Marker2D> b) {
+	if(a.size() != b.size()) return false;
+	std::sort(a.begin(), a.end(), lessMarker);
+	std::sort(b.begin(), b.end(), lessMarker);
+	for(size_t i = 0; i < a.size(); ++i) {
+		if((a[i].x != b[i].x) || (a[i].y != b[i].y) || (a[i].order != b[i].order)) return false;
+	}
+	return true;
+}
+
+#endif // FASTTRACK_TEST_HELPERS_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,236 @@
+#ifndef FASTTRACK_TRACKING_MC_PARSER_H
+#define FASTTRACK_TRACKING_MC_PARSER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "microshackz.h"
+#include "mcparser.h"
+
+/** Holds configuration data values for TrackingMCParser */
+struct TrackingConfig {
+	/**
+	 * Half size of the scanned window around each predicted marker position (in pixels).
+	 * Rem.: Bounded from below like MCParserConfig::densifyPadding - the movement of a marker between two
+	 *       frames must fit into what is left of it.
+	 */
+	int windowPadding = 96;
+
+	/** A full-frame re-acquisition is done at least this often (in frames) to find new markers */
+	unsigned int reacquireEvery = 30;
+
+	/** Predict the positions using the last movement of the markers (otherwise just the last positions) */
+	bool useVelocity = true;
+};
+
+/**
+ * Frame-to-frame ROI tracking on top of an MCParser:
+ *
+ * After a full-frame parse the found markers are tracked - in the next frames only padded windows
+ * around the predicted positions are parsed (overlapping windows are merged so nothing is parsed
+ * twice). A full-frame re-acquisition happens every reacquireEvery frames and right away (on the
+ * very same frame) when any tracked marker is not found in its window. Results are always in
+ * full-frame coordinates.
+ *
+ * Template parameters are those of the MCParser.
+ */
+template<typename MT = uint8_t, typename CT = int, typename ATTRITION = DefaultAttrition, typename PRECISION = DefaultHomerPrecision,
+	typename CONFIG = RuntimeConfig, typename TOKENIZER = Hoparser<MT, CT, ATTRITION, PRECISION, CONFIG>>
+class TrackingMCParser final {
+public:
+	/** Parses the full frame or the windows */
+	using Parser = MCParser<MT, CT, ATTRITION, PRECISION, CONFIG, TOKENIZER>;
+
+	/** Create a tracking parser with default configuration */
+	TrackingMCParser() noexcept {
+	}
+
+	/** Create a tracking parser with the given tracking configuration and the given (already set up) parser */
+	TrackingMCParser(TrackingConfig trackingConfig, Parser mcParser = Parser()) noexcept
+		: config(trackingConfig), parser(std::move(mcParser)) {
+	}
+
+	/**
+	 * BULK FEED OF A WHOLE FRAME: same as MCParser::processFrame(..), but only the windows around the
+	 * tracked markers are parsed when that is possible. The stride is counted in MT elements.
+	 */
+	const ImageFrameResult processFrame(const MT *base, int width, int height, int stride) noexcept {
+		scannedPixels = 0;
+		ImageFrameResult ret;
+		bool full = tracks.empty() || (framesSinceFull + 1 >= config.reacquireEvery);
+		if(!full) {
+			ret = parseWindows(base, width, height, stride);
+			// A lost marker means it moved too much (or got occluded) - re-acquire right now
+			full = !updateTracks(ret, true);
+		}
+		if(full) {
+			ret = parser.processFrame(base, width, height, stride);
+			scannedPixels += (size_t)width * height;
+			updateTracks(ret, false);
+			framesSinceFull = 0;
+			lastWasFull = true;
+		} else {
+			++framesSinceFull;
+			lastWasFull = false;
+		}
+		return ret;
+	}
+
+	/** Forgets all tracked markers: the next frame is parsed fully */
+	inline void reset() noexcept {
+		tracks.clear();
+		framesSinceFull = 0;
+	}
+
+	/** Number of pixels parsed for the last frame (windows and any re-acquisition together) */
+	inline size_t getScannedPixels() const noexcept {
+		return scannedPixels;
+	}
+
+	/** True when the last frame was (also) parsed fully */
+	inline bool wasFullFrame() const noexcept {
+		return lastWasFull;
+	}
+
+	/** The tracking configuration in use */
+	inline const TrackingConfig& getConfig() const noexcept {
+		return config;
+	}
+
+private:
+	/** A tracked marker - with its last movement per frame */
+	struct Track final {
+		Marker2D marker;
+		int vx;
+		int vy;
+	};
+
+	/** A scanned rectangle of the frame: [x0, x1) x [y0, y1) */
+	struct Window final {
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+
+		inline bool overlaps(const Window &o) const noexcept {
+			return (x0 < o.x1) && (o.x0 < x1) && (y0 < o.y1) && (o.y0 < y1);
+		}
+	};
+
+	/** Predicted position of a track in the current frame */
+	inline void predict(const Track &t, int &px, int &py) const noexcept {
+		px = (int)t.marker.x + (config.useVelocity ? t.vx : 0);
+		py = (int)t.marker.y + (config.useVelocity ? t.vy : 0);
+	}
+
+	/** Parses the (merged) windows around the predicted positions */
+	ImageFrameResult parseWindows(const MT *base, int width, int height, int stride) noexcept {
+		windows.clear();
+		for(const auto &t : tracks) {
+			int px, py;
+			predict(t, px, py);
+			Window w{
+				std::max(0, px - config.windowPadding), std::max(0, py - config.windowPadding),
+				std::min(width, px + config.windowPadding + 1), std::min(height, py + config.windowPadding + 1)
+			};
+			if((w.x0 < w.x1) && (w.y0 < w.y1)) windows.push_back(w);
+		}
+		// Merge overlapping windows into their bounding boxes until none overlaps
+		// Rem.: quadratic, but there are only a few tracked markers
+		bool merged = true;
+		while(merged) {
+			merged = false;
+			for(size_t i = 0; !merged && (i < windows.size()); ++i) {
+				for(size_t j = i + 1; j < windows.size(); ++j) {
+					if(windows[i].overlaps(windows[j])) {
+						windows[i].x0 = std::min(windows[i].x0, windows[j].x0);
+						windows[i].y0 = std::min(windows[i].y0, windows[j].y0);
+						windows[i].x1 = std::max(windows[i].x1, windows[j].x1);
+						windows[i].y1 = std::max(windows[i].y1, windows[j].y1);
+						windows.erase(windows.begin() + j);
+						merged = true;
+						break;
+					}
+				}
+			}
+		}
+
+		ImageFrameResult ret;
+		for(const auto &w : windows) {
+			auto windowResult = parser.processFrame(base + (size_t)w.y0 * stride + w.x0, w.x1 - w.x0, w.y1 - w.y0, stride);
+			scannedPixels += (size_t)(w.x1 - w.x0) * (w.y1 - w.y0);
+			// Back to full-frame coordinates
+			for(auto m : windowResult.markers) {
+				m.x += w.x0;
+				m.y += w.y0;
+				ret.markers.push_back(m);
+			}
+		}
+		return ret;
+	}
+
+	/**
+	 * Matches the found markers to the tracks (nearest predicted position within the padding)
+	 * then replaces the tracks with the found markers - new ones have zero velocity.
+	 * Returns false if any of the earlier tracks was not found (when checkLost is true).
+	 */
+	bool updateTracks(const ImageFrameResult &result, bool checkLost) noexcept {
+		newTracks.clear();
+		matched.assign(tracks.size(), false);
+		for(const auto &m : result.markers) {
+			int best = -1;
+			int bestDist = config.windowPadding * 2 + 1;
+			for(size_t i = 0; i < tracks.size(); ++i) {
+				int px, py;
+				predict(tracks[i], px, py);
+				int dist = abs((int)m.x - px) + abs((int)m.y - py);
+				if(dist < bestDist) {
+					bestDist = dist;
+					best = (int)i;
+				}
+			}
+			if(best >= 0) {
+				matched[best] = true;
+				const Marker2D &old = tracks[best].marker;
+				newTracks.push_back(Track{m, (int)m.x - (int)old.x, (int)m.y - (int)old.y});
+			} else {
+				newTracks.push_back(Track{m, 0, 0});
+			}
+		}
+		if(checkLost) {
+			for(bool found : matched) {
+				if(!found) return false;
+			}
+		}
+		std::swap(tracks, newTracks);
+		return true;
+	}
+
+	/** Tracking configuration */
+	TrackingConfig config;
+
+	/** Parses the full frame or the windows */
+	Parser parser;
+
+	/** The markers of the last frame */
+	std::vector<Track> tracks;
+
+	// Reused between frames to avoid allocations
+	std::vector<Track> newTracks;
+	std::vector<bool> matched;
+	std::vector<Window> windows;
+
+	/** Frames parsed only in windows since the last full-frame parse */
+	unsigned int framesSinceFull = 0;
+
+	/** Number of pixels parsed for the last frame */
+	size_t scannedPixels = 0;
+
+	/** True when the last frame was (also) parsed fully */
+	bool lastWasFull = true;
+};
+
+#endif // FASTTRACK_TRACKING_MC_PARSER_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,89 @@
+// Tests the ROI tracking mode of trackingmcparser.h on generated 1080p frames
+// with four moving markers: every frame must give the same markers (in full-frame
+// coordinates) as a full MCParser::processFrame(..) and the tracked frames must
+// scan less than 10% of the pixels. One marker jumps far away at some point so
+// the re-acquisition of lost markers is tested too.
+
+#define FFL_NO_DEBUG_MODE 1 // no list debug logging in the test
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "trackingmcparser.h"
+#include "testhelpers.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FRAMES 90
+#define CIRCLE_SIZE 40
+/** At this frame the last marker jumps far away */
+#define JUMP_FRAME 45
+
+int main() {
+	printf("Testing TrackingMCParser...\n");
+
+	// Start positions and velocities of the markers
+	const int startX[] = { 300, 900, 1500, 700 };
+	const int startY[] = { 200, 300, 800, 700 };
+	const int vx[] = { 3, -2, 1, 4 };
+	const int vy[] = { 2, 1, -3, 0 };
+
+	MCParser<> full;
+	TrackingMCParser<> tracking;
+	std::vector<uint8_t> grey(WIDTH * HEIGHT);
+	int failures = 0;
+	int trackedFrames = 0;
+	int fullFrames = 0;
+	size_t trackedPixels = 0;
+	int firstFrameMarkers = 0;
+	for(int frame = 0; frame < FRAMES; ++frame) {
+		for(auto &p : grey) p = 224 + (rand() % 8);
+		for(int i = 0; i < 4; ++i) {
+			int x = startX[i] + vx[i] * frame;
+			int y = startY[i] + vy[i] * frame;
+			if((i == 3) && (frame >= JUMP_FRAME)) {
+				x += 600;
+				y -= 400;
+			}
+			drawMarker(grey, WIDTH, HEIGHT, x, y, CIRCLE_SIZE, 6);
+		}
+
+		auto expected = full.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+		auto result = tracking.processFrame(&grey[0], WIDTH, HEIGHT, WIDTH);
+		if(frame == 0) firstFrameMarkers = (int)expected.markers.size();
+		if(!sameMarkerSet(expected.markers, result.markers)) {
+			printf("Frame %d: MISMATCH (%d markers instead of %d)\n", frame, (int)result.markers.size(), (int)expected.markers.size());
+			++failures;
+		}
+		if(frame == JUMP_FRAME) {
+			// Rem.: more than the full frame means windows and then the re-acquisition
+			bool reacquired = tracking.wasFullFrame() && (tracking.getScannedPixels() > (size_t)WIDTH * HEIGHT);
+			printf("Frame %d: lost marker %s\n", frame, reacquired ? "re-acquired on the same frame" : "NOT RE-ACQUIRED");
+			if(!reacquired) ++failures;
+		}
+		if(tracking.wasFullFrame()) {
+			++fullFrames;
+		} else {
+			++trackedFrames;
+			trackedPixels += tracking.getScannedPixels();
+		}
+	}
+	if(firstFrameMarkers != 4) {
+		printf("Found %d markers instead of 4 on the first frame - the test frames are bad!\n", firstFrameMarkers);
+		++failures;
+	}
+
+	double ratio = (trackedFrames > 0) ? ((double)trackedPixels / trackedFrames / (WIDTH * HEIGHT)) : 1.0;
+	printf("%d tracked and %d full frames - tracked frames scanned %.2f%% of the pixels\n",
+			trackedFrames, fullFrames, ratio * 100.0);
+	if(ratio >= 0.1) {
+		printf("Tracked frames scan too many pixels!\n");
+		++failures;
+	}
+
+	printf("...testing TrackingMCParser ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,183 @@
+// Tests the capture mode negotiation of the V4LDevice (see chooseV4LMode(..) in v4lwrapper.h) on recorded
+// stand-ins of what the drivers list: one like the vivid test driver (with GREY) and one like a usual UVC
+// webcam (YUYV and MJPG only, lower frame rates at the bigger sizes).
+//
+// With a device path as the argument (for example a vivid device after "modprobe vivid") the device is
+// opened too: its modes are listed, the chosen mode, frame rate and controls are checked and frames are read.
+
+#define V4L_WRAPPER_NO_EXIT 1 // failing devices are test failures - not exits
+
+#include <cstdio>
+#include <vector>
+#include "v4lwrapper.h"
+
+/** Adds one mode for each size with the same frame rates */
+static void addModes(std::vector<V4LMode> &modes, uint32_t pixelFormat, std::vector<std::pair<int, int>> sizes,
+		std::vector<double> fps) {
+	for(auto &size : sizes) {
+		V4LMode mode;
+		mode.pixelFormat = pixelFormat;
+		mode.width = size.first;
+		mode.height = size.second;
+		mode.fps = fps;
+		for(double rate : fps) {
+			if(rate > mode.maxFps) mode.maxFps = rate;
+		}
+		modes.push_back(mode);
+	}
+}
+
+/** Like the webcam input of vivid: many formats (GREY among them) at the same sizes */
+static std::vector<V4LMode> vividModes() {
+	std::vector<V4LMode> modes;
+	std::vector<std::pair<int, int>> sizes = {{320, 180}, {640, 360}, {640, 480}, {1280, 720}, {1920, 1080}};
+	std::vector<double> fps = {1, 2, 4, 5, 10, 12.5, 15, 25, 30, 50, 60};
+	addModes(modes, V4L2_PIX_FMT_YUYV, sizes, fps);
+	addModes(modes, V4L2_PIX_FMT_UYVY, sizes, fps);
+	addModes(modes, V4L2_PIX_FMT_NV12, sizes, fps);
+	addModes(modes, V4L2_PIX_FMT_GREY, sizes, fps);
+	addModes(modes, V4L2_PIX_FMT_RGB24, sizes, fps);
+	return modes;
+}
+
+/** Like a usual UVC webcam: uncompressed YUYV is slow at big sizes, MJPG is not */
+static std::vector<V4LMode> webcamModes() {
+	std::vector<V4LMode> modes;
+	addModes(modes, V4L2_PIX_FMT_YUYV, {{320, 240}, {640, 480}}, {5, 10, 15, 20, 25, 30});
+	addModes(modes, V4L2_PIX_FMT_YUYV, {{800, 600}, {1280, 720}}, {5, 10});
+	addModes(modes, V4L2_PIX_FMT_MJPEG, {{320, 240}, {640, 480}, {800, 600}, {1280, 720}}, {5, 10, 15, 20, 25, 30});
+	return modes;
+}
+
+/** Checks the chosen mode of the config against the expected (-1 as the width when none should be chosen) */
+static int check(const char *name, const std::vector<V4LMode> &modes, const V4LConfig &config,
+		uint32_t pixelFormat, int width, int height) {
+	int chosen = chooseV4LMode(modes, config);
+	bool ok;
+	if(width < 0) {
+		ok = (chosen < 0);
+	} else {
+		ok = (chosen >= 0) && (modes[chosen].pixelFormat == pixelFormat)
+			&& (modes[chosen].width == width) && (modes[chosen].height == height);
+	}
+	if(chosen >= 0) {
+		printf("%s: %dx%d %s @ %.1f FPS max: %s\n", name, modes[chosen].width, modes[chosen].height,
+				fourccToString(modes[chosen].pixelFormat).c_str(), modes[chosen].maxFps, ok ? "OK" : "FAILED");
+	} else {
+		printf("%s: no mode: %s\n", name, ok ? "OK" : "FAILED");
+	}
+	return ok ? 0 : 1;
+}
+
+static int testChoices() {
+	int failures = 0;
+	V4LConfig config;
+	failures += check("vivid YUYV", vividModes(), config, V4L2_PIX_FMT_YUYV, 640, 480);
+	config.preferGrey = true;
+	failures += check("vivid GREY preferred", vividModes(), config, V4L2_PIX_FMT_GREY, 640, 480);
+	failures += check("webcam GREY preferred", webcamModes(), config, V4L2_PIX_FMT_YUYV, 640, 480);
+
+	// The size comes first: the nearest listed one
+	config.width = 1000;
+	config.height = 700;
+	failures += check("vivid nearest size", vividModes(), config, V4L2_PIX_FMT_GREY, 1280, 720);
+
+	// Then the frame rate: GREY that is too slow loses against YUYV that keeps up
+	std::vector<V4LMode> slowGrey = webcamModes();
+	addModes(slowGrey, V4L2_PIX_FMT_GREY, {{640, 480}}, {5, 15});
+	config.width = 640;
+	config.height = 480;
+	config.fps = 30;
+	failures += check("slow GREY", slowGrey, config, V4L2_PIX_FMT_YUYV, 640, 480);
+	config.fps = 15;
+	failures += check("slow GREY fast enough", slowGrey, config, V4L2_PIX_FMT_GREY, 640, 480);
+
+	// ...but the frame rate never beats the size
+	config.preferGrey = false;
+	config.width = 1280;
+	config.height = 720;
+	config.fps = 30;
+	failures += check("webcam HD YUYV", webcamModes(), config, V4L2_PIX_FMT_YUYV, 1280, 720);
+
+	// Unknown frame rates (ranges without a maximum) are not held against a mode
+	std::vector<V4LMode> unknownRate;
+	addModes(unknownRate, V4L2_PIX_FMT_YUYV, {{1280, 720}}, {});
+	failures += check("unknown frame rate", unknownRate, config, V4L2_PIX_FMT_YUYV, 1280, 720);
+
+	// Other formats are never chosen
+	config.pixelFormat = V4L2_PIX_FMT_UYVY;
+	failures += check("webcam without UYVY", webcamModes(), config, 0, -1, -1);
+	failures += check("nothing listed", std::vector<V4LMode>(), config, 0, -1, -1);
+	return failures;
+}
+
+static int testFourcc() {
+	bool ok = (fourccToString(V4L2_PIX_FMT_GREY) == "GREY") && (fourccToString(V4L2_PIX_FMT_YUYV) == "YUYV")
+		&& (fourccToString(0) == "....");
+	printf("fourccToString: %s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/** Opens the device with GREY preferred at 30 FPS and the tracking controls, then reads some frames */
+static int testDevice(const char *device) {
+	V4LConfig config;
+	config.device = device;
+	config.preferGrey = true;
+	config.fps = 30;
+	config.controls = V4LControls::tracking();
+	V4LDevice camera(config);
+	if(!camera.isOk()) {
+		printf("%s: could not open: FAILED\n", device);
+		return 1;
+	}
+	for(auto &mode : camera.enumerateModes()) {
+		printf("  %s %dx%d up to %.1f FPS\n", fourccToString(mode.pixelFormat).c_str(), mode.width, mode.height,
+				mode.maxFps);
+	}
+	printf("%s: capturing %dx%d %s at %.2f FPS\n", device, camera.getWidth(), camera.getHeight(),
+			fourccToString(camera.getPixelFormat()).c_str(), camera.getFps());
+
+	int failures = 0;
+	int value;
+	if(camera.getControl(V4L2_CID_EXPOSURE_AUTO, value) && (value != V4L2_EXPOSURE_MANUAL)) {
+		printf("%s: exposure is not manual: FAILED\n", device);
+		++failures;
+	}
+	if(camera.getControl(V4L2_CID_AUTO_WHITE_BALANCE, value) && (value != 0)) {
+		printf("%s: auto white balance is on: FAILED\n", device);
+		++failures;
+	}
+
+	unsigned int minBytes = camera.getWidth() * camera.getHeight();
+	if(camera.getPixelFormat() == V4L2_PIX_FMT_YUYV) minBytes *= 2;
+	auto start = std::chrono::steady_clock::now();
+	const int FRAMES = 30;
+	for(int i = 0; i < FRAMES; ++i) {
+		uint8_t *frame = camera.nextFrame();
+		if((frame == nullptr) || (camera.getBytesUsed() < minBytes)) {
+			printf("%s: frame %d is missing or short: FAILED\n", device, i);
+			++failures;
+			break;
+		}
+		camera.finishFrame();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%s: %d frames at %.2f FPS: %s\n", device, FRAMES, FRAMES / seconds, (failures == 0) ? "OK" : "FAILED");
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	printf("Testing the V4L2 capture mode negotiation...\n");
+
+	int failures = 0;
+	failures += testFourcc();
+	failures += testChoices();
+	if(argc > 1) {
+		failures += testDevice(argv[1]);
+	}
+
+	printf("...testing the V4L2 capture mode negotiation ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -17,7 +17,14 @@
 
 #include<chrono>
 #include <cstdint> /*uint8_t */
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
 #include <linux/ioctl.h>
 #include <linux/types.h>
 #include <linux/v4l2-common.h>
@@ -27,178 +34,173 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <poll.h>
+#include "asynccapture.h" // CapturedBuffer
 
 // Define when you need debug logging data
+// Rem.: Define V4L_WRAPPER_NO_DEBUG (from client code) to turn off this and the time logging - stdout stays clean
+#ifndef V4L_WRAPPER_NO_DEBUG
 #define V4L_WRAPPER_DEBUG_LOG 1
+#endif // V4L_WRAPPER_NO_DEBUG
 
 // define if you want exit(1) got called on errors - otherwise just the flag is set
+// Rem.: Define V4L_WRAPPER_NO_EXIT when one failing camera should not stop the others (see isOk())
+#ifndef V4L_WRAPPER_NO_EXIT
 #define EXIT_ON_ERROR 1
+#endif // V4L_WRAPPER_NO_EXIT
 
 // when defined we try to log how much time some of the operations take
+#ifndef V4L_WRAPPER_NO_DEBUG
 #define V4L_WRAPPER_DEBUG_TIME 1
+#endif // V4L_WRAPPER_NO_DEBUG
+
+/** Camera controls set when opening the device - negative values leave the control as it is */
+struct V4LControls {
+	/** V4L2_CID_EXPOSURE_AUTO: V4L2_EXPOSURE_MANUAL, V4L2_EXPOSURE_AUTO or one of the priority modes */
+	int exposureAuto = -1;
+	/** V4L2_CID_EXPOSURE_ABSOLUTE in 100 microsecond units */
+	int exposureAbsolute = -1;
+	/** V4L2_CID_EXPOSURE_AUTO_PRIORITY: 0 keeps the frame rate while exposing */
+	int exposureAutoPriority = -1;
+	/** V4L2_CID_AUTO_WHITE_BALANCE */
+	int autoWhiteBalance = -1;
+	/** V4L2_CID_GAIN */
+	int gain = -1;
 
-template<int WIDTH = 640, int HEIGHT = 480>
-class V4LWrapper {
-public:
-	/** Opens a video device and prepares streaming */
-	V4LWrapper() {
-		// 1.  Open the device
-		fd = open("/dev/video0",O_RDWR);
-		if(fd < 0){
-			perror("Failed to open device, OPEN");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
-		}
-
-
-		// 2. Ask the device if it can capture frames
-		if(ioctl(fd, VIDIOC_QUERYCAP, &capability) < 0){
-			// something went wrong... exit
-			perror("Failed to get device capabilities, VIDIOC_QUERYCAP");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
-		}
-
-		// 2.5.) Check for video capture and streaming capabilities
-		if(!(capability.capabilities & V4L2_CAP_VIDEO_CAPTURE)){
-			fprintf(stderr, "The device does not handle single-planar video capture.\n");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
-		}
-
-		if(!(capability.capabilities & V4L2_CAP_STREAMING)){
-			fprintf(stderr, "The device does not handle video capture streaming.\n");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
-		}
-
-
-		// 3. Set Image format
-		imageFormat.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		imageFormat.fmt.pix.width = WIDTH;
-		imageFormat.fmt.pix.height = HEIGHT;
-		imageFormat.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-		imageFormat.fmt.pix.field = V4L2_FIELD_NONE; // we could choose interlacing here - not interlaced
-		//imageFormat.fmt.pix.field = V4L2_FIELD_BOTTOM; // Only even lines? seems it does not work!
-		// tell the device you are using this format
-		if(ioctl(fd, VIDIOC_S_FMT, &imageFormat) < 0){
-			perror("Device could not set format, VIDIOC_S_FMT");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
-		}
+	/**
+	 * Manual exposure without auto white balance - the profile for tracking: a constant frame rate
+	 * (auto exposure drops many webcams to 5 FPS in a dim room) and a constant marker brightness.
+	 * The exposure is in 100 microsecond units - when negative the current exposure is kept.
+	 */
+	static V4LControls tracking(int exposure = -1) {
+		V4LControls controls;
+		controls.exposureAuto = V4L2_EXPOSURE_MANUAL;
+		controls.exposureAbsolute = exposure;
+		controls.exposureAutoPriority = 0;
+		controls.autoWhiteBalance = 0;
+		return controls;
+	}
+};
 
+/** What to open and how - the driver might adjust the resolution and the buffer count (see the getters) */
+struct V4LConfig {
+	/** Path of the video device */
+	std::string device = "/dev/video0";
+	int width = 640;
+	int height = 480;
+	/** The V4L2_PIX_FMT_* fourcc to capture - for example V4L2_PIX_FMT_YUYV or V4L2_PIX_FMT_GREY */
+	uint32_t pixelFormat = V4L2_PIX_FMT_YUYV;
+	/** Number of the buffers asked from the driver (the depth of its queue) */
+	int bufferCount = 4;
+	/** Capture V4L2_PIX_FMT_GREY instead of pixelFormat when the device has it - only the luma is used anyway */
+	bool preferGrey = false;
+	/** Frames per second to ask with VIDIOC_S_PARM - zero keeps the default of the driver */
+	double fps = 0;
+	/** Controls to set before streaming (nothing is changed by default) */
+	V4LControls controls;
+};
 
-		// 4. Request Buffers from the device
-		requestBuffer.count = 4; // one request buffer
-		//requestBuffer.count = 32; // TODO: need the code to handle it differently!
-		requestBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE; // request a buffer wich we an use for capturing frames
-		requestBuffer.memory = V4L2_MEMORY_MMAP;
+/** A capture mode of a device - see V4LDevice::enumerateModes() */
+struct V4LMode {
+	uint32_t pixelFormat = 0;
+	int width = 0;
+	int height = 0;
+	/** The highest frame rate of this format and size - zero when the driver does not tell */
+	double maxFps = 0;
+	/** The frame rates listed by the driver - empty when it gives a range (then only maxFps is known) */
+	std::vector<double> fps;
+};
 
-		if(ioctl(fd, VIDIOC_REQBUFS, &requestBuffer) < 0){
-			perror("Could not request buffer from device, VIDIOC_REQBUFS");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
+/** Printable form of a V4L2_PIX_FMT_* fourcc */
+inline std::string fourccToString(uint32_t fourcc) {
+	std::string str;
+	for(int i = 0; i < 4; ++i) {
+		char c = (char)((fourcc >> (8 * i)) & 0xff);
+		str += (c >= 32 && c < 127) ? c : '.';
+	}
+	return str;
+}
+
+/**
+ * Chooses from the modes the device lists: the nearest size to the asked one first, then a mode
+ * that can keep the asked frame rate, then GREY (when preferred) over the asked pixel format.
+ * Other pixel formats are never chosen. Returns the index of the mode or -1 when none fits.
+ * Rem.: Separate from the device so it can be tested with recorded mode lists.
+ */
+inline int chooseV4LMode(const std::vector<V4LMode> &modes, const V4LConfig &config) {
+	int best = -1;
+	int bestSizeDiff = 0;
+	int bestSlow = 0;
+	int bestRank = 0;
+	for(int i = 0; i < (int)modes.size(); ++i) {
+		const V4LMode &mode = modes[i];
+		int rank;
+		if(config.preferGrey && (mode.pixelFormat == V4L2_PIX_FMT_GREY)) {
+			rank = 0;
+		} else if(mode.pixelFormat == config.pixelFormat) {
+			rank = 1;
+		} else {
+			continue;
 		}
-
-#ifdef V4L_WRAPPER_DEBUG_LOG
-		printf("The number of request buffers is: %d\n", requestBuffer.count);
-#endif // V4L_WRAPPER_DEBUG_LOG
-
-		for(int i = 0; i < requestBuffer.count; ++i) {
-			// 5. Query the buffer to get raw data ie. ask for the requested buffer
-			// and allocate memory for it
-			v4l2_buffer queryBuffer = {0};
-			memset(&queryBuffer, 0, sizeof(queryBuffer));
-			queryBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			queryBuffer.memory = V4L2_MEMORY_MMAP;
-			queryBuffer.index = i;
-			if(ioctl(fd, VIDIOC_QUERYBUF, &queryBuffer) < 0){
-				perror("Device did not return the buffer information, VIDIOC_QUERYBUF");
-#ifdef EXIT_ON_ERROR
-				exit(1);
-#endif
-				errorFlag = true;
-			}
-			// use a pointer to point to the newly created buffer
-			// mmap() will map the memory address of the device to
-			// an address in memory
-			buffers[i] = (uint8_t*)mmap(NULL, queryBuffer.length, PROT_READ | PROT_WRITE, MAP_SHARED,
-								fd, queryBuffer.m.offset);
-			memset(buffers[i], 0, queryBuffer.length);
-
-
-			// 6. Prepare buffer to get a frame
-			// Create a new buffer type so the device knows whichbuffer we are talking about
-			memset(&bufferinfos[i], 0, sizeof(bufferinfos[i]));
-			bufferinfos[i].type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			bufferinfos[i].memory = V4L2_MEMORY_MMAP;
-			bufferinfos[i].index = i;
-
-			// Activate streaming - I have read that on some devices there must be a QUEUE buffer beforehand!!!
-			if(ioctl(fd, VIDIOC_STREAMON, &bufferinfos[i].type) < 0){
-				perror("Could not start streaming, VIDIOC_STREAMON");
-#ifdef EXIT_ON_ERROR
-				exit(1);
-#endif
-				errorFlag = true;
-			}
+		int sizeDiff = abs(mode.width - config.width) + abs(mode.height - config.height);
+		// Rem.: Unknown frame rates are not held against the mode
+		int slow = ((config.fps > 0) && (mode.maxFps > 0) && (mode.maxFps + 0.01 < config.fps)) ? 1 : 0;
+		if((best < 0) || (sizeDiff < bestSizeDiff)
+				|| ((sizeDiff == bestSizeDiff) && ((slow < bestSlow) || ((slow == bestSlow) && (rank < bestRank))))) {
+			best = i;
+			bestSizeDiff = sizeDiff;
+			bestSlow = slow;
+			bestRank = rank;
 		}
-
-		memset(&bufferinfo, 0, sizeof(bufferinfo));
-		bufferinfo.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		bufferinfo.memory = V4L2_MEMORY_MMAP;
-	    //bufferinfo.index = 1; // UNUSED: only type, memory, reserved are used
-
-		// Queue the buffer - this asks the HW to start filling the buffer
-		for(int i = 0; i < requestBuffer.count; ++i) {
-			if(ioctl(fd, VIDIOC_QBUF, &bufferinfos[i]) < 0){
-				perror("Could not queue buffer, VIDIOC_QBUF");
-#ifdef EXIT_ON_ERROR
-				exit(1);
-#endif
-				errorFlag = true;
-			}
+	}
+	return best;
+}
+
+/**
+ * A video4linux2 capture device configured at runtime. Single-planar and multi-planar
+ * (V4L2_CAP_VIDEO_CAPTURE_MPLANE) devices are both handled - for multi-planar formats the
+ * frame data is the first plane (the luma plane of the usual planar YUV formats).
+ *
+ * Every state is per object so more devices can be used at the same time (for example one
+ * AsyncCapture for each). Check isOk() after construction when EXIT_ON_ERROR is not defined.
+ *
+ * The capture mode is negotiated from what the driver lists (see chooseV4LMode(..)) and the frame
+ * rate and the controls of the config are set before streaming - so no v4l2-ctl is needed by hand.
+ */
+class V4LDevice {
+public:
+	/** Opens a video device and starts streaming */
+	V4LDevice(const V4LConfig &config = V4LConfig()) : config(config) {
+		if(openDevice() && setFormat() && setFrameRate()) {
+			applyControls();
+			if(mapBuffers()) startStreaming();
 		}
 	}
 
 	/** Closes resources - or at least tries to do so*/
-	~V4LWrapper() {
-		// end streaming
-		for(int i = 0; i < requestBuffer.count; ++i) {
-			if(ioctl(fd, VIDIOC_STREAMOFF, &bufferinfos[i].type) < 0) {
+	~V4LDevice() {
+		if(streaming) {
+			// end streaming
+			int type = bufferType;
+			if(ioctl(fd, VIDIOC_STREAMOFF, &type) < 0) {
 				perror("Could not end streaming, VIDIOC_STREAMOFF");
-#ifdef EXIT_ON_ERROR
-				exit(1);
-#endif
-				errorFlag = true;
 			}
 		}
-
-		close(fd);
+		for(auto &buffer : buffers) {
+			for(int p = 0; p < buffer.planeCount; ++p) {
+				munmap(buffer.start[p], buffer.length[p]);
+			}
+		}
+		if(fd >= 0) close(fd);
 	}
 
+	V4LDevice(const V4LDevice&) = delete;
+	V4LDevice& operator=(const V4LDevice&) = delete;
+
 	/** Should be ALWAYS called after a nextFrame after processing of memory area is done! */
 	void finishFrame() {
 		// Just ask the driver to refill the buffer we just processed
-		if(ioctl(fd, VIDIOC_QBUF, &bufferinfo) < 0){
-			perror("Could not queue buffer, VIDIOC_QBUF");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
-		}
+		requeue(bufferinfo.index);
 	}
 
 	/**
@@ -211,12 +213,10 @@ public:
 		auto start = std::chrono::steady_clock::now();
 #endif // V4L_WRAPPER_DEBUG_TIME
 		// Dequeue the buffer - this waits here until hardware finishes
+		prepareInfo(bufferinfo, bufferplanes);
 		if(ioctl(fd, VIDIOC_DQBUF, &bufferinfo) < 0){
-			perror("Could not dequeue the buffer, VIDIOC_DQBUF");
-#ifdef EXIT_ON_ERROR
-			exit(1);
-#endif
-			errorFlag = true;
+			fail("Could not dequeue the buffer, VIDIOC_DQBUF");
+			return nullptr;
 		}
 
 #ifdef V4L_WRAPPER_DEBUG_TIME
@@ -226,7 +226,7 @@ public:
 		// Frames get written after dequeuing the buffer
 
 #ifdef V4L_WRAPPER_DEBUG_LOG
-		printf("The buffer has %d KBytes of data\n", bufferinfo.bytesused / 1024);
+		printf("The buffer has %d KBytes of data\n", getBytesUsed() / 1024);
 #endif // V4L_WRAPPER_DEBUG_LOG
 
 #ifdef V4L_WRAPPER_DEBUG_TIME
@@ -235,25 +235,486 @@ public:
 		printf("Videoframe grab took %f ms\n", std::chrono::duration<double, std::milli>(diff).count());
 #endif // V4L_WRAPPER_DEBUG_TIME
 
-		return buffers[bufferinfo.index];
+		return buffers[bufferinfo.index].start[0];
+	}
+
+	/** The number of the buffers we got from the driver */
+	int bufferCount() {
+		return (int)buffers.size();
+	}
+
+	/**
+	 * Waits at most timeoutMs milliseconds (forever if negative) for the next filled buffer and dequeues it.
+	 * Unlike nextFrame() more buffers can be dequeued before giving them back with requeue(..) - so this is
+	 * what AsyncCapture uses (see asynccapture.h). Returns false on timeout and errors - isOk() tells which.
+	 * Rem.: Do not mix with nextFrame() and finishFrame()!
+	 * Rem.: Never exits on errors (not even with EXIT_ON_ERROR) as this runs on the capture thread.
+	 */
+	bool dequeue(CapturedBuffer &out, int timeoutMs = -1) {
+		pollfd pfd = {0};
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		int ready = poll(&pfd, 1, timeoutMs);
+		if(ready == 0) return false;
+		if(ready < 0) {
+			// Rem.: A signal is just like a timeout
+			return (errno == EINTR) ? false : report("Could not wait for a frame, poll");
+		}
+		// Rem.: POLLERR without data when the device is gone (or not streaming anymore)
+		if(!(pfd.revents & POLLIN)) {
+			errno = EIO;
+			return report("The device stopped giving frames, poll");
+		}
+
+		v4l2_buffer info;
+		v4l2_plane planes[VIDEO_MAX_PLANES];
+		prepareInfo(info, planes);
+		if(ioctl(fd, VIDIOC_DQBUF, &info) < 0){
+			if((errno == EAGAIN) || (errno == EINTR)) return false;
+			return report("Could not dequeue the buffer, VIDIOC_DQBUF");
+		}
+
+		out.index = info.index;
+		out.data = buffers[info.index].start[0];
+		out.bytesUsed = multiPlanar ? planes[0].bytesused : info.bytesused;
+		out.sequence = info.sequence;
+		out.captured = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	/**
+	 * Gives back a buffer got from dequeue(..) to the driver for filling - can be called from any thread.
+	 * Rem.: Never exits on errors (like dequeue(..)) - see isOk()
+	 */
+	void requeue(int index) {
+		// Rem.: Each buffer has its own v4l2_buffer so the buffers can be given back in any order
+		if(ioctl(fd, VIDIOC_QBUF, &buffers[index].info) < 0){
+			report("Could not queue buffer, VIDIOC_QBUF");
+		}
 	}
 
 	/** This tells the number of bytes filled into the buffer after nextFrame returns */
 	unsigned int getBytesUsed() {
-		return bufferinfo.bytesused;
+		return multiPlanar ? bufferplanes[0].bytesused : bufferinfo.bytesused;
+	}
+
+	/** The distance of the rows in bytes as told by the driver (rows might be padded) */
+	unsigned int getBytesPerLine() {
+		return bytesPerLine;
 	}
-	
+
+	/** The width as set by the driver (might differ from the asked one) */
+	int getWidth() {
+		return width;
+	}
+
+	/** The height as set by the driver (might differ from the asked one) */
+	int getHeight() {
+		return height;
+	}
+
+	/** The V4L2_PIX_FMT_* fourcc as set by the driver (might differ from the asked one) */
+	uint32_t getPixelFormat() {
+		return pixelFormat;
+	}
+
+	/** Frames per second as told by the driver - zero when it does not tell */
+	double getFps() {
+		return fps;
+	}
+
+	/** Path of the device */
+	const std::string& getDevice() {
+		return config.device;
+	}
+
+	/** True for V4L2_CAP_VIDEO_CAPTURE_MPLANE devices - the frame data is the first plane then */
+	bool isMultiPlanar() {
+		return multiPlanar;
+	}
+
+	/** False when something went wrong (only useful when EXIT_ON_ERROR is not defined) */
+	bool isOk() {
+		return !errorFlag;
+	}
+
+	/**
+	 * Lists the formats, sizes and frame rates of the device (VIDIOC_ENUM_FMT, VIDIOC_ENUM_FRAMESIZES
+	 * and VIDIOC_ENUM_FRAMEINTERVALS). For stepwise and continuous sizes only the allowed size nearest
+	 * to the configured one is listed - and the configured size when the driver does not list sizes.
+	 */
+	std::vector<V4LMode> enumerateModes() {
+		std::vector<V4LMode> modes;
+		v4l2_fmtdesc format;
+		memset(&format, 0, sizeof(format));
+		format.type = bufferType;
+		for(format.index = 0; ioctl(fd, VIDIOC_ENUM_FMT, &format) == 0; ++format.index) {
+			v4l2_frmsizeenum size;
+			memset(&size, 0, sizeof(size));
+			size.pixel_format = format.pixelformat;
+			bool listed = false;
+			for(size.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; ++size.index) {
+				listed = true;
+				if(size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+					addMode(modes, format.pixelformat, size.discrete.width, size.discrete.height);
+				} else {
+					// Rem.: Stepwise (or continuous with a step of one) - this is the only item
+					const v4l2_frmsize_stepwise &range = size.stepwise;
+					addMode(modes, format.pixelformat,
+							nearestStep(config.width, range.min_width, range.max_width, range.step_width),
+							nearestStep(config.height, range.min_height, range.max_height, range.step_height));
+					break;
+				}
+			}
+			if(!listed) {
+				addMode(modes, format.pixelformat, config.width, config.height);
+			}
+		}
+		return modes;
+	}
+
+	/**
+	 * Sets a control (V4L2_CID_*) clamped to its range. Returns false (and logs) when the device
+	 * does not have the control or refuses the value - that is not an error of the device.
+	 */
+	bool setControl(uint32_t id, int value) {
+		v4l2_queryctrl query;
+		memset(&query, 0, sizeof(query));
+		query.id = id;
+		if((ioctl(fd, VIDIOC_QUERYCTRL, &query) < 0) || (query.flags & V4L2_CTRL_FLAG_DISABLED)) {
+#ifdef V4L_WRAPPER_DEBUG_LOG
+			printf("%s: no control 0x%x\n", config.device.c_str(), id);
+#endif // V4L_WRAPPER_DEBUG_LOG
+			return false;
+		}
+		v4l2_control control;
+		memset(&control, 0, sizeof(control));
+		control.id = id;
+		control.value = (value < query.minimum) ? query.minimum : ((value > query.maximum) ? query.maximum : value);
+		if(ioctl(fd, VIDIOC_S_CTRL, &control) < 0) {
+			fprintf(stderr, "%s: could not set %s: ", config.device.c_str(), (const char*)query.name);
+			perror("VIDIOC_S_CTRL");
+			return false;
+		}
+		return true;
+	}
+
+	/** Reads a control (V4L2_CID_*) into value - false when the device does not have it */
+	bool getControl(uint32_t id, int &value) {
+		v4l2_control control;
+		memset(&control, 0, sizeof(control));
+		control.id = id;
+		if(ioctl(fd, VIDIOC_G_CTRL, &control) < 0) return false;
+		value = control.value;
+		return true;
+	}
+
 private:
+	/** A mapped buffer of the driver with its own v4l2_buffer for queueing */
+	struct Buffer {
+		v4l2_buffer info;
+		v4l2_plane planes[VIDEO_MAX_PLANES];
+		uint8_t *start[VIDEO_MAX_PLANES];
+		size_t length[VIDEO_MAX_PLANES];
+		int planeCount = 0;
+	};
+
+	/** Adds the mode with its frame rates (VIDIOC_ENUM_FRAMEINTERVALS) */
+	void addMode(std::vector<V4LMode> &modes, uint32_t pixelFormat, int width, int height) {
+		V4LMode mode;
+		mode.pixelFormat = pixelFormat;
+		mode.width = width;
+		mode.height = height;
+		v4l2_frmivalenum interval;
+		memset(&interval, 0, sizeof(interval));
+		interval.pixel_format = pixelFormat;
+		interval.width = width;
+		interval.height = height;
+		for(interval.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) == 0; ++interval.index) {
+			if(interval.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+				double rate = toFps(interval.discrete);
+				mode.fps.push_back(rate);
+				if(rate > mode.maxFps) mode.maxFps = rate;
+			} else {
+				// Rem.: The shortest interval is the highest frame rate
+				mode.maxFps = toFps(interval.stepwise.min);
+				break;
+			}
+		}
+		modes.push_back(mode);
+	}
+
+	/** Frames per second of a frame interval (zero for an invalid interval) */
+	static double toFps(const v4l2_fract &interval) {
+		return (interval.numerator > 0) ? ((double)interval.denominator / interval.numerator) : 0;
+	}
+
+	/** The allowed value of min + k * step nearest to the wanted one */
+	static int nearestStep(int wanted, int min, int max, int step) {
+		if(wanted <= min) return min;
+		if(wanted >= max) return max;
+		if(step <= 0) step = 1;
+		return min + ((wanted - min + step / 2) / step) * step;
+	}
+
+	/** Logs the error and exits or sets the error flag - always returns false */
+	bool fail(const char *what) {
+		report(what);
+#ifdef EXIT_ON_ERROR
+		exit(1);
+#endif
+		return false;
+	}
+
+	/** Logs the error and sets the error flag (never exits: for the calls from other threads) - returns false */
+	bool report(const char *what) {
+		fprintf(stderr, "%s: ", config.device.c_str());
+		perror(what);
+		errorFlag = true;
+		return false;
+	}
+
+	/** Fills the type and memory fields (and the plane array when multi-planar) for the ioctls */
+	void prepareInfo(v4l2_buffer &info, v4l2_plane *planes) {
+		memset(&info, 0, sizeof(info));
+		info.type = bufferType;
+		info.memory = V4L2_MEMORY_MMAP;
+		if(multiPlanar) {
+			memset(planes, 0, sizeof(v4l2_plane) * VIDEO_MAX_PLANES);
+			info.m.planes = planes;
+			info.length = VIDEO_MAX_PLANES;
+		}
+	}
+
+	bool openDevice() {
+		// 1.  Open the device
+		fd = open(config.device.c_str(), O_RDWR);
+		if(fd < 0){
+			return fail("Failed to open device, OPEN");
+		}
+
+		// 2. Ask the device if it can capture frames
+		v4l2_capability capability;
+		memset(&capability, 0, sizeof(capability));
+		if(ioctl(fd, VIDIOC_QUERYCAP, &capability) < 0){
+			return fail("Failed to get device capabilities, VIDIOC_QUERYCAP");
+		}
+		// Rem.: capabilities are of the whole physical device - device_caps tells about this node
+		uint32_t caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ? capability.device_caps : capability.capabilities;
+
+		// 2.5.) Check for video capture and streaming capabilities
+		if(caps & V4L2_CAP_VIDEO_CAPTURE) {
+			multiPlanar = false;
+			bufferType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		} else if(caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+			multiPlanar = true;
+			bufferType = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+		} else {
+			errno = ENOTTY;
+			return fail("The device does not handle video capture");
+		}
+
+		if(!(caps & V4L2_CAP_STREAMING)){
+			errno = ENOTTY;
+			return fail("The device does not handle video capture streaming");
+		}
+		return true;
+	}
+
+	bool setFormat() {
+		// 3. Choose the mode from the ones listed - or just ask the configured one if none fits
+		V4LMode wanted;
+		wanted.pixelFormat = config.pixelFormat;
+		wanted.width = config.width;
+		wanted.height = config.height;
+		std::vector<V4LMode> modes = enumerateModes();
+		int chosen = chooseV4LMode(modes, config);
+		if(chosen >= 0) wanted = modes[chosen];
+#ifdef V4L_WRAPPER_DEBUG_LOG
+		printf("%s: %d modes listed, asking %dx%d %s\n", config.device.c_str(), (int)modes.size(),
+				wanted.width, wanted.height, fourccToString(wanted.pixelFormat).c_str());
+#endif // V4L_WRAPPER_DEBUG_LOG
+
+		// 3.5. Set Image format
+		v4l2_format imageFormat;
+		memset(&imageFormat, 0, sizeof(imageFormat));
+		imageFormat.type = bufferType;
+		if(multiPlanar) {
+			imageFormat.fmt.pix_mp.width = wanted.width;
+			imageFormat.fmt.pix_mp.height = wanted.height;
+			imageFormat.fmt.pix_mp.pixelformat = wanted.pixelFormat;
+			imageFormat.fmt.pix_mp.field = V4L2_FIELD_NONE;
+		} else {
+			imageFormat.fmt.pix.width = wanted.width;
+			imageFormat.fmt.pix.height = wanted.height;
+			imageFormat.fmt.pix.pixelformat = wanted.pixelFormat;
+			imageFormat.fmt.pix.field = V4L2_FIELD_NONE; // we could choose interlacing here - not interlaced
+		}
+		// tell the device you are using this format
+		if(ioctl(fd, VIDIOC_S_FMT, &imageFormat) < 0){
+			return fail("Device could not set format, VIDIOC_S_FMT");
+		}
+
+		// Rem.: The driver changes the fields to what it really does
+		if(multiPlanar) {
+			width = imageFormat.fmt.pix_mp.width;
+			height = imageFormat.fmt.pix_mp.height;
+			pixelFormat = imageFormat.fmt.pix_mp.pixelformat;
+			bytesPerLine = imageFormat.fmt.pix_mp.plane_fmt[0].bytesperline;
+		} else {
+			width = imageFormat.fmt.pix.width;
+			height = imageFormat.fmt.pix.height;
+			pixelFormat = imageFormat.fmt.pix.pixelformat;
+			bytesPerLine = imageFormat.fmt.pix.bytesperline;
+		}
+#ifdef V4L_WRAPPER_DEBUG_LOG
+		if((width != wanted.width) || (height != wanted.height) || (pixelFormat != wanted.pixelFormat)) {
+			printf("%s: the driver set %dx%d %s instead\n", config.device.c_str(), width, height,
+					fourccToString(pixelFormat).c_str());
+		}
+#endif // V4L_WRAPPER_DEBUG_LOG
+		return true;
+	}
+
+	bool setFrameRate() {
+		v4l2_streamparm parm;
+		memset(&parm, 0, sizeof(parm));
+		parm.type = bufferType;
+		if(ioctl(fd, VIDIOC_G_PARM, &parm) < 0) {
+			// Rem.: Not every driver has streaming parameters - that is only a problem when we want a frame rate
+			if(config.fps > 0) fprintf(stderr, "%s: cannot set the frame rate\n", config.device.c_str());
+			return true;
+		}
+		if((config.fps > 0) && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+			// Rem.: In milliframes so 29.97 and the like work too
+			parm.parm.capture.timeperframe.numerator = 1000;
+			parm.parm.capture.timeperframe.denominator = (uint32_t)lround(config.fps * 1000);
+			if(ioctl(fd, VIDIOC_S_PARM, &parm) < 0) {
+				return fail("Could not set the frame rate, VIDIOC_S_PARM");
+			}
+		} else if(config.fps > 0) {
+			fprintf(stderr, "%s: the driver has no frame rate setting\n", config.device.c_str());
+		}
+		// The driver tells what it really does in the same struct
+		fps = toFps(parm.parm.capture.timeperframe);
+#ifdef V4L_WRAPPER_DEBUG_LOG
+		printf("%s: %.2f FPS\n", config.device.c_str(), fps);
+#endif // V4L_WRAPPER_DEBUG_LOG
+		return true;
+	}
+
+	void applyControls() {
+		const V4LControls &controls = config.controls;
+		// Rem.: The mode first - the absolute exposure is inactive while auto exposure is on
+		if(controls.exposureAuto >= 0) setControl(V4L2_CID_EXPOSURE_AUTO, controls.exposureAuto);
+		if(controls.exposureAutoPriority >= 0) setControl(V4L2_CID_EXPOSURE_AUTO_PRIORITY, controls.exposureAutoPriority);
+		if(controls.exposureAbsolute >= 0) setControl(V4L2_CID_EXPOSURE_ABSOLUTE, controls.exposureAbsolute);
+		if(controls.autoWhiteBalance >= 0) setControl(V4L2_CID_AUTO_WHITE_BALANCE, controls.autoWhiteBalance);
+		if(controls.gain >= 0) setControl(V4L2_CID_GAIN, controls.gain);
+	}
+
+	bool mapBuffers() {
+		// 4. Request Buffers from the device
+		v4l2_requestbuffers requestBuffer;
+		memset(&requestBuffer, 0, sizeof(requestBuffer));
+		requestBuffer.count = config.bufferCount;
+		requestBuffer.type = bufferType; // request a buffer wich we an use for capturing frames
+		requestBuffer.memory = V4L2_MEMORY_MMAP;
+
+		if(ioctl(fd, VIDIOC_REQBUFS, &requestBuffer) < 0){
+			return fail("Could not request buffer from device, VIDIOC_REQBUFS");
+		}
+
+#ifdef V4L_WRAPPER_DEBUG_LOG
+		printf("The number of request buffers is: %d\n", requestBuffer.count);
+#endif // V4L_WRAPPER_DEBUG_LOG
+
+		// Rem.: Sized once - the v4l2_buffer of each points to its own plane array inside
+		buffers.resize(requestBuffer.count);
+		for(int i = 0; i < (int)requestBuffer.count; ++i) {
+			// 5. Query the buffer to get raw data ie. ask for the requested buffer
+			// and allocate memory for it
+			Buffer &buffer = buffers[i];
+			prepareInfo(buffer.info, buffer.planes);
+			buffer.info.index = i;
+			if(ioctl(fd, VIDIOC_QUERYBUF, &buffer.info) < 0){
+				return fail("Device did not return the buffer information, VIDIOC_QUERYBUF");
+			}
+
+			// use a pointer to point to the newly created buffer
+			// mmap() will map the memory address of the device to
+			// an address in memory
+			int planeCount = multiPlanar ? buffer.info.length : 1;
+			for(int p = 0; p < planeCount; ++p) {
+				size_t length = multiPlanar ? buffer.planes[p].length : buffer.info.length;
+				off_t offset = multiPlanar ? buffer.planes[p].m.mem_offset : buffer.info.m.offset;
+				void *start = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+				if(start == MAP_FAILED) {
+					return fail("Could not map the buffer, mmap");
+				}
+				buffer.start[p] = (uint8_t*)start;
+				buffer.length[p] = length;
+				buffer.planeCount = p + 1;
+				memset(start, 0, length);
+			}
+
+			// 6. Prepare buffer to get a frame
+			// Rem.: QUERYBUF filled the fields - only the ones needed for queueing are kept
+			prepareInfo(buffer.info, buffer.planes);
+			buffer.info.index = i;
+		}
+		return true;
+	}
+
+	bool startStreaming() {
+		// Queue the buffers - this asks the HW to start filling them
+		for(int i = 0; i < (int)buffers.size(); ++i) {
+			if(ioctl(fd, VIDIOC_QBUF, &buffers[i].info) < 0){
+				return fail("Could not queue buffer, VIDIOC_QBUF");
+			}
+		}
+
+		// Activate streaming - after the first buffers are queued as some devices need them beforehand
+		int type = bufferType;
+		if(ioctl(fd, VIDIOC_STREAMON, &type) < 0){
+			return fail("Could not start streaming, VIDIOC_STREAMON");
+		}
+		streaming = true;
+		return true;
+	}
+
+	V4LConfig config;
 	// A file descriptor to the video device
-	int fd;
-	v4l2_capability capability;
-	v4l2_format imageFormat;
-	v4l2_requestbuffers requestBuffer = {0};
-	//uint8_t *buffer;
-	uint8_t *buffers[32];
-	v4l2_buffer bufferinfo; // buffer that we successfully grabbed
-	v4l2_buffer bufferinfos[32];
-	bool errorFlag = false;
+	int fd = -1;
+	bool multiPlanar = false;
+	uint32_t bufferType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	int width = 0;
+	int height = 0;
+	uint32_t pixelFormat = 0;
+	unsigned int bytesPerLine = 0;
+	double fps = 0;
+	std::vector<Buffer> buffers;
+	v4l2_buffer bufferinfo = {}; // buffer that we successfully grabbed with nextFrame()
+	v4l2_plane bufferplanes[VIDEO_MAX_PLANES] = {};
+	bool streaming = false;
+	// Rem.: Atomic as the capture thread of an AsyncCapture can set it
+	std::atomic<bool> errorFlag{false};
+};
+
+/** The device with a compile-time resolution and YUYV frames - as the camera apps use it */
+template<int WIDTH = 640, int HEIGHT = 480>
+class V4LWrapper : public V4LDevice {
+public:
+	V4LWrapper(const char *device = "/dev/video0") : V4LDevice(makeConfig(device)) {}
+
+private:
+	static V4LConfig makeConfig(const char *device) {
+		V4LConfig config;
+		config.device = device;
+		config.width = WIDTH;
+		config.height = HEIGHT;
+		return config;
+	}
 };
 
 #endif //_V4L_WRAPPER_H
@@ -0,0 +1,153 @@
+// Benchmarks every attrition and precision variant of the Homer on the same images - and the
+// runtime configured parsers against the compile-time configured (CompileTimeConfig) ones.
+// Reports the time per pixel (for both the next(..)-only and the nextSpan(..) paths) and
+// the number of found markers so that the cheapest good-enough variant can be picked.
+
+#define FFL_NO_DEBUG_MODE 1 // no debug logging in the measured loops
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "CImg.h"
+#include "mcparser.h"
+
+using namespace cimg_library;
+
+// Repeat each frame this many times for more stable measurements
+#define RUNS_PER_FRAME 10
+
+/** Images used when no parameter is given */
+static const char* DEFAULT_BENCH_FILES[] = {
+	"v1_test/real_test1.jpg",
+	"v1_test/real_test2.jpg",
+	"v1_test/real_test3.jpg",
+	"v1_test/real_test4.jpg",
+	"v1_test/real_test4_a.jpg",
+	"v2_test/WP_20180507_07_55_35_Pro.jpg",
+	"v2_test/WP_20180507_07_56_00_Pro.jpg",
+	"v2_test/WP_20180508_09_05_47_Pro.jpg",
+	"v2_test/WP_20180508_09_05_52_Pro.jpg",
+	"v2_test/lores_07_56_00_Pro.jpg",
+};
+
+/** Greyscale pixels of a loaded image */
+struct Frame {
+	std::vector<unsigned char> pixels;
+	int width;
+	int height;
+};
+
+/** Measurement results for one variant */
+struct VariantResult {
+	const char *name;
+	double nsPerPixelNext;
+	double nsPerPixelSpan;
+	int markers;
+};
+
+/** Parses a frame with the given parser - using nextSpan(..) too when useSpans is true */
+template<typename MCP>
+ImageFrameResult parseFrame(MCP &mcp, const Frame &frame, bool useSpans) {
+	for(int y = 0; y < frame.height; ++y) {
+		const unsigned char *row = &frame.pixels[y * frame.width];
+		int x = 0;
+		while(x < frame.width) {
+			if(useSpans) {
+				x += mcp.nextSpan(row + x, frame.width - x);
+				if(x >= frame.width) break;
+			}
+			mcp.next(row[x]);
+			++x;
+		}
+		mcp.endLine();
+	}
+	return mcp.endImageFrame();
+}
+
+/** Returns the nanoseconds per pixel spent in parsing all frames RUNS_PER_FRAME times */
+template<typename MCP>
+double measure(const std::vector<Frame> &frames, bool useSpans, int &markers) {
+	MCP mcp;
+	long long pixelCount = 0;
+	markers = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(auto &frame : frames) {
+		for(int k = 0; k < RUNS_PER_FRAME; ++k) {
+			auto result = parseFrame(mcp, frame, useSpans);
+			if(k == 0) markers += (int)result.markers.size();
+		}
+		pixelCount += (long long)frame.width * frame.height * RUNS_PER_FRAME;
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / pixelCount;
+}
+
+/** Measures one ATTRITION, PRECISION and CONFIG policy combination */
+template<typename ATTRITION, typename PRECISION, typename CONFIG = RuntimeConfig>
+VariantResult benchVariant(const char *name, const std::vector<Frame> &frames) {
+	typedef MCParser<uint8_t, int, ATTRITION, PRECISION, CONFIG> MCP;
+	VariantResult res;
+	int spanMarkers = 0;
+	res.name = name;
+	res.nsPerPixelNext = measure<MCP>(frames, false, res.markers);
+	res.nsPerPixelSpan = measure<MCP>(frames, true, spanMarkers);
+	if(spanMarkers != res.markers) {
+		fprintf(stderr, "Warning: %s found %d markers with spans and %d without!\n", name, spanMarkers, res.markers);
+	}
+	return res;
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> benchFiles;
+	for(int i = 1; i < argc; ++i) benchFiles.push_back(argv[i]);
+	if(benchFiles.empty()) {
+		for(auto f : DEFAULT_BENCH_FILES) benchFiles.push_back(f);
+	}
+
+	std::vector<Frame> frames;
+	long long pixelCount = 0;
+	for(auto &benchFile : benchFiles) {
+		CImg<unsigned char> image(benchFile.c_str());
+		Frame frame;
+		frame.width = image.width();
+		frame.height = image.height();
+		// Rem.: red channel - just like in marker1_mc_eval
+		frame.pixels.resize(frame.width * frame.height);
+		cimg_forXY(image, x, y) {
+			frame.pixels[x + y * frame.width] = image(x, y, 0, 0);
+		}
+		pixelCount += (long long)frame.width * frame.height;
+		frames.push_back(frame);
+	}
+	printf("Benchmarking Homer variants on %d image(s) with %lld pixels (%d runs each)...\n",
+			(int)frames.size(), pixelCount, RUNS_PER_FRAME);
+
+	std::vector<VariantResult> results;
+	results.push_back(benchVariant<NoAttrition, FastHomerPrecision>("NoAttrition", frames));
+	results.push_back(benchVariant<SimpleAttrition, FastHomerPrecision>("SimpleAttrition", frames));
+	results.push_back(benchVariant<LinearAttrition, FastHomerPrecision>("LinearAttrition", frames));
+	results.push_back(benchVariant<ExponentialAttrition, FastHomerPrecision>("ExponentialAttrition", frames));
+	results.push_back(benchVariant<NoAttrition, SlowPreciseHomerPrecision>("NoAttrition+SlowPrecise", frames));
+	results.push_back(benchVariant<SimpleAttrition, SlowPreciseHomerPrecision>("SimpleAttrition+SlowPrecise", frames));
+	results.push_back(benchVariant<LinearAttrition, SlowPreciseHomerPrecision>("LinearAttrition+SlowPrecise", frames));
+	results.push_back(benchVariant<ExponentialAttrition, SlowPreciseHomerPrecision>("ExponentialAttrition+SlowPrecise", frames));
+	// Rem.: Same (default) setup values as above, but as compile-time constants
+	results.push_back(benchVariant<NoAttrition, FastHomerPrecision, CompileTimeConfig>("NoAttrition+CompileTime", frames));
+	results.push_back(benchVariant<SimpleAttrition, FastHomerPrecision, CompileTimeConfig>("SimpleAttrition+CompileTime", frames));
+	results.push_back(benchVariant<LinearAttrition, FastHomerPrecision, CompileTimeConfig>("LinearAttrition+CompileTime", frames));
+	results.push_back(benchVariant<ExponentialAttrition, FastHomerPrecision, CompileTimeConfig>("ExponentialAttrition+CompileTime", frames));
+
+	printf("%-34s %14s %14s %8s\n", "variant", "next ns/px", "nextSpan ns/px", "markers");
+	size_t cheapest = 0;
+	for(size_t i = 0; i < results.size(); ++i) {
+		printf("%-34s %14.3f %14.3f %8d\n", results[i].name,
+				results[i].nsPerPixelNext, results[i].nsPerPixelSpan, results[i].markers);
+		if(results[i].nsPerPixelSpan < results[cheapest].nsPerPixelSpan) cheapest = i;
+	}
+	printf("Cheapest variant: %s\n", results[cheapest].name);
+
+	return 0;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,536 @@
+#ifndef FASTTRACK_VIRTUAL_CAMERA_H
+#define FASTTRACK_VIRTUAL_CAMERA_H
+
+// A camera that replays recorded frames - for measuring and testing the capture pipeline where there
+// is no camera at all (CI, headless build boxes). It has the interface of the V4LDevice (v4lwrapper.h):
+// nextFrame() / finishFrame() / getBytesUsed() and dequeue(..) / requeue(..) / bufferCount() for the
+// AsyncCapture - so it can be put in its place.
+//
+// Replayed files (when more are given, their frames follow each other):
+// - raw frame dumps like input_poc/out_interesting/*/webcam_output.yuv422.data: YUYV or GREY frames
+//   of the configured size - a file can hold more frames
+// - Y4M (YUV4MPEG2) files: only the luma plane is given out - as GREY frames
+// - binary PGM (P5) images
+// - anything CImg can load (like the JPEGs of v1_test and v2_test) when VIRTUAL_CAMERA_CIMG is defined
+//
+// The files are mmap-ed so the frames are not copied (only the ones decoded by CImg are in memory).
+//
+// Like a real camera it captures at its frame rate whether or not the frames are taken: when all of
+// its buffers are taken the frame is lost (see VirtualCameraStats::lost). With a zero frame rate it
+// captures a frame whenever one is asked for (as fast as possible - nothing is lost then).
+//
+// Usage:
+//
+//     VirtualCameraConfig config;
+//     config.files.push_back("../input_poc/out_interesting/marker_reco1/webcam_output.yuv422.data");
+//     VirtualCamera camera(config);
+//     AsyncCapture<VirtualCamera> capture(camera);
+//     ...
+//     auto stats = camera.getStats(); // sustained FPS, lost frames, latencies
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <linux/videodev2.h> // V4L2_PIX_FMT_*
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "asynccapture.h" // CapturedBuffer
+
+#ifdef VIRTUAL_CAMERA_CIMG
+#include "CImg.h"
+#endif // VIRTUAL_CAMERA_CIMG
+
+/** What to replay and how */
+struct VirtualCameraConfig {
+	/** The files to replay in this order */
+	std::vector<std::string> files;
+	/** Size of the frames in the raw dumps (the other files tell their own size) */
+	int width = 640;
+	int height = 480;
+	/** Format of the raw dumps: V4L2_PIX_FMT_YUYV or V4L2_PIX_FMT_GREY */
+	uint32_t pixelFormat = V4L2_PIX_FMT_YUYV;
+	/** Frames per second - zero means as fast as the frames are taken */
+	double fps = 30;
+	/** Number of the buffers - like the queue depth of a V4L2 driver */
+	int bufferCount = 4;
+	/** Start again after the last frame - otherwise the camera ends (nextFrame() gives nullptr then) */
+	bool loop = true;
+};
+
+/** Measurements of a VirtualCamera since it was created */
+struct VirtualCameraStats {
+	/** Frames captured into a buffer */
+	uint64_t captured = 0;
+	/** Frames lost because all buffers were taken */
+	uint64_t lost = 0;
+	/** Frames given back (finishFrame() or requeue(..)) */
+	uint64_t released = 0;
+	/** Given back frames per second - the sustained frame rate of the consumer */
+	double fps = 0;
+	/** Milliseconds from the capture to the give back of the frames */
+	double meanLatencyMs = 0;
+	double maxLatencyMs = 0;
+};
+
+/** Replays recorded frames like a camera - see the top of this file */
+class VirtualCamera {
+public:
+	/** Maps (or loads) the files - check isOk() after this */
+	VirtualCamera(const VirtualCameraConfig &config) : config(config) {
+		for(const auto &file : config.files) {
+			if(!addFile(file)) {
+				errorFlag = true;
+				break;
+			}
+		}
+		if(!errorFlag && frames.empty()) {
+			fprintf(stderr, "VirtualCamera: there are no frames to replay!\n");
+			errorFlag = true;
+		}
+		buffers.resize((config.bufferCount > 0) ? config.bufferCount : 1);
+		start = Clock::now();
+	}
+
+	~VirtualCamera() {
+		for(auto &mapping : mappings) {
+			munmap(mapping.first, mapping.second);
+		}
+	}
+
+	VirtualCamera(const VirtualCamera&) = delete;
+	VirtualCamera& operator=(const VirtualCamera&) = delete;
+
+	/** Waits for the next frame - nullptr when the replay ended (no loop) or on errors */
+	uint8_t* nextFrame() {
+		hasCurrent = dequeue(current, -1);
+		return hasCurrent ? current.data : nullptr;
+	}
+
+	/** Should be ALWAYS called after a nextFrame after processing of memory area is done! */
+	void finishFrame() {
+		if(hasCurrent) requeue(current.index);
+		hasCurrent = false;
+	}
+
+	/** This tells the number of bytes filled into the buffer after nextFrame returns */
+	unsigned int getBytesUsed() {
+		return frameBytes;
+	}
+
+	/** The distance of the rows in bytes */
+	unsigned int getBytesPerLine() {
+		return bytesPerLine;
+	}
+
+	int getWidth() {
+		return width;
+	}
+
+	int getHeight() {
+		return height;
+	}
+
+	/** V4L2_PIX_FMT_YUYV or V4L2_PIX_FMT_GREY */
+	uint32_t getPixelFormat() {
+		return pixelFormat;
+	}
+
+	/** The configured frame rate - zero for as fast as possible */
+	double getFps() {
+		return config.fps;
+	}
+
+	/** Number of the replayed frames (before looping) */
+	int frameCount() {
+		return (int)frames.size();
+	}
+
+	/** True when the replay ended (no loop) and every captured frame was taken */
+	bool hasEnded() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return ended() && filled.empty();
+	}
+
+	/** False when some file could not be replayed */
+	bool isOk() {
+		return !errorFlag;
+	}
+
+	/** The number of the buffers */
+	int bufferCount() {
+		return (int)buffers.size();
+	}
+
+	/**
+	 * Waits at most timeoutMs milliseconds (forever if negative) for the next captured frame - see
+	 * V4LDevice::dequeue(..). Returns false on timeout, when the replay ended and on errors.
+	 * Rem.: After the end of the replay the timeout is waited out (like a camera without frames) and after
+	 *       an error isOk() is false (an AsyncCapture ends then) - so neither makes a capture thread spin.
+	 */
+	bool dequeue(CapturedBuffer &out, int timeoutMs = -1) {
+		if(errorFlag) return false;
+		std::unique_lock<std::mutex> lock(mutex);
+		bool forever = (timeoutMs < 0);
+		auto deadline = Clock::now() + std::chrono::milliseconds(forever ? 0 : timeoutMs);
+		while(true) {
+			auto now = Clock::now();
+			if(config.fps > 0) {
+				advance(now);
+			} else if(filled.empty() && !ended()) {
+				// As fast as possible: the frame is captured right when it is asked for
+				int index = freeBuffer();
+				if(index >= 0) capture(index, now);
+			}
+
+			if(!filled.empty()) {
+				int index = filled.front();
+				filled.pop_front();
+				Buffer &buffer = buffers[index];
+				buffer.state = LEASED;
+				out.index = index;
+				out.data = frames[buffer.sequence % frames.size()];
+				out.bytesUsed = frameBytes;
+				out.sequence = (uint32_t)buffer.sequence;
+				out.captured = buffer.captured;
+				return true;
+			}
+			if(!forever && (now >= deadline)) return false;
+			if(ended()) {
+				// Rem.: Like a camera without frames: waits out the timeout so a capture thread does not spin
+				if(!forever) available.wait_until(lock, deadline);
+				return false;
+			}
+
+			// Sleep until the next frame is due or a buffer is given back
+			auto wakeUp = (config.fps > 0) ? dueTime(nextSequence) : (now + std::chrono::seconds(1));
+			if(!forever && (deadline < wakeUp)) wakeUp = deadline;
+			available.wait_until(lock, wakeUp);
+		}
+	}
+
+	/** Gives back a buffer got from dequeue(..) - can be called from any thread */
+	void requeue(int index) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto now = Clock::now();
+		// Rem.: The frames due until now could not get into this buffer
+		if(config.fps > 0) advance(now);
+		Buffer &buffer = buffers[index];
+		if(buffer.state != LEASED) return;
+		buffer.state = FREE;
+		double latencyMs = std::chrono::duration<double, std::milli>(now - buffer.captured).count();
+		latencySumMs += latencyMs;
+		if(latencyMs > maxLatencyMs) maxLatencyMs = latencyMs;
+		++released;
+		available.notify_all();
+	}
+
+	/** The measurements so far */
+	VirtualCameraStats getStats() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if(config.fps > 0) advance(Clock::now());
+		VirtualCameraStats stats;
+		stats.captured = captured;
+		stats.lost = lost;
+		stats.released = released;
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		stats.fps = (seconds > 0) ? (released / seconds) : 0;
+		stats.meanLatencyMs = (released > 0) ? (latencySumMs / released) : 0;
+		stats.maxLatencyMs = maxLatencyMs;
+		return stats;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	enum BufferState { FREE, FILLED, LEASED };
+
+	struct Buffer {
+		BufferState state = FREE;
+		uint64_t sequence = 0;
+		Clock::time_point captured;
+	};
+
+	/** When the frame of the sequence number is captured (with a non-zero frame rate) */
+	inline Clock::time_point dueTime(uint64_t sequence) const {
+		return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(sequence / config.fps));
+	}
+
+	inline bool ended() const {
+		return !config.loop && (nextSequence >= frames.size());
+	}
+
+	inline int freeBuffer() const {
+		for(int i = 0; i < (int)buffers.size(); ++i) {
+			if(buffers[i].state == FREE) return i;
+		}
+		return -1;
+	}
+
+	inline void capture(int index, Clock::time_point when) {
+		Buffer &buffer = buffers[index];
+		buffer.state = FILLED;
+		buffer.sequence = nextSequence++;
+		buffer.captured = when;
+		filled.push_back(index);
+		++captured;
+	}
+
+	/** Captures the frames due until now into the free buffers - the ones without a free buffer are lost */
+	void advance(Clock::time_point now) {
+		while(!ended() && (dueTime(nextSequence) <= now)) {
+			int index = freeBuffer();
+			if(index >= 0) {
+				capture(index, dueTime(nextSequence));
+			} else {
+				++nextSequence;
+				++lost;
+			}
+		}
+	}
+
+	/** Checks the size and format of the frames of a file against the earlier files */
+	bool setGeometry(const std::string &file, int w, int h, uint32_t format, unsigned int stride) {
+		if(frames.empty()) {
+			width = w;
+			height = h;
+			pixelFormat = format;
+			bytesPerLine = stride;
+			frameBytes = stride * h;
+			return true;
+		}
+		if((w != width) || (h != height) || (format != pixelFormat) || (stride != bytesPerLine)) {
+			fprintf(stderr, "VirtualCamera: the frames of %s differ from the earlier ones!\n", file.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/** Maps the whole file read-only (writes only change our private copy) - nullptr on errors */
+	uint8_t* mapFile(const std::string &file, size_t &length) {
+		int fd = open(file.c_str(), O_RDONLY);
+		if(fd < 0) {
+			perror(("VirtualCamera: cannot open " + file).c_str());
+			return nullptr;
+		}
+		struct stat st;
+		void *data = MAP_FAILED;
+		if((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+			length = st.st_size;
+			data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+		if(data == MAP_FAILED) {
+			fprintf(stderr, "VirtualCamera: cannot map %s!\n", file.c_str());
+			return nullptr;
+		}
+		mappings.push_back(std::make_pair(data, length));
+		return (uint8_t*)data;
+	}
+
+	bool addFile(const std::string &file) {
+		std::string extension = file.substr(file.find_last_of('.') + 1);
+		if(extension == "y4m") return addY4m(file);
+		if(extension == "pgm") return addPgm(file);
+#ifdef VIRTUAL_CAMERA_CIMG
+		if((extension != "data") && (extension != "raw") && (extension != "yuv")) return addImage(file);
+#endif // VIRTUAL_CAMERA_CIMG
+		return addRaw(file);
+	}
+
+	/** Raw frames of the configured size and format one after the other */
+	bool addRaw(const std::string &file) {
+		unsigned int stride = config.width * ((config.pixelFormat == V4L2_PIX_FMT_YUYV) ? 2 : 1);
+		if(!setGeometry(file, config.width, config.height, config.pixelFormat, stride)) return false;
+		size_t length;
+		uint8_t *data = mapFile(file, length);
+		if(data == nullptr) return false;
+		if((length % frameBytes) != 0) {
+			fprintf(stderr, "VirtualCamera: %s is not made of %dx%d %s frames!\n", file.c_str(), width, height,
+					(pixelFormat == V4L2_PIX_FMT_YUYV) ? "YUYV" : "GREY");
+			return false;
+		}
+		for(size_t offset = 0; offset < length; offset += frameBytes) {
+			frames.push_back(data + offset);
+		}
+		return true;
+	}
+
+	/** Reads the next unsigned number of a text header skipping whitespace and # comments - -1 on errors */
+	static long readHeaderNumber(const uint8_t *data, size_t length, size_t &pos) {
+		while(pos < length) {
+			if(data[pos] == '#') {
+				while((pos < length) && (data[pos] != '\n')) ++pos;
+			} else if(isspace(data[pos])) {
+				++pos;
+			} else {
+				break;
+			}
+		}
+		if((pos >= length) || !isdigit(data[pos])) return -1;
+		long value = 0;
+		while((pos < length) && isdigit(data[pos]) && (value < 1000000)) {
+			value = value * 10 + (data[pos++] - '0');
+		}
+		return value;
+	}
+
+	/** Binary PGM: "P5 width height maxval" and a single whitespace before the pixels */
+	bool addPgm(const std::string &file) {
+		size_t length;
+		uint8_t *data = mapFile(file, length);
+		if(data == nullptr) return false;
+		size_t pos = 2;
+		long w = -1, h = -1, maxValue = -1;
+		if((length > 2) && (data[0] == 'P') && (data[1] == '5')) {
+			w = readHeaderNumber(data, length, pos);
+			h = readHeaderNumber(data, length, pos);
+			maxValue = readHeaderNumber(data, length, pos);
+		}
+		++pos;
+		if((w <= 0) || (h <= 0) || (maxValue <= 0) || (maxValue > 255) || (pos + w * h > length)) {
+			fprintf(stderr, "VirtualCamera: %s is not an 8 bit binary PGM!\n", file.c_str());
+			return false;
+		}
+		if(!setGeometry(file, w, h, V4L2_PIX_FMT_GREY, w)) return false;
+		frames.push_back(data + pos);
+		return true;
+	}
+
+	/** YUV4MPEG2: a header line then "FRAME" lines each followed by the planes (the luma first) */
+	bool addY4m(const std::string &file) {
+		size_t length;
+		uint8_t *data = mapFile(file, length);
+		if(data == nullptr) return false;
+		const char *MAGIC = "YUV4MPEG2 ";
+		const uint8_t *headerEnd = (const uint8_t*)memchr(data, '\n', length);
+		if((length < strlen(MAGIC)) || (memcmp(data, MAGIC, strlen(MAGIC)) != 0) || (headerEnd == nullptr)) {
+			fprintf(stderr, "VirtualCamera: %s is not a Y4M file!\n", file.c_str());
+			return false;
+		}
+
+		// The parameters are separated by spaces - the first letter tells which one it is
+		std::string header((const char*)data, headerEnd - data);
+		long w = 0, h = 0;
+		std::string colorSpace = "420";
+		size_t pos = strlen(MAGIC);
+		while(pos < header.size()) {
+			size_t end = header.find(' ', pos);
+			if(end == std::string::npos) end = header.size();
+			std::string param = header.substr(pos, end - pos);
+			if(!param.empty()) {
+				if(param[0] == 'W') w = atol(param.c_str() + 1);
+				if(param[0] == 'H') h = atol(param.c_str() + 1);
+				if(param[0] == 'C') colorSpace = param.substr(1);
+			}
+			pos = end + 1;
+		}
+
+		size_t chromaBytes;
+		size_t chromaW = (w + 1) / 2;
+		size_t chromaH = (h + 1) / 2;
+		if(colorSpace == "mono") {
+			chromaBytes = 0;
+		} else if(colorSpace.compare(0, 3, "420") == 0) {
+			chromaBytes = 2 * chromaW * chromaH;
+		} else if(colorSpace == "422") {
+			chromaBytes = 2 * chromaW * h;
+		} else if(colorSpace == "444") {
+			chromaBytes = 2 * w * h;
+		} else {
+			fprintf(stderr, "VirtualCamera: the %s colour space of %s is not supported!\n", colorSpace.c_str(),
+					file.c_str());
+			return false;
+		}
+		if((w <= 0) || (h <= 0) || !setGeometry(file, w, h, V4L2_PIX_FMT_GREY, w)) {
+			if((w <= 0) || (h <= 0)) fprintf(stderr, "VirtualCamera: %s has no frame size!\n", file.c_str());
+			return false;
+		}
+
+		size_t planeBytes = (size_t)w * h + chromaBytes;
+		size_t offset = (headerEnd - data) + 1;
+		while(offset < length) {
+			const uint8_t *lineEnd = (const uint8_t*)memchr(data + offset, '\n', length - offset);
+			if((lineEnd == nullptr) || (lineEnd - (data + offset) < 5) || (memcmp(data + offset, "FRAME", 5) != 0)) {
+				fprintf(stderr, "VirtualCamera: broken frame header in %s!\n", file.c_str());
+				return false;
+			}
+			offset = (lineEnd - data) + 1;
+			if(offset + planeBytes > length) {
+				fprintf(stderr, "VirtualCamera: the last frame of %s is cut!\n", file.c_str());
+				return false;
+			}
+			frames.push_back(data + offset);
+			offset += planeBytes;
+		}
+		return true;
+	}
+
+#ifdef VIRTUAL_CAMERA_CIMG
+	/** Any image CImg can load - decoded into greyscale once */
+	bool addImage(const std::string &file) {
+		cimg_library::CImg<unsigned char> image;
+		try {
+			image.load(file.c_str());
+		} catch(cimg_library::CImgException &e) {
+			fprintf(stderr, "VirtualCamera: cannot load %s!\n", file.c_str());
+			return false;
+		}
+		if(!setGeometry(file, image.width(), image.height(), V4L2_PIX_FMT_GREY, image.width())) return false;
+		std::vector<uint8_t> grey(image.width() * image.height());
+		cimg_forXY(image, x, y) {
+			// Same luma weights as the camera formats have (BT.601)
+			grey[x + y * image.width()] = (image.spectrum() >= 3)
+				? (uint8_t)((299 * image(x, y, 0, 0) + 587 * image(x, y, 0, 1) + 114 * image(x, y, 0, 2)) / 1000)
+				: image(x, y, 0, 0);
+		}
+		// Rem.: Moving the inner vectors keeps their data where it is
+		decoded.push_back(std::move(grey));
+		frames.push_back(&decoded.back()[0]);
+		return true;
+	}
+#endif // VIRTUAL_CAMERA_CIMG
+
+	VirtualCameraConfig config;
+	int width = 0;
+	int height = 0;
+	uint32_t pixelFormat = 0;
+	unsigned int bytesPerLine = 0;
+	unsigned int frameBytes = 0;
+	/** Where each frame starts in the mapped (or decoded) files */
+	std::vector<uint8_t*> frames;
+	std::vector<std::pair<void*, size_t>> mappings;
+	std::vector<std::vector<uint8_t>> decoded;
+	bool errorFlag = false;
+
+	// Rem.: All below is guarded by the mutex - the capture and the consumer threads both use it
+	std::mutex mutex;
+	std::condition_variable available;
+	std::vector<Buffer> buffers;
+	/** The captured buffers in capture order */
+	std::deque<int> filled;
+	uint64_t nextSequence = 0;
+	Clock::time_point start;
+	uint64_t captured = 0;
+	uint64_t lost = 0;
+	uint64_t released = 0;
+	double latencySumMs = 0;
+	double maxLatencyMs = 0;
+
+	/** The frame of nextFrame() - for finishFrame() */
+	CapturedBuffer current;
+	bool hasCurrent = false;
+};
+
+#endif // FASTTRACK_VIRTUAL_CAMERA_H
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4
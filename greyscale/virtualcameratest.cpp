@@ -0,0 +1,246 @@
+// Tests the VirtualCamera (virtualcamera.h):
+// - the raw YUYV webcam dumps of the input_poc directory are replayed byte-by-byte (one file has more frames)
+// - Y4M (mono and 4:2:0) and PGM files written here are replayed as GREY frames
+// - files with different frame sizes and broken files are refused
+// - with a frame rate and a slow consumer frames are lost like with a real camera - and counted
+// - as fast as possible through the AsyncCapture nothing is lost and the frames come in order
+// - neither the end of the replay nor broken files make the capture thread of an AsyncCapture spin
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "virtualcamera.h"
+
+/** Raw YUYV webcam frames - the missing ones are skipped */
+static const char* RAW_FILES[] = {
+	"../input_poc/out_interesting/marker_reco1/webcam_output.yuv422.data", // 5 frames
+	"../input_poc/out_interesting/marker1/webcam_output.yuv422.data",
+};
+#define WEBCAM_FRAME_BYTES (640 * 480 * 2)
+
+/** Writes the bytes into a new temporary file with the extension - returns its path */
+static std::string writeTemp(const std::string &extension, const std::string &bytes) {
+	char path[] = "/tmp/virtualcameratestXXXXXX";
+	int fd = mkstemp(path);
+	if(fd < 0) return "";
+	close(fd);
+	std::string file = std::string(path) + "." + extension;
+	rename(path, file.c_str());
+	FILE *f = fopen(file.c_str(), "wb");
+	fwrite(bytes.data(), 1, bytes.size(), f);
+	fclose(f);
+	return file;
+}
+
+/** A Y4M file of frames filled with luma value 1, 2, 3... (and chroma 128 when not mono) */
+static std::string makeY4m(int width, int height, int frames, const std::string &colorSpace, int chromaBytes) {
+	std::string bytes = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F30:1 Ip A1:1";
+	if(!colorSpace.empty()) bytes += " C" + colorSpace;
+	bytes += "\n";
+	for(int i = 0; i < frames; ++i) {
+		bytes += (i == 1) ? "FRAME Ip\n" : "FRAME\n";
+		bytes += std::string(width * height, (char)(i + 1));
+		bytes += std::string(chromaBytes, (char)128);
+	}
+	return writeTemp("y4m", bytes);
+}
+
+/** Tells if the whole frame is filled with the value */
+static bool filledWith(const uint8_t *frame, unsigned int bytes, uint8_t value) {
+	for(unsigned int i = 0; i < bytes; ++i) {
+		if(frame[i] != value) return false;
+	}
+	return true;
+}
+
+static int testRawDumps() {
+	VirtualCameraConfig config;
+	config.fps = 0;
+	config.loop = false;
+	std::vector<std::vector<uint8_t>> expected;
+	for(auto file : RAW_FILES) {
+		FILE *f = fopen(file, "rb");
+		if(f == nullptr) continue;
+		std::vector<uint8_t> frame(WEBCAM_FRAME_BYTES);
+		while(fread(&frame[0], 1, frame.size(), f) == frame.size()) {
+			expected.push_back(frame);
+		}
+		fclose(f);
+		config.files.push_back(file);
+	}
+	if(config.files.empty()) {
+		printf("Raw dumps: SKIPPED (missing)\n");
+		return 0;
+	}
+
+	VirtualCamera camera(config);
+	bool ok = camera.isOk() && (camera.frameCount() == (int)expected.size())
+		&& (camera.getPixelFormat() == V4L2_PIX_FMT_YUYV) && (camera.getBytesPerLine() == 640 * 2);
+	for(size_t i = 0; ok && (i < expected.size()); ++i) {
+		uint8_t *frame = camera.nextFrame();
+		ok = (frame != nullptr) && (camera.getBytesUsed() == WEBCAM_FRAME_BYTES)
+			&& (memcmp(frame, &expected[i][0], WEBCAM_FRAME_BYTES) == 0);
+		camera.finishFrame();
+	}
+	// No loop: the replay ends
+	ok = ok && (camera.nextFrame() == nullptr);
+	printf("Raw dumps: %d frames replayed: %s\n", (int)expected.size(), ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+static int testGreyFiles() {
+	int failures = 0;
+	std::string mono = makeY4m(8, 4, 3, "mono", 0);
+	std::string yuv420 = makeY4m(8, 4, 2, "420jpeg", 2 * 4 * 2);
+	std::string noColorSpace = makeY4m(8, 4, 1, "", 2 * 4 * 2); // 4:2:0 is the default
+	std::string pgm = writeTemp("pgm", "P5\n# a comment\n8 4\n255\n" + std::string(32, (char)9));
+	std::vector<std::string> temps = {mono, yuv420, noColorSpace, pgm};
+
+	VirtualCameraConfig config;
+	config.files = temps;
+	config.fps = 0;
+	config.loop = false;
+	VirtualCamera camera(config);
+	std::vector<uint8_t> values = {1, 2, 3, 1, 2, 1, 9};
+	bool ok = camera.isOk() && (camera.frameCount() == (int)values.size())
+		&& (camera.getPixelFormat() == V4L2_PIX_FMT_GREY) && (camera.getWidth() == 8) && (camera.getHeight() == 4);
+	for(size_t i = 0; ok && (i < values.size()); ++i) {
+		uint8_t *frame = camera.nextFrame();
+		ok = (frame != nullptr) && (camera.getBytesUsed() == 32) && filledWith(frame, 32, values[i]);
+		camera.finishFrame();
+	}
+	if(!ok) ++failures;
+	printf("Y4M and PGM frames: %s\n", ok ? "OK" : "FAILED");
+
+	// Refused: other frame size, cut frame, unknown colour space, not a PGM
+	std::string wider = makeY4m(16, 4, 1, "mono", 0);
+	std::string cut = writeTemp("y4m", "YUV4MPEG2 W8 H4 Cmono\nFRAME\n" + std::string(20, 'x'));
+	std::string alpha = makeY4m(8, 4, 1, "444alpha", 0);
+	std::string ascii = writeTemp("pgm", "P2\n8 4\n255\n");
+	std::vector<std::vector<std::string>> bad = {{mono, wider}, {cut}, {alpha}, {ascii}, {"/nonexistent.y4m"}};
+	for(auto &files : bad) {
+		config.files = files;
+		VirtualCamera badCamera(config);
+		if(badCamera.isOk() || (badCamera.nextFrame() != nullptr)) {
+			++failures;
+			printf("%s should be refused: FAILED\n", files.back().c_str());
+		}
+	}
+	printf("Bad files refused: %s\n", (failures == 0) ? "OK" : "FAILED");
+
+	for(auto &file : {mono, yuv420, noColorSpace, pgm, wider, cut, alpha, ascii}) {
+		remove(file.c_str());
+	}
+	return failures;
+}
+
+/** A slow consumer at 100 FPS with 2 buffers: frames get lost, the rest comes in order and late */
+static int testFrameRate() {
+	std::string mono = makeY4m(8, 4, 3, "mono", 0);
+	VirtualCameraConfig config;
+	config.files.push_back(mono);
+	config.fps = 100;
+	config.bufferCount = 2;
+	VirtualCamera camera(config);
+
+	std::vector<uint32_t> sequences;
+	bool ok = camera.isOk();
+	for(int i = 0; ok && (i < 10); ++i) {
+		CapturedBuffer buffer;
+		ok = camera.dequeue(buffer, 1000) && filledWith(buffer.data, 32, (uint8_t)(buffer.sequence % 3 + 1));
+		sequences.push_back(buffer.sequence);
+		// Processing takes 3.5 frame times
+		std::this_thread::sleep_for(std::chrono::milliseconds(35));
+		camera.requeue(buffer.index);
+	}
+	uint64_t gaps = sequences.empty() ? 0 : sequences[0];
+	for(size_t i = 1; i < sequences.size(); ++i) {
+		if(sequences[i] <= sequences[i - 1]) ok = false;
+		gaps += sequences[i] - sequences[i - 1] - 1;
+	}
+	auto stats = camera.getStats();
+	// Rem.: Lost frames after the last taken one are counted too
+	ok = ok && (stats.lost > 0) && (gaps <= stats.lost) && (stats.released == 10) && (stats.maxLatencyMs >= 35)
+		&& (stats.fps < 100);
+	printf("100 FPS with a slow consumer: %llu captured, %llu lost, %.1f FPS, %.1f ms latency (max %.1f): %s\n",
+			(unsigned long long)stats.captured, (unsigned long long)stats.lost, stats.fps, stats.meanLatencyMs,
+			stats.maxLatencyMs, ok ? "OK" : "FAILED");
+	remove(mono.c_str());
+	return ok ? 0 : 1;
+}
+
+/** As fast as possible through the AsyncCapture: all frames in order, none lost */
+static int testAsFastAsPossible() {
+	std::string mono = makeY4m(8, 4, 3, "mono", 0);
+	VirtualCameraConfig config;
+	config.files.push_back(mono);
+	config.fps = 0;
+	VirtualCamera camera(config);
+	bool ok = camera.isOk();
+	{
+		AsyncCapture<VirtualCamera> capture(camera, CapturePolicy::EVERY_FRAME);
+		for(uint32_t i = 0; ok && (i < 200); ++i) {
+			auto frame = capture.acquire(1000);
+			ok = frame && (frame.sequence() == i) && filledWith(frame.data(), frame.bytesUsed(), (uint8_t)(i % 3 + 1));
+		}
+	}
+	auto stats = camera.getStats();
+	ok = ok && (stats.lost == 0) && (stats.released >= 200);
+	printf("As fast as possible: %llu frames at %.0f FPS, %llu lost: %s\n", (unsigned long long)stats.released,
+			stats.fps, (unsigned long long)stats.lost, ok ? "OK" : "FAILED");
+	remove(mono.c_str());
+	return ok ? 0 : 1;
+}
+
+/** After the end of the replay dequeue(..) waits out the timeout - a broken camera ends the AsyncCapture */
+static int testEndAndError() {
+	std::string mono = makeY4m(8, 4, 3, "mono", 0);
+	VirtualCameraConfig config;
+	config.files.push_back(mono);
+	config.fps = 0;
+	config.loop = false;
+	VirtualCamera camera(config);
+	bool ok = camera.isOk();
+	for(int i = 0; ok && (i < 3); ++i) {
+		CapturedBuffer buffer;
+		ok = camera.dequeue(buffer, 1000);
+		camera.requeue(buffer.index);
+	}
+	auto start = std::chrono::steady_clock::now();
+	CapturedBuffer buffer;
+	ok = ok && !camera.dequeue(buffer, 50) && camera.hasEnded();
+	double waitedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	ok = ok && (waitedMs >= 45);
+	printf("End of the replay: dequeue waited %.1f ms: %s\n", waitedMs, ok ? "OK" : "FAILED");
+	remove(mono.c_str());
+
+	config.files = {"/nonexistent.y4m"};
+	VirtualCamera broken(config);
+	bool failed;
+	{
+		AsyncCapture<VirtualCamera> capture(broken, CapturePolicy::EVERY_FRAME);
+		start = std::chrono::steady_clock::now();
+		failed = !capture.acquire(1000) && capture.hasFailed();
+		waitedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	failed = failed && (waitedMs < 500);
+	printf("Broken files: the capture failed in %.1f ms: %s\n", waitedMs, failed ? "OK" : "FAILED");
+	return (ok ? 0 : 1) + (failed ? 0 : 1);
+}
+
+int main() {
+	printf("Testing the VirtualCamera...\n");
+
+	int failures = 0;
+	failures += testRawDumps();
+	failures += testGreyFiles();
+	failures += testFrameRate();
+	failures += testAsFastAsPossible();
+	failures += testEndAndError();
+
+	printf("...testing the VirtualCamera ended with %d failure(s)!\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
+
+// vim: tabstop=4 noexpandtab shiftwidth=4 softtabstop=4